@@ -0,0 +1,242 @@
+/*
+  ==============================================================================
+
+    Additive.cpp
+
+  ==============================================================================
+*/
+
+#include "Additive.h"
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+//// ==============================================================================
+//// Patch Struct
+//// ==============================================================================
+
+AdditiveOscillatorBank::Patch::Patch(const String &patchName) : name(patchName) {}
+
+void AdditiveOscillatorBank::Patch::add(float ratio, float amplitude, float decayRate) {
+    jassert(this->ratios.size() < MAX_PARTIALS);
+    this->ratios.add(ratio);
+    this->amplitudes.add(amplitude);
+    this->decayRates.add(decayRate);
+}
+
+void AdditiveOscillatorBank::Patch::finalise() {
+    std::vector<int> order((size_t) this->ratios.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this] (int a, int b) {
+        return this->ratios[a] < this->ratios[b];
+    });
+    const float sum = std::accumulate(this->amplitudes.begin(), this->amplitudes.end(), 0.0f);
+
+    Array<float> sortedRatios, sortedAmplitudes, sortedDecayRates;
+    for (int index : order) {
+        sortedRatios.add(this->ratios[index]);
+        sortedAmplitudes.add(this->amplitudes[index] / sum);
+        sortedDecayRates.add(this->decayRates[index]);
+        this->logRatios.add(std::log2(this->ratios[index]));
+        this->hasDecay = this->hasDecay || this->decayRates[index] > 0.0f;
+    }
+    this->ratios.swapWith(sortedRatios);
+    this->amplitudes.swapWith(sortedAmplitudes);
+    this->decayRates.swapWith(sortedDecayRates);
+}
+
+//// ==============================================================================
+//// AdditiveOscillatorBank Class
+//// ==============================================================================
+
+constexpr int AdditiveOscillatorBank::MAX_PARTIALS;
+constexpr int AdditiveOscillatorBank::MAX_BLOCK_SIZE;
+constexpr int AdditiveOscillatorBank::NUM_LANES;
+
+AdditiveOscillatorBank::AdditiveOscillatorBank() {
+    const int numPartialArrays = 8;
+    this->memory.calloc((size_t) (numPartialArrays * MAX_PARTIALS + MAX_BLOCK_SIZE * NUM_LANES + NUM_LANES));
+    float* aligned = dsp::SIMDRegister<float>::getNextSIMDAlignedPtr(this->memory.get());
+    for (float** array : {&this->real, &this->imaginary, &this->rotationReal, &this->rotationImaginary,
+                          &this->amplitudes, &this->amplitudeSteps, &this->targetAmplitudes, &this->levels}) {
+        *array = aligned;
+        aligned += MAX_PARTIALS;
+    }
+    this->accumulators = aligned;
+}
+
+StringArray AdditiveOscillatorBank::getPatchNames() {
+    StringArray names;
+    for (auto* patch : getPatches()) {
+        names.add(patch->name);
+    }
+    return names;
+}
+
+const OwnedArray<AdditiveOscillatorBank::Patch>& AdditiveOscillatorBank::getPatches() {
+    struct PatchList {
+        OwnedArray<Patch> patches;
+
+        PatchList() {
+            auto* sawtooth = this->patches.add(new Patch("Sawtooth"));
+            for (int harmonic = 1; harmonic <= MAX_PARTIALS; ++harmonic) {
+                sawtooth->add((float) harmonic, 1.0f / (float) harmonic);
+            }
+
+            auto* square = this->patches.add(new Patch("Square"));
+            for (int harmonic = 1; harmonic < 2 * MAX_PARTIALS; harmonic += 2) {
+                square->add((float) harmonic, 1.0f / (float) harmonic);
+            }
+
+            // Nine drawbars, each one a pipe with its own harmonics falling at 12 dB per octave.
+            auto* organ = this->patches.add(new Patch("Organ"));
+            const float drawbarRatios[] {0.5f, 1.5f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 8.0f};
+            const float drawbarLevels[] {0.8f, 0.6f, 1.0f, 0.7f, 0.5f, 0.6f, 0.3f, 0.3f, 0.4f};
+            for (int drawbar = 0; drawbar < 9; ++drawbar) {
+                for (int harmonic = 1; harmonic <= 24; ++harmonic) {
+                    organ->add(drawbarRatios[drawbar] * (float) harmonic,
+                               drawbarLevels[drawbar] / (float) (harmonic * harmonic));
+                }
+            }
+
+            // Risset's bell, over a stretched inharmonic series where the higher partials die out first.
+            auto* bell = this->patches.add(new Patch("Bell"));
+            const float bellRatios[] {0.56f, 0.5625f, 0.92f, 0.9225f, 1.19f, 1.7f, 2.0f, 2.74f, 3.0f, 3.76f, 4.07f};
+            const float bellLevels[] {1.0f, 0.67f, 1.0f, 1.8f, 2.67f, 1.67f, 1.46f, 1.33f, 1.33f, 1.0f, 1.33f};
+            const float bellDurations[] {1.0f, 0.9f, 0.65f, 0.55f, 0.325f, 0.35f, 0.25f, 0.2f, 0.15f, 0.1f, 0.075f};
+            for (int partial = 0; partial < 11; ++partial) {
+                bell->add(bellRatios[partial], bellLevels[partial], 1.0f / (4.0f * bellDurations[partial]));
+            }
+            for (int mode = 2; mode <= 160; ++mode) {
+                const auto stretched = (float) mode * std::sqrt(1.0f + 0.0004f * (float) (mode * mode));
+                bell->add(stretched, 0.5f / (float) mode, 1.0f + 0.5f * (float) mode);
+            }
+
+            // Three slightly detuned copies of every harmonic.
+            auto* ensemble = this->patches.add(new Patch("Ensemble"));
+            for (int harmonic = 1; harmonic <= 80; ++harmonic) {
+                for (float detune : {-0.004f, 0.0f, 0.004f}) {
+                    ensemble->add((float) harmonic * (1.0f + detune), 1.0f / (float) harmonic);
+                }
+            }
+
+            for (auto* patch : this->patches) {
+                patch->finalise();
+            }
+        }
+    };
+    static const PatchList patchList;
+    return patchList.patches;
+}
+
+void AdditiveOscillatorBank::startNote(int patchIndex) {
+    const OwnedArray<Patch>& patches = getPatches();
+    this->patch = patches[jlimit(0, patches.size() - 1, patchIndex)];
+    this->numPartials = this->patch->ratios.size();
+    for (int partial = 0; partial < MAX_PARTIALS; ++partial) {
+        this->real[partial] = 1.0f;
+        this->imaginary[partial] = 0.0f;
+        this->rotationReal[partial] = 1.0f;
+        this->rotationImaginary[partial] = 0.0f;
+        this->amplitudes[partial] = 0.0f;
+        this->levels[partial] = 1.0f;
+    }
+    this->numAudiblePartials = 0;
+    this->numRenderedPartials = 0;
+    this->currentAngleDelta = -1.0f;
+}
+
+void AdditiveOscillatorBank::render(float *destination, int numSamples, float fundamentalAngleDelta, float tilt,
+                                    double sampleRate) {
+    jassert(numSamples <= MAX_BLOCK_SIZE);
+    if (this->patch == nullptr) {
+        FloatVectorOperations::clear(destination, numSamples);
+        return;
+    }
+    const float* ratios = this->patch->ratios.begin();
+
+    // Cull the partials above the Nyquist frequency and rotate the others, only when the pitch changes.
+    if (fundamentalAngleDelta != this->currentAngleDelta) {
+        this->numAudiblePartials = 0;
+        while (this->numAudiblePartials < this->numPartials
+               && ratios[this->numAudiblePartials] * fundamentalAngleDelta < MathConstants<float>::pi) {
+            const float angleDelta = ratios[this->numAudiblePartials] * fundamentalAngleDelta;
+            this->rotationReal[this->numAudiblePartials] = std::cos(angleDelta);
+            this->rotationImaginary[this->numAudiblePartials] = std::sin(angleDelta);
+            ++this->numAudiblePartials;
+        }
+        this->currentAngleDelta = fundamentalAngleDelta;
+    }
+
+    if (this->patch->hasDecay) {
+        const auto seconds = (float) (numSamples / sampleRate);
+        const float* decayRates = this->patch->decayRates.begin();
+        for (int partial = 0; partial < this->numPartials; ++partial) {
+            this->levels[partial] *= std::exp(-decayRates[partial] * seconds);
+        }
+    }
+
+    // The partials culled since the last block fade out instead of stopping with a click.
+    const int numToRender = jmax(this->numAudiblePartials, this->numRenderedPartials);
+    const int numBatchedPartials = (numToRender + NUM_LANES - 1) / NUM_LANES * NUM_LANES;
+    const float* patchAmplitudes = this->patch->amplitudes.begin();
+    const float* logRatios = this->patch->logRatios.begin();
+    for (int partial = 0; partial < numBatchedPartials; ++partial) {
+        float target = 0.0f;
+        if (partial < this->numAudiblePartials) {
+            target = patchAmplitudes[partial] * this->levels[partial];
+            if (tilt != 0.0f) {
+                target *= std::exp2(-tilt * logRatios[partial]);
+            }
+        }
+        this->targetAmplitudes[partial] = target;
+        this->amplitudeSteps[partial] = (target - this->amplitudes[partial]) / (float) numSamples;
+    }
+
+    using Register = dsp::SIMDRegister<float>;
+    FloatVectorOperations::clear(this->accumulators, numSamples * NUM_LANES);
+    for (int first = 0; first < numBatchedPartials; first += NUM_LANES) {
+        Register re = Register::fromRawArray(this->real + first);
+        Register im = Register::fromRawArray(this->imaginary + first);
+        const Register rotationRe = Register::fromRawArray(this->rotationReal + first);
+        const Register rotationIm = Register::fromRawArray(this->rotationImaginary + first);
+        Register amplitude = Register::fromRawArray(this->amplitudes + first);
+        const Register amplitudeStep = Register::fromRawArray(this->amplitudeSteps + first);
+
+        for (int i = 0; i < numSamples; ++i) {
+            const Register rotated = re * rotationRe - im * rotationIm;
+            im = re * rotationIm + im * rotationRe;
+            re = rotated;
+            amplitude += amplitudeStep;
+            float* accumulator = this->accumulators + i * NUM_LANES;
+            (Register::fromRawArray(accumulator) + amplitude * im).copyToRawArray(accumulator);
+        }
+
+        // The rotation factors are rounded, so pull the phasors back to the unit circle once per block.
+        const Register correction = (Register::expand(3.0f) - (re * re + im * im)) * 0.5f;
+        (re * correction).copyToRawArray(this->real + first);
+        (im * correction).copyToRawArray(this->imaginary + first);
+        Register::fromRawArray(this->targetAmplitudes + first).copyToRawArray(this->amplitudes + first);
+    }
+
+    for (int i = 0; i < numSamples; ++i) {
+        destination[i] = Register::fromRawArray(this->accumulators + i * NUM_LANES).sum();
+    }
+    this->numRenderedPartials = this->numAudiblePartials;
+}
+
+//// ==============================================================================
+//// AdditiveRenderer Class
+//// ==============================================================================
+
+bool AdditiveRenderer::startNote(const Note &note, NoiseGenerator &noise) {
+    this->bank.startNote(note.patchIndex);
+    return true;
+}
+
+bool AdditiveRenderer::render(float *const *destinations, int numSamples, const ControlBlock &control,
+                              NoiseGenerator &noise) {
+    const float tilt = -control.brightness * MAX_SPECTRAL_TILT;
+    this->bank.render(destinations[0], numSamples, control.angleDelta, tilt, control.sampleRate);
+    return true;
+}
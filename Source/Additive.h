@@ -0,0 +1,124 @@
+/*
+  ==============================================================================
+
+    Additive.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "VoiceRenderer.h"
+
+/**
+ * A bank of up to MAX_PARTIALS sinusoids playing an additive patch.
+ * Every partial is a complex phasor rotated by a fixed complex factor on every sample, so a partial costs four
+ * multiplications and two additions per sample instead of a sine. The phasors are stored as structures of arrays
+ * and rotated in SIMD batches, with the whole state of a batch kept in registers during a control block.
+ * The rotations are only recomputed when the pitch changes, and the partials above the Nyquist frequency are culled
+ * at the same time. The patches are sorted by frequency ratio, so the audible partials are always a prefix.
+ */
+class AdditiveOscillatorBank {
+public:
+    static constexpr int MAX_PARTIALS = 256;
+    /** The longest block passed to render(), the control block size of the voices */
+    static constexpr int MAX_BLOCK_SIZE = 32;
+
+    AdditiveOscillatorBank();
+
+    /**
+     * The names of the built-in patches
+     * @return the patch names, in the order of their indices
+     */
+    static StringArray getPatchNames();
+
+    /**
+     * Restart every partial of a patch at phase zero. It does not allocate, so it can be called from the audio thread.
+     * @param patchIndex the index of the patch in getPatchNames()
+     */
+    void startNote(int patchIndex);
+
+    /**
+     * Render the sum of the partials. The amplitudes are ramped from the previous block.
+     * @param destination the samples to overwrite
+     * @param numSamples the number of samples, at most MAX_BLOCK_SIZE
+     * @param fundamentalAngleDelta the phase increment of a partial of ratio 1
+     * @param tilt the spectral tilt. Every partial is scaled by its ratio to the power of -tilt,
+     * so a positive tilt darkens the patch and a negative one brightens it.
+     * @param sampleRate the sample rate, used by the decay of the partials
+     */
+    void render(float* destination, int numSamples, float fundamentalAngleDelta, float tilt, double sampleRate);
+
+private:
+    /**
+     * A patch: the frequency ratio, the amplitude and the decay rate of every partial, sorted by ratio.
+     * The amplitudes are normalised so that their sum is one, and the output never clips.
+     */
+    struct Patch {
+        explicit Patch(const String& patchName);
+
+        String name;
+        Array<float> ratios;
+        Array<float> amplitudes;
+        /** The decay rate of every partial in 1/s, zero for a sustained partial */
+        Array<float> decayRates;
+        /** The base two logarithms of the ratios, used by the spectral tilt */
+        Array<float> logRatios;
+        bool hasDecay = false;
+
+        void add(float ratio, float amplitude, float decayRate = 0.0f);
+        void finalise();
+    };
+
+    /**
+     * The built-in patches. They are built on the first call, which getPatchNames() makes on the message thread.
+     * @return the patches
+     */
+    static const OwnedArray<Patch>& getPatches();
+
+    static constexpr int NUM_LANES = (int) dsp::SIMDRegister<float>::SIMDNumElements;
+
+    const Patch* patch = nullptr;
+    int numPartials = 0;
+    /** The number of partials below the Nyquist frequency, and the number rendered by the last block */
+    int numAudiblePartials = 0;
+    int numRenderedPartials = 0;
+    float currentAngleDelta = -1.0f;
+
+    /** The memory of all the arrays below, aligned to the SIMD register size */
+    HeapBlock<float> memory;
+    float* real;
+    float* imaginary;
+    float* rotationReal;
+    float* rotationImaginary;
+    float* amplitudes;
+    float* amplitudeSteps;
+    float* targetAmplitudes;
+    /** The decay envelope of every partial */
+    float* levels;
+    /** One SIMD register of partial sums per sample, reduced once at the end of the block */
+    float* accumulators;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AdditiveOscillatorBank)
+};
+
+/**
+ * The renderer of the "Additive" voice type, which sums the partials of a patch. The partials above the Nyquist
+ * frequency are culled, so it plays at the device rate like the other renderers.
+ */
+class AdditiveRenderer : public VoiceRenderer {
+public:
+    AdditiveRenderer() = default;
+
+    bool startNote(const Note& note, NoiseGenerator& noise) override;
+    bool render(float* const* destinations, int numSamples, const ControlBlock& control,
+                NoiseGenerator& noise) override;
+
+private:
+    /** The brightness destination tilts the partials by up to this many octaves of slope, i.e. 6 dB per octave */
+    const float MAX_SPECTRAL_TILT = 1.0f;
+    AdditiveOscillatorBank bank;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AdditiveRenderer)
+};
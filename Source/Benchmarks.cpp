@@ -0,0 +1,302 @@
+/*
+  ==============================================================================
+
+    Benchmarks.cpp
+
+  ==============================================================================
+*/
+
+#include "Benchmarks.h"
+#include "SynthesiserSource.h"
+#include <iomanip>
+#include <iostream>
+
+namespace {
+/**
+ * Renders blocks at the pace of an audio device and times every callback. The results are read once the thread has
+ * stopped.
+ */
+class StressAudioThread : public Thread {
+public:
+    StressAudioThread(VoiceSynthesiser& source, double sampleRate, int blockSize)
+        : Thread("Stress audio"), source(source), blockSize(blockSize), buffer(2, blockSize),
+          blockMilliseconds(1000.0 * blockSize / sampleRate) {}
+
+    void run() override {
+        double nextBlockTime = Time::getMillisecondCounterHiRes();
+        while (!this->threadShouldExit()) {
+            AudioSourceChannelInfo bufferToFill(&this->buffer, 0, this->blockSize);
+            const int64 start = Time::getHighResolutionTicks();
+            this->source.getNextAudioBlock(bufferToFill);
+            const double milliseconds =
+                    1000.0 * Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+            this->worstMilliseconds = jmax(this->worstMilliseconds, milliseconds);
+            this->totalMilliseconds += milliseconds;
+            ++this->numCallbacks;
+            if (milliseconds > this->blockMilliseconds) {
+                ++this->numMissedDeadlines;
+            }
+
+            nextBlockTime += this->blockMilliseconds;
+            const double now = Time::getMillisecondCounterHiRes();
+            if (nextBlockTime - now > 1.0) {
+                this->wait((int) (nextBlockTime - now));
+            } else if (now - nextBlockTime > this->blockMilliseconds) {
+                // A device would have dropped the late blocks rather than asking for them all at once.
+                nextBlockTime = now;
+            }
+        }
+    }
+
+    double getBlockMilliseconds() const {
+        return this->blockMilliseconds;
+    }
+
+    double worstMilliseconds = 0.0;
+    double totalMilliseconds = 0.0;
+    int numCallbacks = 0;
+    int numMissedDeadlines = 0;
+
+private:
+    VoiceSynthesiser& source;
+    const int blockSize;
+    AudioBuffer<float> buffer;
+    const double blockMilliseconds;
+};
+
+/**
+ * Plays random notes, pitch bends and controllers on every channel, through the lock-free queue like the OSC
+ * receiver, and through the keyboard state like a MIDI input.
+ */
+class StressMidiThread : public Thread {
+public:
+    StressMidiThread(VoiceSynthesiser& source, MidiKeyboardState& keyboardState)
+        : Thread("Stress MIDI"), source(source), keyboardState(keyboardState) {}
+
+    void run() override {
+        Random random(2);
+        MidiMessageQueue& queue = this->source.getMidiMessageQueue();
+        while (!this->threadShouldExit()) {
+            const int channel = 1 + random.nextInt(16);
+            const int note = 36 + random.nextInt(49);
+            switch (random.nextInt(6)) {
+                case 0: queue.push(MidiMessage::noteOn(channel, note, random.nextFloat())); break;
+                case 1: queue.push(MidiMessage::noteOff(channel, note)); break;
+                case 2: this->keyboardState.noteOn(channel, note, random.nextFloat()); break;
+                case 3: this->keyboardState.noteOff(channel, note, 0.0f); break;
+                case 4: queue.push(MidiMessage::pitchWheel(channel, random.nextInt(16384))); break;
+                default: queue.push(MidiMessage::controllerEvent(channel, 1 + random.nextInt(74), random.nextInt(128)));
+            }
+            // Bursts of events, without filling the queue faster than the audio thread drains it.
+            if (++this->numEvents % 16 == 0) {
+                this->wait(1);
+            }
+        }
+    }
+
+    int numEvents = 0;
+
+private:
+    VoiceSynthesiser& source;
+    MidiKeyboardState& keyboardState;
+};
+}
+
+bool Benchmarks::runFromCommandLine(const String &commandLine) {
+    StringArray arguments = StringArray::fromTokens(commandLine, true);
+    if (arguments.contains("--benchmark-oversampling")) {
+        runOversamplingBenchmark(48000.0, 512, 2000);
+        return true;
+    }
+    if (arguments.contains("--benchmark-additive")) {
+        runPatchBenchmark("Additive", AdditiveOscillatorBank::getPatchNames(), 48000.0, 512, 2000);
+        return true;
+    }
+    if (arguments.contains("--benchmark-noise")) {
+        runPatchBenchmark("Noise", NoiseOscillator::getPatchNames(), 48000.0, 512, 2000);
+        return true;
+    }
+    if (arguments.contains("--benchmark-granular")) {
+        runPatchBenchmark("Granular", GrainCloud::getPatchNames(), 48000.0, 512, 2000);
+        return true;
+    }
+    if (arguments.contains("--benchmark-fm")) {
+        runPatchBenchmark("FM", FmEngine::getPatchNames(), 48000.0, 512, 2000);
+        return true;
+    }
+    if (arguments.contains("--stress")) {
+        runConcurrencyStressTest(48000.0, 256, 10.0);
+        return true;
+    }
+    return false;
+}
+
+void Benchmarks::runOversamplingBenchmark(double sampleRate, int blockSize, int numBlocks) {
+    const StringArray waveforms {"Sine", "Square", "Triangle", "Sawtooth"};
+    const int factors[] {1, 2, 4, 8};
+    AudioBuffer<float> buffer(2, blockSize);
+    MidiBuffer noMidi;
+
+    std::cout << "Oversampling benchmark: " << sampleRate << " Hz, " << blockSize << " samples per block"
+              << std::endl;
+    std::cout << std::setw(10) << "waveform";
+    for (int factor : factors) {
+        std::cout << std::setw(10) << (String(factor) + "x").toStdString();
+    }
+    std::cout << "   (ns per sample)" << std::endl;
+
+    for (const String& waveform : waveforms) {
+        std::cout << std::setw(10) << waveform.toStdString();
+        for (int factor : factors) {
+            // A fresh synthesiser for every measurement, so no filter state is shared between the runs.
+            Synthesiser synthesiser;
+            synthesiser.addSound(new ElementarySound());
+            auto* voice = new ElementaryVoice(waveform);
+            voice->prepareToPlay(blockSize, sampleRate);
+            voice->setOversamplingFactor(factor);
+            synthesiser.addVoice(voice);
+            synthesiser.setCurrentPlaybackSampleRate(sampleRate);
+            synthesiser.noteOn(1, 69, 0.8f);
+
+            // Warm up the caches and let the attack finish.
+            for (int block = 0; block < 16; ++block) {
+                buffer.clear();
+                synthesiser.renderNextBlock(buffer, noMidi, 0, blockSize);
+            }
+
+            const int64 start = Time::getHighResolutionTicks();
+            for (int block = 0; block < numBlocks; ++block) {
+                buffer.clear();
+                synthesiser.renderNextBlock(buffer, noMidi, 0, blockSize);
+            }
+            const double seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+            const double nanosecondsPerSample = seconds * 1.0e9 / ((double) numBlocks * blockSize);
+            std::cout << std::setw(10) << std::fixed << std::setprecision(1) << nanosecondsPerSample;
+        }
+        std::cout << std::endl;
+    }
+}
+
+void Benchmarks::runPatchBenchmark(const String &voiceType, const StringArray &patches, double sampleRate,
+                                   int blockSize, int numBlocks) {
+    AudioBuffer<float> buffer(2, blockSize);
+    MidiBuffer noMidi;
+
+    std::cout << voiceType << " benchmark: " << sampleRate << " Hz, " << blockSize << " samples per block" << std::endl;
+    std::cout << std::setw(10) << "patch" << std::setw(10) << "ns" << "   (per sample)" << std::endl;
+
+    for (int patch = 0; patch < patches.size(); ++patch) {
+        Synthesiser synthesiser;
+        synthesiser.addSound(new ElementarySound());
+        auto* voice = new ElementaryVoice(voiceType);
+        voice->prepareToPlay(blockSize, sampleRate);
+        voice->setParameter("patch", (float) patch);
+        synthesiser.addVoice(voice);
+        synthesiser.setCurrentPlaybackSampleRate(sampleRate);
+        // Two octaves below middle C only the top of the stretched bell series is above the Nyquist frequency.
+        synthesiser.noteOn(1, 36, 0.8f);
+
+        for (int block = 0; block < 16; ++block) {
+            buffer.clear();
+            synthesiser.renderNextBlock(buffer, noMidi, 0, blockSize);
+        }
+
+        const int64 start = Time::getHighResolutionTicks();
+        for (int block = 0; block < numBlocks; ++block) {
+            buffer.clear();
+            synthesiser.renderNextBlock(buffer, noMidi, 0, blockSize);
+        }
+        const double seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+        const double nanosecondsPerSample = seconds * 1.0e9 / ((double) numBlocks * blockSize);
+        std::cout << std::setw(10) << patches[patch].toStdString()
+                  << std::setw(10) << std::fixed << std::setprecision(1) << nanosecondsPerSample << std::endl;
+    }
+}
+
+void Benchmarks::runConcurrencyStressTest(double sampleRate, int blockSize, double seconds) {
+    const StringArray voiceTypes = ElementaryVoice::getVoiceTypeNames();
+    const StringArray sliderParameters {"amplitude", "frequency", "tailOn", "tailOff", "cutoff", "lfo1Rate",
+                                        "lfo2Rate", "detune", "spread"};
+    const int oversamplingFactors[] {1, 2, 4, 8};
+    const int unisonCopies[] {1, 2, 4, 8};
+
+    MidiKeyboardState keyboardState;
+    VoiceSynthesiser source(keyboardState);
+    source.prepareToPlay(blockSize, sampleRate);
+    StressAudioThread audioThread(source, sampleRate, blockSize);
+    StressMidiThread midiThread(source, keyboardState);
+    audioThread.startThread(10);
+    midiThread.startThread();
+
+    std::cout << "Concurrency stress test: " << sampleRate << " Hz, " << blockSize << " samples per block, "
+              << seconds << " s" << std::endl;
+    Random random(1);
+    int numMutations = 0;
+    const double endTime = Time::getMillisecondCounterHiRes() + 1000.0 * seconds;
+    while (Time::getMillisecondCounterHiRes() < endTime) {
+        const int numVoices = source.getTotalNumVoices();
+        ElementaryVoice* voice = numVoices > 0 ? source.getVoice(random.nextInt(numVoices)) : nullptr;
+        switch (random.nextInt(10)) {
+            case 0:
+                if (numVoices < VoiceAllocator::MAX_VOICES) {
+                    source.addVoice(new ElementaryVoice(voiceTypes[random.nextInt(voiceTypes.size())]));
+                }
+                break;
+            case 1:
+                if (numVoices > 0) {
+                    source.removeVoice(random.nextInt(numVoices));
+                }
+                break;
+            case 2:
+                // Clearing is rarer, so that most of the time there are voices to edit.
+                if (random.nextInt(8) == 0) {
+                    source.removeAllVoices();
+                }
+                break;
+            case 3:
+                if (voice != nullptr) {
+                    voice->setVoiceType(voiceTypes[random.nextInt(voiceTypes.size())]);
+                }
+                break;
+            case 4:
+                if (voice != nullptr) {
+                    voice->setParameter("oversampling", (float) oversamplingFactors[random.nextInt(4)]);
+                    voice->setParameter("unison", (float) unisonCopies[random.nextInt(4)]);
+                }
+                break;
+            case 5:
+                if (voice != nullptr) {
+                    voice->setParameter("channel", (float) random.nextInt(17));
+                }
+                break;
+            case 6:
+                source.setStealingPolicy((VoiceAllocator::StealingPolicy) random.nextInt(3));
+                source.setMpeEnabled(random.nextInt(4) == 0);
+                source.getEffectsBus().setDelayMix(random.nextFloat());
+                break;
+            default:
+                // The sliders call sliderValueChanged() synchronously, as a drag in the editor does.
+                if (voice != nullptr) {
+                    voice->setParameter(sliderParameters[random.nextInt(sliderParameters.size())],
+                                        random.nextFloat() * 2.0f);
+                }
+        }
+        ++numMutations;
+    }
+
+    midiThread.stopThread(1000);
+    audioThread.stopThread(1000);
+    source.removeAllVoices();
+    source.releaseResources();
+
+    const double meanMilliseconds = audioThread.numCallbacks > 0
+            ? audioThread.totalMilliseconds / audioThread.numCallbacks : 0.0;
+    std::cout << std::fixed << std::setprecision(3)
+              << "callbacks:         " << audioThread.numCallbacks << std::endl
+              << "mean callback:     " << meanMilliseconds << " ms" << std::endl
+              << "worst callback:    " << audioThread.worstMilliseconds << " ms" << std::endl
+              << "deadline:          " << audioThread.getBlockMilliseconds() << " ms" << std::endl
+              << "missed deadlines:  " << audioThread.numMissedDeadlines << std::endl
+              << "voice mutations:   " << numMutations << std::endl
+              << "MIDI events:       " << midiThread.numEvents << std::endl;
+}
@@ -0,0 +1,58 @@
+/*
+  ==============================================================================
+
+    Benchmarks.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/**
+ * Micro benchmarks of the rendering code, run from the command line instead of opening the main window.
+ * Each benchmark renders without an audio device and prints its results to the standard output.
+ */
+namespace Benchmarks {
+    /**
+     * Run the benchmark selected by the command line, if any.
+     * @param commandLine the command line arguments of the application
+     * @return true if a benchmark was run and the application should quit
+     */
+    bool runFromCommandLine(const String& commandLine);
+
+    /**
+     * Measure the cost of one voice for every waveform and every oversampling factor.
+     * The results are printed in nanoseconds per output sample.
+     * @param sampleRate the sample rate to render at
+     * @param blockSize the size of the rendered blocks
+     * @param numBlocks the number of blocks rendered for every measurement
+     */
+    void runOversamplingBenchmark(double sampleRate, int blockSize, int numBlocks);
+
+    /**
+     * Measure the cost of one voice for every patch of a voice type, playing a low note so that few additive
+     * partials are culled. The results are printed in nanoseconds per output sample.
+     * @param voiceType the voice type, "Additive", "FM", "Noise" or "Granular"
+     * @param patches the patch names of the voice type
+     * @param sampleRate the sample rate to render at
+     * @param blockSize the size of the rendered blocks
+     * @param numBlocks the number of blocks rendered for every measurement
+     */
+    void runPatchBenchmark(const String& voiceType, const StringArray& patches, double sampleRate, int blockSize,
+                           int numBlocks);
+
+    /**
+     * Stress the synthesiser the way the application drives it. A simulated audio thread renders blocks at the pace
+     * of a device, a MIDI thread plays notes through the queue and the keyboard state, and the calling thread,
+     * standing for the message thread, adds, removes and edits voices as fast as it can. The number of callbacks,
+     * their mean and worst times and the number of missed deadlines are printed.
+     * Every thread draws its actions from a fixed seed, so the actions are the same on every run. Build with
+     * -fsanitize=thread to check the same run for data races.
+     * @param sampleRate the sample rate to render at
+     * @param blockSize the size of the rendered blocks
+     * @param seconds the length of the run
+     */
+    void runConcurrencyStressTest(double sampleRate, int blockSize, double seconds);
+}
@@ -0,0 +1,58 @@
+/*
+  ==============================================================================
+
+    BlockPhase.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include <cmath>
+
+/**
+ * The phase of an oscillator, advanced a block at a time.
+ * PeriodicAngle is advanced and wrapped on every sample. This class writes the phases of a whole block at once and
+ * wraps them once per block, so the loop writing them has no branch. The phase is counted in cycles instead of
+ * radians, and wrapping is a single floor().
+ */
+class BlockPhase {
+public:
+    /**
+     * Restart at phase zero.
+     * @param newIncrement the phase increment of the first block in cycles per sample
+     */
+    void reset(float newIncrement) {
+        this->phase = 0.0f;
+        this->increment = newIncrement;
+    }
+
+    /**
+     * Write the phases of the next block and advance. The increment is ramped linearly to its new value.
+     * The phases are not wrapped inside the block, they stay below numSamples cycles.
+     * @param phases the phases to overwrite, in cycles
+     * @param numSamples the length of the block
+     * @param targetIncrement the increment reached at the end of the block, in cycles per sample
+     */
+    void fill(float* phases, int numSamples, float targetIncrement) {
+        const float step = (targetIncrement - this->increment) / (float) numSamples;
+        float currentPhase = this->phase;
+        float currentIncrement = this->increment;
+        for (int i = 0; i < numSamples; ++i) {
+            phases[i] = currentPhase;
+            currentIncrement += step;
+            currentPhase += currentIncrement;
+        }
+        this->phase = currentPhase - std::floor(currentPhase);
+        this->increment = targetIncrement;
+    }
+
+    float getIncrement() const {
+        return this->increment;
+    }
+
+private:
+    float phase = 0.0f;
+    float increment = 0.0f;
+};
@@ -0,0 +1,119 @@
+/*
+  ==============================================================================
+
+    Decimation.cpp
+
+  ==============================================================================
+*/
+
+#include "Decimation.h"
+
+//// ==============================================================================
+//// HalfBandDecimator Class
+//// ==============================================================================
+
+HalfBandDecimator::HalfBandDecimator(int numCoefficientPairs) :
+    centreDelay(2 * numCoefficientPairs - 1),
+    historyLength(4 * numCoefficientPairs - 2) {
+    const int numTaps = 4 * numCoefficientPairs - 1;
+    std::vector<float> window((size_t) numTaps);
+    dsp::WindowingFunction<float>::fillWindowingTables(window.data(), (size_t) numTaps,
+                                                       dsp::WindowingFunction<float>::kaiser, false, 8.0f);
+
+    float sum = 0.5f;
+    for (int pair = 0; pair < numCoefficientPairs; ++pair) {
+        const int distance = 2 * pair + 1;
+        const float x = MathConstants<float>::halfPi * (float) distance;
+        const float coefficient = 0.5f * std::sin(x) / x * window[(size_t) (centreDelay + distance)];
+        this->pairCoefficients.push_back(coefficient);
+        sum += 2.0f * coefficient;
+    }
+    // Unity gain at DC, the centre tap keeps its 0.5 so the filter stays half-band.
+    const float correction = 0.5f / (sum - 0.5f);
+    for (float& coefficient : this->pairCoefficients) {
+        coefficient *= correction;
+    }
+}
+
+void HalfBandDecimator::prepare(int maxOutputSamples) {
+    this->maxInputSamples = 2 * maxOutputSamples;
+    this->buffer.calloc((size_t) (this->historyLength + this->maxInputSamples));
+}
+
+void HalfBandDecimator::reset() {
+    FloatVectorOperations::clear(this->buffer, this->historyLength + this->maxInputSamples);
+}
+
+void HalfBandDecimator::process(const float *input, float *output, int numOutputSamples) {
+    const int numInputSamples = 2 * numOutputSamples;
+    jassert(numInputSamples <= this->maxInputSamples);
+    FloatVectorOperations::copy(this->buffer + this->historyLength, input, numInputSamples);
+
+    const auto numPairs = (int) this->pairCoefficients.size();
+    const float* coefficients = this->pairCoefficients.data();
+    for (int i = 0; i < numOutputSamples; ++i) {
+        // The newest sample used by this output, the filter reaches back historyLength samples from it.
+        const float* newest = this->buffer + this->historyLength + 2 * i + 1;
+        const float* centre = newest - this->centreDelay;
+        float sum = 0.5f * centre[0];
+        for (int pair = 0; pair < numPairs; ++pair) {
+            const int distance = 2 * pair + 1;
+            sum += coefficients[pair] * (centre[-distance] + centre[distance]);
+        }
+        output[i] = sum;
+    }
+
+    std::memmove(this->buffer, this->buffer + numInputSamples, sizeof(float) * (size_t) this->historyLength);
+}
+
+//// ==============================================================================
+//// DecimatorCascade Class
+//// ==============================================================================
+
+constexpr int DecimatorCascade::MAX_STAGES;
+
+DecimatorCascade::DecimatorCascade() {
+    // The last stage has to keep the whole audio band and reject everything above the base Nyquist frequency.
+    this->stages.add(new HalfBandDecimator(12));
+    this->stages.add(new HalfBandDecimator(5));
+    this->stages.add(new HalfBandDecimator(3));
+}
+
+void DecimatorCascade::prepare(int maxOutputSamples) {
+    for (int stage = 0; stage < MAX_STAGES; ++stage) {
+        this->stages[stage]->prepare(maxOutputSamples << stage);
+    }
+    this->reset();
+}
+
+void DecimatorCascade::reset() {
+    for (auto* stage : this->stages) {
+        stage->reset();
+    }
+}
+
+void DecimatorCascade::setFactor(int newFactor) {
+    jassert(newFactor == 1 || newFactor == 2 || newFactor == 4 || newFactor == 8);
+    this->factor = newFactor;
+    this->numActiveStages = 0;
+    while ((1 << this->numActiveStages) < newFactor && this->numActiveStages < MAX_STAGES) {
+        ++this->numActiveStages;
+    }
+    this->reset();
+}
+
+int DecimatorCascade::getFactor() const {
+    return this->factor;
+}
+
+void DecimatorCascade::process(float *input, float *output, int numOutputSamples) {
+    if (this->numActiveStages == 0) {
+        FloatVectorOperations::copy(output, input, numOutputSamples);
+        return;
+    }
+    // Work in place from the highest rate down, the last stage writes to the output.
+    for (int stage = this->numActiveStages - 1; stage > 0; --stage) {
+        this->stages[stage]->process(input, input, numOutputSamples << stage);
+    }
+    this->stages[0]->process(input, output, numOutputSamples);
+}
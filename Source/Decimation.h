@@ -0,0 +1,100 @@
+/*
+  ==============================================================================
+
+    Decimation.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include <vector>
+
+/**
+ * A polyphase half-band FIR filter decimating its input by two.
+ * Every second coefficient of a half-band filter is zero and the centre coefficient is 0.5,
+ * so each output sample only needs one multiplication per symmetric coefficient pair plus the centre tap.
+ */
+class HalfBandDecimator {
+public:
+    /**
+     * Design the filter with a Kaiser windowed sinc.
+     * @param numCoefficientPairs the number of non-zero coefficients on each side of the centre tap.
+     * The filter has 4 * numCoefficientPairs - 1 taps.
+     */
+    explicit HalfBandDecimator(int numCoefficientPairs);
+
+    /**
+     * Allocate the working memory.
+     * @param maxOutputSamples the largest number of output samples produced by one call to process()
+     */
+    void prepare(int maxOutputSamples);
+
+    /**
+     * Clear the filter history.
+     */
+    void reset();
+
+    /**
+     * Decimate a block. The output may alias the input.
+     * @param input twice numOutputSamples input samples
+     * @param output the decimated samples
+     * @param numOutputSamples the number of samples to produce. It should not exceed the prepared size.
+     */
+    void process(const float* input, float* output, int numOutputSamples);
+
+private:
+    /** The coefficients at odd distances 1, 3, 5... from the centre tap */
+    std::vector<float> pairCoefficients;
+    int centreDelay;
+    int historyLength;
+    int maxInputSamples = 0;
+    /** The filter history followed by the current input block */
+    HeapBlock<float> buffer;
+};
+
+/**
+ * A cascade of half-band decimators bringing a 2x, 4x or 8x oversampled signal back to the base rate.
+ * The stages working at higher rates only have to reject the images far above the audio band,
+ * so they use much shorter filters than the last stage.
+ */
+class DecimatorCascade {
+public:
+    DecimatorCascade();
+
+    /**
+     * Allocate the working memory of all the stages.
+     * @param maxOutputSamples the largest number of samples produced by one call to process()
+     */
+    void prepare(int maxOutputSamples);
+
+    /**
+     * Clear the history of all the stages.
+     */
+    void reset();
+
+    /**
+     * Set the oversampling factor. It resets the stages.
+     * @param newFactor 1, 2, 4 or 8
+     */
+    void setFactor(int newFactor);
+
+    int getFactor() const;
+
+    /**
+     * Decimate a block to the base rate. The input is used as scratch space.
+     * @param input numOutputSamples * factor oversampled samples
+     * @param output the samples at the base rate
+     * @param numOutputSamples the number of samples to produce
+     */
+    void process(float* input, float* output, int numOutputSamples);
+
+private:
+    static constexpr int MAX_STAGES = 3;
+
+    /** stages[0] goes from 2x to 1x, stages[1] from 4x to 2x and stages[2] from 8x to 4x */
+    OwnedArray<HalfBandDecimator> stages;
+    int factor = 1;
+    int numActiveStages = 0;
+};
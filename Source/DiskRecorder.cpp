@@ -0,0 +1,258 @@
+/*
+  ==============================================================================
+
+    DiskRecorder.cpp
+
+  ==============================================================================
+*/
+
+#include "DiskRecorder.h"
+
+DiskRecorder::DiskRecorder() : Thread("Disk recorder") {}
+
+DiskRecorder::~DiskRecorder() {
+    this->stopRecording();
+}
+
+void DiskRecorder::prepareToPlay(int samplesPerBlockExpected, double sampleRate, int numChannels) {
+    const bool wasRecording = this->recording.load();
+    this->stopRecording();
+    this->currentSampleRate = sampleRate;
+    this->numRecordedChannels = numChannels;
+    this->writeChunkSamples = roundToInt(WRITE_CHUNK_SECONDS * sampleRate);
+    const int fifoSize = jmax(roundToInt(FIFO_SECONDS * sampleRate), 4 * samplesPerBlockExpected);
+    this->fifoBuffer.setSize(numChannels, fifoSize);
+    this->fifo.setTotalSize(fifoSize);
+    if (wasRecording) {
+        const File nextFile = this->recordingFile.getNonexistentSibling();
+        if (!this->startRecording(nextFile)) {
+            Logger::writeToLog("The recording stopped, " + nextFile.getFullPathName() + " cannot be created");
+        }
+    }
+}
+
+void DiskRecorder::releaseResources() {
+    this->stopRecording();
+    this->fifoBuffer.setSize(0, 0);
+    this->currentSampleRate = 0.0;
+}
+
+bool DiskRecorder::startRecording(const File &file) {
+    this->stopRecording();
+    if (this->currentSampleRate <= 0.0 || this->numRecordedChannels == 0) {
+        return false;
+    }
+
+    std::unique_ptr<AudioFormat> format;
+    if (file.hasFileExtension(".flac")) {
+        format = std::make_unique<FlacAudioFormat>();
+    } else {
+        format = std::make_unique<WavAudioFormat>();
+    }
+    // FileOutputStream appends to existing files.
+    if (file.exists() && !file.deleteFile()) {
+        return false;
+    }
+    auto stream = std::make_unique<FileOutputStream>(file, FILE_BUFFER_BYTES);
+    if (!stream->openedOk()) {
+        return false;
+    }
+    AudioFormatWriter* newWriter = format->createWriterFor(stream.get(), this->currentSampleRate,
+                                                           (unsigned int) this->numRecordedChannels, 24, {}, 0);
+    if (newWriter == nullptr) {
+        return false;
+    }
+    // The writer owns the stream from now on.
+    stream.release();
+    this->writer.reset(newWriter);
+
+    this->recordingFile = file;
+    this->fifo.reset();
+    this->numDroppedBlocks.store(0);
+    this->numRecordedSamples.store(0);
+    this->startThread();
+    this->recording.store(true);
+    return true;
+}
+
+void DiskRecorder::stopRecording() {
+    this->recording.store(false);
+    // The thread writes what is left in the FIFO before exiting.
+    this->stopThread(-1);
+    this->writer = nullptr;
+}
+
+void DiskRecorder::push(const AudioSourceChannelInfo &bufferToFill) {
+    if (!this->recording.load()) {
+        return;
+    }
+    const int numSamples = bufferToFill.numSamples;
+    if (this->fifo.getFreeSpace() < numSamples) {
+        this->numDroppedBlocks.fetch_add(1);
+        return;
+    }
+
+    int start1, size1, start2, size2;
+    this->fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+    const int numChannels = jmin(this->numRecordedChannels, bufferToFill.buffer->getNumChannels());
+    for (int channel = 0; channel < numChannels; ++channel) {
+        const float* source = bufferToFill.buffer->getReadPointer(channel, bufferToFill.startSample);
+        this->fifoBuffer.copyFrom(channel, start1, source, size1);
+        if (size2 > 0) {
+            this->fifoBuffer.copyFrom(channel, start2, source + size1, size2);
+        }
+    }
+    // Channels missing in the device buffer are recorded as silence.
+    for (int channel = numChannels; channel < this->numRecordedChannels; ++channel) {
+        this->fifoBuffer.clear(channel, start1, size1);
+        if (size2 > 0) {
+            this->fifoBuffer.clear(channel, start2, size2);
+        }
+    }
+    this->fifo.finishedWrite(size1 + size2);
+}
+
+bool DiskRecorder::isRecording() const {
+    return this->recording.load();
+}
+
+File DiskRecorder::getRecordingFile() const {
+    return this->recordingFile;
+}
+
+int DiskRecorder::getNumDroppedBlocks() const {
+    return this->numDroppedBlocks.load();
+}
+
+double DiskRecorder::getRecordedSeconds() const {
+    return this->currentSampleRate > 0.0 ? (double) this->numRecordedSamples.load() / this->currentSampleRate : 0.0;
+}
+
+String DiskRecorder::getFileWildcard() {
+    return "*.wav;*.flac";
+}
+
+void DiskRecorder::run() {
+    while (!this->threadShouldExit()) {
+        const int numReady = this->fifo.getNumReady();
+        if (numReady >= this->writeChunkSamples) {
+            this->writeFromFifo(numReady);
+        } else {
+            this->wait(WRITER_POLL_MILLISECONDS);
+        }
+    }
+    this->writeFromFifo(this->fifo.getNumReady());
+}
+
+void DiskRecorder::writeFromFifo(int numSamples) {
+    if (numSamples <= 0 || this->writer == nullptr) {
+        return;
+    }
+    int start1, size1, start2, size2;
+    this->fifo.prepareToRead(numSamples, start1, size1, start2, size2);
+    // Write straight from the FIFO memory, no copy is needed.
+    const float* channels[32];
+    const int numChannels = jmin(this->numRecordedChannels, (int) numElementsInArray(channels));
+    for (int channel = 0; channel < numChannels; ++channel) {
+        channels[channel] = this->fifoBuffer.getReadPointer(channel, start1);
+    }
+    this->writer->writeFromFloatArrays(channels, numChannels, size1);
+    if (size2 > 0) {
+        for (int channel = 0; channel < numChannels; ++channel) {
+            channels[channel] = this->fifoBuffer.getReadPointer(channel, start2);
+        }
+        this->writer->writeFromFloatArrays(channels, numChannels, size2);
+    }
+    this->fifo.finishedRead(size1 + size2);
+    this->numRecordedSamples.fetch_add(size1 + size2);
+}
+
+#if JUCE_UNIT_TESTS
+
+/**
+ * Records to temporary files and reads them back, across a change of sample rate and with a block too large for the
+ * FIFO.
+ */
+class DiskRecorderTests : public UnitTest {
+public:
+    DiskRecorderTests() : UnitTest("Disk recorder", "MIDISynth") {}
+
+    void runTest() override {
+        formatManager.registerBasicFormats();
+        const File file = File::createTempFile(".wav");
+        AudioBuffer<float> block(2, 100);
+        for (int channel = 0; channel < block.getNumChannels(); ++channel) {
+            block.clear(channel, 0, block.getNumSamples());
+            block.setSample(channel, 0, 0.5f);
+        }
+        const AudioSourceChannelInfo blockInfo(block);
+
+        beginTest("Sample rate change");
+        DiskRecorder recorder;
+        recorder.prepareToPlay(100, 1000.0, 2);
+        expect(recorder.startRecording(file));
+        for (int i = 0; i < 3; ++i) {
+            recorder.push(blockInfo);
+        }
+        // The first file is closed at its rate, and the recording goes on in a new file at the new rate.
+        recorder.prepareToPlay(100, 2000.0, 2);
+        expect(recorder.isRecording(), "the recording stops on a rate change");
+        const File nextFile = recorder.getRecordingFile();
+        expect(nextFile != file, "the first file is overwritten");
+        for (int i = 0; i < 5; ++i) {
+            recorder.push(blockInfo);
+        }
+        recorder.stopRecording();
+        expectWithinAbsoluteError(recorder.getRecordedSeconds(), 0.25, 1e-9);
+        expectFile(file, 1000.0, 300);
+        expectFile(nextFile, 2000.0, 500);
+        nextFile.deleteFile();
+
+        beginTest("Dropped blocks");
+        // The FIFO of four seconds keeps one sample free, so a block of four seconds never fits.
+        AudioBuffer<float> largeBlock(2, 8000);
+        largeBlock.clear();
+        expect(recorder.startRecording(file));
+        expectEquals(recorder.getNumDroppedBlocks(), 0);
+        recorder.push(blockInfo);
+        recorder.push(AudioSourceChannelInfo(largeBlock));
+        recorder.push(AudioSourceChannelInfo(largeBlock));
+        recorder.push(blockInfo);
+        expectEquals(recorder.getNumDroppedBlocks(), 2);
+        recorder.stopRecording();
+        expectFile(file, 2000.0, 200);
+        expect(recorder.startRecording(file));
+        expectEquals(recorder.getNumDroppedBlocks(), 0, "the counter is not reset by a new recording");
+        recorder.stopRecording();
+
+        file.deleteFile();
+    }
+
+private:
+    AudioFormatManager formatManager;
+
+    /**
+     * Read a recorded file back.
+     * @param file the recorded file
+     * @param sampleRate the expected sample rate
+     * @param numSamples the expected length, made of the test blocks starting with a sample at 0.5
+     */
+    void expectFile(const File& file, double sampleRate, int numSamples) {
+        std::unique_ptr<AudioFormatReader> reader(this->formatManager.createReaderFor(file));
+        expect(reader != nullptr, file.getFileName() + " cannot be read");
+        if (reader == nullptr) {
+            return;
+        }
+        expectEquals(reader->sampleRate, sampleRate);
+        expectEquals(reader->lengthInSamples, (int64) numSamples);
+        expectEquals((int) reader->numChannels, 2);
+        AudioBuffer<float> contents(2, numSamples);
+        reader->read(&contents, 0, numSamples, 0, true, true);
+        expectWithinAbsoluteError(contents.getSample(1, 0), 0.5f, 1e-4f);
+        expectWithinAbsoluteError(contents.getSample(0, 1), 0.0f, 1e-4f);
+    }
+};
+
+static DiskRecorderTests diskRecorderTests;
+
+#endif
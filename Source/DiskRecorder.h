@@ -0,0 +1,119 @@
+/*
+  ==============================================================================
+
+    DiskRecorder.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include <atomic>
+
+/**
+ * Records the master output to a WAV or FLAC file.
+ * The audio thread only copies every block into a lock-free FIFO allocated in prepareToPlay(). A background thread
+ * wakes up regularly and writes everything in the FIFO at once, so the file is written in large sequential chunks
+ * and a slow disk never blocks the audio callback. If the disk falls behind and the FIFO is full, the block is
+ * dropped and counted instead.
+ */
+class DiskRecorder : private Thread {
+public:
+    DiskRecorder();
+    ~DiskRecorder() override;
+
+    /**
+     * Allocate the FIFO. A file has a fixed sample rate, so a recording in progress is closed and goes on in a new
+     * file next to it, see getRecordingFile(). It should not be called while the audio thread is pushing blocks.
+     * @param samplesPerBlockExpected the expected device block size
+     * @param sampleRate the sample rate of the recording
+     * @param numChannels the number of channels to record
+     */
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate, int numChannels);
+
+    /**
+     * Stop the recording and free the FIFO.
+     */
+    void releaseResources();
+
+    /**
+     * Start recording to a file. It should be called from the message thread.
+     * The format is chosen by the extension of the file, ".flac" for FLAC and WAV otherwise. An existing file is
+     * replaced.
+     * @param file the file to record to
+     * @return false if the recorder is not prepared or the file cannot be created
+     */
+    bool startRecording(const File& file);
+
+    /**
+     * Stop recording, write what is left in the FIFO and close the file. It should be called from the message thread.
+     */
+    void stopRecording();
+
+    /**
+     * Copy a block to the FIFO if the recorder is recording. It should only be called from the audio thread.
+     * @param bufferToFill the block leaving the audio callback
+     */
+    void push(const AudioSourceChannelInfo& bufferToFill);
+
+    bool isRecording() const;
+
+    /**
+     * The file being recorded to. It changes when the device is prepared again during a recording.
+     * It should be called from the message thread.
+     * @return the file of the current or last recording
+     */
+    File getRecordingFile() const;
+
+    /**
+     * The number of blocks dropped because the FIFO was full, since the recording started
+     * @return the counter of dropped blocks
+     */
+    int getNumDroppedBlocks() const;
+
+    /**
+     * The length of the audio written to the file
+     * @return the length in seconds
+     */
+    double getRecordedSeconds() const;
+
+    /**
+     * Get the wildcard of the supported file formats
+     * @return the wildcard for a FileChooser
+     */
+    static String getFileWildcard();
+
+private:
+    /** The FIFO holds this much audio, the writer has to keep up on average only */
+    const double FIFO_SECONDS = 4.0;
+    /** The writer waits until this much audio is in the FIFO before writing */
+    const double WRITE_CHUNK_SECONDS = 0.5;
+    const int WRITER_POLL_MILLISECONDS = 50;
+    const size_t FILE_BUFFER_BYTES = 1 << 20;
+
+    AudioBuffer<float> fifoBuffer;
+    AbstractFifo fifo {1};
+    double currentSampleRate = 0.0;
+    int numRecordedChannels = 0;
+    int writeChunkSamples = 0;
+
+    File recordingFile;
+    std::unique_ptr<AudioFormatWriter> writer;
+    std::atomic<bool> recording {false};
+    std::atomic<int> numDroppedBlocks {0};
+    std::atomic<int64> numRecordedSamples {0};
+
+    /**
+     * The writer thread. It drains the FIFO until it is asked to exit, then writes what is left.
+     */
+    void run() override;
+
+    /**
+     * Write up to numSamples samples from the FIFO to the file.
+     * @param numSamples the number of samples to write
+     */
+    void writeFromFifo(int numSamples);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DiskRecorder)
+};
@@ -0,0 +1,392 @@
+/*
+  ==============================================================================
+
+    DspKernels.cpp
+
+  ==============================================================================
+*/
+
+#include "DspKernels.h"
+
+namespace {
+#if JUCE_GCC || JUCE_CLANG
+typedef float Float4 __attribute__((vector_size(16)));
+typedef uint32 UInt4 __attribute__((vector_size(16)));
+typedef int32 Int4 __attribute__((vector_size(16)));
+typedef float Float8 __attribute__((vector_size(32)));
+typedef uint32 UInt8 __attribute__((vector_size(32)));
+typedef int32 Int8 __attribute__((vector_size(32)));
+typedef float Float16 __attribute__((vector_size(64)));
+typedef uint32 UInt16 __attribute__((vector_size(64)));
+typedef int32 Int16 __attribute__((vector_size(64)));
+
+/**
+ * The kernels on vectors of any width, the remainder of a block is processed one sample at a time.
+ * They are always inlined into the functions of an instruction set below, so their vector operations are compiled
+ * for it. The vectors never cross a function boundary, which would depend on the instruction set.
+ */
+template <typename Float, typename UInt, typename Int>
+struct VectorKernels {
+    static constexpr int numLanes = (int) (sizeof(Float) / sizeof(float));
+
+    // The scale is a power of two, so the product and the sum are exact, fused or not.
+    __attribute__((always_inline)) static inline void fillNoise(float* destination, int numValues, uint32 key,
+                                                                uint32 start, float scale, float offset) {
+        UInt counters;
+        for (int lane = 0; lane < numLanes; ++lane) {
+            counters[lane] = start + (uint32) lane;
+        }
+        int i = 0;
+        for (; i + numLanes <= numValues; i += numLanes) {
+            UInt hashes = counters;
+            mixBits(hashes, key);
+            const Float values = __builtin_convertvector((Int) (hashes >> 8), Float) * scale + offset;
+            std::memcpy(destination + i, &values, sizeof(values));
+            counters += (uint32) numLanes;
+        }
+        for (; i < numValues; ++i) {
+            uint32 hash = start + (uint32) i;
+            mixBits(hash, key);
+            destination[i] = (float) (int32) (hash >> 8) * scale + offset;
+        }
+    }
+
+    __attribute__((always_inline)) static inline void multiplyByRamp(float* samples, int numSamples, float start,
+                                                                     float step) {
+        Float lanes;
+        for (int lane = 0; lane < numLanes; ++lane) {
+            lanes[lane] = (float) lane;
+        }
+        int i = 0;
+        for (; i + numLanes <= numSamples; i += numLanes) {
+            Float values;
+            std::memcpy(&values, samples + i, sizeof(values));
+            values *= start + step * (lanes + (float) i);
+            std::memcpy(samples + i, &values, sizeof(values));
+        }
+        for (; i < numSamples; ++i) {
+            samples[i] *= start + step * (float) i;
+        }
+    }
+
+    __attribute__((always_inline)) static inline void multiplyByDecay(float* samples, int numSamples, float start,
+                                                                      float ratio) {
+        Float gains;
+        float stride = 1.0f;
+        for (int lane = 0; lane < numLanes; ++lane) {
+            gains[lane] = start * stride;
+            stride *= ratio;
+        }
+        int i = 0;
+        for (; i + numLanes <= numSamples; i += numLanes) {
+            Float values;
+            std::memcpy(&values, samples + i, sizeof(values));
+            values *= gains;
+            std::memcpy(samples + i, &values, sizeof(values));
+            gains *= stride;
+        }
+        for (float gain = gains[0]; i < numSamples; ++i, gain *= ratio) {
+            samples[i] *= gain;
+        }
+    }
+
+    __attribute__((always_inline)) static inline void add(float* destination, const float* source, int numSamples) {
+        int i = 0;
+        for (; i + numLanes <= numSamples; i += numLanes) {
+            Float values, addends;
+            std::memcpy(&values, destination + i, sizeof(values));
+            std::memcpy(&addends, source + i, sizeof(addends));
+            values += addends;
+            std::memcpy(destination + i, &values, sizeof(values));
+        }
+        for (; i < numSamples; ++i) {
+            destination[i] += source[i];
+        }
+    }
+
+    __attribute__((always_inline)) static inline void multiply(float* destination, const float* first,
+                                                               const float* second, int numSamples) {
+        int i = 0;
+        for (; i + numLanes <= numSamples; i += numLanes) {
+            Float values, factors;
+            std::memcpy(&values, first + i, sizeof(values));
+            std::memcpy(&factors, second + i, sizeof(factors));
+            values *= factors;
+            std::memcpy(destination + i, &values, sizeof(values));
+        }
+        for (; i < numSamples; ++i) {
+            destination[i] = first[i] * second[i];
+        }
+    }
+
+    __attribute__((always_inline)) static inline void softClip(float* samples, int numSamples) {
+        int i = 0;
+        for (; i + numLanes <= numSamples; i += numLanes) {
+            Float x;
+            std::memcpy(&x, samples + i, sizeof(x));
+            const Float x2 = x * x;
+            const Float numerator = x * (135135.0f + x2 * (17325.0f + x2 * (378.0f + x2)));
+            const Float denominator = 135135.0f + x2 * (62370.0f + x2 * (3150.0f + 28.0f * x2));
+            x = numerator / denominator;
+            std::memcpy(samples + i, &x, sizeof(x));
+        }
+        for (; i < numSamples; ++i) {
+            samples[i] = dsp::FastMathApproximations::tanh(samples[i]);
+        }
+    }
+};
+
+typedef VectorKernels<Float4, UInt4, Int4> BaselineKernels;
+
+void fillNoiseBaseline(float* destination, int numValues, uint32 key, uint32 start, float scale, float offset) {
+    BaselineKernels::fillNoise(destination, numValues, key, start, scale, offset);
+}
+
+void multiplyByRampBaseline(float* samples, int numSamples, float start, float step) {
+    BaselineKernels::multiplyByRamp(samples, numSamples, start, step);
+}
+
+void multiplyByDecayBaseline(float* samples, int numSamples, float start, float ratio) {
+    BaselineKernels::multiplyByDecay(samples, numSamples, start, ratio);
+}
+
+void addBaseline(float* destination, const float* source, int numSamples) {
+    BaselineKernels::add(destination, source, numSamples);
+}
+
+void multiplyBaseline(float* destination, const float* first, const float* second, int numSamples) {
+    BaselineKernels::multiply(destination, first, second, numSamples);
+}
+
+void softClipBaseline(float* samples, int numSamples) {
+    BaselineKernels::softClip(samples, numSamples);
+}
+
+#if JUCE_INTEL
+typedef VectorKernels<Float8, UInt8, Int8> Avx2Kernels;
+
+__attribute__((target("avx2")))
+void fillNoiseAvx2(float* destination, int numValues, uint32 key, uint32 start, float scale, float offset) {
+    Avx2Kernels::fillNoise(destination, numValues, key, start, scale, offset);
+}
+
+__attribute__((target("avx2")))
+void multiplyByRampAvx2(float* samples, int numSamples, float start, float step) {
+    Avx2Kernels::multiplyByRamp(samples, numSamples, start, step);
+}
+
+__attribute__((target("avx2")))
+void multiplyByDecayAvx2(float* samples, int numSamples, float start, float ratio) {
+    Avx2Kernels::multiplyByDecay(samples, numSamples, start, ratio);
+}
+
+__attribute__((target("avx2")))
+void addAvx2(float* destination, const float* source, int numSamples) {
+    Avx2Kernels::add(destination, source, numSamples);
+}
+
+__attribute__((target("avx2")))
+void multiplyAvx2(float* destination, const float* first, const float* second, int numSamples) {
+    Avx2Kernels::multiply(destination, first, second, numSamples);
+}
+
+__attribute__((target("avx2")))
+void softClipAvx2(float* samples, int numSamples) {
+    Avx2Kernels::softClip(samples, numSamples);
+}
+
+typedef VectorKernels<Float16, UInt16, Int16> Avx512Kernels;
+
+__attribute__((target("avx512f")))
+void fillNoiseAvx512(float* destination, int numValues, uint32 key, uint32 start, float scale, float offset) {
+    Avx512Kernels::fillNoise(destination, numValues, key, start, scale, offset);
+}
+
+__attribute__((target("avx512f")))
+void multiplyByRampAvx512(float* samples, int numSamples, float start, float step) {
+    Avx512Kernels::multiplyByRamp(samples, numSamples, start, step);
+}
+
+__attribute__((target("avx512f")))
+void multiplyByDecayAvx512(float* samples, int numSamples, float start, float ratio) {
+    Avx512Kernels::multiplyByDecay(samples, numSamples, start, ratio);
+}
+
+__attribute__((target("avx512f")))
+void addAvx512(float* destination, const float* source, int numSamples) {
+    Avx512Kernels::add(destination, source, numSamples);
+}
+
+__attribute__((target("avx512f")))
+void multiplyAvx512(float* destination, const float* first, const float* second, int numSamples) {
+    Avx512Kernels::multiply(destination, first, second, numSamples);
+}
+
+__attribute__((target("avx512f")))
+void softClipAvx512(float* samples, int numSamples) {
+    Avx512Kernels::softClip(samples, numSamples);
+}
+#endif
+#else
+// Without vector extensions the baseline is left to the auto-vectoriser of the compiler.
+void fillNoiseBaseline(float* destination, int numValues, uint32 key, uint32 start, float scale, float offset) {
+    for (int i = 0; i < numValues; ++i) {
+        uint32 hash = start + (uint32) i;
+        mixBits(hash, key);
+        destination[i] = (float) (int32) (hash >> 8) * scale + offset;
+    }
+}
+
+void multiplyByRampBaseline(float* samples, int numSamples, float start, float step) {
+    for (int i = 0; i < numSamples; ++i) {
+        samples[i] *= start + step * (float) i;
+    }
+}
+
+void multiplyByDecayBaseline(float* samples, int numSamples, float start, float ratio) {
+    for (int i = 0; i < numSamples; ++i, start *= ratio) {
+        samples[i] *= start;
+    }
+}
+
+void addBaseline(float* destination, const float* source, int numSamples) {
+    FloatVectorOperations::add(destination, source, numSamples);
+}
+
+void multiplyBaseline(float* destination, const float* first, const float* second, int numSamples) {
+    FloatVectorOperations::multiply(destination, first, second, numSamples);
+}
+
+void softClipBaseline(float* samples, int numSamples) {
+    for (int i = 0; i < numSamples; ++i) {
+        samples[i] = dsp::FastMathApproximations::tanh(samples[i]);
+    }
+}
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+const char* const BASELINE_NAME = "SSE2";
+#else
+const char* const BASELINE_NAME = "Generic";
+#endif
+
+const DspKernels baselineKernels {BASELINE_NAME, fillNoiseBaseline, multiplyByRampBaseline, multiplyByDecayBaseline,
+                                  addBaseline, multiplyBaseline, softClipBaseline};
+#if (JUCE_GCC || JUCE_CLANG) && JUCE_INTEL
+const DspKernels avx2Kernels {"AVX2", fillNoiseAvx2, multiplyByRampAvx2, multiplyByDecayAvx2, addAvx2, multiplyAvx2,
+                              softClipAvx2};
+const DspKernels avx512Kernels {"AVX-512", fillNoiseAvx512, multiplyByRampAvx512, multiplyByDecayAvx512,
+                                addAvx512, multiplyAvx512, softClipAvx512};
+#endif
+}
+
+Array<const DspKernels*> DspKernels::getSupportedVariants() {
+    Array<const DspKernels*> variants {&baselineKernels};
+#if (JUCE_GCC || JUCE_CLANG) && JUCE_INTEL
+    // The builtins read cpuid, and check that the operating system saves the wide registers.
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        variants.add(&avx2Kernels);
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        variants.add(&avx512Kernels);
+    }
+#endif
+    return variants;
+}
+
+const DspKernels& DspKernels::get() {
+    static const DspKernels& kernels = *getSupportedVariants().getLast();
+    return kernels;
+}
+
+#if JUCE_UNIT_TESTS
+
+/**
+ * Runs every supported variant on the same blocks as the baseline. The noise, the sums and the products must be
+ * identical, the ramps, the decays and the soft clip equal within a few rounding errors.
+ */
+class DspKernelsTests : public UnitTest {
+public:
+    DspKernelsTests() : UnitTest("DSP kernels", "MIDISynth") {}
+
+    void runTest() override {
+        const Array<const DspKernels*> variants = DspKernels::getSupportedVariants();
+        const DspKernels& baseline = *variants.getFirst();
+        Random random(1);
+        // The odd lengths leave a remainder after the vectors of every width.
+        for (int numSamples : {1, 7, 64, 253}) {
+            HeapBlock<float> input(numSamples), other(numSamples), expected(numSamples), actual(numSamples);
+            for (int i = 0; i < numSamples; ++i) {
+                input[i] = random.nextFloat() * 2.0f - 1.0f;
+                other[i] = random.nextFloat() * 2.0f - 1.0f;
+            }
+            for (const DspKernels* variant : variants) {
+                beginTest(String(variant->name) + ", " + String(numSamples) + " samples");
+
+                baseline.fillNoise(expected, numSamples, 0x2545f491u, 12345u, 1.0f / 8388608.0f, -1.0f);
+                variant->fillNoise(actual, numSamples, 0x2545f491u, 12345u, 1.0f / 8388608.0f, -1.0f);
+                expectIdentical(expected, actual, numSamples, "noise");
+
+                copyAndRun(input, expected, numSamples, [&baseline, &other, numSamples](float* samples) {
+                    baseline.add(samples, other, numSamples);
+                });
+                copyAndRun(input, actual, numSamples, [variant, &other, numSamples](float* samples) {
+                    variant->add(samples, other, numSamples);
+                });
+                expectIdentical(expected, actual, numSamples, "add");
+
+                baseline.multiply(expected, input, other, numSamples);
+                variant->multiply(actual, input, other, numSamples);
+                expectIdentical(expected, actual, numSamples, "multiply");
+
+                copyAndRun(input, expected, numSamples, [&baseline, numSamples](float* samples) {
+                    baseline.multiplyByRamp(samples, numSamples, 0.1f, 0.003f);
+                });
+                copyAndRun(input, actual, numSamples, [variant, numSamples](float* samples) {
+                    variant->multiplyByRamp(samples, numSamples, 0.1f, 0.003f);
+                });
+                expectClose(expected, actual, numSamples, "ramp");
+
+                copyAndRun(input, expected, numSamples, [&baseline, numSamples](float* samples) {
+                    baseline.multiplyByDecay(samples, numSamples, 0.9f, 0.999f);
+                });
+                copyAndRun(input, actual, numSamples, [variant, numSamples](float* samples) {
+                    variant->multiplyByDecay(samples, numSamples, 0.9f, 0.999f);
+                });
+                expectClose(expected, actual, numSamples, "decay");
+
+                copyAndRun(input, expected, numSamples, [&baseline, numSamples](float* samples) {
+                    baseline.softClip(samples, numSamples);
+                });
+                copyAndRun(input, actual, numSamples, [variant, numSamples](float* samples) {
+                    variant->softClip(samples, numSamples);
+                });
+                expectClose(expected, actual, numSamples, "soft clip");
+            }
+        }
+    }
+
+private:
+    template <typename Kernel>
+    static void copyAndRun(const float* input, float* output, int numSamples, Kernel kernel) {
+        FloatVectorOperations::copy(output, input, numSamples);
+        kernel(output);
+    }
+
+    void expectIdentical(const float* expected, const float* actual, int numSamples, const String& kernel) {
+        expect(std::memcmp(expected, actual, sizeof(float) * (size_t) numSamples) == 0, kernel + " differs");
+    }
+
+    void expectClose(const float* expected, const float* actual, int numSamples, const String& kernel) {
+        float error = 0.0f;
+        for (int i = 0; i < numSamples; ++i) {
+            error = jmax(error, std::abs(expected[i] - actual[i]));
+        }
+        expectLessOrEqual(error, 1.0e-5f, kernel + " differs");
+    }
+};
+
+static DspKernelsTests dspKernelsTests;
+
+#endif
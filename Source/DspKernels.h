@@ -0,0 +1,120 @@
+/*
+  ==============================================================================
+
+    DspKernels.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/**
+ * The hot loops of the synthesiser, compiled for several instruction sets in the same binary.
+ * On x86 with GCC or Clang every kernel is built for the baseline SSE2, for AVX2 and for AVX-512, and the widest
+ * variant the processor and the operating system support is chosen the first time the table is asked for. Other
+ * platforms get the baseline build only. The noise, the sums and the products are bit-exact in every variant, so the
+ * noise is reproducible across machines. The ramps, the decays and the soft clip may differ in the last bits, as a
+ * wider variant may fuse a multiply and an add, or chain the multiplications of a decay in larger steps.
+ */
+struct DspKernels {
+    /** The name of the instruction set of the variant, for the log */
+    const char* name;
+
+    /**
+     * Fill a block with values of the counter-based generator of NoiseGenerator
+     * @param destination the values to overwrite, (hash >> 8) * scale + offset
+     * @param numValues the number of values
+     * @param key the key of the sequence, mixed into the hash of every counter
+     * @param start the counter of the first value, the following values take the next counters
+     * @param scale the scale of the 24 bit hash
+     * @param offset added to the scaled hash
+     */
+    void (*fillNoise)(float* destination, int numValues, uint32 key, uint32 start, float scale, float offset);
+
+    /**
+     * Multiply a block by a linear ramp, the gain of an attack. The gain of every sample is computed from its index,
+     * so it does not drift over a long block.
+     * @param samples the samples to scale
+     * @param numSamples the number of samples
+     * @param start the gain of the first sample
+     * @param step the gain of sample i is start + i * step
+     */
+    void (*multiplyByRamp)(float* samples, int numSamples, float start, float step);
+
+    /**
+     * Multiply a block by an exponential decay, the gain of a release tail
+     * @param samples the samples to scale
+     * @param numSamples the number of samples
+     * @param start the gain of the first sample
+     * @param ratio the gain is multiplied by it after every sample
+     */
+    void (*multiplyByDecay)(float* samples, int numSamples, float start, float ratio);
+
+    /**
+     * Add a block to another one, the mix of a voice into the output
+     * @param destination the samples added to
+     * @param source the samples to add
+     * @param numSamples the number of samples
+     */
+    void (*add)(float* destination, const float* source, int numSamples);
+
+    /**
+     * Multiply two blocks, the gain of the limiter
+     * @param destination the products
+     * @param first the first factors
+     * @param second the second factors
+     * @param numSamples the number of samples
+     */
+    void (*multiply)(float* destination, const float* first, const float* second, int numSamples);
+
+    /**
+     * Replace every sample by the rational approximation of its hyperbolic tangent, the one of
+     * dsp::FastMathApproximations. The samples should already be clipped to its range.
+     * @param samples the samples to saturate
+     * @param numSamples the number of samples
+     */
+    void (*softClip)(float* samples, int numSamples);
+
+    /**
+     * Get the kernels of the fastest instruction set of the processor. The choice is made on the first call, which
+     * should not happen on the audio thread.
+     * @return the table of kernels
+     */
+    static const DspKernels& get();
+
+    /**
+     * Get every variant the processor supports, so that they can be compared with each other
+     * @return the variants, the baseline first and the one of get() last
+     */
+    static Array<const DspKernels*> getSupportedVariants();
+};
+
+/**
+ * Mix the bits of 32 bit integers, so that consecutive inputs give unrelated outputs.
+ * It works on single integers and on the vectors of the kernels alike.
+ * @param value the integer to mix in place
+ */
+template <typename Integer>
+inline void mixBits(Integer& value) {
+    value ^= value >> 16;
+    value *= 0x7feb352du;
+    value ^= value >> 15;
+    value *= 0x846ca68bu;
+    value ^= value >> 16;
+}
+
+/**
+ * Mix the bits of 32 bit integers under a key. The key enters both rounds of the mix, so the sequences of the
+ * counters under two keys are unrelated, rather than shifted copies of each other as with mixBits(key + counter).
+ * @param value the integer to mix in place
+ * @param key the key
+ */
+template <typename Integer>
+inline void mixBits(Integer& value, uint32 key) {
+    value ^= key;
+    mixBits(value);
+    value ^= key;
+    mixBits(value);
+}
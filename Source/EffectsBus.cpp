@@ -0,0 +1,551 @@
+/*
+  ==============================================================================
+
+    EffectsBus.cpp
+
+  ==============================================================================
+*/
+
+#include "EffectsBus.h"
+
+//// ==============================================================================
+//// PartitionedConvolver::Engine Class
+//// ==============================================================================
+
+namespace {
+    int getFftOrder(int partitionSize) {
+        int order = 1;
+        while ((1 << order) < 2 * partitionSize) {
+            ++order;
+        }
+        return order;
+    }
+}
+
+PartitionedConvolver::Engine::Engine(const AudioBuffer<float> &impulseResponse, int newPartitionSize) :
+    partitionSize(newPartitionSize),
+    numBins(newPartitionSize + 1),
+    numPartitions(jmax(1, (impulseResponse.getNumSamples() + newPartitionSize - 1) / newPartitionSize)),
+    numRingSlots(numPartitions + 2),
+    numChannels(jlimit(1, 2, impulseResponse.getNumChannels())),
+    fft(getFftOrder(newPartitionSize)) {
+    const int fftSize = 2 * partitionSize;
+
+    partitionSpectra.resize((size_t) (numChannels * numPartitions * numBins));
+    inputSpectra.resize((size_t) (numRingSlots * numBins));
+    backgroundTail.resize((size_t) (2 * numChannels * numBins));
+    fallbackTail.resize((size_t) (numChannels * numBins));
+
+    inputHistory.resize((size_t) fftSize);
+    // The real-only transforms need twice the FFT size of working space.
+    fftBuffer.resize((size_t) (2 * fftSize));
+    inputBlock.resize((size_t) partitionSize);
+    outputBlock.resize((size_t) (numChannels * partitionSize));
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+        for (int partition = 0; partition < numPartitions; ++partition) {
+            std::fill(fftBuffer.begin(), fftBuffer.end(), 0.0f);
+            const int offset = partition * partitionSize;
+            const int numToCopy = jmin(partitionSize, impulseResponse.getNumSamples() - offset);
+            if (numToCopy > 0) {
+                FloatVectorOperations::copy(fftBuffer.data(), impulseResponse.getReadPointer(channel, offset), numToCopy);
+            }
+            fft.performRealOnlyForwardTransform(fftBuffer.data(), true);
+            auto* spectrum = reinterpret_cast<const std::complex<float>*>(fftBuffer.data());
+            auto* destination = partitionSpectra.data() + (channel * numPartitions + partition) * numBins;
+            std::copy(spectrum, spectrum + numBins, destination);
+        }
+    }
+}
+
+const std::complex<float>* PartitionedConvolver::Engine::getPartition(int channel, int partition) const {
+    return partitionSpectra.data() + (channel * numPartitions + partition) * numBins;
+}
+
+std::complex<float>* PartitionedConvolver::Engine::getInputSpectrum(int64 blockIndex) {
+    return inputSpectra.data() + (int) (blockIndex % numRingSlots) * numBins;
+}
+
+const std::complex<float>* PartitionedConvolver::Engine::getInputSpectrum(int64 blockIndex) const {
+    return inputSpectra.data() + (int) (blockIndex % numRingSlots) * numBins;
+}
+
+std::complex<float>* PartitionedConvolver::Engine::getBackgroundTail(int64 blockIndex, int channel) {
+    return backgroundTail.data() + ((int) (blockIndex & 1) * numChannels + channel) * numBins;
+}
+
+bool PartitionedConvolver::Engine::accumulateTail(int64 blockIndex, std::complex<float> *destination,
+                                                  const std::atomic<int64> *latestRequest) const {
+    std::fill(destination, destination + numChannels * numBins, std::complex<float>());
+    for (int partition = 1; partition < numPartitions; ++partition) {
+        const int64 sourceBlock = blockIndex - partition;
+        if (sourceBlock < firstBlock) {
+            break;
+        }
+        // Once a newer block has been requested, the audio thread has already moved past this one.
+        if (latestRequest != nullptr && latestRequest->load(std::memory_order_relaxed) > blockIndex) {
+            return false;
+        }
+        const std::complex<float>* input = getInputSpectrum(sourceBlock);
+        for (int channel = 0; channel < numChannels; ++channel) {
+            const std::complex<float>* coefficients = getPartition(channel, partition);
+            std::complex<float>* accumulator = destination + channel * numBins;
+            for (int bin = 0; bin < numBins; ++bin) {
+                accumulator[bin] += coefficients[bin] * input[bin];
+            }
+        }
+    }
+    return true;
+}
+
+//// ==============================================================================
+//// PartitionedConvolver Class
+//// ==============================================================================
+
+PartitionedConvolver::PartitionedConvolver() : Thread("Convolution tail") {}
+
+PartitionedConvolver::~PartitionedConvolver() {
+    this->releaseResources();
+}
+
+void PartitionedConvolver::prepareToPlay(int samplesPerBlockExpected, double sampleRate) {
+    this->stopThread(2000);
+    {
+        const ScopedLock sl(impulseResponseLock);
+        this->partitionSize = jlimit(128, 2048, nextPowerOfTwo(samplesPerBlockExpected));
+        this->currentSampleRate = sampleRate;
+    }
+    // The background thread is stopped, so every engine can be deleted here.
+    delete this->pendingEngine.exchange(nullptr);
+    delete this->retiredEngine.exchange(nullptr);
+    Engine* newEngine = this->createEngine().release();
+    if (newEngine != nullptr) {
+        newEngine->firstBlock = this->currentBlock;
+    }
+    delete this->engine.exchange(newEngine);
+
+    this->numLateTails.store(0);
+    this->startThread(8);
+}
+
+void PartitionedConvolver::releaseResources() {
+    this->stopThread(2000);
+    delete this->engine.exchange(nullptr);
+    delete this->pendingEngine.exchange(nullptr);
+    delete this->retiredEngine.exchange(nullptr);
+}
+
+void PartitionedConvolver::process(const float *input, float *const *outputs, int numOutputChannels, int numSamples) {
+    this->adoptPendingEngine();
+    Engine* current = this->engine.load(std::memory_order_relaxed);
+    if (current == nullptr) {
+        for (int channel = 0; channel < numOutputChannels; ++channel) {
+            FloatVectorOperations::clear(outputs[channel], numSamples);
+        }
+        return;
+    }
+
+    const int blockSize = current->partitionSize;
+    int samplesDone = 0;
+    while (samplesDone < numSamples) {
+        const int numToProcess = jmin(numSamples - samplesDone, blockSize - current->blockPosition);
+        FloatVectorOperations::copy(current->inputBlock.data() + current->blockPosition,
+                                    input + samplesDone, numToProcess);
+        for (int channel = 0; channel < numOutputChannels; ++channel) {
+            const int sourceChannel = jmin(channel, current->numChannels - 1);
+            FloatVectorOperations::copy(outputs[channel] + samplesDone,
+                                        current->outputBlock.data() + sourceChannel * blockSize + current->blockPosition,
+                                        numToProcess);
+        }
+        current->blockPosition += numToProcess;
+        samplesDone += numToProcess;
+        if (current->blockPosition == blockSize) {
+            this->processPartition(*current);
+            current->blockPosition = 0;
+        }
+    }
+}
+
+void PartitionedConvolver::setImpulseResponse(const AudioBuffer<float> &newImpulseResponse,
+                                              double newImpulseResponseSampleRate) {
+    std::unique_ptr<Engine> newEngine;
+    {
+        const ScopedLock sl(impulseResponseLock);
+        this->impulseResponse.makeCopyOf(newImpulseResponse);
+        this->impulseResponseSampleRate = newImpulseResponseSampleRate;
+        newEngine = this->createEngine();
+    }
+    // A pending engine the audio thread has not adopted yet is simply replaced.
+    delete this->pendingEngine.exchange(newEngine.release());
+    this->impulseResponseLengthSeconds.store(newImpulseResponse.getNumSamples() / newImpulseResponseSampleRate);
+    this->impulseResponseLoaded.store(true);
+}
+
+bool PartitionedConvolver::hasImpulseResponse() const {
+    return this->impulseResponseLoaded.load();
+}
+
+double PartitionedConvolver::getImpulseResponseLengthSeconds() const {
+    return this->impulseResponseLengthSeconds.load();
+}
+
+int PartitionedConvolver::getLatencyInSamples() const {
+    const ScopedLock sl(impulseResponseLock);
+    return this->partitionSize;
+}
+
+int PartitionedConvolver::getNumLateTails() const {
+    return this->numLateTails.load();
+}
+
+void PartitionedConvolver::run() {
+    while (!this->threadShouldExit()) {
+        // The engine was retired between two jobs, and this thread is between two jobs as well, so nothing reads it.
+        delete this->retiredEngine.exchange(nullptr, std::memory_order_acq_rel);
+        for (;;) {
+            const int64 job = this->requestedBlock.load(std::memory_order_acquire);
+            if (job == this->completedBlock.load(std::memory_order_relaxed) || this->threadShouldExit()) {
+                break;
+            }
+            // The audio thread only swaps the engine while no job is pending, so it stays the same until the job
+            // is marked completed.
+            Engine* current = this->engine.load(std::memory_order_acquire);
+            if (current != nullptr && current->numPartitions > 1) {
+                // An abandoned job still marks itself completed. Its block index is stale, so it is never used.
+                current->accumulateTail(job, current->getBackgroundTail(job, 0), &this->requestedBlock);
+            }
+            this->completedBlock.store(job, std::memory_order_release);
+        }
+        this->wait(POLL_INTERVAL);
+    }
+}
+
+void PartitionedConvolver::processPartition(Engine &current) {
+    const int blockSize = current.partitionSize;
+    const int64 blockIndex = this->currentBlock;
+
+    // Slide the input window: the previous block followed by the new block.
+    std::copy(current.inputHistory.begin() + blockSize, current.inputHistory.end(), current.inputHistory.begin());
+    std::copy(current.inputBlock.begin(), current.inputBlock.end(), current.inputHistory.begin() + blockSize);
+    std::copy(current.inputHistory.begin(), current.inputHistory.end(), current.fftBuffer.begin());
+    std::fill(current.fftBuffer.begin() + 2 * blockSize, current.fftBuffer.end(), 0.0f);
+    current.fft.performRealOnlyForwardTransform(current.fftBuffer.data(), true);
+
+    auto* spectrum = reinterpret_cast<std::complex<float>*>(current.fftBuffer.data());
+    std::complex<float>* inputSpectrum = current.getInputSpectrum(blockIndex);
+    std::copy(spectrum, spectrum + current.numBins, inputSpectrum);
+
+    const std::complex<float>* tail = nullptr;
+    // The first block of an engine has no previous input, so it has no tail.
+    if (current.numPartitions > 1 && blockIndex > current.firstBlock) {
+        if (this->completedBlock.load(std::memory_order_acquire) == blockIndex) {
+            tail = current.getBackgroundTail(blockIndex, 0);
+        } else {
+            current.accumulateTail(blockIndex, current.fallbackTail.data(), nullptr);
+            tail = current.fallbackTail.data();
+            this->numLateTails.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    for (int channel = 0; channel < current.numChannels; ++channel) {
+        const std::complex<float>* head = current.getPartition(channel, 0);
+        for (int bin = 0; bin < current.numBins; ++bin) {
+            spectrum[bin] = head[bin] * inputSpectrum[bin];
+        }
+        if (tail != nullptr) {
+            const std::complex<float>* channelTail = tail + channel * current.numBins;
+            for (int bin = 0; bin < current.numBins; ++bin) {
+                spectrum[bin] += channelTail[bin];
+            }
+        }
+        current.fft.performRealOnlyInverseTransform(current.fftBuffer.data());
+        // Overlap-save: only the second half of the circular convolution is valid.
+        std::copy(current.fftBuffer.begin() + blockSize, current.fftBuffer.begin() + 2 * blockSize,
+                  current.outputBlock.begin() + channel * blockSize);
+    }
+
+    this->currentBlock = blockIndex + 1;
+    this->requestedBlock.store(this->currentBlock, std::memory_order_release);
+}
+
+void PartitionedConvolver::adoptPendingEngine() {
+    if (this->pendingEngine.load(std::memory_order_relaxed) == nullptr
+        || this->retiredEngine.load(std::memory_order_acquire) != nullptr) {
+        return;
+    }
+    // Only swap while the background thread is idle, it is the only other reader of the engine.
+    if (this->completedBlock.load(std::memory_order_acquire) != this->requestedBlock.load(std::memory_order_relaxed)) {
+        return;
+    }
+    Engine* newEngine = this->pendingEngine.exchange(nullptr, std::memory_order_acq_rel);
+    newEngine->firstBlock = this->currentBlock;
+    Engine* oldEngine = this->engine.exchange(newEngine, std::memory_order_acq_rel);
+    // The background thread frees it, the audio thread never does.
+    this->retiredEngine.store(oldEngine, std::memory_order_release);
+}
+
+std::unique_ptr<PartitionedConvolver::Engine> PartitionedConvolver::createEngine() {
+    const ScopedLock sl(impulseResponseLock);
+    const int sourceLength = this->impulseResponse.getNumSamples();
+    if (sourceLength == 0) {
+        return nullptr;
+    }
+
+    const double ratio = this->impulseResponseSampleRate / this->currentSampleRate;
+    const int numChannels = jlimit(1, 2, this->impulseResponse.getNumChannels());
+    const auto numSamples = (int) std::ceil(sourceLength / ratio);
+    AudioBuffer<float> resampled(numChannels, numSamples);
+
+    // Lagrange interpolation reads a few samples ahead, so feed it a zero padded copy.
+    AudioBuffer<float> padded(1, sourceLength + 8);
+    float peakEnergy = 0.0f;
+    for (int channel = 0; channel < numChannels; ++channel) {
+        padded.clear();
+        padded.copyFrom(0, 0, this->impulseResponse, channel, 0, sourceLength);
+        LagrangeInterpolator interpolator;
+        interpolator.process(ratio, padded.getReadPointer(0), resampled.getWritePointer(channel), numSamples);
+        float energy = 0.0f;
+        const float* data = resampled.getReadPointer(channel);
+        for (int i = 0; i < numSamples; ++i) {
+            energy += data[i] * data[i];
+        }
+        peakEnergy = jmax(peakEnergy, energy);
+    }
+    // Normalise the impulse response to unit energy so long and short tails have a comparable loudness.
+    if (peakEnergy > 0.0f) {
+        resampled.applyGain(1.0f / std::sqrt(peakEnergy));
+    }
+    return std::make_unique<Engine>(resampled, this->partitionSize);
+}
+
+//// ==============================================================================
+//// FeedbackDelay Class
+//// ==============================================================================
+
+void FeedbackDelay::prepareToPlay(double maxDelaySeconds, double sampleRate, int numChannels) {
+    this->currentSampleRate = sampleRate;
+    this->delayBuffer.setSize(numChannels, (int) std::ceil(maxDelaySeconds * sampleRate) + 1);
+    this->delayBuffer.clear();
+    this->writePosition = 0;
+    this->hasParameters = false;
+}
+
+void FeedbackDelay::releaseResources() {
+    this->delayBuffer.setSize(0, 0);
+}
+
+void FeedbackDelay::process(AudioBuffer<float> &buffer, int startSample, int numSamples,
+                            float delaySeconds, float feedback, float mix) {
+    const int delayLength = this->delayBuffer.getNumSamples();
+    if (delayLength < 2 || numSamples <= 0) {
+        return;
+    }
+    const float targetDelay = jlimit(1.0f, (float) (delayLength - 1), delaySeconds * (float) this->currentSampleRate);
+    if (!this->hasParameters) {
+        this->currentDelay = targetDelay;
+        this->currentFeedback = feedback;
+        this->currentMix = mix;
+        this->hasParameters = true;
+    }
+    const auto numSlices = (float) ((numSamples + PARAMETER_SLICE - 1) / PARAMETER_SLICE);
+    const float delayStep = (targetDelay - this->currentDelay) / numSlices;
+    const float feedbackStep = (feedback - this->currentFeedback) / numSlices;
+    const float mixStep = (mix - this->currentMix) / numSlices;
+    const int numChannels = jmin(buffer.getNumChannels(), this->delayBuffer.getNumChannels());
+
+    for (int offset = 0; offset < numSamples; offset += PARAMETER_SLICE) {
+        const int sliceLength = jmin(PARAMETER_SLICE, numSamples - offset);
+        // Every slice uses the values reached at its end.
+        this->currentDelay += delayStep;
+        this->currentFeedback += feedbackStep;
+        this->currentMix += mixStep;
+        const int delaySamples = jlimit(1, delayLength - 1, roundToInt(this->currentDelay));
+        for (int channel = 0; channel < numChannels; ++channel) {
+            float* samples = buffer.getWritePointer(channel, startSample + offset);
+            float* line = this->delayBuffer.getWritePointer(channel);
+            int position = this->writePosition;
+            for (int i = 0; i < sliceLength; ++i) {
+                int readPosition = position - delaySamples;
+                if (readPosition < 0) {
+                    readPosition += delayLength;
+                }
+                const float delayed = line[readPosition];
+                line[position] = samples[i] + delayed * this->currentFeedback;
+                samples[i] += delayed * this->currentMix;
+                if (++position == delayLength) {
+                    position = 0;
+                }
+            }
+        }
+        this->writePosition = (this->writePosition + sliceLength) % delayLength;
+    }
+    // No rounding error is carried over to the next block.
+    this->currentDelay = targetDelay;
+    this->currentFeedback = feedback;
+    this->currentMix = mix;
+}
+
+//// ==============================================================================
+//// EffectsBus Class
+//// ==============================================================================
+
+EffectsBus::EffectsBus() {
+    this->formatManager.registerBasicFormats();
+}
+
+void EffectsBus::prepareToPlay(int samplesPerBlockExpected, double sampleRate) {
+    this->monoInput.setSize(1, samplesPerBlockExpected);
+    this->reverbOutput.setSize(2, samplesPerBlockExpected);
+    this->reverb.prepareToPlay(samplesPerBlockExpected, sampleRate);
+    this->delay.prepareToPlay(MAX_DELAY_SECONDS, sampleRate, 2);
+}
+
+void EffectsBus::releaseResources() {
+    this->reverb.releaseResources();
+    this->delay.releaseResources();
+}
+
+void EffectsBus::process(AudioBuffer<float> &buffer, int startSample, int numSamples) {
+    const int numChannels = buffer.getNumChannels();
+    const int scratchSize = this->monoInput.getNumSamples();
+    const float currentReverbMix = this->reverbMix.load();
+    if (numChannels == 0) {
+        return;
+    }
+
+    if (this->reverb.hasImpulseResponse() && currentReverbMix > 0.0f && scratchSize > 0) {
+        float* mono = this->monoInput.getWritePointer(0);
+        float* const wet[2] = {this->reverbOutput.getWritePointer(0), this->reverbOutput.getWritePointer(1)};
+        // Devices may deliver more samples than they announced, so work in chunks of the scratch size.
+        for (int offset = 0; offset < numSamples; offset += scratchSize) {
+            const int numToProcess = jmin(scratchSize, numSamples - offset);
+            FloatVectorOperations::copy(mono, buffer.getReadPointer(0, startSample + offset), numToProcess);
+            for (int channel = 1; channel < numChannels; ++channel) {
+                FloatVectorOperations::add(mono, buffer.getReadPointer(channel, startSample + offset), numToProcess);
+            }
+            FloatVectorOperations::multiply(mono, 1.0f / (float) numChannels, numToProcess);
+            this->reverb.process(mono, wet, 2, numToProcess);
+            for (int channel = 0; channel < numChannels; ++channel) {
+                buffer.addFrom(channel, startSample + offset, this->reverbOutput, jmin(channel, 1), 0,
+                               numToProcess, currentReverbMix);
+            }
+        }
+    }
+
+    this->delay.process(buffer, startSample, numSamples,
+                        this->delayTime.load(), this->delayFeedback.load(), this->delayMix.load());
+}
+
+bool EffectsBus::loadImpulseResponse(const File &file) {
+    std::unique_ptr<AudioFormatReader> reader(this->formatManager.createReaderFor(file));
+    if (reader == nullptr || reader->sampleRate <= 0.0) {
+        return false;
+    }
+    const auto numSamples = (int) jmin(reader->lengthInSamples,
+                                       (int64) (MAX_IMPULSE_RESPONSE_SECONDS * reader->sampleRate));
+    if (numSamples <= 0) {
+        return false;
+    }
+    AudioBuffer<float> impulseResponse(jmin(2, (int) reader->numChannels), numSamples);
+    reader->read(&impulseResponse, 0, numSamples, 0, true, true);
+    this->reverb.setImpulseResponse(impulseResponse, reader->sampleRate);
+    return true;
+}
+
+String EffectsBus::getImpulseResponseWildcard() const {
+    return this->formatManager.getWildcardForAllFormats();
+}
+
+double EffectsBus::getTailLengthSeconds() const {
+    double tailLength = 0.0;
+    if (this->reverb.hasImpulseResponse() && this->reverbMix.load() > 0.0f) {
+        tailLength += this->reverb.getImpulseResponseLengthSeconds();
+    }
+    const double currentDelayTime = this->delayTime.load();
+    const double currentFeedback = this->delayFeedback.load();
+    if (this->delayMix.load() > 0.0f && currentDelayTime > 0.0) {
+        // Every repeat is quieter by the feedback gain, the first one is played at the delay mix.
+        const double numRepeats = currentFeedback > 0.0
+                ? 1.0 + std::ceil(std::log(SILENCE_GAIN) / std::log(currentFeedback)) : 1.0;
+        tailLength += currentDelayTime * numRepeats;
+    }
+    return tailLength;
+}
+
+void EffectsBus::setReverbMix(float newMix) {
+    this->reverbMix.store(jlimit(0.0f, 1.0f, newMix));
+}
+
+void EffectsBus::setDelayTime(float newDelaySeconds) {
+    this->delayTime.store(jlimit(0.0f, MAX_DELAY_SECONDS, newDelaySeconds));
+}
+
+void EffectsBus::setDelayFeedback(float newFeedback) {
+    this->delayFeedback.store(jlimit(0.0f, 0.95f, newFeedback));
+}
+
+void EffectsBus::setDelayMix(float newMix) {
+    this->delayMix.store(jlimit(0.0f, 1.0f, newMix));
+}
+
+#if JUCE_UNIT_TESTS
+
+/**
+ * Convolves random noise with a random impulse response several partitions long, in blocks that do not line up with
+ * the partitions, and compares the wet output with the direct convolution delayed by one partition.
+ */
+class PartitionedConvolverTests : public UnitTest {
+public:
+    PartitionedConvolverTests() : UnitTest("Partitioned convolver", "MIDISynth") {}
+
+    void runTest() override {
+        beginTest("Direct convolution");
+        const double sampleRate = 48000.0;
+        const int impulseLength = 1000;
+        const int inputLength = 3000;
+        const int blockSize = 100;
+        Random random(2);
+
+        AudioBuffer<float> impulseResponse(1, impulseLength);
+        double energy = 0.0;
+        for (int i = 0; i < impulseLength; ++i) {
+            const float sample = (random.nextFloat() * 2.0f - 1.0f) * std::exp(-(float) i / 200.0f);
+            impulseResponse.setSample(0, i, sample);
+            energy += sample * sample;
+        }
+        HeapBlock<float> input(inputLength);
+        for (int i = 0; i < inputLength; ++i) {
+            input[i] = random.nextFloat() * 2.0f - 1.0f;
+        }
+
+        PartitionedConvolver convolver;
+        convolver.prepareToPlay(128, sampleRate);
+        convolver.setImpulseResponse(impulseResponse, sampleRate);
+        const int latency = convolver.getLatencyInSamples();
+        AudioBuffer<float> output(2, inputLength);
+        for (int offset = 0; offset < inputLength; offset += blockSize) {
+            float* const outputs[] {output.getWritePointer(0, offset), output.getWritePointer(1, offset)};
+            convolver.process(input + offset, outputs, 2, jmin(blockSize, inputLength - offset));
+        }
+        convolver.releaseResources();
+
+        // The convolver normalises the impulse response to unit energy.
+        const float* taps = impulseResponse.getReadPointer(0);
+        const double gain = 1.0 / std::sqrt(energy);
+        float error = 0.0f;
+        for (int i = 0; i < inputLength; ++i) {
+            double expected = 0.0;
+            for (int tap = 0; tap <= i - latency && tap < impulseLength; ++tap) {
+                expected += gain * taps[tap] * input[i - latency - tap];
+            }
+            for (int channel = 0; channel < 2; ++channel) {
+                error = jmax(error, std::abs((float) expected - output.getSample(channel, i)));
+            }
+        }
+        expectLessOrEqual(error, 1.0e-4f, "the wet output differs from the direct convolution");
+    }
+};
+
+static PartitionedConvolverTests partitionedConvolverTests;
+
+#endif
@@ -0,0 +1,302 @@
+/*
+  ==============================================================================
+
+    EffectsBus.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include <atomic>
+#include <complex>
+#include <vector>
+
+/**
+ * A uniformly partitioned overlap-save FFT convolution engine.
+ * The impulse response is cut into partitions of the same length as the processing block.
+ * For every block the audio thread only transforms the incoming samples and multiplies them with the head partition.
+ * The contribution of all the other partitions only depends on the spectra of previous blocks,
+ * so a background thread accumulates it while the audio thread is waiting for the next block. The audio thread never
+ * wakes the background thread up, which would take a lock, the background thread polls for jobs instead.
+ * The per-block cost on the audio thread is therefore independent of the impulse response length.
+ * The wet output is delayed by one partition.
+ */
+class PartitionedConvolver : private Thread {
+public:
+//// ==============================================================================
+//// Constructors and destructors
+//// ==============================================================================
+
+    PartitionedConvolver();
+    ~PartitionedConvolver() override;
+
+//// ==============================================================================
+//// Audio source life cycle
+//// ==============================================================================
+
+    /**
+     * Rebuild the partitions for the new device settings.
+     * This function allocates, so it must never be called from the audio callback.
+     * @param samplesPerBlockExpected the expected device block size. The partition size is derived from it.
+     * @param sampleRate the sample rate the impulse response is resampled to
+     */
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate);
+
+    /**
+     * Stop the background thread and free the partitions.
+     */
+    void releaseResources();
+
+    /**
+     * Convolve a mono input with every channel of the impulse response.
+     * The output is overwritten with the wet signal. If no impulse response is loaded, the output is cleared.
+     * @param input the mono input samples
+     * @param outputs the output channels. There should be numOutputChannels of them.
+     * @param numOutputChannels the number of output channels
+     * @param numSamples the number of samples to process
+     */
+    void process(const float* input, float* const* outputs, int numOutputChannels, int numSamples);
+
+//// ==============================================================================
+//// Impulse response management
+//// ==============================================================================
+
+    /**
+     * Replace the impulse response. It is called from the message thread.
+     * The impulse response is resampled to the device sample rate and normalised to unit energy.
+     * The new partitions are handed over to the audio thread without blocking it.
+     * @param newImpulseResponse the impulse response. Only the first two channels are used.
+     * @param newImpulseResponseSampleRate the sample rate of the impulse response
+     */
+    void setImpulseResponse(const AudioBuffer<float>& newImpulseResponse, double newImpulseResponseSampleRate);
+
+    /**
+     * Whether an impulse response has been loaded
+     * @return true if the convolver has an impulse response
+     */
+    bool hasImpulseResponse() const;
+
+    /**
+     * The length of the loaded impulse response, which is how long the reverb rings after its input stops
+     * @return the length in seconds, 0 if no impulse response has been loaded
+     */
+    double getImpulseResponseLengthSeconds() const;
+
+    /**
+     * The latency of the wet signal
+     * @return the latency in samples
+     */
+    int getLatencyInSamples() const;
+
+    /**
+     * Number of blocks where the background thread was late and the tail was computed on the audio thread
+     * @return the counter of late tails since the last prepareToPlay()
+     */
+    int getNumLateTails() const;
+
+private:
+    /**
+     * Everything the convolution needs for one impulse response and one partition size.
+     * An engine is built on the message thread and then only touched by the audio and the background thread.
+     */
+    struct Engine {
+        Engine(const AudioBuffer<float>& impulseResponse, int partitionSize);
+
+        int partitionSize;
+        int numBins;
+        int numPartitions;
+        int numRingSlots;
+        int numChannels;
+
+        dsp::FFT fft;
+
+        /** The spectra of the impulse response partitions. [channel][partition][bin] */
+        std::vector<std::complex<float>> partitionSpectra;
+        /** The spectra of the previous input blocks, a.k.a. the frequency domain delay line. [slot][bin] */
+        std::vector<std::complex<float>> inputSpectra;
+        /** The tail accumulated by the background thread, double buffered by block parity. [parity][channel][bin] */
+        std::vector<std::complex<float>> backgroundTail;
+        /** The tail accumulated on the audio thread when the background thread was late. [channel][bin] */
+        std::vector<std::complex<float>> fallbackTail;
+
+        std::vector<float> inputHistory;
+        std::vector<float> fftBuffer;
+        std::vector<float> inputBlock;
+        std::vector<float> outputBlock;
+        int blockPosition = 0;
+        /** The index of the first block processed with the engine, the earlier blocks have no input spectrum */
+        int64 firstBlock = 0;
+
+        const std::complex<float>* getPartition(int channel, int partition) const;
+        std::complex<float>* getInputSpectrum(int64 blockIndex);
+        const std::complex<float>* getInputSpectrum(int64 blockIndex) const;
+        std::complex<float>* getBackgroundTail(int64 blockIndex, int channel);
+
+        /**
+         * Accumulate the contribution of every partition except the head partition.
+         * @param blockIndex the block whose tail should be computed
+         * @param destination the accumulator of numChannels * numBins bins
+         * @param latestRequest the newest block requested from the background thread, used to abandon stale jobs
+         * @return false if the job was abandoned because it became stale
+         */
+        bool accumulateTail(int64 blockIndex, std::complex<float>* destination,
+                            const std::atomic<int64>* latestRequest) const;
+    };
+
+    void run() override;
+    void processPartition(Engine& engine);
+    void adoptPendingEngine();
+    std::unique_ptr<Engine> createEngine();
+
+    /** How often the background thread looks for a new job, in milliseconds */
+    const int POLL_INTERVAL = 1;
+
+    /** Guards the stored impulse response and the device settings. It is never taken on the audio thread. */
+    CriticalSection impulseResponseLock;
+    AudioBuffer<float> impulseResponse;
+    double impulseResponseSampleRate = 44100.0;
+    int partitionSize = 512;
+    double currentSampleRate = 44100.0;
+
+    /** The engine of the audio thread. Only the audio thread replaces it while the background thread runs. */
+    std::atomic<Engine*> engine {nullptr};
+    std::atomic<Engine*> pendingEngine {nullptr};
+    /** The engine the audio thread has let go of, freed by the background thread before its next pass */
+    std::atomic<Engine*> retiredEngine {nullptr};
+    std::atomic<bool> impulseResponseLoaded {false};
+    std::atomic<double> impulseResponseLengthSeconds {0.0};
+
+    /** The block indices only ever grow, an engine swap included, so a stale job can never look current */
+    int64 currentBlock = 0;
+    std::atomic<int64> requestedBlock {0};
+    std::atomic<int64> completedBlock {0};
+    std::atomic<int> numLateTails {0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PartitionedConvolver)
+};
+
+/**
+ * A simple feedback delay line per channel.
+ * The memory is allocated in prepareToPlay() for the longest delay time. A change of the parameters is spread over
+ * the block in steps of PARAMETER_SLICE samples, so automation does not jump once per host block.
+ */
+class FeedbackDelay {
+public:
+    /** The number of samples between two steps of the parameters */
+    static constexpr int PARAMETER_SLICE = 32;
+
+    /**
+     * Allocate the delay memory.
+     * @param maxDelaySeconds the longest delay time supported
+     * @param sampleRate the expected sample rate
+     * @param numChannels the number of channels to delay
+     */
+    void prepareToPlay(double maxDelaySeconds, double sampleRate, int numChannels);
+
+    /**
+     * Free the delay memory.
+     */
+    void releaseResources();
+
+    /**
+     * Add the delayed signal to the buffer in place. The parameters move from their values at the end of the
+     * previous block and reach the new ones at the end of this block.
+     * @param buffer the buffer to process
+     * @param startSample the first sample to process
+     * @param numSamples the number of samples to process
+     * @param delaySeconds the delay time
+     * @param feedback the feedback gain. It should be smaller than 1.
+     * @param mix the gain of the delayed signal
+     */
+    void process(AudioBuffer<float>& buffer, int startSample, int numSamples,
+                 float delaySeconds, float feedback, float mix);
+
+private:
+    AudioBuffer<float> delayBuffer;
+    int writePosition = 0;
+    double currentSampleRate = 44100.0;
+
+    /** The parameters reached by the last block, in samples for the delay time */
+    float currentDelay = 0.0f;
+    float currentFeedback = 0.0f;
+    float currentMix = 0.0f;
+    /** False until the first block after prepareToPlay(), which starts at its parameters without a ramp */
+    bool hasParameters = false;
+};
+
+/**
+ * The post-mix effects stage of the synthesiser.
+ * It holds a convolution reverb and a feedback delay, and processes the mixed voices in place.
+ * All the mix parameters can be set from any thread.
+ */
+class EffectsBus {
+public:
+    EffectsBus();
+
+    /**
+     * Allocate the scratch buffers and prepare the effects.
+     * @param samplesPerBlockExpected the expected device block size
+     * @param sampleRate the expected sample rate
+     */
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate);
+
+    /**
+     * Free the scratch buffers and stop the background work.
+     */
+    void releaseResources();
+
+    /**
+     * Apply the effects in place.
+     * @param buffer the mixed output of the synthesiser
+     * @param startSample the first sample to process
+     * @param numSamples the number of samples to process
+     */
+    void process(AudioBuffer<float>& buffer, int startSample, int numSamples);
+
+    /**
+     * Load an impulse response from an audio file. It should be called from the message thread.
+     * @param file the audio file. Any format registered in the AudioFormatManager is accepted.
+     * @return true if the impulse response is loaded
+     */
+    bool loadImpulseResponse(const File& file);
+
+    /**
+     * Get the wildcard of the audio formats accepted by loadImpulseResponse()
+     * @return the wildcard for a FileChooser
+     */
+    String getImpulseResponseWildcard() const;
+
+    /**
+     * Get how long the effects keep sounding after their input stops, with the current parameters.
+     * The delay rings until its repeats have decayed by 60 dB, and it repeats the reverb tail.
+     * @return the tail length in seconds
+     */
+    double getTailLengthSeconds() const;
+
+    void setReverbMix(float newMix);
+    void setDelayTime(float newDelaySeconds);
+    void setDelayFeedback(float newFeedback);
+    void setDelayMix(float newMix);
+
+private:
+    const float MAX_IMPULSE_RESPONSE_SECONDS = 10.0f;
+    const float MAX_DELAY_SECONDS = 2.0f;
+    /** The decay after which a tail is considered silent, -60 dB */
+    const double SILENCE_GAIN = 0.001;
+
+    AudioFormatManager formatManager;
+    PartitionedConvolver reverb;
+    FeedbackDelay delay;
+
+    AudioBuffer<float> monoInput;
+    AudioBuffer<float> reverbOutput;
+
+    std::atomic<float> reverbMix {0.3f};
+    std::atomic<float> delayTime {0.25f};
+    std::atomic<float> delayFeedback {0.3f};
+    std::atomic<float> delayMix {0.0f};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (EffectsBus)
+};
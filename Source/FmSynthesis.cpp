@@ -0,0 +1,284 @@
+/*
+  ==============================================================================
+
+    FmSynthesis.cpp
+
+  ==============================================================================
+*/
+
+#include "FmSynthesis.h"
+
+namespace {
+
+//// ==============================================================================
+//// Sine table
+//// ==============================================================================
+
+constexpr int SINE_TABLE_SIZE = 4096;
+
+/** One cycle of a sine, with two guard points so a phase rounded up to a whole cycle can still be interpolated */
+struct SineTable {
+    float values[SINE_TABLE_SIZE + 2];
+
+    SineTable() {
+        for (int i = 0; i < SINE_TABLE_SIZE + 2; ++i) {
+            values[i] = std::sin(MathConstants<float>::twoPi * (float) i / (float) SINE_TABLE_SIZE);
+        }
+    }
+};
+
+const SineTable sineTable;
+
+inline float sineOfCycles(float cycles) {
+    const float position = (cycles - std::floor(cycles)) * (float) SINE_TABLE_SIZE;
+    const auto index = (int) position;
+    const float fraction = position - (float) index;
+    return sineTable.values[index] + fraction * (sineTable.values[index + 1] - sineTable.values[index]);
+}
+
+//// ==============================================================================
+//// Algorithms
+//// ==============================================================================
+
+constexpr uint32 op(int index) {
+    return 1u << index;
+}
+
+/**
+ * The routing of an algorithm as compile-time constants. An operator is only modulated by operators of a higher
+ * index, so the operators are evaluated from the last to the first.
+ * @tparam NumOperators 4 or 6
+ * @tparam FeedbackOperator the operator modulating itself
+ * @tparam Carriers the mask of the operators heard at the output
+ * @tparam M0 ... M5 the mask of the operators modulating every operator
+ */
+template <int NumOperators, int FeedbackOperator, uint32 Carriers,
+          uint32 M0, uint32 M1, uint32 M2, uint32 M3, uint32 M4 = 0, uint32 M5 = 0>
+struct Algorithm {
+    static constexpr int numOperators = NumOperators;
+    static constexpr int feedbackOperator = FeedbackOperator;
+    static constexpr uint32 carriers = Carriers;
+
+    static constexpr uint32 modulatorsOf(int index) {
+        return index == 0 ? M0 : index == 1 ? M1 : index == 2 ? M2 : index == 3 ? M3 : index == 4 ? M4 : M5;
+    }
+};
+
+using StackOfSix = Algorithm<6, 5, op(0), op(1), op(2), op(3), op(4), op(5), 0>;
+using TwoStacks = Algorithm<6, 5, op(0) | op(3), op(1), op(2), 0, op(4), op(5), 0>;
+using ThreePairs = Algorithm<6, 5, op(0) | op(2) | op(4), op(1), 0, op(3), 0, op(5), 0>;
+using Branch = Algorithm<6, 5, op(0) | op(4), op(1) | op(2) | op(3), 0, 0, 0, op(5), 0>;
+using StackOfFour = Algorithm<4, 3, op(0), op(1), op(2), op(3), 0>;
+using TwoPairs = Algorithm<4, 3, op(0) | op(2), op(1), 0, op(3), 0>;
+using AllCarriers = Algorithm<6, 5, op(0) | op(1) | op(2) | op(3) | op(4) | op(5), 0, 0, 0, 0, 0, 0>;
+
+/** The sum of the outputs of the operators from Source down to Operator + 1 modulating Operator */
+template <typename Routing, int Operator, int Source>
+struct ModulationSum {
+    static inline float sum(const float* outputs) {
+        return ((Routing::modulatorsOf(Operator) & op(Source)) != 0 ? outputs[Source] : 0.0f)
+               + ModulationSum<Routing, Operator, Source - 1>::sum(outputs);
+    }
+};
+
+template <typename Routing, int Operator>
+struct ModulationSum<Routing, Operator, Operator> {
+    static inline float sum(const float*) {
+        return 0.0f;
+    }
+};
+
+/** Evaluate Operator and every operator below it for one sample */
+template <typename Routing, int Operator>
+struct OperatorPass {
+    static inline void run(FmEngine::RenderState& state, int sample, float* outputs) {
+        float phaseOffset = ModulationSum<Routing, Operator, Routing::numOperators - 1>::sum(outputs);
+        if (Operator == Routing::feedbackOperator) {
+            phaseOffset += state.feedback * (state.feedbackHistory[0] + state.feedbackHistory[1]);
+        }
+        state.levels[Operator] += state.levelSteps[Operator];
+        outputs[Operator] = state.levels[Operator] * sineOfCycles(state.phases[Operator][sample] + phaseOffset);
+        if (Operator == Routing::feedbackOperator) {
+            state.feedbackHistory[1] = state.feedbackHistory[0];
+            state.feedbackHistory[0] = outputs[Operator];
+        }
+        OperatorPass<Routing, Operator - 1>::run(state, sample, outputs);
+    }
+};
+
+template <typename Routing>
+struct OperatorPass<Routing, -1> {
+    static inline void run(FmEngine::RenderState&, int, float*) {}
+};
+
+/** The sum of the carriers from Operator down to operator 1 */
+template <typename Routing, int Operator>
+struct CarrierSum {
+    static inline float sum(const float* outputs) {
+        return ((Routing::carriers & op(Operator)) != 0 ? outputs[Operator] : 0.0f)
+               + CarrierSum<Routing, Operator - 1>::sum(outputs);
+    }
+};
+
+template <typename Routing>
+struct CarrierSum<Routing, -1> {
+    static inline float sum(const float*) {
+        return 0.0f;
+    }
+};
+
+template <typename Routing>
+void renderAlgorithm(FmEngine::RenderState& state, float* destination, int numSamples) {
+    float outputs[FmEngine::MAX_OPERATORS] {};
+    for (int i = 0; i < numSamples; ++i) {
+        OperatorPass<Routing, Routing::numOperators - 1>::run(state, i, outputs);
+        destination[i] = CarrierSum<Routing, Routing::numOperators - 1>::sum(outputs);
+    }
+}
+
+struct AlgorithmInfo {
+    void (*render)(FmEngine::RenderState&, float*, int);
+    int numOperators;
+    uint32 carriers;
+};
+
+template <typename Routing>
+constexpr AlgorithmInfo describe() {
+    return {&renderAlgorithm<Routing>, Routing::numOperators, Routing::carriers};
+}
+
+/** The instantiations of the render loop, in the order of AlgorithmIndex */
+const AlgorithmInfo ALGORITHMS[] {
+    describe<StackOfSix>(),
+    describe<TwoStacks>(),
+    describe<ThreePairs>(),
+    describe<Branch>(),
+    describe<StackOfFour>(),
+    describe<TwoPairs>(),
+    describe<AllCarriers>()
+};
+
+enum AlgorithmIndex {
+    stackOfSix = 0,
+    twoStacks,
+    threePairs,
+    branch,
+    stackOfFour,
+    twoPairs,
+    allCarriers
+};
+
+}
+
+//// ==============================================================================
+//// FmEngine Class
+//// ==============================================================================
+
+constexpr int FmEngine::MAX_OPERATORS;
+constexpr int FmEngine::MAX_BLOCK_SIZE;
+
+// {ratio, level, decay rate, sustain} for operators 1 to 6. The levels of the modulators are in cycles.
+const FmEngine::Patch FmEngine::PATCHES[] {
+    {"E. piano", threePairs, 0.05f, {{1.0f, 1.0f, 0.8f, 0.0f}, {14.0f, 0.06f, 4.0f, 0.0f},
+                                     {1.0f, 1.0f, 0.5f, 0.0f}, {1.0f, 0.25f, 1.5f, 0.1f},
+                                     {1.0f, 0.6f, 0.6f, 0.0f}, {1.0f, 0.15f, 1.0f, 0.0f}}},
+    {"Bass", stackOfFour, 0.2f, {{1.0f, 1.0f, 1.5f, 0.3f}, {1.0f, 0.5f, 3.0f, 0.1f},
+                                 {2.0f, 0.2f, 5.0f, 0.0f}, {1.0f, 0.1f, 2.0f, 0.0f},
+                                 {1.0f, 0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f, 0.0f}}},
+    {"Bell", twoPairs, 0.0f, {{1.0f, 1.0f, 0.6f, 0.0f}, {3.5f, 0.4f, 0.8f, 0.0f},
+                              {2.0f, 0.6f, 0.8f, 0.0f}, {5.19f, 0.3f, 1.2f, 0.0f},
+                              {1.0f, 0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f, 0.0f}}},
+    {"Brass", branch, 0.15f, {{1.0f, 1.0f, 0.2f, 0.8f}, {1.0f, 0.4f, 0.5f, 0.6f},
+                              {1.0f, 0.15f, 0.5f, 0.5f}, {2.0f, 0.1f, 1.0f, 0.3f},
+                              {1.0f, 0.5f, 0.2f, 0.8f}, {1.0f, 0.3f, 0.5f, 0.5f}}},
+    {"Organ", allCarriers, 0.05f, {{0.5f, 0.5f, 0.0f, 1.0f}, {1.0f, 1.0f, 0.0f, 1.0f},
+                                   {2.0f, 0.6f, 0.0f, 1.0f}, {3.0f, 0.4f, 0.0f, 1.0f},
+                                   {4.0f, 0.3f, 0.0f, 1.0f}, {6.0f, 0.2f, 0.0f, 1.0f}}},
+    {"Metal", stackOfSix, 0.3f, {{1.0f, 1.0f, 0.4f, 0.2f}, {1.41f, 0.8f, 0.6f, 0.2f},
+                                 {2.23f, 0.6f, 0.8f, 0.1f}, {3.17f, 0.5f, 1.0f, 0.1f},
+                                 {1.0f, 0.4f, 1.2f, 0.0f}, {0.5f, 0.3f, 1.5f, 0.0f}}},
+    {"Strings", twoStacks, 0.1f, {{1.0f, 1.0f, 0.1f, 0.9f}, {1.0f, 0.2f, 0.3f, 0.7f},
+                                  {3.0f, 0.05f, 0.5f, 0.5f}, {1.003f, 1.0f, 0.1f, 0.9f},
+                                  {2.0f, 0.15f, 0.3f, 0.7f}, {1.0f, 0.1f, 0.5f, 0.5f}}}
+};
+
+const int FmEngine::NUM_PATCHES = numElementsInArray(FmEngine::PATCHES);
+
+StringArray FmEngine::getPatchNames() {
+    StringArray names;
+    for (const Patch& patchToName : PATCHES) {
+        names.add(patchToName.name);
+    }
+    return names;
+}
+
+void FmEngine::startNote(int patchIndex) {
+    this->patch = &PATCHES[jlimit(0, NUM_PATCHES - 1, patchIndex)];
+    const AlgorithmInfo& algorithm = ALGORITHMS[this->patch->algorithm];
+    float carrierSum = 0.0f;
+    for (int index = 0; index < MAX_OPERATORS; ++index) {
+        this->phases[index].reset(0.0f);
+        this->envelopes[index] = 1.0f;
+        this->levels[index] = 0.0f;
+        if ((algorithm.carriers & op(index)) != 0) {
+            carrierSum += this->patch->operators[index].level;
+        }
+    }
+    this->carrierGain = carrierSum > 0.0f ? 1.0f / carrierSum : 0.0f;
+    this->feedbackHistory[0] = 0.0f;
+    this->feedbackHistory[1] = 0.0f;
+}
+
+void FmEngine::render(float *destination, int numSamples, float fundamentalIncrement, float modulationDepth,
+                      double sampleRate) {
+    jassert(numSamples <= MAX_BLOCK_SIZE);
+    if (this->patch == nullptr) {
+        FloatVectorOperations::clear(destination, numSamples);
+        return;
+    }
+    const AlgorithmInfo& algorithm = ALGORITHMS[this->patch->algorithm];
+    const auto seconds = (float) (numSamples / sampleRate);
+
+    RenderState state;
+    for (int index = 0; index < algorithm.numOperators; ++index) {
+        const Operator& settings = this->patch->operators[index];
+        // An operator can not go above the Nyquist frequency, but its sidebands can.
+        this->phases[index].fill(this->phaseBuffers[index], numSamples,
+                                 jmin(0.5f, settings.ratio * fundamentalIncrement));
+        this->envelopes[index] = settings.sustain
+                + (this->envelopes[index] - settings.sustain) * std::exp(-settings.decayRate * seconds);
+
+        const bool isCarrier = (algorithm.carriers & op(index)) != 0;
+        const float target = settings.level * this->envelopes[index]
+                * (isCarrier ? this->carrierGain : modulationDepth);
+        state.phases[index] = this->phaseBuffers[index];
+        state.levels[index] = this->levels[index];
+        state.levelSteps[index] = (target - this->levels[index]) / (float) numSamples;
+        this->levels[index] = target;
+    }
+    state.feedback = this->patch->feedback * modulationDepth;
+    state.feedbackHistory[0] = this->feedbackHistory[0];
+    state.feedbackHistory[1] = this->feedbackHistory[1];
+
+    algorithm.render(state, destination, numSamples);
+
+    this->feedbackHistory[0] = state.feedbackHistory[0];
+    this->feedbackHistory[1] = state.feedbackHistory[1];
+}
+
+//// ==============================================================================
+//// FmRenderer Class
+//// ==============================================================================
+
+bool FmRenderer::startNote(const Note &note, NoiseGenerator &noise) {
+    this->engine.startNote(note.patchIndex);
+    return true;
+}
+
+bool FmRenderer::render(float *const *destinations, int numSamples, const ControlBlock &control,
+                        NoiseGenerator &noise) {
+    const float depth = jmax(0.0f, 1.0f + control.brightness);
+    this->engine.render(destinations[0], numSamples, control.angleDelta / MathConstants<float>::twoPi, depth,
+                        control.sampleRate);
+    return true;
+}
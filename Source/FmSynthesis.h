@@ -0,0 +1,112 @@
+/*
+  ==============================================================================
+
+    FmSynthesis.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "BlockPhase.h"
+#include "VoiceRenderer.h"
+
+/**
+ * A frequency modulation engine of four or six sine operators.
+ * Every algorithm, i.e. the routing between the operators, is a type. Its render loop is instantiated from a template
+ * where the routing is a compile-time constant, so the compiler unrolls the operators and the loop has no branch
+ * on the routing. The engine only picks the instantiation of the patch's algorithm once per block.
+ * The operator phases are computed a block at a time by BlockPhase, and the sines are read from a table.
+ */
+class FmEngine {
+public:
+    static constexpr int MAX_OPERATORS = 6;
+    /** The longest block passed to render(), the control block size of the voices */
+    static constexpr int MAX_BLOCK_SIZE = 32;
+
+    /**
+     * The per-block inputs of the render loop of an algorithm
+     */
+    struct RenderState {
+        const float* phases[MAX_OPERATORS];
+        float levels[MAX_OPERATORS];
+        float levelSteps[MAX_OPERATORS];
+        /** The feedback of the feedback operator, in cycles */
+        float feedback;
+        float feedbackHistory[2];
+    };
+
+    /**
+     * The names of the built-in patches
+     * @return the patch names, in the order of their indices
+     */
+    static StringArray getPatchNames();
+
+    /**
+     * Restart every operator of a patch. It does not allocate, so it can be called from the audio thread.
+     * @param patchIndex the index of the patch in getPatchNames()
+     */
+    void startNote(int patchIndex);
+
+    /**
+     * Render a block. The operator levels are ramped from the previous block.
+     * @param destination the samples to overwrite
+     * @param numSamples the number of samples, at most MAX_BLOCK_SIZE
+     * @param fundamentalIncrement the phase increment of an operator of ratio 1, in cycles per sample
+     * @param modulationDepth the factor applied to the level of every modulator, i.e. to the modulation indices
+     * @param sampleRate the sample rate, used by the operator envelopes
+     */
+    void render(float* destination, int numSamples, float fundamentalIncrement, float modulationDepth,
+                double sampleRate);
+
+private:
+    /**
+     * An operator: its frequency ratio, its level and a decaying envelope.
+     * The level of a modulator is its modulation index in cycles.
+     */
+    struct Operator {
+        float ratio;
+        float level;
+        /** The decay rate of the envelope towards the sustain level in 1/s */
+        float decayRate;
+        float sustain;
+    };
+
+    struct Patch {
+        const char* name;
+        int algorithm;
+        float feedback;
+        Operator operators[MAX_OPERATORS];
+    };
+
+    static const Patch PATCHES[];
+    static const int NUM_PATCHES;
+
+    const Patch* patch = nullptr;
+    /** The level of every carrier is divided by the sum of the carrier levels, so the output never clips */
+    float carrierGain = 1.0f;
+    BlockPhase phases[MAX_OPERATORS];
+    float phaseBuffers[MAX_OPERATORS][MAX_BLOCK_SIZE] {};
+    float envelopes[MAX_OPERATORS] {};
+    float levels[MAX_OPERATORS] {};
+    float feedbackHistory[2] {};
+};
+
+/**
+ * The renderer of the "FM" voice type, which plays a patch of four or six operators. The brightness destination
+ * scales the modulation indices.
+ */
+class FmRenderer : public VoiceRenderer {
+public:
+    FmRenderer() = default;
+
+    bool startNote(const Note& note, NoiseGenerator& noise) override;
+    bool render(float* const* destinations, int numSamples, const ControlBlock& control,
+                NoiseGenerator& noise) override;
+
+private:
+    FmEngine engine;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FmRenderer)
+};
@@ -0,0 +1,242 @@
+/*
+  ==============================================================================
+
+    Granular.cpp
+
+  ==============================================================================
+*/
+
+#include "Granular.h"
+
+namespace {
+constexpr int WINDOW_SIZE = 1024;
+constexpr int SINE_TABLE_SIZE = 2048;
+
+/**
+ * The windows and one cycle of a sine, each with a guard point for the linear interpolation
+ */
+struct GrainTables {
+    float windows[GrainCloud::numWindows][WINDOW_SIZE + 1];
+    float sine[SINE_TABLE_SIZE + 1];
+
+    GrainTables() {
+        for (int i = 0; i <= WINDOW_SIZE; ++i) {
+            const float x = (float) i / (float) WINDOW_SIZE;
+            windows[GrainCloud::hannWindow][i] = 0.5f - 0.5f * std::cos(MathConstants<float>::twoPi * x);
+            // Fades of a tenth of the grain, for grains that keep the attack of the sample.
+            windows[GrainCloud::trapezoidWindow][i] = jmin(1.0f, 10.0f * x, 10.0f * (1.0f - x));
+            const float distance = (x - 0.5f) / 0.15f;
+            windows[GrainCloud::gaussianWindow][i] = std::exp(-0.5f * distance * distance);
+        }
+        for (int i = 0; i <= SINE_TABLE_SIZE; ++i) {
+            sine[i] = std::sin(MathConstants<float>::twoPi * (float) i / (float) SINE_TABLE_SIZE);
+        }
+    }
+};
+
+const GrainTables& getTables() {
+    static const GrainTables tables;
+    return tables;
+}
+}
+
+//// ==============================================================================
+//// GrainCloud Class
+//// ==============================================================================
+
+constexpr int GrainCloud::MAX_GRAINS;
+constexpr int GrainCloud::MAX_BLOCK_SIZE;
+
+const GrainCloud::Patch GrainCloud::PATCHES[] {
+    {"Cloud", sineSource, hannWindow, 150.0f, 0.06f, 0.3f, 25.0f, 0.0f, 0.0f},
+    {"Swarm", sineSource, hannWindow, 2000.0f, 0.08f, 0.4f, 40.0f, 0.0f, 0.0f},
+    {"Sparkle", sineSource, gaussianWindow, 60.0f, 0.015f, 0.5f, 1200.0f, 0.0f, 0.0f},
+    {"Texture", sampleSource, hannWindow, 300.0f, 0.08f, 0.3f, 10.0f, 0.5f, 0.05f},
+    {"Freeze", sampleSource, trapezoidWindow, 80.0f, 0.15f, 0.2f, 0.0f, 0.0f, 0.02f},
+    {"Stutter", sampleSource, trapezoidWindow, 20.0f, 0.04f, 0.0f, 0.0f, 1.0f, 0.0f}
+};
+
+const int GrainCloud::NUM_PATCHES = numElementsInArray(GrainCloud::PATCHES);
+
+StringArray GrainCloud::getPatchNames() {
+    getTables();
+    StringArray names;
+    for (const Patch& patchToName : PATCHES) {
+        names.add(patchToName.name);
+    }
+    return names;
+}
+
+void GrainCloud::startNote(int patchIndex, const StreamedSample *newSample, float frequency, double sampleRate) {
+    this->patch = &PATCHES[jlimit(0, NUM_PATCHES - 1, patchIndex)];
+    // Without a sample the sample patches read the oscillator.
+    this->source = this->patch->source == sampleSource && newSample != nullptr ? sampleSource : sineSource;
+    this->sample = this->source == sampleSource ? newSample : nullptr;
+    if (this->source == sampleSource) {
+        const auto rootFrequency = (float) MidiMessage::getMidiNoteInHertz(this->sample->getRootNote());
+        const auto rateRatio = (float) (this->sample->getSampleRate() / sampleRate);
+        this->baseIncrement = frequency / rootFrequency * rateRatio;
+        this->scanIncrement = this->patch->scanRate * rateRatio;
+        this->samplePositionJitter = this->patch->positionJitter * (float) this->sample->getSampleRate();
+    } else {
+        this->baseIncrement = frequency / (float) sampleRate * (float) SINE_TABLE_SIZE;
+        this->scanIncrement = 0.0f;
+        this->samplePositionJitter = 0.0f;
+    }
+    this->grainLength = this->patch->duration * (float) sampleRate;
+    this->grainInterval = (float) sampleRate / this->patch->density;
+    // The grains overlap with random phases, so their sum grows with the square root of their number.
+    this->grainAmplitude = 1.0f / std::sqrt(jmax(1.0f, this->patch->density * this->patch->duration));
+    this->samplesToNextGrain = 0.0f;
+    this->scanPosition = 0.0f;
+    this->numActiveGrains = 0;
+}
+
+void GrainCloud::stop() {
+    this->patch = nullptr;
+    this->sample = nullptr;
+    this->numActiveGrains = 0;
+}
+
+bool GrainCloud::isUsingSample() const {
+    return this->sample != nullptr;
+}
+
+int GrainCloud::getNumActiveGrains() const {
+    return this->numActiveGrains;
+}
+
+void GrainCloud::render(float *destination, int numSamples, float pitchRatio, NoiseGenerator &generator) {
+    jassert(numSamples <= MAX_BLOCK_SIZE);
+    FloatVectorOperations::clear(destination, numSamples);
+    if (this->patch == nullptr) {
+        return;
+    }
+
+    while (this->samplesToNextGrain < (float) numSamples) {
+        this->startGrain((int) this->samplesToNextGrain, pitchRatio, generator);
+        const float jitter = 1.0f + this->patch->durationJitter * generator.nextWhite();
+        this->samplesToNextGrain += jmax(1.0f, this->grainInterval * jitter);
+    }
+    this->samplesToNextGrain -= (float) numSamples;
+
+    // The source is chosen once per block, the render loops are instantiated for each one.
+    if (this->source == sampleSource) {
+        this->renderGrains<sampleSource>(destination, numSamples);
+        // The read head loops over the preloaded attack.
+        const auto preloadLength = (float) this->sample->getPreloadLength();
+        this->scanPosition += this->scanIncrement * (float) numSamples;
+        if (this->scanPosition >= preloadLength) {
+            this->scanPosition = std::fmod(this->scanPosition, preloadLength);
+        }
+    } else {
+        this->renderGrains<sineSource>(destination, numSamples);
+    }
+}
+
+void GrainCloud::startGrain(int startOffset, float pitchRatio, NoiseGenerator &generator) {
+    if (this->numActiveGrains == MAX_GRAINS) {
+        return;
+    }
+    const int length = jmax(16, roundToInt(this->grainLength
+            * (1.0f + this->patch->durationJitter * generator.nextWhite())));
+    float increment = this->baseIncrement * pitchRatio;
+    if (this->patch->pitchJitter > 0.0f) {
+        increment *= std::exp2(this->patch->pitchJitter * generator.nextWhite() / 1200.0f);
+    }
+
+    float position;
+    if (this->source == sampleSource) {
+        // The grains only read the preloaded attack, which never waits for the disk.
+        const float lastStart = (float) this->sample->getPreloadLength() - 2.0f - increment * (float) length;
+        if (lastStart < 0.0f) {
+            return;
+        }
+        position = jlimit(0.0f, lastStart, this->scanPosition + this->samplePositionJitter * generator.nextWhite());
+    } else {
+        // A grain above the Nyquist frequency would only alias. Keeping it below also keeps the wrap of the phase
+        // in renderGrains() to a single subtraction.
+        increment = jmin(increment, 0.5f * (float) SINE_TABLE_SIZE - 1.0f);
+        // A random phase, so the grains do not add up to a pulse train.
+        position = (0.5f + 0.5f * generator.nextWhite()) * (float) SINE_TABLE_SIZE;
+        if (position >= (float) SINE_TABLE_SIZE) {
+            position -= (float) SINE_TABLE_SIZE;
+        }
+    }
+
+    Grain& grain = this->grains[this->numActiveGrains++];
+    grain.windowPosition = 0.0f;
+    grain.windowIncrement = (float) WINDOW_SIZE / (float) length;
+    grain.sourcePosition = position;
+    grain.sourceIncrement = increment;
+    grain.amplitude = this->grainAmplitude;
+    grain.startOffset = startOffset;
+    grain.remaining = length;
+}
+
+template <int sourceType>
+void GrainCloud::renderGrains(float *destination, int numSamples) {
+    const float* window = getTables().windows[this->patch->window];
+    const float* table = sourceType == sampleSource ? this->sample->getPreloadedSamples() : getTables().sine;
+    int index = 0;
+    while (index < this->numActiveGrains) {
+        Grain& grain = this->grains[index];
+        const int count = jmin(numSamples - grain.startOffset, grain.remaining);
+        float* output = destination + grain.startOffset;
+        float windowPosition = grain.windowPosition;
+        float sourcePosition = grain.sourcePosition;
+
+        for (int i = 0; i < count; ++i) {
+            // The rounding errors of the position may carry the last sample of a grain past the end of the window.
+            const int windowIndex = jmin((int) windowPosition, WINDOW_SIZE - 1);
+            const float windowFraction = windowPosition - (float) windowIndex;
+            const float gain = window[windowIndex] + windowFraction * (window[windowIndex + 1] - window[windowIndex]);
+            const auto sourceIndex = (int) sourcePosition;
+            const float sourceFraction = sourcePosition - (float) sourceIndex;
+            const float value = table[sourceIndex] + sourceFraction * (table[sourceIndex + 1] - table[sourceIndex]);
+            output[i] += grain.amplitude * gain * value;
+            windowPosition += grain.windowIncrement;
+            sourcePosition += grain.sourceIncrement;
+            // The increment of a sine grain is below half the table, so one subtraction wraps it.
+            if (sourceType == sineSource && sourcePosition >= (float) SINE_TABLE_SIZE) {
+                sourcePosition -= (float) SINE_TABLE_SIZE;
+            }
+        }
+
+        grain.remaining -= count;
+        if (grain.remaining == 0) {
+            // The last active grain takes the place of the finished one, so the pool stays packed.
+            grain = this->grains[--this->numActiveGrains];
+        } else {
+            grain.windowPosition = windowPosition;
+            grain.sourcePosition = sourcePosition;
+            grain.startOffset = 0;
+            ++index;
+        }
+    }
+}
+
+//// ==============================================================================
+//// GranularRenderer Class
+//// ==============================================================================
+
+bool GranularRenderer::startNote(const Note &note, NoiseGenerator &noise) {
+    const StreamedSample* sample = note.sampleLibrary != nullptr
+            ? note.sampleLibrary->findSample(note.midiNoteNumber) : nullptr;
+    this->cloud.startNote(note.patchIndex, sample, note.frequency, note.sampleRate);
+    return true;
+}
+
+bool GranularRenderer::render(float *const *destinations, int numSamples, const ControlBlock &control,
+                              NoiseGenerator &noise) {
+    this->cloud.render(destinations[0], numSamples, control.pitchRatio, noise);
+    return true;
+}
+
+void GranularRenderer::stopNote() {
+    this->cloud.stop();
+}
+
+bool GranularRenderer::isUsingSample() const {
+    return this->cloud.isUsingSample();
+}
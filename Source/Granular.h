@@ -0,0 +1,173 @@
+/*
+  ==============================================================================
+
+    Granular.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "Noise.h"
+#include "Sampler.h"
+#include "VoiceRenderer.h"
+
+/**
+ * A cloud of short windowed grains read from a sine oscillator or from the attack of a sample.
+ * The grains live in a pool of MAX_GRAINS plain structures, where the active ones are kept packed at the front, so
+ * starting and ending a grain never allocates. A scheduler emits the grains of every block at the exact sample where
+ * they start. The grains are then rendered one after the other into the block, by a render loop instantiated for
+ * the source of the patch, with the window and the sine read from precomputed tables.
+ */
+class GrainCloud {
+public:
+    static constexpr int MAX_GRAINS = 256;
+    /** The longest block passed to render(), the control block size of the voices */
+    static constexpr int MAX_BLOCK_SIZE = 32;
+
+    /**
+     * The names of the built-in patches. The first call builds the window and sine tables, so it should be made
+     * on the message thread.
+     * @return the patch names, in the order of their indices
+     */
+    static StringArray getPatchNames();
+
+    /**
+     * Start the grains of a note. It does not allocate, so it can be called from the audio thread.
+     * @param patchIndex the index of the patch in getPatchNames()
+     * @param sample the sample read by the sample patches, or nullptr to read the sine oscillator instead
+     * @param frequency the frequency of the note in Hz
+     * @param sampleRate the sample rate
+     */
+    void startNote(int patchIndex, const StreamedSample* sample, float frequency, double sampleRate);
+
+    /**
+     * Drop every grain and forget the sample
+     */
+    void stop();
+
+    /**
+     * Whether the grains read a sample, which has to outlive them
+     * @return true if the current note reads a sample
+     */
+    bool isUsingSample() const;
+
+    /**
+     * Schedule and render the grains of a block
+     * @param destination the samples to overwrite
+     * @param numSamples the number of samples, at most MAX_BLOCK_SIZE
+     * @param pitchRatio the pitch bend and modulation of the note, applied to the grains starting in this block
+     * @param generator the noise generator of the voice, which draws the jitter of the grains
+     */
+    void render(float* destination, int numSamples, float pitchRatio, NoiseGenerator& generator);
+
+    /**
+     * The number of grains sounding
+     * @return the number of active grains in the pool
+     */
+    int getNumActiveGrains() const;
+
+    enum Source {
+        sineSource = 0,
+        sampleSource
+    };
+
+    enum Window {
+        hannWindow = 0,
+        trapezoidWindow,
+        gaussianWindow,
+        numWindows
+    };
+
+private:
+    /**
+     * A patch: where the grains are read, how many start per second and how much they vary
+     */
+    struct Patch {
+        const char* name;
+        Source source;
+        Window window;
+        /** The number of grains started per second */
+        float density;
+        /** The length of a grain in seconds */
+        float duration;
+        /** The relative random variation of the length of a grain, and of the time between two grains */
+        float durationJitter;
+        /** The random detune of a grain in cents */
+        float pitchJitter;
+        /** The speed of the read head through the sample, 1 for the speed of the sample */
+        float scanRate;
+        /** The random offset of a grain from the read head in seconds */
+        float positionJitter;
+    };
+
+    /**
+     * A grain of the pool. It starts at startOffset in the current block, and ends after remaining samples.
+     */
+    struct Grain {
+        float windowPosition;
+        float windowIncrement;
+        float sourcePosition;
+        float sourceIncrement;
+        float amplitude;
+        int startOffset;
+        int remaining;
+    };
+
+    static const Patch PATCHES[];
+    static const int NUM_PATCHES;
+
+    const Patch* patch = nullptr;
+    Source source = sineSource;
+    const StreamedSample* sample = nullptr;
+    /** The increment of a grain at the pitch of the note, in sine table entries or in sample frames per sample */
+    float baseIncrement = 0.0f;
+    float grainLength = 0.0f;
+    float grainInterval = 0.0f;
+    float grainAmplitude = 0.0f;
+    float samplesToNextGrain = 0.0f;
+    /** The read head in the sample and its speed in sample frames per sample */
+    float scanPosition = 0.0f;
+    float scanIncrement = 0.0f;
+    float samplePositionJitter = 0.0f;
+
+    Grain grains[MAX_GRAINS];
+    int numActiveGrains = 0;
+
+    /**
+     * Take a grain from the pool. The grain is skipped if the pool is full.
+     * @param startOffset the sample of the current block where the grain starts
+     * @param pitchRatio the pitch bend and modulation of the note
+     * @param generator the noise generator drawing the jitter
+     */
+    void startGrain(int startOffset, float pitchRatio, NoiseGenerator& generator);
+
+    /**
+     * Render every active grain into a block, and give the grains that end back to the pool
+     * @param destination the samples to add to
+     * @param numSamples the number of samples
+     */
+    template <int sourceType>
+    void renderGrains(float* destination, int numSamples);
+};
+
+/**
+ * The renderer of the "Granular" voice type, which plays a cloud of grains of a sine or of the sample of the note.
+ * The sample patches fall back to the sine when no sample is loaded.
+ */
+class GranularRenderer : public VoiceRenderer {
+public:
+    GranularRenderer() = default;
+
+    bool startNote(const Note& note, NoiseGenerator& noise) override;
+    bool render(float* const* destinations, int numSamples, const ControlBlock& control,
+                NoiseGenerator& noise) override;
+    void stopNote() override;
+    bool isUsingSample() const override;
+
+private:
+    GrainCloud cloud;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GranularRenderer)
+};
@@ -0,0 +1,214 @@
+/*
+  ==============================================================================
+
+    HeadlessHost.cpp
+
+  ==============================================================================
+*/
+
+#include "HeadlessHost.h"
+
+namespace {
+    /**
+     * Read a numeric OSC argument, clients send either integers or floats.
+     * @param message the OSC message
+     * @param index the index of the argument
+     * @param value the value of the argument
+     * @return false if the argument is missing or not a number
+     */
+    bool getNumber(const OSCMessage& message, int index, float& value) {
+        if (index >= message.size()) {
+            return false;
+        }
+        const OSCArgument& argument = message[index];
+        if (argument.isFloat32()) {
+            value = argument.getFloat32();
+            return true;
+        }
+        if (argument.isInt32()) {
+            value = (float) argument.getInt32();
+            return true;
+        }
+        return false;
+    }
+
+    bool getString(const OSCMessage& message, int index, String& value) {
+        if (index >= message.size() || !message[index].isString()) {
+            return false;
+        }
+        value = message[index].getString();
+        return true;
+    }
+}
+
+HeadlessHost::HeadlessHost() : Thread("Null audio device"), audioSource(midiKeyboardState) {
+    this->selfReference = this;
+}
+
+HeadlessHost::~HeadlessHost() {
+    this->stop();
+}
+
+bool HeadlessHost::start(int oscPort, bool useNullDevice, String &errorMessage) {
+    this->usingNullDevice = useNullDevice;
+    if (useNullDevice) {
+        this->audioSource.prepareToPlay(NULL_DEVICE_BLOCK_SIZE, NULL_DEVICE_SAMPLE_RATE);
+        this->startThread(Thread::realtimeAudioPriority);
+    } else {
+        errorMessage = this->deviceManager.initialiseWithDefaultDevices(0, 2);
+        if (errorMessage.isNotEmpty()) {
+            return false;
+        }
+        this->audioSourcePlayer.setSource(&this->audioSource);
+        this->deviceManager.addAudioCallback(&this->audioSourcePlayer);
+    }
+
+    if (!this->oscReceiver.connect(oscPort)) {
+        errorMessage = "Cannot listen on UDP port " + String(oscPort) + ".";
+        this->stop();
+        return false;
+    }
+    this->oscReceiver.addListener(this);
+    this->startTimer(500);
+    return true;
+}
+
+void HeadlessHost::stop() {
+    this->stopTimer();
+    this->oscReceiver.removeListener(this);
+    this->oscReceiver.disconnect();
+    if (this->usingNullDevice) {
+        this->stopThread(1000);
+        this->audioSource.releaseResources();
+    } else {
+        this->deviceManager.removeAudioCallback(&this->audioSourcePlayer);
+        this->audioSourcePlayer.setSource(nullptr);
+        this->deviceManager.closeAudioDevice();
+    }
+    this->audioSource.removeAllVoices();
+}
+
+void HeadlessHost::oscMessageReceived(const OSCMessage &message) {
+    const String address = message.getAddressPattern().toString();
+    MidiMessageQueue& queue = this->audioSource.getMidiMessageQueue();
+    float first, second;
+
+    if (address == "/synth/note/on" && getNumber(message, 0, first) && getNumber(message, 1, second)) {
+        const int note = jlimit(0, 127, roundToInt(first));
+        // Integer velocities are MIDI velocities, floats are normalised.
+        if (message[1].isInt32()) {
+            queue.push(MidiMessage::noteOn(1, note, (uint8) jlimit(0, 127, roundToInt(second))));
+        } else {
+            queue.push(MidiMessage::noteOn(1, note, jlimit(0.0f, 1.0f, second)));
+        }
+    } else if (address == "/synth/note/off" && getNumber(message, 0, first)) {
+        queue.push(MidiMessage::noteOff(1, jlimit(0, 127, roundToInt(first))));
+    } else if (address == "/synth/pitchbend" && getNumber(message, 0, first)) {
+        queue.push(MidiMessage::pitchWheel(1, jlimit(0, 16383, roundToInt(first))));
+    } else if (address == "/synth/cc" && getNumber(message, 0, first) && getNumber(message, 1, second)) {
+        queue.push(MidiMessage::controllerEvent(1, jlimit(0, 127, roundToInt(first)),
+                                                jlimit(0, 127, roundToInt(second))));
+    } else {
+        // Everything else touches objects owned by the message thread.
+        WeakReference<HeadlessHost> host = this->selfReference;
+        MessageManager::callAsync([host, message] {
+            if (host != nullptr) {
+                host->handleControlMessage(message);
+            }
+        });
+    }
+}
+
+void HeadlessHost::handleControlMessage(const OSCMessage &message) {
+    const String address = message.getAddressPattern().toString();
+    float value;
+    String text;
+    bool handled = true;
+
+    if (address == "/synth/voice/add" && getString(message, 0, text)) {
+        if (!ElementaryVoice::getVoiceTypeNames().contains(text)) {
+            handled = false;
+        } else {
+            this->audioSource.addVoice(new ElementaryVoice(text));
+        }
+    } else if (address == "/synth/voice/remove" && getNumber(message, 0, value)) {
+        const int index = roundToInt(value);
+        handled = index >= 0 && index < this->audioSource.getTotalNumVoices();
+        if (handled) {
+            this->audioSource.removeVoice(index);
+        }
+    } else if (address == "/synth/voice/clear") {
+        this->audioSource.removeAllVoices();
+    } else if ((address == "/synth/voice/type" || address == "/synth/voice/set") && getNumber(message, 0, value)) {
+        const int index = roundToInt(value);
+        ElementaryVoice* voice = index >= 0 && index < this->audioSource.getTotalNumVoices()
+                ? this->audioSource.getVoice(index) : nullptr;
+        float parameterValue;
+        if (voice == nullptr || !getString(message, 1, text)) {
+            handled = false;
+        } else if (address == "/synth/voice/type") {
+            handled = voice->setVoiceType(text);
+        } else {
+            handled = getNumber(message, 2, parameterValue) && voice->setParameter(text, parameterValue);
+        }
+    } else if (address == "/synth/stealing" && getString(message, 0, text)) {
+        const int policy = VoiceAllocator::getPolicyNames().indexOf(text, true);
+        handled = policy >= 0;
+        if (handled) {
+            this->audioSource.setStealingPolicy((VoiceAllocator::StealingPolicy) policy);
+        }
+    } else if (address == "/synth/mpe" && getNumber(message, 0, value)) {
+        this->audioSource.setMpeEnabled(value != 0.0f);
+    } else if (address == "/synth/governor" && getNumber(message, 0, value)) {
+        this->audioSource.getQualityGovernor().setEnabled(value != 0.0f);
+    } else if (address == "/synth/tuning/load" && getString(message, 0, text)) {
+        handled = this->audioSource.loadScalaTuning(File(text));
+    } else if (address == "/synth/tuning/reset") {
+        this->audioSource.resetTuning();
+    } else if (address == "/synth/samples/load" && getString(message, 0, text)) {
+        handled = this->audioSource.loadSampleLibrary(File(text));
+    } else if (address == "/synth/reverb/load" && getString(message, 0, text)) {
+        handled = this->audioSource.getEffectsBus().loadImpulseResponse(File(text));
+    } else if (address == "/synth/reverb/mix" && getNumber(message, 0, value)) {
+        this->audioSource.getEffectsBus().setReverbMix(jlimit(0.0f, 1.0f, value));
+    } else if (address == "/synth/delay/mix" && getNumber(message, 0, value)) {
+        this->audioSource.getEffectsBus().setDelayMix(jlimit(0.0f, 1.0f, value));
+    } else if (address == "/synth/sequencer/load" && getString(message, 0, text)) {
+        handled = this->audioSource.getSequencer().loadFile(File(text));
+    } else if (address == "/synth/sequencer/play") {
+        this->audioSource.getSequencer().play();
+    } else if (address == "/synth/sequencer/stop") {
+        this->audioSource.getSequencer().stop();
+    } else if (address == "/synth/sequencer/seek" && getNumber(message, 0, value)) {
+        this->audioSource.getSequencer().seek(value);
+    } else if (address == "/synth/quit") {
+        JUCEApplication::getInstance()->systemRequestedQuit();
+    } else {
+        handled = false;
+    }
+
+    if (!handled) {
+        Logger::writeToLog("Ignored OSC message " + address);
+    }
+}
+
+void HeadlessHost::run() {
+    AudioBuffer<float> buffer(2, NULL_DEVICE_BLOCK_SIZE);
+    const double blockMilliseconds = 1000.0 * NULL_DEVICE_BLOCK_SIZE / NULL_DEVICE_SAMPLE_RATE;
+    double nextBlockTime = Time::getMillisecondCounterHiRes();
+
+    while (!this->threadShouldExit()) {
+        AudioSourceChannelInfo bufferToFill(&buffer, 0, NULL_DEVICE_BLOCK_SIZE);
+        this->audioSource.getNextAudioBlock(bufferToFill);
+        // Keep the pace of a real device, so the timing of the notes is the same.
+        nextBlockTime += blockMilliseconds;
+        const double waitTime = nextBlockTime - Time::getMillisecondCounterHiRes();
+        if (waitTime > 1.0) {
+            this->wait((int) waitTime);
+        }
+    }
+}
+
+void HeadlessHost::timerCallback() {
+    this->audioSource.logQualityTransitions();
+}
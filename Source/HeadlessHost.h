@@ -0,0 +1,107 @@
+/*
+  ==============================================================================
+
+    HeadlessHost.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "SynthesiserSource.h"
+
+/**
+ * Runs the synthesiser without any window, controlled over OSC on a local UDP port.
+ * Notes, pitch bend and controllers are received on the network thread and pushed to the lock-free MIDI queue of
+ * the synthesiser, so they never wait for the message thread. Voice, tuning and effect commands change objects
+ * owned by the message thread, so they are forwarded to it.
+ *
+ * The OSC address space:
+ *  - /synth/note/on note velocity     velocity between 0 and 1, or 0 to 127 as an integer
+ *  - /synth/note/off note
+ *  - /synth/pitchbend value           14 bit value, 8192 is the centre
+ *  - /synth/cc controller value
+ *  - /synth/voice/add type            "Sine", "Square", "Triangle", "Sawtooth", "Sample", "Additive", "FM",
+ *                                     "String", "Noise" or "Granular"
+ *  - /synth/voice/remove index
+ *  - /synth/voice/clear
+ *  - /synth/voice/type index type
+ *  - /synth/voice/set index name value  see ElementaryVoice::setParameter()
+ *  - /synth/stealing policy           "Oldest", "Quietest" or "Same note"
+ *  - /synth/mpe on                    1 to read the channels as an MPE lower zone, 0 to switch it off
+ *  - /synth/governor on               0 to keep the full quality under load, 1 to let it degrade (the default)
+ *  - /synth/tuning/load path          a Scala .scl file
+ *  - /synth/tuning/reset
+ *  - /synth/samples/load path         a WAV or AIFF file, or a directory of them
+ *  - /synth/reverb/load path
+ *  - /synth/reverb/mix value
+ *  - /synth/delay/mix value
+ *  - /synth/sequencer/load path       a Standard MIDI File
+ *  - /synth/sequencer/play
+ *  - /synth/sequencer/stop
+ *  - /synth/sequencer/seek seconds
+ *  - /synth/quit
+ */
+class HeadlessHost : private OSCReceiver::Listener<OSCReceiver::RealtimeCallback>, private Thread, private Timer {
+public:
+    HeadlessHost();
+    ~HeadlessHost() override;
+
+    /**
+     * Open the audio device and start listening for OSC messages.
+     * @param oscPort the UDP port to listen on
+     * @param useNullDevice render in real time on a background thread and discard the output,
+     * instead of opening the default audio device
+     * @param errorMessage the reason of the failure
+     * @return true if the host is running
+     */
+    bool start(int oscPort, bool useNullDevice, String& errorMessage);
+
+    /**
+     * Stop listening and close the audio device.
+     */
+    void stop();
+
+private:
+    const double NULL_DEVICE_SAMPLE_RATE = 48000.0;
+    const int NULL_DEVICE_BLOCK_SIZE = 512;
+
+    MidiKeyboardState midiKeyboardState;
+    VoiceSynthesiser audioSource;
+    AudioDeviceManager deviceManager;
+    AudioSourcePlayer audioSourcePlayer;
+    OSCReceiver oscReceiver;
+    bool usingNullDevice = false;
+
+    /**
+     * Created on the message thread, so the network thread only copies it. The commands forwarded to the message
+     * thread check it, as the host may be deleted before they are delivered.
+     */
+    WeakReference<HeadlessHost> selfReference;
+
+    /**
+     * Called on the network thread for every OSC message.
+     * @param message the received message
+     */
+    void oscMessageReceived(const OSCMessage& message) override;
+
+    /**
+     * Apply a voice, tuning or effect command on the message thread.
+     * @param message the received message
+     */
+    void handleControlMessage(const OSCMessage& message);
+
+    /**
+     * The render loop of the null device. The synthesiser is prepared on the message thread before it starts.
+     */
+    void run() override;
+
+    /**
+     * Write the quality transitions of the synthesiser to the log.
+     */
+    void timerCallback() override;
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE (HeadlessHost)
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HeadlessHost)
+};
@@ -12,6 +12,10 @@
 
 #include <memory>
 #include "MainComponent.h"
+#include "Benchmarks.h"
+#include "HeadlessHost.h"
+#include "DspKernels.h"
+#include "RealtimeLog.h"
 
 //==============================================================================
 class MIDISynthApplication : public JUCEApplication {
@@ -54,6 +58,26 @@ public:
      * @param command line arguments to be handled
      */
     void initialise (const String& commandLine) override {
+        RealtimeLog::getInstance().start();
+        Logger::writeToLog("DSP kernels: " + String(DspKernels::get().name));
+        // Benchmarks run without any window and quit when they are done.
+        if (Benchmarks::runFromCommandLine(commandLine)) {
+            MIDISynthApplication::quit();
+            return;
+        }
+        StringArray arguments = StringArray::fromTokens(commandLine, true);
+#if JUCE_UNIT_TESTS
+        // The tests also run without any window, and the exit code tells whether they passed.
+        if (arguments.contains("--test")) {
+            this->setApplicationReturnValue(MIDISynthApplication::runTests() ? 0 : 1);
+            MIDISynthApplication::quit();
+            return;
+        }
+#endif
+        if (arguments.contains("--headless")) {
+            this->startHeadless(arguments);
+            return;
+        }
         this->mainWindow = std::make_unique<MainWindow> (this->getApplicationName());
     }
 
@@ -61,7 +85,9 @@ public:
      * This function is called when the app is shutting down.
      */
     void shutdown() override {
+        this->headlessHost = nullptr;
         this->mainWindow = nullptr; // (deletes our window)
+        RealtimeLog::getInstance().stop();
     }
 
     //==============================================================================
@@ -69,7 +95,10 @@ public:
      * This is called when the app is being asked to quit
      */
     void systemRequestedQuit() override {
-        MIDISynthApplication::closeAllWindows();
+        // The headless mode, the benchmarks and the tests have no window to close.
+        if (this->mainWindow != nullptr) {
+            MIDISynthApplication::closeAllWindows();
+        }
         MIDISynthApplication::quit();
     }
 
@@ -136,6 +165,53 @@ private:
     /** The main window pointer being hold by the main application. */
     std::unique_ptr<MainWindow> mainWindow;
 
+    /** The synthesiser of the headless mode. The main window is never created in this mode. */
+    std::unique_ptr<HeadlessHost> headlessHost;
+
+    /**
+     * Run the synthesiser without any window, controlled over OSC.
+     * The options are --osc-port=PORT (9000 by default) and --null-device to render without an audio device.
+     * @param arguments the command line arguments
+     */
+    void startHeadless(const StringArray& arguments) {
+        int oscPort = 9000;
+        for (const String& argument : arguments) {
+            if (argument.startsWith("--osc-port=")) {
+                oscPort = argument.fromFirstOccurrenceOf("=", false, false).getIntValue();
+            }
+        }
+        const bool useNullDevice = arguments.contains("--null-device");
+
+        String errorMessage;
+        this->headlessHost = std::make_unique<HeadlessHost>();
+        if (!this->headlessHost->start(oscPort, useNullDevice, errorMessage)) {
+            Logger::writeToLog("Cannot start the headless synthesiser: " + errorMessage);
+            this->headlessHost = nullptr;
+            this->setApplicationReturnValue(1);
+            MIDISynthApplication::quit();
+            return;
+        }
+        Logger::writeToLog("MIDISynth is listening for OSC messages on UDP port " + String(oscPort)
+                           + (useNullDevice ? " with the null audio device." : "."));
+    }
+
+#if JUCE_UNIT_TESTS
+    /**
+     * Run the unit tests of the synthesiser, which all are in the "MIDISynth" category, and log their results.
+     * @return true if every test passed
+     */
+    static bool runTests() {
+        UnitTestRunner runner;
+        runner.setAssertOnFailure(false);
+        runner.runTestsInCategory("MIDISynth");
+        int failures = 0;
+        for (int i = 0; i < runner.getNumResults(); ++i) {
+            failures += runner.getResult(i)->failures;
+        }
+        return failures == 0;
+    }
+#endif
+
     /**
      * Helper function to close all the displaying windows.
      * It creates a unique pointer to each instance of the opening windows and push it to a container,
@@ -7,15 +7,56 @@
 MainComponent::MainComponent() :
     midiKeyboardComponent(midiKeyboardState, juce::MidiKeyboardComponent::horizontalKeyboard),
     synthesiserList("synthesiserList", this),
-    audioVisualiserComponent(2),
     audioSource(midiKeyboardState)
 {
-    // Initialise audioSettings button
+    // Initialise audioSettings button, it is enabled once the device is open
     audioSettings.addListener(this);
+    audioSettings.setEnabled(false);
     addAndMakeVisible(audioSettings);
     // Initialise clearAllVoice button
     clearAllVoice.addListener(this);
     addAndMakeVisible(clearAllVoice);
+    // Initialise loadImpulseResponse button
+    loadImpulseResponse.addListener(this);
+    addAndMakeVisible(loadImpulseResponse);
+    // Initialise tuningButton
+    tuningButton.addListener(this);
+    addAndMakeVisible(tuningButton);
+    // Initialise loadSamples button
+    loadSamples.addListener(this);
+    addAndMakeVisible(loadSamples);
+    // Initialise effect mix sliders
+    reverbMixSlider.addListener(this);
+    reverbMixSlider.setRange(0.0, 1.0);
+    reverbMixSlider.setValue(0.3);
+    addAndMakeVisible(reverbMixSlider);
+    addAndMakeVisible(reverbMixLabel);
+    delayMixSlider.addListener(this);
+    delayMixSlider.setRange(0.0, 1.0);
+    delayMixSlider.setValue(0.0);
+    addAndMakeVisible(delayMixSlider);
+    addAndMakeVisible(delayMixLabel);
+    // Initialise the sequencer transport
+    loadMidiFile.addListener(this);
+    addAndMakeVisible(loadMidiFile);
+    playButton.addListener(this);
+    addAndMakeVisible(playButton);
+    sequencerPosition.setRange(0.0, 1.0);
+    sequencerPosition.setTextValueSuffix(" s");
+    sequencerPosition.setNumDecimalPlacesToDisplay(1);
+    sequencerPosition.addListener(this);
+    addAndMakeVisible(sequencerPosition);
+    // Initialise the voice stealing policy
+    stealingSelection.addItemList(VoiceAllocator::getPolicyNames(), 1);
+    stealingSelection.setSelectedItemIndex(audioSource.getStealingPolicy(), dontSendNotification);
+    stealingSelection.addListener(this);
+    addAndMakeVisible(stealingSelection);
+    addAndMakeVisible(stealingLabel);
+    // Initialise the recorder
+    recordButton.addListener(this);
+    addAndMakeVisible(recordButton);
+    recorderStatus.setJustificationType(Justification::centredLeft);
+    addAndMakeVisible(recorderStatus);
     // Initialise midiKeyboardComponent
     midiKeyboardComponent.setOctaveForMiddleC(4);
     addAndMakeVisible(midiKeyboardComponent);
@@ -25,19 +66,28 @@ MainComponent::MainComponent() :
     addAndMakeVisible(synthesiserList);
     // Initialise synthesiserVoiceAdder
     synthesiserVoiceAdder.addItemList(
-            {"Sine", "Square", "Triangle", "Sawtooth"}, 1);
+            {"Sine", "Square", "Triangle", "Sawtooth", "Sample", "Additive", "FM", "String", "Noise", "Granular"},
+            1);
     synthesiserVoiceAdder.setSelectedId(1, dontSendNotification);
     addAndMakeVisible(synthesiserVoiceAdder);
     // Initialise addVoiceButton
     addVoiceButton.addListener(this);
     addAndMakeVisible(addVoiceButton);
-    // Initialise audioVisualiserComponent
-    addAndMakeVisible(audioVisualiserComponent);
     // Initialise CPU Usage Label
     addAndMakeVisible(cpuUsageLabel);
     // Initialise CPU Usage
     cpuUsage.setJustificationType(Justification::centredLeft);
     addAndMakeVisible(cpuUsage);
+    // Initialise limiter meter
+    addAndMakeVisible(gainReductionLabel);
+    gainReduction.setJustificationType(Justification::centredLeft);
+    addAndMakeVisible(gainReduction);
+    // Initialise soft clip toggle
+    softClipToggle.addListener(this);
+    addAndMakeVisible(softClipToggle);
+    // Initialise MPE toggle
+    mpeToggle.addListener(this);
+    addAndMakeVisible(mpeToggle);
     // Make sure we set the size of the component at last!
     this->setSize (852,608);
     // Some platforms require permissions to open input channels so request that here
@@ -49,13 +99,16 @@ MainComponent::MainComponent() :
 //                }
 //        });
 //    } else {
-        this->setAudioChannels(0, 2);
+        // The window shows before the device is probed and opened.
+        this->openAudioDeviceLater();
 //    }
     // Timer setup
     this->startTimer(500);
 }
 
 MainComponent::~MainComponent() {
+    this->deviceManager.removeAudioCallback(&this->devicePlayer);
+    this->devicePlayer.setSource(nullptr);
     // This shuts down the audio device and clears the audio source.
     this->shutdownAudio();
     this->audioSource.removeAllVoices();
@@ -67,19 +120,29 @@ MainComponent::~MainComponent() {
 
 void MainComponent::prepareToPlay (int samplesPerBlockExpected, double sampleRate) {
     this->audioSource.prepareToPlay(samplesPerBlockExpected, sampleRate);
-    this->audioVisualiserComponent.setSamplesPerBlock(8);
-    this->audioVisualiserComponent.setBufferSize(samplesPerBlockExpected);
+    this->recorder.prepareToPlay(samplesPerBlockExpected, sampleRate, 2);
+    if (this->audioVisualiserComponent != nullptr) {
+        this->audioVisualiserComponent->setSamplesPerBlock(8);
+        this->audioVisualiserComponent->setBufferSize(samplesPerBlockExpected);
+    }
 }
 
 void MainComponent::getNextAudioBlock (const AudioSourceChannelInfo& bufferToFill) {
     bufferToFill.clearActiveBufferRegion();
     this->audioSource.getNextAudioBlock(bufferToFill);
-    audioVisualiserComponent.pushBuffer(bufferToFill);
+    this->recorder.push(bufferToFill);
+    if (this->audioVisualiserComponent != nullptr) {
+        this->audioVisualiserComponent->pushBuffer(bufferToFill);
+    }
+    if (this->firstBlockTime.load() == 0.0) {
+        this->firstBlockTime.store(Time::getMillisecondCounterHiRes());
+    }
 //    DBG(audioSource.getStatus());
 }
 
 void MainComponent::releaseResources() {
     this->audioSource.releaseResources();
+    this->recorder.releaseResources();
 }
 
 //// ==============================================================================
@@ -101,7 +164,34 @@ void MainComponent::resized() {
     Rectangle<int> firstRow = globalBound.removeFromTop(24);
 
     this->audioSettings.setBounds(firstRow.removeFromLeft(120));
+    firstRow.removeFromLeft(8);
+    this->loadImpulseResponse.setBounds(firstRow.removeFromLeft(120));
+    firstRow.removeFromLeft(8);
+    this->tuningButton.setBounds(firstRow.removeFromLeft(80));
+    firstRow.removeFromLeft(8);
+    this->loadSamples.setBounds(firstRow.removeFromLeft(100));
+    firstRow.removeFromLeft(8);
     this->clearAllVoice.setBounds(firstRow.removeFromRight(120));
+    firstRow.removeFromRight(8);
+    Rectangle<int> reverbBound = firstRow.removeFromLeft(firstRow.getWidth() / 2);
+    this->reverbMixLabel.setBounds(reverbBound.removeFromLeft(60));
+    this->reverbMixSlider.setBounds(reverbBound);
+    this->delayMixLabel.setBounds(firstRow.removeFromLeft(60));
+    this->delayMixSlider.setBounds(firstRow);
+
+    globalBound.removeFromTop(8);
+    Rectangle<int> transportRow = globalBound.removeFromTop(24);
+    this->loadMidiFile.setBounds(transportRow.removeFromLeft(120));
+    transportRow.removeFromLeft(8);
+    this->playButton.setBounds(transportRow.removeFromLeft(80));
+    transportRow.removeFromLeft(8);
+    this->stealingLabel.setBounds(transportRow.removeFromLeft(60));
+    this->stealingSelection.setBounds(transportRow.removeFromLeft(100));
+    transportRow.removeFromLeft(8);
+    this->recorderStatus.setBounds(transportRow.removeFromRight(160));
+    this->recordButton.setBounds(transportRow.removeFromRight(80));
+    transportRow.removeFromRight(8);
+    this->sequencerPosition.setBounds(transportRow);
 
     globalBound.removeFromTop(8);
     this->midiKeyboardComponent.setBounds(globalBound.removeFromTop(64));
@@ -111,6 +201,10 @@ void MainComponent::resized() {
 
     this->cpuUsageLabel.setBounds(lastColumn.removeFromLeft(100));
     this->cpuUsage.setBounds(lastColumn.removeFromLeft(100));
+    this->gainReductionLabel.setBounds(lastColumn.removeFromLeft(60));
+    this->gainReduction.setBounds(lastColumn.removeFromLeft(70));
+    this->softClipToggle.setBounds(lastColumn.removeFromLeft(90));
+    this->mpeToggle.setBounds(lastColumn.removeFromLeft(60));
     this->addVoiceButton.setBounds(lastColumn.removeFromRight(120));
     lastColumn.removeFromRight(8);
     this->synthesiserVoiceAdder.setBounds(lastColumn.removeFromRight(
@@ -120,7 +214,9 @@ void MainComponent::resized() {
     this->synthesiserList.setBounds(middleColumn.removeFromRight(
             (int) totalWidth * (MathConstants<float>::sqrt2 - 1.)));
     middleColumn.removeFromRight(8);
-    this->audioVisualiserComponent.setBounds(middleColumn);
+    if (this->audioVisualiserComponent != nullptr) {
+        this->audioVisualiserComponent->setBounds(middleColumn);
+    }
 }
 
 //// ==============================================================================
@@ -138,6 +234,50 @@ void MainComponent::buttonClicked(Button *button) {
     } else if (button == &this->clearAllVoice) {
         this->audioSource.removeAllVoices();
         this->updateSynthesiserList();
+    } else if (button == &this->loadImpulseResponse) {
+        this->openImpulseResponseChooser();
+    } else if (button == &this->loadSamples) {
+        this->openSampleLibraryChooser();
+    } else if (button == &this->loadMidiFile) {
+        this->openMidiFileChooser();
+    } else if (button == &this->playButton) {
+        MidiSequencer& sequencer = this->audioSource.getSequencer();
+        if (sequencer.isPlaying()) {
+            sequencer.stop();
+        } else {
+            sequencer.play();
+        }
+        this->updateTransport();
+    } else if (button == &this->recordButton) {
+        if (this->recorder.isRecording()) {
+            this->recorder.stopRecording();
+            this->updateRecorderStatus();
+        } else {
+            this->openRecordingChooser();
+        }
+    } else if (button == &this->tuningButton) {
+        this->openTuningMenu();
+    } else if (button == &this->softClipToggle) {
+        this->audioSource.getOutputStage().setSoftClipEnabled(button->getToggleState());
+    } else if (button == &this->mpeToggle) {
+        this->audioSource.setMpeEnabled(button->getToggleState());
+    }
+}
+
+void MainComponent::sliderValueChanged(Slider *slider) {
+    if (slider == &this->reverbMixSlider) {
+        this->audioSource.getEffectsBus().setReverbMix((float) slider->getValue());
+    } else if (slider == &this->delayMixSlider) {
+        this->audioSource.getEffectsBus().setDelayMix((float) slider->getValue());
+    } else if (slider == &this->sequencerPosition) {
+        this->audioSource.getSequencer().seek(slider->getValue());
+    }
+}
+
+void MainComponent::comboBoxChanged(ComboBox *comboBoxThatHasChanged) {
+    if (comboBoxThatHasChanged == &this->stealingSelection) {
+        this->audioSource.setStealingPolicy(
+                (VoiceAllocator::StealingPolicy) comboBoxThatHasChanged->getSelectedItemIndex());
     }
 }
 
@@ -150,6 +290,19 @@ void MainComponent::timerCallback() {
     std::stringstream ss;
     ss << std::fixed << std::setprecision(2) << this->deviceManager.getCpuUsage() << " %";
     this->cpuUsage.setText(ss.str(), dontSendNotification);
+    this->audioSource.logQualityTransitions();
+    // Updates the gain reduction of the limiter
+    ss.str("");
+    ss << std::fixed << std::setprecision(1) << this->audioSource.getOutputStage().getGainReductionDecibels() << " dB";
+    this->gainReduction.setText(ss.str(), dontSendNotification);
+    if (!this->hasReportedFirstSound && this->firstBlockTime.load() > 0.0) {
+        this->hasReportedFirstSound = true;
+        Logger::writeToLog("Time to first sound: " + String(this->firstBlockTime.load() - this->constructionTime, 1)
+                           + " ms, the audio device opened after "
+                           + String(this->deviceOpenedTime - this->constructionTime, 1) + " ms");
+    }
+    this->updateTransport();
+    this->updateRecorderStatus();
     if (audioSource.shouldUpdateStatus()) {
         updateSynthesiserList();
     }
@@ -197,6 +350,30 @@ void MainComponent::deleteKeyPressed(int lastRowSelected) {
 //// Private functions
 //// ==============================================================================
 
+void MainComponent::openAudioDeviceLater() {
+    const SafePointer<MainComponent> safeThis(this);
+    Timer::callAfterDelay(DEVICE_OPENING_DELAY, [safeThis] {
+        if (MainComponent* component = safeThis.getComponent()) {
+            component->openAudioDevice();
+        }
+    });
+}
+
+void MainComponent::openAudioDevice() {
+    const String errorMessage = this->deviceManager.initialiseWithDefaultDevices(0, 2);
+    this->deviceOpenedTime = Time::getMillisecondCounterHiRes();
+    if (errorMessage.isNotEmpty()) {
+        Logger::writeToLog("Cannot open the audio device: " + errorMessage);
+    }
+    // The visualiser exists before the first block, the audio thread never sees it change.
+    this->audioVisualiserComponent = std::make_unique<AudioVisualiserComponent>(2);
+    addAndMakeVisible(*this->audioVisualiserComponent);
+    this->resized();
+    this->devicePlayer.setSource(this);
+    this->deviceManager.addAudioCallback(&this->devicePlayer);
+    this->audioSettings.setEnabled(true);
+}
+
 void MainComponent::openAudioSettings() {
     auto audioSettingsPanel = std::make_unique<juce::AudioDeviceSelectorComponent>(
             this->deviceManager, 0, 2,
@@ -213,6 +390,121 @@ void MainComponent::openAudioSettings() {
     dialogWindow.launchAsync();
 }
 
+void MainComponent::openImpulseResponseChooser() {
+    EffectsBus& effectsBus = this->audioSource.getEffectsBus();
+    this->fileChooser = std::make_unique<FileChooser>("Select an impulse response", File(),
+                                                      effectsBus.getImpulseResponseWildcard());
+    this->fileChooser->launchAsync(FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles,
+                                   [&effectsBus] (const FileChooser& chooser) {
+        File file = chooser.getResult();
+        if (file.existsAsFile() && !effectsBus.loadImpulseResponse(file)) {
+            AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon, "Load reverb IR",
+                                             "Cannot read " + file.getFileName() + " as an audio file.");
+        }
+    });
+}
+
+void MainComponent::openTuningMenu() {
+    PopupMenu menu;
+    menu.addSectionHeader("Current: " + this->audioSource.getTuningName());
+    menu.addItem(1, "12-TET");
+    menu.addItem(2, "Load Scala file...");
+    menu.showMenuAsync(PopupMenu::Options().withTargetComponent(&this->tuningButton),
+                       ModalCallbackFunction::create([this] (int result) {
+        if (result == 1) {
+            this->audioSource.resetTuning();
+        } else if (result == 2) {
+            this->fileChooser = std::make_unique<FileChooser>("Select a Scala scale", File(), "*.scl");
+            this->fileChooser->launchAsync(FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles,
+                                           [this] (const FileChooser& chooser) {
+                File file = chooser.getResult();
+                if (file.existsAsFile() && !this->audioSource.loadScalaTuning(file)) {
+                    AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon, "Load tuning",
+                                                     "Cannot read " + file.getFileName() + " as a Scala scale.");
+                }
+            });
+        }
+    }));
+}
+
+void MainComponent::openMidiFileChooser() {
+    this->fileChooser = std::make_unique<FileChooser>("Select a MIDI file", File(), "*.mid;*.midi");
+    this->fileChooser->launchAsync(FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles,
+                                   [this] (const FileChooser& chooser) {
+        File file = chooser.getResult();
+        if (!file.existsAsFile()) {
+            return;
+        }
+        if (!this->audioSource.getSequencer().loadFile(file)) {
+            AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon, "Load MIDI file",
+                                             "Cannot read " + file.getFileName() + " as a MIDI file.");
+        }
+        this->updateTransport();
+    });
+}
+
+void MainComponent::openSampleLibraryChooser() {
+    this->fileChooser = std::make_unique<FileChooser>("Select a sample or a directory of samples", File(),
+                                                      SampleLibrary::getFileWildcard());
+    this->fileChooser->launchAsync(FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles
+                                   | FileBrowserComponent::canSelectDirectories,
+                                   [this] (const FileChooser& chooser) {
+        File file = chooser.getResult();
+        if (!file.exists()) {
+            return;
+        }
+        if (!this->audioSource.loadSampleLibrary(file)) {
+            AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon, "Load samples",
+                                             "Cannot find any WAV or AIFF sample in " + file.getFileName() + ".");
+        }
+    });
+}
+
+void MainComponent::updateTransport() {
+    MidiSequencer& sequencer = this->audioSource.getSequencer();
+    this->playButton.setButtonText(sequencer.isPlaying() ? "Stop" : "Play");
+    // Do not fight with the user while the position is dragged.
+    if (!this->sequencerPosition.isMouseButtonDown()) {
+        this->sequencerPosition.setRange(0.0, jmax(1.0, sequencer.getLengthSeconds()));
+        this->sequencerPosition.setValue(sequencer.getPositionSeconds(), dontSendNotification);
+    }
+}
+
+void MainComponent::openRecordingChooser() {
+    this->fileChooser = std::make_unique<FileChooser>("Record to", File(), DiskRecorder::getFileWildcard());
+    this->fileChooser->launchAsync(FileBrowserComponent::saveMode | FileBrowserComponent::canSelectFiles
+                                   | FileBrowserComponent::warnAboutOverwriting,
+                                   [this] (const FileChooser& chooser) {
+        File file = chooser.getResult();
+        if (file == File()) {
+            return;
+        }
+        if (!file.hasFileExtension(".wav;.flac")) {
+            file = file.withFileExtension(".wav");
+        }
+        if (!this->recorder.startRecording(file)) {
+            AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon, "Record",
+                                             "Cannot record to " + file.getFileName() + ".");
+        }
+        this->updateRecorderStatus();
+    });
+}
+
+void MainComponent::updateRecorderStatus() {
+    const bool recording = this->recorder.isRecording();
+    this->recordButton.setButtonText(recording ? "Stop rec" : "Record");
+    if (!recording) {
+        this->recorderStatus.setText("", dontSendNotification);
+        return;
+    }
+    // A change of the sample rate goes on recording in a new file, so the file is shown.
+    std::stringstream ss;
+    ss << this->recorder.getRecordingFile().getFileName() << ": "
+       << std::fixed << std::setprecision(1) << this->recorder.getRecordedSeconds() << " s, "
+       << this->recorder.getNumDroppedBlocks() << " dropped";
+    this->recorderStatus.setText(ss.str(), dontSendNotification);
+}
+
 void MainComponent::updateSynthesiserList() {
     synthesiserList.updateContent();
     synthesiserList.repaint();
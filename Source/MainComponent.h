@@ -10,6 +10,7 @@
 
 #include <JuceHeader.h>
 #include "SynthesiserSource.h"
+#include "DiskRecorder.h"
 
 /**
  * This component lives inside our window, and this is where we put all our controls and content.
@@ -23,6 +24,8 @@
 class MainComponent :
         public AudioAppComponent,
         public Button::Listener,
+        public Slider::Listener,
+        public ComboBox::Listener,
         public juce::Timer,
         public juce::ListBoxModel
 {
@@ -90,13 +93,25 @@ public:
      */
     void buttonClicked(Button *button) override;
 
+    /**
+     * Called when a slider is dragged
+     * @param slider the slider whose value is changed
+     */
+    void sliderValueChanged(Slider *slider) override;
+
+    /**
+     * Called when an item of a combo box is selected
+     * @param comboBoxThatHasChanged the combo box whose selection is changed
+     */
+    void comboBoxChanged(ComboBox *comboBoxThatHasChanged) override;
+
 //// ==============================================================================
 //// Timer callback
 //// ==============================================================================
 
     /**
      * Called periodically to carry out certain task
-     * This function periodically updates the CPU usage.
+     * This function periodically updates the CPU usage, the gain reduction of the limiter and the recorder status.
      */
     void timerCallback() override;
 
@@ -132,8 +147,34 @@ public:
     void deleteKeyPressed (int lastRowSelected) override;
 
 private:
+    /** The start of the construction, time-to-first-sound is measured from it */
+    const double constructionTime = Time::getMillisecondCounterHiRes();
+    double deviceOpenedTime = 0.0;
+    /** The time of the first audio block, 0 until it is rendered */
+    std::atomic<double> firstBlockTime {0.0};
+    bool hasReportedFirstSound = false;
+
     TextButton audioSettings {"Audio settings"};
     TextButton clearAllVoice {"Clear all voice"};
+    TextButton loadImpulseResponse {"Load reverb IR"};
+    TextButton tuningButton {"Tuning"};
+    TextButton loadSamples {"Load samples"};
+
+    Label reverbMixLabel {"reverbMixLabel", "Reverb:"};
+    Slider reverbMixSlider {Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::NoTextBox};
+    Label delayMixLabel {"delayMixLabel", "Delay:"};
+    Slider delayMixSlider {Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::NoTextBox};
+    std::unique_ptr<FileChooser> fileChooser;
+
+    TextButton loadMidiFile {"Load MIDI file"};
+    TextButton playButton {"Play"};
+    Slider sequencerPosition {Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::TextBoxRight};
+    /** The voice stealing policy of the synthesiser */
+    Label stealingLabel {"stealingLabel", "Stealing:"};
+    ComboBox stealingSelection {"stealingSelection"};
+
+    TextButton recordButton {"Record"};
+    Label recorderStatus {"recorderStatus", ""};
 
     MidiKeyboardComponent midiKeyboardComponent;
     MidiKeyboardState midiKeyboardState;
@@ -142,14 +183,53 @@ private:
     ComboBox synthesiserVoiceAdder;
     TextButton addVoiceButton {"Add voice"};
 
-    AudioVisualiserComponent audioVisualiserComponent;
+    /** Built once the audio device is open, before the first block is rendered */
+    std::unique_ptr<AudioVisualiserComponent> audioVisualiserComponent;
     Label cpuUsageLabel {"cpuUsageLabel", "CPU usage:"};
     Label cpuUsage {"cpuUsage", "0.00 %"};
+    Label gainReductionLabel {"gainReductionLabel", "Limiter:"};
+    Label gainReduction {"gainReduction", "0.0 dB"};
+    ToggleButton softClipToggle {"Soft clip"};
+    /** Reads the MIDI input as an MPE lower zone */
+    ToggleButton mpeToggle {"MPE"};
 
     VoiceSynthesiser audioSource;
 
+    /** Records every block leaving getNextAudioBlock() */
+    DiskRecorder recorder;
+
+    /** Plays the component on the audio device, once it is open */
+    AudioSourcePlayer devicePlayer;
+    /** How long the window has to show itself before the device is opened, in milliseconds */
+    const int DEVICE_OPENING_DELAY = 50;
+
+    /**
+     * Open the default audio device shortly after the window has shown. The device manager is only used on the
+     * message thread, so it is opened there, once the first paint is out of the way.
+     */
+    void openAudioDeviceLater();
+
+    /**
+     * Open the default audio device, build the widgets that need audio and start playing on the device
+     */
+    void openAudioDevice();
+
     inline void openAudioSettings();
 
+    inline void openImpulseResponseChooser();
+
+    inline void openTuningMenu();
+
+    inline void openMidiFileChooser();
+
+    inline void openSampleLibraryChooser();
+
+    inline void updateTransport();
+
+    inline void openRecordingChooser();
+
+    inline void updateRecorderStatus();
+
     inline void updateSynthesiserList();
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MainComponent)
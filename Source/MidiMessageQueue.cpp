@@ -0,0 +1,115 @@
+/*
+  ==============================================================================
+
+    MidiMessageQueue.cpp
+
+  ==============================================================================
+*/
+
+#include "MidiMessageQueue.h"
+
+MidiMessageQueue::MidiMessageQueue(int capacity) : fifo(capacity), messages((size_t) capacity) {}
+
+bool MidiMessageQueue::push(const MidiMessage &message) {
+    const int size = message.getRawDataSize();
+    if (size <= 0 || size > 3) {
+        return false;
+    }
+
+    const SpinLock::ScopedLockType lock(this->producerLock);
+    int start1, size1, start2, size2;
+    this->fifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 + size2 == 0) {
+        this->numDroppedMessages.fetch_add(1);
+        return false;
+    }
+    ShortMessage& slot = this->messages[size1 > 0 ? start1 : start2];
+    std::memcpy(slot.data, message.getRawData(), (size_t) size);
+    slot.size = size;
+    this->fifo.finishedWrite(1);
+    return true;
+}
+
+void MidiMessageQueue::popInto(MidiBuffer &destination, int sampleNumber) {
+    const int numReady = this->fifo.getNumReady();
+    if (numReady == 0) {
+        return;
+    }
+    int start1, size1, start2, size2;
+    this->fifo.prepareToRead(numReady, start1, size1, start2, size2);
+    for (int i = 0; i < size1; ++i) {
+        destination.addEvent(this->messages[start1 + i].data, this->messages[start1 + i].size, sampleNumber);
+    }
+    for (int i = 0; i < size2; ++i) {
+        destination.addEvent(this->messages[start2 + i].data, this->messages[start2 + i].size, sampleNumber);
+    }
+    this->fifo.finishedRead(size1 + size2);
+}
+
+int MidiMessageQueue::getNumDroppedMessages() const {
+    return this->numDroppedMessages.load();
+}
+
+#if JUCE_UNIT_TESTS
+
+/**
+ * Fills a small queue past its capacity and around the end of its ring, and checks the messages coming out.
+ */
+class MidiMessageQueueTests : public UnitTest {
+public:
+    MidiMessageQueueTests() : UnitTest("MIDI message queue", "MIDISynth") {}
+
+    void runTest() override {
+        beginTest("Capacity");
+        // The FIFO keeps one slot empty, so a queue of four holds three messages.
+        MidiMessageQueue queue(4);
+        const MidiMessage messages[] {MidiMessage::noteOn(1, 60, (uint8) 100), MidiMessage::controllerEvent(2, 7, 64),
+                                      MidiMessage::programChange(3, 5)};
+        for (const MidiMessage& message : messages) {
+            expect(queue.push(message));
+        }
+        expect(!queue.push(MidiMessage::noteOff(1, 60)), "a full queue accepts a message");
+        expectEquals(queue.getNumDroppedMessages(), 1);
+        const uint8 sysEx[] {0x7e, 0x7f, 0x09, 0x01};
+        expect(!queue.push(MidiMessage::createSysExMessage(sysEx, (int) sizeof(sysEx))),
+               "a long message is queued");
+
+        MidiBuffer buffer;
+        queue.popInto(buffer, 10);
+        expectMessages(buffer, messages, 3, 10);
+
+        beginTest("Wrapping around");
+        for (int round = 0; round < 5; ++round) {
+            const MidiMessage roundMessages[] {MidiMessage::noteOn(1, round, (uint8) 1),
+                                               MidiMessage::noteOff(1, round)};
+            for (const MidiMessage& message : roundMessages) {
+                expect(queue.push(message));
+            }
+            buffer.clear();
+            queue.popInto(buffer, round);
+            expectMessages(buffer, roundMessages, 2, round);
+        }
+        buffer.clear();
+        queue.popInto(buffer, 0);
+        expect(buffer.isEmpty(), "an empty queue pops a message");
+    }
+
+private:
+    void expectMessages(const MidiBuffer& buffer, const MidiMessage* expected, int numExpected, int sampleNumber) {
+        expectEquals(buffer.getNumEvents(), numExpected);
+        MidiBuffer::Iterator iterator(buffer);
+        MidiMessage message;
+        int position;
+        for (int i = 0; i < numExpected && iterator.getNextEvent(message, position); ++i) {
+            expectEquals(position, sampleNumber);
+            expect(message.getRawDataSize() == expected[i].getRawDataSize()
+                   && std::memcmp(message.getRawData(), expected[i].getRawData(),
+                                  (size_t) message.getRawDataSize()) == 0,
+                   "message " + String(i) + " differs");
+        }
+    }
+};
+
+static MidiMessageQueueTests midiMessageQueueTests;
+
+#endif
@@ -0,0 +1,60 @@
+/*
+  ==============================================================================
+
+    MidiMessageQueue.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include <atomic>
+
+/**
+ * A lock-free queue of short MIDI messages going to the audio thread.
+ * Any thread can push messages, the producers are serialised by a spin lock that the audio thread never takes.
+ * The audio thread pops all the queued messages at the beginning of every block.
+ * Only messages of up to three bytes are queued, so the queue never allocates after construction.
+ */
+class MidiMessageQueue {
+public:
+    /**
+     * Allocate the queue.
+     * @param capacity the number of messages the queue can hold
+     */
+    explicit MidiMessageQueue(int capacity = 1024);
+
+    /**
+     * Queue a message. It can be called from any thread except the audio thread.
+     * @param message the message to queue. Messages longer than three bytes are rejected.
+     * @return false if the message is rejected or the queue is full
+     */
+    bool push(const MidiMessage& message);
+
+    /**
+     * Move all the queued messages to a MIDI buffer. It should only be called from the audio thread.
+     * @param destination the buffer the messages are added to
+     * @param sampleNumber the position of the messages in the buffer
+     */
+    void popInto(MidiBuffer& destination, int sampleNumber);
+
+    /**
+     * The number of messages rejected because the queue was full
+     * @return the counter of dropped messages
+     */
+    int getNumDroppedMessages() const;
+
+private:
+    struct ShortMessage {
+        uint8 data[3];
+        int size;
+    };
+
+    AbstractFifo fifo;
+    HeapBlock<ShortMessage> messages;
+    SpinLock producerLock;
+    std::atomic<int> numDroppedMessages {0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidiMessageQueue)
+};
@@ -0,0 +1,455 @@
+/*
+  ==============================================================================
+
+    MidiSequencer.cpp
+
+  ==============================================================================
+*/
+
+#include "MidiSequencer.h"
+#include <algorithm>
+
+constexpr int MidiSequencer::NUM_CHANNELS;
+constexpr int MidiSequencer::MAX_TRANSPORT_EVENTS;
+
+//// ==============================================================================
+//// ChaseState
+//// ==============================================================================
+
+void MidiSequencer::ChaseState::reset() {
+    std::memset(this->noteVelocities, 0, sizeof(this->noteVelocities));
+    std::memset(this->controllers, -1, sizeof(this->controllers));
+    std::memset(this->programs, -1, sizeof(this->programs));
+    for (auto& pitchWheel : this->pitchWheels) {
+        pitchWheel = -1;
+    }
+}
+
+void MidiSequencer::ChaseState::releaseAllNotes() {
+    std::memset(this->noteVelocities, 0, sizeof(this->noteVelocities));
+}
+
+void MidiSequencer::ChaseState::apply(const uint8 *data) {
+    const int channel = data[0] & 0x0f;
+    switch (data[0] & 0xf0) {
+        case 0x80:
+            this->noteVelocities[channel][data[1]] = 0;
+            break;
+        case 0x90:
+            this->noteVelocities[channel][data[1]] = data[2];
+            break;
+        case 0xb0:
+            // All sound off and all notes off release the channel, the other mode messages are not chased.
+            if (data[1] == 120 || data[1] == 123) {
+                std::memset(this->noteVelocities[channel], 0, sizeof(this->noteVelocities[channel]));
+            } else if (data[1] < 120) {
+                this->controllers[channel][data[1]] = (int8) data[2];
+            }
+            break;
+        case 0xc0:
+            this->programs[channel] = (int8) data[1];
+            break;
+        case 0xe0:
+            this->pitchWheels[channel] = (int16) (data[1] | (data[2] << 7));
+            break;
+        default:
+            break;
+    }
+}
+
+//// ==============================================================================
+//// MidiSequencer Class
+//// ==============================================================================
+
+MidiSequencer::MidiSequencer() {
+    this->soundingState.reset();
+    this->chaseState.reset();
+}
+
+void MidiSequencer::prepareToPlay(double sampleRate) {
+    {
+        const ScopedLock lock(this->sourceLock);
+        if (sampleRate == this->currentSampleRate) {
+            return;
+        }
+        this->currentSampleRate = sampleRate;
+    }
+    this->publishTimeline();
+}
+
+bool MidiSequencer::loadFile(const File &file) {
+    FileInputStream stream(file);
+    MidiFile midiFile;
+    if (!stream.openedOk() || !midiFile.readFrom(stream)) {
+        return false;
+    }
+    // The tempo map is applied here, every event gets its time in seconds.
+    midiFile.convertTimestampTicksToSeconds();
+
+    std::vector<SourceEvent> events;
+    for (int track = 0; track < midiFile.getNumTracks(); ++track) {
+        for (const auto* holder : *midiFile.getTrack(track)) {
+            const MidiMessage& message = holder->message;
+            // Only channel messages reach the synthesiser.
+            if (message.isMetaEvent() || message.isSysEx() || message.getRawDataSize() > 3) {
+                continue;
+            }
+            SourceEvent event {message.getTimeStamp(), {0, 0, 0}, (uint8) message.getRawDataSize()};
+            std::memcpy(event.data, message.getRawData(), event.size);
+            events.push_back(event);
+        }
+    }
+    // Note offs go before note ons at the same time, so repeated notes are not cut.
+    std::stable_sort(events.begin(), events.end(), [] (const SourceEvent& a, const SourceEvent& b) {
+        if (a.seconds != b.seconds) {
+            return a.seconds < b.seconds;
+        }
+        const bool aIsNoteOff = (a.data[0] & 0xf0) == 0x80 || ((a.data[0] & 0xf0) == 0x90 && a.data[2] == 0);
+        const bool bIsNoteOff = (b.data[0] & 0xf0) == 0x80 || ((b.data[0] & 0xf0) == 0x90 && b.data[2] == 0);
+        return aIsNoteOff && !bIsNoteOff;
+    });
+
+    {
+        const ScopedLock lock(this->sourceLock);
+        this->sourceEvents = std::move(events);
+        ++this->sourceGeneration;
+    }
+    this->playRequested.store(false);
+    this->positionSeconds.store(0.0);
+    this->publishTimeline();
+    return true;
+}
+
+void MidiSequencer::play() {
+    this->playRequested.store(true);
+}
+
+void MidiSequencer::stop() {
+    this->playRequested.store(false);
+}
+
+void MidiSequencer::seek(double newPositionSeconds) {
+    this->seekRequest.store(jmax(0.0, newPositionSeconds));
+    this->positionSeconds.store(jmax(0.0, newPositionSeconds));
+}
+
+bool MidiSequencer::isPlaying() const {
+    return this->playRequested.load();
+}
+
+double MidiSequencer::getPositionSeconds() const {
+    return this->positionSeconds.load();
+}
+
+double MidiSequencer::getLengthSeconds() const {
+    return this->lengthSeconds.load();
+}
+
+void MidiSequencer::process(MidiBuffer &destination, int startSample, int numSamples) {
+    {
+        const SpinLock::ScopedTryLockType handOverLock(this->timelineLock);
+        if (handOverLock.isLocked() && this->pendingTimeline != nullptr) {
+            const Timeline& newTimeline = *this->pendingTimeline;
+            if (this->timeline != nullptr && this->timeline->sourceGeneration == newTimeline.sourceGeneration) {
+                // Only the sample rate has changed. The events are the same in the same order, so the cursor and
+                // the sounding notes stay valid, and the playhead is converted without going past the next event.
+                this->playhead = (int64) ((double) this->playhead * newTimeline.sampleRate
+                                          / this->timeline->sampleRate);
+                if (this->cursor < (int) newTimeline.events.size()) {
+                    this->playhead = jmin(this->playhead, newTimeline.events[(size_t) this->cursor].samplePosition);
+                }
+            } else {
+                this->releaseSoundingNotes(destination, startSample);
+                this->playing = false;
+                this->cursor = 0;
+                this->playhead = 0;
+            }
+            // The retained array still owns the old timeline, so it is not freed here.
+            this->timeline = this->pendingTimeline;
+            this->pendingTimeline = nullptr;
+        }
+    }
+    if (this->timeline == nullptr) {
+        return;
+    }
+    const Timeline& currentTimeline = *this->timeline;
+
+    const bool shouldPlay = this->playRequested.load();
+    const double seekTarget = this->seekRequest.exchange(-1.0);
+    if (seekTarget >= 0.0 || (shouldPlay && !this->playing)) {
+        if (seekTarget >= 0.0) {
+            this->playhead = jmin(currentTimeline.lengthInSamples,
+                                  (int64) (seekTarget * currentTimeline.sampleRate));
+        }
+        this->playing = shouldPlay;
+        this->locate(destination, startSample, this->playhead);
+    } else if (!shouldPlay && this->playing) {
+        this->releaseSoundingNotes(destination, startSample);
+        this->playing = false;
+    }
+    if (!this->playing) {
+        return;
+    }
+
+    const int64 blockEnd = this->playhead + numSamples;
+    const auto numEvents = (int) currentTimeline.events.size();
+    while (this->cursor < numEvents && currentTimeline.events[(size_t) this->cursor].samplePosition < blockEnd) {
+        const Event& event = currentTimeline.events[(size_t) this->cursor++];
+        destination.addEvent(event.data, event.size, startSample + (int) (event.samplePosition - this->playhead));
+        this->soundingState.apply(event.data);
+    }
+    this->playhead = blockEnd;
+    this->positionSeconds.store((double) this->playhead / currentTimeline.sampleRate);
+
+    if (this->cursor >= numEvents && this->playhead >= currentTimeline.lengthInSamples) {
+        // The end of the file: stop and rewind, the next play starts from the beginning.
+        this->releaseSoundingNotes(destination, startSample + numSamples - 1);
+        this->playing = false;
+        this->playhead = 0;
+        this->cursor = 0;
+        this->playRequested.store(false);
+        this->positionSeconds.store(0.0);
+    }
+}
+
+void MidiSequencer::publishTimeline() {
+    const ScopedLock lock(this->sourceLock);
+    if (this->currentSampleRate <= 0.0) {
+        // The timeline is built when the device is prepared.
+        return;
+    }
+
+    Timeline::Ptr newTimeline = new Timeline();
+    newTimeline->sampleRate = this->currentSampleRate;
+    newTimeline->sourceGeneration = this->sourceGeneration;
+    newTimeline->events.reserve(this->sourceEvents.size());
+    for (const SourceEvent& source : this->sourceEvents) {
+        Event event {(int64) std::llround(source.seconds * this->currentSampleRate), {0, 0, 0}, source.size};
+        std::memcpy(event.data, source.data, sizeof(event.data));
+        newTimeline->events.push_back(event);
+    }
+    newTimeline->lengthInSamples = newTimeline->events.empty() ? 0 : newTimeline->events.back().samplePosition;
+
+    newTimeline->indexInterval = jmax((int64) 1, (int64) (INDEX_INTERVAL_SECONDS * this->currentSampleRate));
+    const auto numEntries = (size_t) (newTimeline->lengthInSamples / newTimeline->indexInterval + 1);
+    newTimeline->indexEvents.resize(numEntries);
+    newTimeline->indexStates.resize(numEntries);
+    ChaseState state;
+    state.reset();
+    size_t eventIndex = 0;
+    for (size_t entry = 0; entry < numEntries; ++entry) {
+        const int64 entryPosition = (int64) entry * newTimeline->indexInterval;
+        while (eventIndex < newTimeline->events.size()
+               && newTimeline->events[eventIndex].samplePosition < entryPosition) {
+            state.apply(newTimeline->events[eventIndex++].data);
+        }
+        newTimeline->indexEvents[entry] = (int) eventIndex;
+        newTimeline->indexStates[entry] = state;
+    }
+    this->lengthSeconds.store((double) newTimeline->lengthInSamples / this->currentSampleRate);
+
+    // A timeline only referenced by this array has been dropped by the audio thread, and cannot come back.
+    for (int i = this->retainedTimelines.size(); --i >= 0;) {
+        if (this->retainedTimelines.getObjectPointerUnchecked(i)->getReferenceCount() == 1) {
+            this->retainedTimelines.remove(i);
+        }
+    }
+    this->retainedTimelines.add(newTimeline);
+
+    const SpinLock::ScopedLockType handOverLock(this->timelineLock);
+    this->pendingTimeline = newTimeline;
+}
+
+void MidiSequencer::locate(MidiBuffer &destination, int sampleNumber, int64 position) {
+    const Timeline& currentTimeline = *this->timeline;
+    this->releaseSoundingNotes(destination, sampleNumber);
+
+    // Start from the closest index entry before the position, then replay at most one interval of events.
+    const auto entry = (size_t) jmin((int64) currentTimeline.indexStates.size() - 1,
+                                     position / currentTimeline.indexInterval);
+    this->chaseState = currentTimeline.indexStates[entry];
+    int eventIndex = currentTimeline.indexEvents[entry];
+    const auto numEvents = (int) currentTimeline.events.size();
+    while (eventIndex < numEvents && currentTimeline.events[(size_t) eventIndex].samplePosition < position) {
+        this->chaseState.apply(currentTimeline.events[(size_t) eventIndex++].data);
+    }
+    this->cursor = eventIndex;
+    this->playhead = position;
+    this->positionSeconds.store((double) position / currentTimeline.sampleRate);
+
+    for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+        const int midiChannel = channel + 1;
+        if (this->chaseState.programs[channel] >= 0) {
+            destination.addEvent(MidiMessage::programChange(midiChannel, this->chaseState.programs[channel]),
+                                 sampleNumber);
+        }
+        for (int controller = 0; controller < 120; ++controller) {
+            if (this->chaseState.controllers[channel][controller] >= 0) {
+                destination.addEvent(MidiMessage::controllerEvent(midiChannel, controller,
+                                                                  this->chaseState.controllers[channel][controller]),
+                                     sampleNumber);
+            }
+        }
+        if (this->chaseState.pitchWheels[channel] >= 0) {
+            destination.addEvent(MidiMessage::pitchWheel(midiChannel, this->chaseState.pitchWheels[channel]),
+                                 sampleNumber);
+        }
+    }
+
+    // The notes held at the position are restarted only if the sequencer is playing.
+    if (!this->playing) {
+        this->chaseState.releaseAllNotes();
+    } else {
+        for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+            for (int note = 0; note < 128; ++note) {
+                const uint8 velocity = this->chaseState.noteVelocities[channel][note];
+                if (velocity > 0) {
+                    destination.addEvent(MidiMessage::noteOn(channel + 1, note, velocity), sampleNumber);
+                }
+            }
+        }
+    }
+    this->soundingState = this->chaseState;
+}
+
+void MidiSequencer::releaseSoundingNotes(MidiBuffer &destination, int sampleNumber) {
+    for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+        for (int note = 0; note < 128; ++note) {
+            if (this->soundingState.noteVelocities[channel][note] > 0) {
+                destination.addEvent(MidiMessage::noteOff(channel + 1, note), sampleNumber);
+            }
+        }
+    }
+    this->soundingState.releaseAllNotes();
+}
+
+#if JUCE_UNIT_TESTS
+
+/**
+ * Plays a short file written to a temporary file, and checks the events chased by a seek and the playhead kept
+ * across a change of sample rate.
+ */
+class MidiSequencerTests : public UnitTest {
+public:
+    MidiSequencerTests() : UnitTest("MIDI sequencer", "MIDISynth") {}
+
+    void runTest() override {
+        const File file = File::createTempFile(".mid");
+        expect(writeFile(file), "the test file cannot be written");
+
+        beginTest("Seek and chase");
+        {
+            MidiSequencer sequencer;
+            MidiBuffer buffer;
+            sequencer.prepareToPlay(1000.0);
+            expect(sequencer.loadFile(file));
+            expectWithinAbsoluteError(sequencer.getLengthSeconds(), 10.0, 1e-9);
+            sequencer.process(buffer, 0, 0);
+
+            sequencer.play();
+            sequencer.seek(5.5);
+            sequencer.process(buffer, 0, 10);
+            // The program and the controller set at the beginning, then both notes held at 5.5 seconds.
+            const MidiMessage expected[] {MidiMessage::programChange(1, 5), MidiMessage::controllerEvent(1, 7, 100),
+                                          MidiMessage::noteOn(1, 60, (uint8) 100),
+                                          MidiMessage::noteOn(1, 64, (uint8) 90)};
+            expectMessages(buffer, expected, 4, 0);
+            expectWithinAbsoluteError(sequencer.getPositionSeconds(), 5.51, 1e-9);
+
+            buffer.clear();
+            sequencer.seek(7.0);
+            sequencer.process(buffer, 0, 10);
+            const MidiMessage afterRelease[] {MidiMessage::noteOff(1, 60), MidiMessage::noteOff(1, 64),
+                                              MidiMessage::programChange(1, 5),
+                                              MidiMessage::controllerEvent(1, 7, 100),
+                                              MidiMessage::noteOn(1, 60, (uint8) 100)};
+            expectMessages(buffer, afterRelease, 5, 0);
+        }
+
+        beginTest("Sample rate change");
+        {
+            MidiSequencer sequencer;
+            MidiBuffer buffer;
+            sequencer.prepareToPlay(1000.0);
+            expect(sequencer.loadFile(file));
+            sequencer.process(buffer, 0, 0);
+            sequencer.play();
+            for (int block = 0; block < 30; ++block) {
+                sequencer.process(buffer, 0, 100);
+            }
+            expectWithinAbsoluteError(sequencer.getPositionSeconds(), 3.0, 1e-9);
+
+            // The playhead keeps its position in seconds, and the held note is not released.
+            sequencer.prepareToPlay(2000.0);
+            buffer.clear();
+            sequencer.process(buffer, 0, 100);
+            expect(buffer.isEmpty(), "the rate change sends events");
+            expectWithinAbsoluteError(sequencer.getPositionSeconds(), 3.05, 1e-9);
+            expect(sequencer.isPlaying());
+
+            // The second note starts at 5 seconds, that is sample 10000 at the new rate.
+            int64 blockStart = 6100;
+            int64 noteOnSample = -1;
+            while (noteOnSample < 0 && blockStart < 20000) {
+                buffer.clear();
+                sequencer.process(buffer, 0, 100);
+                MidiBuffer::Iterator iterator(buffer);
+                MidiMessage message;
+                int position;
+                while (iterator.getNextEvent(message, position)) {
+                    if (message.isNoteOn() && message.getNoteNumber() == 64) {
+                        noteOnSample = blockStart + position;
+                    }
+                }
+                blockStart += 100;
+            }
+            expectEquals(noteOnSample, (int64) 10000);
+        }
+
+        file.deleteFile();
+    }
+
+private:
+    /**
+     * Write one channel at 120 beats per minute: a program, a controller and a note held from 0 to 10 seconds, and a
+     * second note from 5 to 6 seconds.
+     * @param file the file to overwrite
+     * @return true if the file is written
+     */
+    static bool writeFile(const File& file) {
+        const double ticksPerSecond = 1920.0;
+        MidiMessageSequence track;
+        track.addEvent(MidiMessage(MidiMessage::tempoMetaEvent(500000), 0.0));
+        track.addEvent(MidiMessage(MidiMessage::programChange(1, 5), 0.0));
+        track.addEvent(MidiMessage(MidiMessage::controllerEvent(1, 7, 100), 0.0));
+        track.addEvent(MidiMessage(MidiMessage::noteOn(1, 60, (uint8) 100), 0.0));
+        track.addEvent(MidiMessage(MidiMessage::noteOn(1, 64, (uint8) 90), 5.0 * ticksPerSecond));
+        track.addEvent(MidiMessage(MidiMessage::noteOff(1, 64), 6.0 * ticksPerSecond));
+        track.addEvent(MidiMessage(MidiMessage::noteOff(1, 60), 10.0 * ticksPerSecond));
+
+        MidiFile midiFile;
+        midiFile.setTicksPerQuarterNote(960);
+        midiFile.addTrack(track);
+        file.deleteFile();
+        FileOutputStream stream(file);
+        return stream.openedOk() && midiFile.writeTo(stream);
+    }
+
+    void expectMessages(const MidiBuffer& buffer, const MidiMessage* expected, int numExpected, int sampleNumber) {
+        expectEquals(buffer.getNumEvents(), numExpected);
+        MidiBuffer::Iterator iterator(buffer);
+        MidiMessage message;
+        int position;
+        for (int i = 0; i < numExpected && iterator.getNextEvent(message, position); ++i) {
+            expectEquals(position, sampleNumber);
+            expect(message.getRawDataSize() == expected[i].getRawDataSize()
+                   && std::memcmp(message.getRawData(), expected[i].getRawData(),
+                                  (size_t) message.getRawDataSize()) == 0,
+                   "message " + String(i) + " differs");
+        }
+    }
+};
+
+static MidiSequencerTests midiSequencerTests;
+
+#endif
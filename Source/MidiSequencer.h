@@ -0,0 +1,172 @@
+/*
+  ==============================================================================
+
+    MidiSequencer.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include <atomic>
+#include <vector>
+
+/**
+ * Plays Standard MIDI Files with sample accuracy.
+ * All the tracks of a file are merged into one sorted timeline whose positions are converted to samples through the
+ * tempo map when the file is loaded or the sample rate changes, so playing a block only walks a cursor over the
+ * events of that block.
+ * Every couple of seconds the timeline keeps an index entry with the state of every channel at that point: held
+ * notes, controllers, programs and pitch wheels. Seeking starts from the closest entry and replays at most one
+ * interval of events, then chases the state by sending it to the synthesiser.
+ * The transport can be driven from any thread, the audio thread never allocates or waits for a lock.
+ */
+class MidiSequencer {
+public:
+    static constexpr int NUM_CHANNELS = 16;
+
+    /**
+     * The most events process() adds in one block on top of the events of the file: a seek releasing every note,
+     * chasing every program, controller and pitch wheel and restarting every note, then the note offs at the end of
+     * the file.
+     */
+    static constexpr int MAX_TRANSPORT_EVENTS = NUM_CHANNELS * (128 + 1 + 120 + 1 + 128 + 128);
+
+    MidiSequencer();
+
+    /**
+     * Convert the loaded file to the new sample rate. The playhead keeps its position in seconds, and a playing file
+     * goes on playing. It should not be called while the audio thread is rendering.
+     * @param sampleRate the device sample rate
+     */
+    void prepareToPlay(double sampleRate);
+
+    /**
+     * Load a Standard MIDI File. It should be called from the message thread. Playback stops at the beginning.
+     * @param file the .mid file
+     * @return true if the file is loaded
+     */
+    bool loadFile(const File& file);
+
+    void play();
+    void stop();
+
+    /**
+     * Move the playhead. The held notes and the controllers are chased at the new position.
+     * @param positionSeconds the new position in seconds
+     */
+    void seek(double positionSeconds);
+
+    bool isPlaying() const;
+    double getPositionSeconds() const;
+    double getLengthSeconds() const;
+
+    /**
+     * Add the events of the next block to a MIDI buffer. It should only be called from the audio thread.
+     * @param destination the buffer passed to the synthesiser. It should have room for MAX_TRANSPORT_EVENTS events
+     * on top of the events of the file.
+     * @param startSample the position of the block in the buffer
+     * @param numSamples the length of the block
+     */
+    void process(MidiBuffer& destination, int startSample, int numSamples);
+
+private:
+    const double INDEX_INTERVAL_SECONDS = 2.0;
+
+    struct Event {
+        int64 samplePosition;
+        uint8 data[3];
+        uint8 size;
+    };
+
+    struct SourceEvent {
+        double seconds;
+        uint8 data[3];
+        uint8 size;
+    };
+
+    /**
+     * The state of every channel that should be restored after a seek
+     */
+    struct ChaseState {
+        /** 0 if the note is not held */
+        uint8 noteVelocities[NUM_CHANNELS][128];
+        /** -1 if the controller has not been set */
+        int8 controllers[NUM_CHANNELS][128];
+        /** -1 if the program has not been set */
+        int8 programs[NUM_CHANNELS];
+        /** -1 if the pitch wheel has not been moved */
+        int16 pitchWheels[NUM_CHANNELS];
+
+        void reset();
+        void releaseAllNotes();
+        void apply(const uint8* data);
+    };
+
+    /**
+     * The events of a file at one sample rate, with its seek index. It is never modified after being built.
+     */
+    struct Timeline : public ReferenceCountedObject {
+        using Ptr = ReferenceCountedObjectPtr<Timeline>;
+
+        std::vector<Event> events;
+        /** The first event at or after every index position */
+        std::vector<int> indexEvents;
+        /** The state before the first event of every index position */
+        std::vector<ChaseState> indexStates;
+        int64 indexInterval = 1;
+        int64 lengthInSamples = 0;
+        double sampleRate = 44100.0;
+        /** The file the timeline was built from, the timelines of one file only differ by their sample rate */
+        int sourceGeneration = 0;
+    };
+
+    /** Guards the source events and the retained timelines. It is never taken on the audio thread. */
+    CriticalSection sourceLock;
+    std::vector<SourceEvent> sourceEvents;
+    /** Bumped every time a file is loaded */
+    int sourceGeneration = 0;
+    double currentSampleRate = 0.0;
+    /** Every published timeline stays here until the audio thread has dropped it, so it is never freed there. */
+    ReferenceCountedArray<Timeline> retainedTimelines;
+
+    /** Guards the hand-over of a new timeline. The audio thread only tries to take it. */
+    SpinLock timelineLock;
+    Timeline::Ptr pendingTimeline;
+
+    /** The state owned by the audio thread */
+    Timeline::Ptr timeline;
+    int cursor = 0;
+    int64 playhead = 0;
+    bool playing = false;
+    ChaseState soundingState;
+    ChaseState chaseState;
+
+    std::atomic<bool> playRequested {false};
+    std::atomic<double> seekRequest {-1.0};
+    std::atomic<double> positionSeconds {0.0};
+    std::atomic<double> lengthSeconds {0.0};
+
+    /**
+     * Build a timeline from the source events and hand it over to the audio thread.
+     */
+    void publishTimeline();
+
+    /**
+     * Move the cursor to a position and chase the state of every channel.
+     * @param destination the buffer receiving the chased events
+     * @param sampleNumber the position of the chased events in the buffer
+     * @param position the new playhead position in samples
+     */
+    void locate(MidiBuffer& destination, int sampleNumber, int64 position);
+
+    /**
+     * Send a note off for every sounding note.
+     * @param destination the buffer receiving the note offs
+     * @param sampleNumber the position of the note offs in the buffer
+     */
+    void releaseSoundingNotes(MidiBuffer& destination, int sampleNumber);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidiSequencer)
+};
@@ -0,0 +1,203 @@
+/*
+  ==============================================================================
+
+    Modulation.cpp
+
+  ==============================================================================
+*/
+
+#include "Modulation.h"
+
+//// ==============================================================================
+//// Lfo Class
+//// ==============================================================================
+
+Lfo::Lfo(Lfo::Shape shape) : shape(shape) {}
+
+void Lfo::reset() {
+    this->phase = 0.0f;
+}
+
+float Lfo::advance(float frequency, int numSamples, double sampleRate) {
+    this->phase += frequency * (float) numSamples / (float) sampleRate;
+    this->phase -= std::floor(this->phase);
+    switch (this->shape) {
+        case triangle:
+            return this->phase < 0.5f ? 4.0f * this->phase - 1.0f : 3.0f - 4.0f * this->phase;
+        case sawtooth:
+            return 2.0f * this->phase - 1.0f;
+        case square:
+            return this->phase < 0.5f ? 1.0f : -1.0f;
+        case sine:
+        default:
+            return std::sin(MathConstants<float>::twoPi * this->phase);
+    }
+}
+
+//// ==============================================================================
+//// ModulationMatrix Class
+//// ==============================================================================
+
+constexpr int ModulationMatrix::NUM_SLOTS;
+
+StringArray ModulationMatrix::getSourceNames() {
+    return {"LFO 1", "LFO 2", "Envelope", "Velocity", "Mod wheel", "Expression", "Noise", "Drift", "Pressure",
+            "Timbre"};
+}
+
+StringArray ModulationMatrix::getDestinationNames() {
+    return {"Amplitude", "Frequency", "Filter cutoff", "Brightness"};
+}
+
+void ModulationMatrix::setSlot(int slot, int source, int destination, float amount) {
+    jassert(slot >= 0 && slot < NUM_SLOTS);
+    this->slotDestinations[slot].store(jlimit(0, numDestinations - 1, destination));
+    this->slotAmounts[slot].store(jlimit(-1.0f, 1.0f, amount));
+    this->slotSources[slot].store(source >= 0 && source < numSources ? source : -1);
+}
+
+bool ModulationMatrix::isModulated(int destination) const {
+    for (int slot = 0; slot < NUM_SLOTS; ++slot) {
+        if (this->slotSources[slot].load() >= 0 && this->slotDestinations[slot].load() == destination) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ModulationMatrix::evaluate(const float *sources, float *destinations) const {
+    for (int destination = 0; destination < numDestinations; ++destination) {
+        destinations[destination] = 0.0f;
+    }
+    for (int slot = 0; slot < NUM_SLOTS; ++slot) {
+        const int source = this->slotSources[slot].load();
+        if (source >= 0) {
+            destinations[this->slotDestinations[slot].load()] += sources[source] * this->slotAmounts[slot].load();
+        }
+    }
+}
+
+//// ==============================================================================
+//// ModulationMatrixEditor Class
+//// ==============================================================================
+
+ModulationMatrixEditor::ModulationMatrixEditor(ModulationMatrix &matrixToEdit) : matrix(matrixToEdit) {
+    for (int slot = 0; slot < ModulationMatrix::NUM_SLOTS; ++slot) {
+        auto* sourceSelection = this->sourceSelections.add(new ComboBox("sourceSelection"));
+        sourceSelection->addItem("None", 1);
+        sourceSelection->addItemList(ModulationMatrix::getSourceNames(), 2);
+        sourceSelection->setSelectedItemIndex(0, dontSendNotification);
+        sourceSelection->addListener(this);
+        addAndMakeVisible(sourceSelection);
+
+        auto* destinationSelection = this->destinationSelections.add(new ComboBox("destinationSelection"));
+        destinationSelection->addItemList(ModulationMatrix::getDestinationNames(), 1);
+        destinationSelection->setSelectedItemIndex(0, dontSendNotification);
+        destinationSelection->addListener(this);
+        addAndMakeVisible(destinationSelection);
+
+        auto* amountSlider = this->amountSliders.add(
+                new Slider(Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::TextBoxLeft));
+        amountSlider->setRange(-1.0, 1.0);
+        amountSlider->setValue(0.0, dontSendNotification);
+        amountSlider->addListener(this);
+        addAndMakeVisible(amountSlider);
+    }
+}
+
+void ModulationMatrixEditor::comboBoxChanged(ComboBox *comboBoxThatHasChanged) {
+    for (int slot = 0; slot < ModulationMatrix::NUM_SLOTS; ++slot) {
+        if (comboBoxThatHasChanged == this->sourceSelections[slot]
+            || comboBoxThatHasChanged == this->destinationSelections[slot]) {
+            this->updateSlot(slot);
+        }
+    }
+}
+
+void ModulationMatrixEditor::sliderValueChanged(Slider *slider) {
+    const int slot = this->amountSliders.indexOf(slider);
+    if (slot >= 0) {
+        this->updateSlot(slot);
+    }
+}
+
+void ModulationMatrixEditor::resized() {
+    Rectangle<int> globalBound = this->getLocalBounds();
+    for (int slot = 0; slot < ModulationMatrix::NUM_SLOTS; ++slot) {
+        if (slot > 0) {
+            globalBound.removeFromTop(8);
+        }
+        Rectangle<int> row = globalBound.removeFromTop(24);
+        this->sourceSelections[slot]->setBounds(row.removeFromLeft(110));
+        row.removeFromLeft(4);
+        this->destinationSelections[slot]->setBounds(row.removeFromLeft(110));
+        row.removeFromLeft(4);
+        this->amountSliders[slot]->setBounds(row);
+    }
+}
+
+int ModulationMatrixEditor::getIdealHeight() {
+    return ModulationMatrix::NUM_SLOTS * 32 - 8;
+}
+
+void ModulationMatrixEditor::updateSlot(int slot) {
+    // The first item of the source selection is "None".
+    this->matrix.setSlot(slot, this->sourceSelections[slot]->getSelectedItemIndex() - 1,
+                         this->destinationSelections[slot]->getSelectedItemIndex(),
+                         (float) this->amountSliders[slot]->getValue());
+}
+
+//// ==============================================================================
+//// StateVariableFilter Class
+//// ==============================================================================
+
+constexpr int StateVariableFilter::MAX_CHANNELS;
+
+void StateVariableFilter::reset(float cutoff, double sampleRate) {
+    for (int channel = 0; channel < MAX_CHANNELS; ++channel) {
+        this->ic1eq[channel] = 0.0f;
+        this->ic2eq[channel] = 0.0f;
+    }
+    this->computeCoefficients(cutoff, sampleRate, this->a1, this->a2, this->a3);
+}
+
+void StateVariableFilter::process(float *const *channels, int numChannels, int numSamples, float targetCutoff,
+                                  double sampleRate) {
+    jassert(numChannels <= MAX_CHANNELS);
+    float targetA1, targetA2, targetA3;
+    this->computeCoefficients(targetCutoff, sampleRate, targetA1, targetA2, targetA3);
+    const float step1 = (targetA1 - this->a1) / (float) numSamples;
+    const float step2 = (targetA2 - this->a2) / (float) numSamples;
+    const float step3 = (targetA3 - this->a3) / (float) numSamples;
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+        float* samples = channels[channel];
+        float a1 = this->a1, a2 = this->a2, a3 = this->a3;
+        float ic1 = this->ic1eq[channel], ic2 = this->ic2eq[channel];
+        for (int i = 0; i < numSamples; ++i) {
+            a1 += step1;
+            a2 += step2;
+            a3 += step3;
+            const float v3 = samples[i] - ic2;
+            const float v1 = a1 * ic1 + a2 * v3;
+            const float v2 = ic2 + a2 * ic1 + a3 * v3;
+            ic1 = 2.0f * v1 - ic1;
+            ic2 = 2.0f * v2 - ic2;
+            samples[i] = v2;
+        }
+        this->ic1eq[channel] = ic1;
+        this->ic2eq[channel] = ic2;
+    }
+    // Avoid drifting away from the exact coefficients.
+    this->a1 = targetA1;
+    this->a2 = targetA2;
+    this->a3 = targetA3;
+}
+
+void StateVariableFilter::computeCoefficients(float cutoff, double sampleRate,
+                                              float &newA1, float &newA2, float &newA3) const {
+    const float g = std::tan(MathConstants<float>::pi * cutoff / (float) sampleRate);
+    newA1 = 1.0f / (1.0f + g * (g + DAMPING));
+    newA2 = g * newA1;
+    newA3 = g * newA2;
+}
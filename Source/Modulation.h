@@ -0,0 +1,190 @@
+/*
+  ==============================================================================
+
+    Modulation.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include <atomic>
+
+/**
+ * A low frequency oscillator evaluated at the control rate.
+ * It returns one value per control block, the voice interpolates between them.
+ */
+class Lfo {
+public:
+    enum Shape {
+        sine = 0,
+        triangle,
+        sawtooth,
+        square
+    };
+
+    explicit Lfo(Shape shape = sine);
+
+    /**
+     * Restart the oscillator at the beginning of its cycle.
+     */
+    void reset();
+
+    /**
+     * Move the oscillator forward by one control block.
+     * @param frequency the frequency of the oscillator in Hz
+     * @param numSamples the length of the control block
+     * @param sampleRate the sample rate of the voice
+     * @return the value at the end of the block, between -1 and 1
+     */
+    float advance(float frequency, int numSamples, double sampleRate);
+
+private:
+    Shape shape;
+    float phase = 0.0f;
+};
+
+/**
+ * Routes the modulation sources of a voice to its destinations.
+ * Every slot connects one source to one destination with an amount between -1 and 1.
+ * The slots can be edited from any thread, the voice evaluates the matrix once per control block.
+ */
+class ModulationMatrix {
+public:
+    enum Source {
+        lfo1Source = 0,
+        lfo2Source,
+        envelopeSource,
+        velocitySource,
+        modWheelSource,
+        expressionSource,
+        noiseSource,
+        driftSource,
+        pressureSource,
+        timbreSource,
+        numSources
+    };
+
+    enum Destination {
+        amplitudeDestination = 0,
+        frequencyDestination,
+        filterCutoffDestination,
+        brightnessDestination,
+        numDestinations
+    };
+
+    static constexpr int NUM_SLOTS = 3;
+
+    /**
+     * The names of the sources, in the order of the Source enumeration
+     * @return the source names
+     */
+    static StringArray getSourceNames();
+
+    /**
+     * The names of the destinations, in the order of the Destination enumeration
+     * @return the destination names
+     */
+    static StringArray getDestinationNames();
+
+    /**
+     * Set a slot of the matrix. It can be called from any thread.
+     * @param slot the index of the slot
+     * @param source the Source to read, or -1 to disable the slot
+     * @param destination the Destination to modulate
+     * @param amount the amount between -1 and 1
+     */
+    void setSlot(int slot, int source, int destination, float amount);
+
+    /**
+     * Whether any enabled slot modulates a destination
+     * @param destination the Destination to check
+     * @return true if the destination is modulated
+     */
+    bool isModulated(int destination) const;
+
+    /**
+     * Sum the modulation of every destination.
+     * @param sources the current value of every source
+     * @param destinations the sum of the modulation of every destination. It is overwritten.
+     */
+    void evaluate(const float* sources, float* destinations) const;
+
+private:
+    std::atomic<int> slotSources[NUM_SLOTS] {{-1}, {-1}, {-1}};
+    std::atomic<int> slotDestinations[NUM_SLOTS] {{0}, {0}, {0}};
+    std::atomic<float> slotAmounts[NUM_SLOTS] {{0.0f}, {0.0f}, {0.0f}};
+};
+
+/**
+ * The editor of a modulation matrix: a source, a destination and an amount for every slot.
+ */
+class ModulationMatrixEditor : public Component, public ComboBox::Listener, public Slider::Listener {
+public:
+    /**
+     * Create the editor. The matrix should outlive the editor.
+     * @param matrixToEdit the modulation matrix to edit
+     */
+    explicit ModulationMatrixEditor(ModulationMatrix& matrixToEdit);
+
+    void comboBoxChanged(ComboBox *comboBoxThatHasChanged) override;
+    void sliderValueChanged(Slider *slider) override;
+    void resized() override;
+
+    /**
+     * The height needed to show all the slots
+     * @return the height in pixels
+     */
+    static int getIdealHeight();
+
+private:
+    ModulationMatrix& matrix;
+    OwnedArray<ComboBox> sourceSelections;
+    OwnedArray<ComboBox> destinationSelections;
+    OwnedArray<Slider> amountSliders;
+
+    void updateSlot(int slot);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ModulationMatrixEditor)
+};
+
+/**
+ * A state variable low pass filter in the topology preserving transform form.
+ * It stays stable while its cutoff is modulated. The coefficients are computed once per control block and
+ * linearly interpolated in between, so modulating the cutoff costs one tan() per control block.
+ */
+class StateVariableFilter {
+public:
+    /** The channels share the coefficients, so a stereo voice computes them once */
+    static constexpr int MAX_CHANNELS = 2;
+
+    /**
+     * Clear the state of the filter and jump to a cutoff frequency.
+     * @param cutoff the cutoff frequency in Hz
+     * @param sampleRate the sample rate of the filter
+     */
+    void reset(float cutoff, double sampleRate);
+
+    /**
+     * Filter a block in place, moving the cutoff linearly to a new value.
+     * @param channels the samples of every channel to filter
+     * @param numChannels the number of channels, at most MAX_CHANNELS
+     * @param numSamples the number of samples
+     * @param targetCutoff the cutoff frequency at the end of the block in Hz
+     * @param sampleRate the sample rate of the filter
+     */
+    void process(float* const* channels, int numChannels, int numSamples, float targetCutoff, double sampleRate);
+
+private:
+    /** The damping of a Butterworth response */
+    const float DAMPING = MathConstants<float>::sqrt2;
+
+    float a1 = 1.0f;
+    float a2 = 0.0f;
+    float a3 = 0.0f;
+    float ic1eq[MAX_CHANNELS] {};
+    float ic2eq[MAX_CHANNELS] {};
+
+    void computeCoefficients(float cutoff, double sampleRate, float& newA1, float& newA2, float& newA3) const;
+};
@@ -0,0 +1,187 @@
+/*
+  ==============================================================================
+
+    Noise.cpp
+
+  ==============================================================================
+*/
+
+#include "Noise.h"
+
+//// ==============================================================================
+//// NoiseGenerator Class
+//// ==============================================================================
+
+NoiseGenerator::NoiseGenerator(uint32 seed) {
+    this->setSeed(seed);
+}
+
+void NoiseGenerator::setSeed(uint32 newSeed) {
+    this->key = hash(newSeed ^ 0x9e3779b9u);
+    this->counter = 0;
+}
+
+void NoiseGenerator::fillUniform(float *destination, int numValues) {
+    // The top 24 bits fit in the mantissa of a float.
+    DspKernels::get().fillNoise(destination, numValues, this->key, this->counter, 1.0f / 16777216.0f, 0.0f);
+    this->counter += (uint32) numValues;
+}
+
+void NoiseGenerator::fillWhite(float *destination, int numSamples) {
+    DspKernels::get().fillNoise(destination, numSamples, this->key, this->counter, 2.0f / 16777216.0f, -1.0f);
+    this->counter += (uint32) numSamples;
+}
+
+float NoiseGenerator::nextWhite() {
+    // A single value is not worth the call through the kernel table.
+    return (float) (int32) (hash(this->counter++, this->key) >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+//// ==============================================================================
+//// NoiseOscillator Class
+//// ==============================================================================
+
+const NoiseOscillator::Patch NoiseOscillator::PATCHES[] {
+    {"White", false, 0.0f, 0.0f},
+    {"Pink", true, 0.0f, 0.0f},
+    {"Wind", false, 30.0f, 0.0f},
+    {"Breath", true, 4.0f, 0.0f},
+    {"Snare", false, 0.7f, 0.25f},
+    {"Hi-hat", false, 2.0f, 0.08f}
+};
+
+const int NoiseOscillator::NUM_PATCHES = numElementsInArray(NoiseOscillator::PATCHES);
+
+StringArray NoiseOscillator::getPatchNames() {
+    StringArray names;
+    for (const Patch& patchToName : PATCHES) {
+        names.add(patchToName.name);
+    }
+    return names;
+}
+
+void NoiseOscillator::startNote(int patchIndex) {
+    this->patch = &PATCHES[jlimit(0, NUM_PATCHES - 1, patchIndex)];
+    for (float& state : this->pinkStates) {
+        state = 0.0f;
+    }
+    this->ic1eq = 0.0f;
+    this->ic2eq = 0.0f;
+    this->level = 1.0f;
+}
+
+bool NoiseOscillator::render(float *destination, int numSamples, NoiseGenerator &generator, float centreFrequency,
+                             float brightness, double sampleRate) {
+    generator.fillWhite(destination, numSamples);
+    if (this->patch == nullptr) {
+        FloatVectorOperations::clear(destination, numSamples);
+        return false;
+    }
+
+    if (this->patch->pink) {
+        // Seven one pole filters whose sum falls at 3 dB per octave.
+        float* b = this->pinkStates;
+        for (int i = 0; i < numSamples; ++i) {
+            const float white = destination[i];
+            b[0] = 0.99886f * b[0] + white * 0.0555179f;
+            b[1] = 0.99332f * b[1] + white * 0.0750759f;
+            b[2] = 0.96900f * b[2] + white * 0.1538520f;
+            b[3] = 0.86650f * b[3] + white * 0.3104856f;
+            b[4] = 0.55000f * b[4] + white * 0.5329522f;
+            b[5] = -0.7616f * b[5] - white * 0.0168980f;
+            destination[i] = 0.11f * (b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + white * 0.5362f);
+            b[6] = white * 0.115926f;
+        }
+    }
+
+    if (this->patch->bandQuality > 0.0f) {
+        const float quality = this->patch->bandQuality * std::exp2(-2.0f * brightness);
+        const float centre = jlimit(20.0f, 0.45f * (float) sampleRate, centreFrequency);
+        const float g = std::tan(MathConstants<float>::pi * centre / (float) sampleRate);
+        const float k = 1.0f / quality;
+        const float a1 = 1.0f / (1.0f + g * (g + k));
+        const float a2 = g * a1;
+        // The band output v1 peaks at 1 / k, so k * v1 has a unity peak. White noise keeps exactly k * a2 of its
+        // power through k * v1, so the narrow bands are scaled back to the loudness of the full band, by 18 dB at most.
+        const float gain = k * jmin(8.0f, 1.0f / std::sqrt(k * a2));
+        for (int i = 0; i < numSamples; ++i) {
+            const float v3 = destination[i] - this->ic2eq;
+            const float v1 = a1 * this->ic1eq + a2 * v3;
+            const float v2 = this->ic2eq + g * v1;
+            this->ic1eq = 2.0f * v1 - this->ic1eq;
+            this->ic2eq = 2.0f * v2 - this->ic2eq;
+            destination[i] = gain * v1;
+        }
+    }
+
+    if (this->patch->decayTime > 0.0f) {
+        const float target = this->level * std::exp(-6.9f * (float) numSamples
+                                                    / (this->patch->decayTime * (float) sampleRate));
+        const float step = (target - this->level) / (float) numSamples;
+        for (int i = 0; i < numSamples; ++i) {
+            this->level += step;
+            destination[i] *= this->level;
+        }
+        this->level = target;
+        return this->level > SILENCE_LEVEL;
+    }
+    return true;
+}
+
+//// ==============================================================================
+//// NoiseRenderer Class
+//// ==============================================================================
+
+bool NoiseRenderer::startNote(const Note &note, NoiseGenerator &noise) {
+    this->oscillator.startNote(note.patchIndex);
+    return true;
+}
+
+bool NoiseRenderer::render(float *const *destinations, int numSamples, const ControlBlock &control,
+                           NoiseGenerator &noise) {
+    const float centreFrequency = control.angleDelta * (float) control.sampleRate / MathConstants<float>::twoPi;
+    return this->oscillator.render(destinations[0], numSamples, noise, centreFrequency, control.brightness,
+                                   control.sampleRate);
+}
+
+#if JUCE_UNIT_TESTS
+
+/**
+ * Checks that a key gives a sequence of its own rather than a shifted copy of the sequence of another key, as the
+ * hash of key + counter did, and that the single values follow the blocks.
+ */
+class NoiseGeneratorTests : public UnitTest {
+public:
+    NoiseGeneratorTests() : UnitTest("Noise generator", "MIDISynth") {}
+
+    void runTest() override {
+        const int numValues = 256;
+        const uint32 shift = 1000;
+
+        beginTest("A key is not a shift of the counter");
+        HeapBlock<float> shiftedCounter(numValues), shiftedKey(numValues);
+        for (uint32 key : {1u, 0x9e3779b9u, 0xfffffff0u}) {
+            DspKernels::get().fillNoise(shiftedCounter, numValues, key, shift, 1.0f / 16777216.0f, 0.0f);
+            DspKernels::get().fillNoise(shiftedKey, numValues, key + shift, 0, 1.0f / 16777216.0f, 0.0f);
+            int numEqualValues = 0;
+            for (int i = 0; i < numValues; ++i) {
+                numEqualValues += shiftedCounter[i] == shiftedKey[i] ? 1 : 0;
+            }
+            expectLessThan(numEqualValues, 2);
+        }
+
+        beginTest("The blocks and the single values follow the same sequence");
+        NoiseGenerator blocks(3), singles(3);
+        HeapBlock<float> blockValues(64);
+        blocks.fillWhite(blockValues, 64);
+        int numDifferences = 0;
+        for (int i = 0; i < 64; ++i) {
+            numDifferences += blockValues[i] != singles.nextWhite() ? 1 : 0;
+        }
+        expectEquals(numDifferences, 0);
+    }
+};
+
+static NoiseGeneratorTests noiseGeneratorTests;
+
+#endif
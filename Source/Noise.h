@@ -0,0 +1,151 @@
+/*
+  ==============================================================================
+
+    Noise.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DspKernels.h"
+#include "VoiceRenderer.h"
+
+/**
+ * A counter-based pseudo random generator.
+ * Every value is a hash of the seed and of its position in the sequence, so no value depends on the previous one.
+ * The blocks are filled by the noise kernel of DspKernels, vectorised for the processor, and the same seed always
+ * gives the same sequence on every processor, so an offline render is reproducible.
+ */
+class NoiseGenerator {
+public:
+    explicit NoiseGenerator(uint32 seed = 1);
+
+    /**
+     * Restart the sequence of a seed
+     * @param newSeed the seed, every seed gives a different sequence
+     */
+    void setSeed(uint32 newSeed);
+
+    /**
+     * Fill a block with uniform values and advance the sequence
+     * @param destination the values to overwrite, between 0 and 1
+     * @param numValues the number of values
+     */
+    void fillUniform(float* destination, int numValues);
+
+    /**
+     * Fill a block with white noise and advance the sequence
+     * @param destination the samples to overwrite, between -1 and 1
+     * @param numSamples the number of samples
+     */
+    void fillWhite(float* destination, int numSamples);
+
+    /**
+     * Get the next value of the sequence
+     * @return a white noise sample between -1 and 1
+     */
+    float nextWhite();
+
+private:
+    uint32 key = 0;
+    uint32 counter = 0;
+
+    /**
+     * Mix the bits of a 32 bit integer, so that consecutive inputs give unrelated outputs
+     * @param value the input
+     * @return the hash of the input
+     */
+    static inline uint32 hash(uint32 value) {
+        mixBits(value);
+        return value;
+    }
+
+    /**
+     * Hash a counter under the key of a sequence, as the noise kernel does
+     * @param value the counter
+     * @param sequenceKey the key of the sequence
+     * @return the hash of the counter
+     */
+    static inline uint32 hash(uint32 value, uint32 sequenceKey) {
+        mixBits(value, sequenceKey);
+        return value;
+    }
+};
+
+/**
+ * The oscillator of the "Noise" voice type: white or pink noise, optionally through a band pass centred on the note.
+ * The narrow band patches sound pitched, like wind, and the decaying patches are percussive.
+ */
+class NoiseOscillator {
+public:
+    /**
+     * The names of the built-in patches
+     * @return the patch names, in the order of their indices
+     */
+    static StringArray getPatchNames();
+
+    /**
+     * Restart the filters of a patch. It does not allocate, so it can be called from the audio thread.
+     * @param patchIndex the index of the patch in getPatchNames()
+     */
+    void startNote(int patchIndex);
+
+    /**
+     * Render a block of noise
+     * @param destination the samples to overwrite
+     * @param numSamples the number of samples
+     * @param generator the generator of the voice
+     * @param centreFrequency the centre of the band pass in Hz, i.e. the frequency of the note
+     * @param brightness from -1 to 1, widening the band pass as it goes up
+     * @param sampleRate the sample rate
+     * @return false once a decaying patch has decayed to silence
+     */
+    bool render(float* destination, int numSamples, NoiseGenerator& generator, float centreFrequency,
+                float brightness, double sampleRate);
+
+private:
+    /**
+     * A patch: the colour of the noise, the band pass and the decay
+     */
+    struct Patch {
+        const char* name;
+        bool pink;
+        /** The quality factor of the band pass, 0 for no band pass */
+        float bandQuality;
+        /** The time to decay by 60 dB in seconds, 0 for a sustained patch */
+        float decayTime;
+    };
+
+    static const Patch PATCHES[];
+    static const int NUM_PATCHES;
+
+    const float SILENCE_LEVEL = 1.0e-5f;
+
+    const Patch* patch = nullptr;
+    /** The states of the pink noise filter of Paul Kellet */
+    float pinkStates[7] {};
+    /** The states of the band pass, a state variable filter */
+    float ic1eq = 0.0f;
+    float ic2eq = 0.0f;
+    float level = 1.0f;
+};
+
+/**
+ * The renderer of the "Noise" voice type, which plays white, pink or band passed noise centred on the note.
+ * It draws from the noise generator of the voice, so a seeded voice renders the same noise again.
+ */
+class NoiseRenderer : public VoiceRenderer {
+public:
+    NoiseRenderer() = default;
+
+    bool startNote(const Note& note, NoiseGenerator& noise) override;
+    bool render(float* const* destinations, int numSamples, const ControlBlock& control,
+                NoiseGenerator& noise) override;
+
+private:
+    NoiseOscillator oscillator;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (NoiseRenderer)
+};
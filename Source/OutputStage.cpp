@@ -0,0 +1,345 @@
+/*
+  ==============================================================================
+
+    OutputStage.cpp
+
+  ==============================================================================
+*/
+
+#include "OutputStage.h"
+
+//// ==============================================================================
+//// LookaheadLimiter Class
+//// ==============================================================================
+
+constexpr int LookaheadLimiter::NUM_PHASES;
+constexpr int LookaheadLimiter::NUM_TAPS;
+constexpr int LookaheadLimiter::DETECTOR_DELAY;
+constexpr float LookaheadLimiter::LOOKAHEAD_SECONDS;
+constexpr int LookaheadLimiter::PARAMETER_SLICE;
+
+void LookaheadLimiter::prepareToPlay(int maximumBlockSize, double sampleRate, int numChannels) {
+    this->maxBlockSize = maximumBlockSize;
+    this->numPreparedChannels = numChannels;
+    this->currentSampleRate = sampleRate;
+    this->lookahead = jmax(1, roundToInt(LOOKAHEAD_SECONDS * sampleRate));
+    // The box filter aligns its output with the oldest sample of the window, and the detector lags the input.
+    this->delayLength = this->lookahead - 1 + DETECTOR_DELAY;
+
+    // Windowed sinc interpolating the points at 1/4, 2/4 and 3/4 between the two samples around the detector delay.
+    for (int phase = 1; phase < NUM_PHASES; ++phase) {
+        const float fraction = (float) phase / (float) NUM_PHASES;
+        float sum = 0.0f;
+        for (int tap = 0; tap < NUM_TAPS; ++tap) {
+            const float distance = (float) DETECTOR_DELAY - fraction - (float) tap;
+            const float sinc = distance == 0.0f ? 1.0f
+                    : std::sin(MathConstants<float>::pi * distance) / (MathConstants<float>::pi * distance);
+            const float window = 0.5f + 0.5f * std::cos(MathConstants<float>::pi * distance / (float) DETECTOR_DELAY);
+            this->interpolator[phase - 1][tap] = sinc * window;
+            sum += sinc * window;
+        }
+        for (float& coefficient : this->interpolator[phase - 1]) {
+            coefficient /= sum;
+        }
+    }
+
+    this->detectorInput.setSize(numChannels, NUM_TAPS - 1 + maximumBlockSize);
+    this->delayLine.setSize(numChannels, this->delayLength + maximumBlockSize);
+    this->peaks.calloc((size_t) maximumBlockSize);
+    this->interpolated.calloc((size_t) maximumBlockSize);
+    this->gains.calloc((size_t) maximumBlockSize);
+    this->queueValues.calloc((size_t) this->lookahead + 1);
+    this->queueIndices.calloc((size_t) this->lookahead + 1);
+    this->boxHistory.calloc((size_t) this->lookahead);
+    this->updateReleaseCoefficient();
+    this->reset();
+}
+
+void LookaheadLimiter::reset() {
+    this->detectorInput.clear();
+    this->delayLine.clear();
+    this->queueHead = 0;
+    this->queueSize = 0;
+    this->sampleCounter = 0;
+    for (int i = 0; i < this->lookahead; ++i) {
+        this->boxHistory[i] = 1.0f;
+    }
+    this->boxPosition = 0;
+    this->boxSum = this->lookahead;
+    this->currentGain = 1.0f;
+    this->minimumGain = 1.0f;
+    this->ceiling = this->targetCeiling;
+}
+
+void LookaheadLimiter::process(AudioBuffer<float> &buffer, int startSample, int numSamples) {
+    jassert(numSamples <= this->maxBlockSize);
+    const int numChannels = jmin(buffer.getNumChannels(), this->numPreparedChannels);
+    if (numChannels == 0 || numSamples <= 0) {
+        return;
+    }
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+        FloatVectorOperations::copy(this->detectorInput.getWritePointer(channel, NUM_TAPS - 1),
+                                    buffer.getReadPointer(channel, startSample), numSamples);
+    }
+    this->detectPeaks(numSamples);
+    this->computeGains(numSamples);
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+        float* line = this->delayLine.getWritePointer(channel);
+        float* samples = buffer.getWritePointer(channel, startSample);
+        FloatVectorOperations::copy(line + this->delayLength, samples, numSamples);
+        DspKernels::get().multiply(samples, line, this->gains, numSamples);
+        // Keep the newest samples as the history of the next block.
+        std::memmove(line, line + numSamples, sizeof(float) * (size_t) this->delayLength);
+
+        float* history = this->detectorInput.getWritePointer(channel);
+        std::memmove(history, history + numSamples, sizeof(float) * (NUM_TAPS - 1));
+    }
+}
+
+void LookaheadLimiter::setCeilingDecibels(float newCeilingDecibels) {
+    this->targetCeiling = Decibels::decibelsToGain(newCeilingDecibels);
+}
+
+void LookaheadLimiter::setReleaseTime(float newReleaseSeconds) {
+    this->releaseSeconds = jmax(0.001f, newReleaseSeconds);
+    this->updateReleaseCoefficient();
+}
+
+int LookaheadLimiter::getLatencyInSamples() const {
+    return this->delayLength;
+}
+
+float LookaheadLimiter::getMinimumGain() const {
+    return this->minimumGain;
+}
+
+void LookaheadLimiter::updateReleaseCoefficient() {
+    this->releaseCoefficient = 1.0f - std::exp(-1.0f / (this->releaseSeconds * (float) this->currentSampleRate));
+}
+
+void LookaheadLimiter::detectPeaks(int numSamples) {
+    const int numChannels = this->detectorInput.getNumChannels();
+    FloatVectorOperations::clear(this->peaks, numSamples);
+    for (int channel = 0; channel < numChannels; ++channel) {
+        // The newest sample of the block is at index NUM_TAPS - 1 + i.
+        const float* newest = this->detectorInput.getReadPointer(channel, NUM_TAPS - 1);
+        // The sample points on both sides of the interpolated interval.
+        FloatVectorOperations::abs(this->interpolated, newest - DETECTOR_DELAY, numSamples);
+        FloatVectorOperations::max(this->peaks, this->peaks, this->interpolated, numSamples);
+        FloatVectorOperations::abs(this->interpolated, newest - DETECTOR_DELAY + 1, numSamples);
+        FloatVectorOperations::max(this->peaks, this->peaks, this->interpolated, numSamples);
+        for (auto& coefficients : this->interpolator) {
+            FloatVectorOperations::clear(this->interpolated, numSamples);
+            for (int tap = 0; tap < NUM_TAPS; ++tap) {
+                FloatVectorOperations::addWithMultiply(this->interpolated, newest - tap, coefficients[tap], numSamples);
+            }
+            FloatVectorOperations::abs(this->interpolated, this->interpolated, numSamples);
+            FloatVectorOperations::max(this->peaks, this->peaks, this->interpolated, numSamples);
+        }
+    }
+}
+
+void LookaheadLimiter::computeGains(int numSamples) {
+    const auto numSlices = (float) ((numSamples + PARAMETER_SLICE - 1) / PARAMETER_SLICE);
+    const float ceilingStep = (this->targetCeiling - this->ceiling) / numSlices;
+    for (int offset = 0; offset < numSamples; offset += PARAMETER_SLICE) {
+        const int sliceLength = jmin(PARAMETER_SLICE, numSamples - offset);
+        this->ceiling += ceilingStep;
+        const float limit = this->ceiling;
+        FloatVectorOperations::max(this->peaks + offset, this->peaks + offset, limit, sliceLength);
+        for (int i = offset; i < offset + sliceLength; ++i) {
+            this->gains[i] = limit / this->peaks[i];
+        }
+    }
+    this->ceiling = this->targetCeiling;
+
+    const int capacity = this->lookahead + 1;
+    float blockMinimum = 1.0f;
+    for (int i = 0; i < numSamples; ++i) {
+        const float target = this->gains[i];
+        const int64 index = this->sampleCounter++;
+
+        // Sliding minimum over the last lookahead targets.
+        while (this->queueSize > 0) {
+            const int back = (this->queueHead + this->queueSize - 1) % capacity;
+            if (this->queueValues[back] < target) {
+                break;
+            }
+            --this->queueSize;
+        }
+        const int slot = (this->queueHead + this->queueSize) % capacity;
+        this->queueValues[slot] = target;
+        this->queueIndices[slot] = index;
+        ++this->queueSize;
+        if (this->queueIndices[this->queueHead] <= index - this->lookahead) {
+            this->queueHead = (this->queueHead + 1) % capacity;
+            --this->queueSize;
+        }
+        const float held = this->queueValues[this->queueHead];
+
+        // Box filter of the same length, so the gain ramps down over the whole lookahead.
+        this->boxSum += held - this->boxHistory[this->boxPosition];
+        this->boxHistory[this->boxPosition] = held;
+        if (++this->boxPosition == this->lookahead) {
+            this->boxPosition = 0;
+        }
+        const auto smoothed = jmin(1.0f, (float) (this->boxSum / this->lookahead));
+
+        // Attack is handled by the lookahead, only the release is smoothed.
+        if (smoothed < this->currentGain) {
+            this->currentGain = smoothed;
+        } else {
+            this->currentGain += (smoothed - this->currentGain) * this->releaseCoefficient;
+        }
+        this->gains[i] = this->currentGain;
+        blockMinimum = jmin(blockMinimum, this->currentGain);
+    }
+    this->minimumGain = blockMinimum;
+}
+
+//// ==============================================================================
+//// OutputStage Class
+//// ==============================================================================
+
+void OutputStage::prepareToPlay(int samplesPerBlockExpected, double sampleRate, int numChannels) {
+    this->maxBlockSize = samplesPerBlockExpected;
+    this->numPreparedChannels = numChannels;
+    this->limiter.setCeilingDecibels(this->ceilingDecibels.load());
+    this->limiter.prepareToPlay(samplesPerBlockExpected, sampleRate, numChannels);
+    this->oversampler = std::make_unique<dsp::Oversampling<float>>(
+            (size_t) numChannels, 1, dsp::Oversampling<float>::filterHalfBandPolyphaseIIR, false);
+    this->oversampler->initProcessing((size_t) samplesPerBlockExpected);
+    this->wasClipping = false;
+    this->gainReductionDecibels.store(0.0f);
+}
+
+void OutputStage::releaseResources() {
+    this->oversampler.reset();
+}
+
+void OutputStage::process(AudioBuffer<float> &buffer, int startSample, int numSamples) {
+    const int numChannels = jmin(buffer.getNumChannels(), this->numPreparedChannels);
+    if (this->oversampler == nullptr || numChannels == 0) {
+        return;
+    }
+    this->limiter.setCeilingDecibels(this->ceilingDecibels.load());
+    const bool shouldClip = this->softClipEnabled.load();
+    if (shouldClip && !this->wasClipping) {
+        // The filters start again from silence rather than from the block they last saw.
+        this->oversampler->reset();
+    }
+    this->wasClipping = shouldClip;
+
+    float minimumGain = 1.0f;
+    for (int offset = 0; offset < numSamples; offset += this->maxBlockSize) {
+        const int numToProcess = jmin(this->maxBlockSize, numSamples - offset);
+        if (shouldClip) {
+            dsp::AudioBlock<float> block(buffer.getArrayOfWritePointers(), (size_t) numChannels,
+                                         (size_t) (startSample + offset), (size_t) numToProcess);
+            dsp::AudioBlock<float> oversampled = this->oversampler->processSamplesUp(block);
+            for (size_t channel = 0; channel < oversampled.getNumChannels(); ++channel) {
+                float* samples = oversampled.getChannelPointer(channel);
+                const auto numOversampled = (int) oversampled.getNumSamples();
+                // The rational tanh approximation is only accurate inside this range.
+                FloatVectorOperations::clip(samples, samples, -SOFT_CLIP_RANGE, SOFT_CLIP_RANGE, numOversampled);
+                DspKernels::get().softClip(samples, numOversampled);
+            }
+            this->oversampler->processSamplesDown(block);
+        }
+
+        this->limiter.process(buffer, startSample + offset, numToProcess);
+        minimumGain = jmin(minimumGain, this->limiter.getMinimumGain());
+    }
+    this->gainReductionDecibels.store(-Decibels::gainToDecibels(minimumGain));
+}
+
+void OutputStage::setSoftClipEnabled(bool shouldBeEnabled) {
+    this->softClipEnabled.store(shouldBeEnabled);
+}
+
+bool OutputStage::isSoftClipEnabled() const {
+    return this->softClipEnabled.load();
+}
+
+void OutputStage::setCeilingDecibels(float newCeilingDecibels) {
+    this->ceilingDecibels.store(jmin(0.0f, newCeilingDecibels));
+}
+
+float OutputStage::getGainReductionDecibels() const {
+    return this->gainReductionDecibels.load();
+}
+
+int OutputStage::getLatencyInSamples() const {
+    const int oversamplerLatency = this->oversampler != nullptr && this->softClipEnabled.load()
+            ? (int) std::ceil(this->oversampler->getLatencyInSamples()) : 0;
+    return this->limiter.getLatencyInSamples() + oversamplerLatency;
+}
+
+#if JUCE_UNIT_TESTS
+
+/**
+ * Drives the limiter with loud noise and checks every output sample against the ceiling, and checks that a quiet
+ * signal only comes out delayed by the latency.
+ */
+class LookaheadLimiterTests : public UnitTest {
+public:
+    LookaheadLimiterTests() : UnitTest("Lookahead limiter", "MIDISynth") {}
+
+    void runTest() override {
+        const double sampleRate = 48000.0;
+        const int blockSize = 256;
+        const int numBlocks = 200;
+
+        for (float ceilingDecibels : {-1.0f, -6.0f}) {
+            beginTest("Ceiling of " + String(ceilingDecibels) + " dB");
+            LookaheadLimiter limiter;
+            limiter.setCeilingDecibels(ceilingDecibels);
+            limiter.prepareToPlay(blockSize, sampleRate, 2);
+            const float ceiling = Decibels::decibelsToGain(ceilingDecibels);
+            Random random(3);
+            AudioBuffer<float> buffer(2, blockSize);
+            float peak = 0.0f;
+            for (int block = 0; block < numBlocks; ++block) {
+                // Bursts from silence to 12 dB above full scale.
+                const float level = block % 4 == 0 ? 0.0f : (float) (block % 4) * 1.33f;
+                for (int channel = 0; channel < 2; ++channel) {
+                    for (int i = 0; i < blockSize; ++i) {
+                        buffer.setSample(channel, i, level * (random.nextFloat() * 2.0f - 1.0f));
+                    }
+                }
+                limiter.process(buffer, 0, blockSize);
+                peak = jmax(peak, buffer.getMagnitude(0, blockSize));
+            }
+            expectLessOrEqual(peak, ceiling * 1.0001f, "a sample is above the ceiling");
+        }
+
+        beginTest("Quiet signal");
+        LookaheadLimiter limiter;
+        limiter.setCeilingDecibels(-1.0f);
+        limiter.prepareToPlay(blockSize, sampleRate, 1);
+        const int latency = limiter.getLatencyInSamples();
+        const int length = 4 * blockSize;
+        HeapBlock<float> input(length);
+        AudioBuffer<float> buffer(1, length);
+        Random random(4);
+        for (int i = 0; i < length; ++i) {
+            input[i] = 0.5f * (random.nextFloat() * 2.0f - 1.0f);
+            buffer.setSample(0, i, input[i]);
+        }
+        for (int offset = 0; offset < length; offset += blockSize) {
+            limiter.process(buffer, offset, blockSize);
+        }
+        float error = 0.0f;
+        for (int i = 0; i < length; ++i) {
+            const float expected = i >= latency ? input[i - latency] : 0.0f;
+            error = jmax(error, std::abs(expected - buffer.getSample(0, i)));
+        }
+        expectEquals(error, 0.0f, "a signal below the ceiling is changed");
+    }
+};
+
+static LookaheadLimiterTests lookaheadLimiterTests;
+
+#endif
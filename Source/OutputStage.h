@@ -0,0 +1,179 @@
+/*
+  ==============================================================================
+
+    OutputStage.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DspKernels.h"
+#include <atomic>
+
+/**
+ * A true-peak lookahead limiter.
+ * The peak detector looks at the samples and at three interpolated points between every two samples,
+ * so the peaks a DAC reconstructs between samples are caught as well.
+ * The gain is the sliding minimum of the required gain over the lookahead window, smoothed by a box filter
+ * of the same length, so the gain reaches its target exactly when the peak leaves the delay line.
+ * Every stage costs O(1) per sample, and the latency only depends on the sample rate.
+ */
+class LookaheadLimiter {
+public:
+    /**
+     * Allocate all the working memory.
+     * @param maximumBlockSize the largest block passed to process()
+     * @param sampleRate the expected sample rate
+     * @param numChannels the number of channels to limit
+     */
+    void prepareToPlay(int maximumBlockSize, double sampleRate, int numChannels);
+
+    /**
+     * Clear the delay lines and the gain state.
+     */
+    void reset();
+
+    /**
+     * Limit the buffer in place.
+     * @param buffer the buffer to limit. Only the prepared number of channels are processed.
+     * @param startSample the first sample to process
+     * @param numSamples the number of samples to process. It should not exceed the prepared block size.
+     */
+    void process(AudioBuffer<float>& buffer, int startSample, int numSamples);
+
+    /**
+     * Set the highest true peak level allowed at the output. The next block moves the ceiling to it in steps of
+     * PARAMETER_SLICE samples, and reset() applies it at once.
+     * @param newCeilingDecibels the ceiling in dBFS
+     */
+    void setCeilingDecibels(float newCeilingDecibels);
+
+    /**
+     * Set the time the gain needs to recover after a peak
+     * @param newReleaseSeconds the release time in seconds
+     */
+    void setReleaseTime(float newReleaseSeconds);
+
+    /**
+     * The latency of the limiter
+     * @return the latency in samples
+     */
+    int getLatencyInSamples() const;
+
+    /**
+     * The smallest gain applied in the last processed block
+     * @return the gain as a linear factor
+     */
+    float getMinimumGain() const;
+
+private:
+    static constexpr int NUM_PHASES = 4;
+    static constexpr int NUM_TAPS = 12;
+    static constexpr int DETECTOR_DELAY = NUM_TAPS / 2;
+    static constexpr float LOOKAHEAD_SECONDS = 0.0015f;
+    /** The length of the steps of a moving ceiling */
+    static constexpr int PARAMETER_SLICE = 32;
+
+    float interpolator[NUM_PHASES - 1][NUM_TAPS] {};
+
+    int maxBlockSize = 0;
+    int numPreparedChannels = 0;
+    int lookahead = 1;
+    int delayLength = 0;
+    double currentSampleRate = 44100.0;
+
+    /** The ceiling reached by the last block, and the one set by setCeilingDecibels() */
+    float ceiling = 0.891f;
+    float targetCeiling = 0.891f;
+    float releaseCoefficient = 0.0f;
+    float releaseSeconds = 0.05f;
+    float currentGain = 1.0f;
+    float minimumGain = 1.0f;
+
+    /** The input of the peak detector: NUM_TAPS - 1 samples of history followed by the block */
+    AudioBuffer<float> detectorInput;
+    /** The audio delay line: delayLength samples of history followed by the block */
+    AudioBuffer<float> delayLine;
+    HeapBlock<float> peaks;
+    HeapBlock<float> interpolated;
+    HeapBlock<float> gains;
+
+    /** The monotonic queue computing the sliding minimum of the target gain */
+    HeapBlock<float> queueValues;
+    HeapBlock<int64> queueIndices;
+    int queueHead = 0;
+    int queueSize = 0;
+    int64 sampleCounter = 0;
+
+    /** The running box filter smoothing the sliding minimum */
+    HeapBlock<float> boxHistory;
+    int boxPosition = 0;
+    double boxSum = 0.0;
+
+    void updateReleaseCoefficient();
+    void detectPeaks(int numSamples);
+    void computeGains(int numSamples);
+};
+
+/**
+ * The last stage of the synthesiser before the audio device.
+ * Voices are summed without any headroom, so an optional soft clipper running at twice the sample rate shapes
+ * the summed signal, and a true-peak lookahead limiter keeps it below the ceiling.
+ * The oversampler is bypassed while the soft clipper is off, so its latency is only added when it is on.
+ */
+class OutputStage {
+public:
+    /**
+     * Allocate the working memory of the limiter and the oversampler.
+     * @param samplesPerBlockExpected the expected device block size
+     * @param sampleRate the expected sample rate
+     * @param numChannels the number of channels to process
+     */
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate, int numChannels);
+
+    /**
+     * Free the working memory.
+     */
+    void releaseResources();
+
+    /**
+     * Process the buffer in place. Blocks longer than the prepared size are processed in chunks.
+     * @param buffer the buffer to process
+     * @param startSample the first sample to process
+     * @param numSamples the number of samples to process
+     */
+    void process(AudioBuffer<float>& buffer, int startSample, int numSamples);
+
+    void setSoftClipEnabled(bool shouldBeEnabled);
+    bool isSoftClipEnabled() const;
+    void setCeilingDecibels(float newCeilingDecibels);
+
+    /**
+     * The gain reduction of the limiter in the last processed block. It can be called from any thread.
+     * @return the gain reduction in decibels, 0 if the limiter is idle
+     */
+    float getGainReductionDecibels() const;
+
+    /**
+     * The total latency of the output stage. It changes when the soft clipper is switched on or off.
+     * @return the latency in samples
+     */
+    int getLatencyInSamples() const;
+
+private:
+    const float SOFT_CLIP_RANGE = 5.0f;
+
+    int maxBlockSize = 0;
+    int numPreparedChannels = 0;
+
+    LookaheadLimiter limiter;
+    std::unique_ptr<dsp::Oversampling<float>> oversampler;
+
+    std::atomic<bool> softClipEnabled {false};
+    /** Whether the last block went through the oversampler, only used on the audio thread */
+    bool wasClipping = false;
+    std::atomic<float> ceilingDecibels {-1.0f};
+    std::atomic<float> gainReductionDecibels {0.0f};
+};
@@ -0,0 +1,223 @@
+/*
+  ==============================================================================
+
+    PhysicalModel.cpp
+
+  ==============================================================================
+*/
+
+#include "PhysicalModel.h"
+
+//// ==============================================================================
+//// DelayLineArena Class
+//// ==============================================================================
+
+void DelayLineArena::prepare(int newNumLines, double sampleRate) {
+    this->numLines = newNumLines;
+    this->lineLength = (int) std::ceil(sampleRate / LOWEST_FREQUENCY) + 2;
+    this->memory.calloc((size_t) (this->numLines * this->lineLength));
+    this->linesInUse.calloc((size_t) this->numLines);
+}
+
+float* DelayLineArena::acquire() {
+    for (int index = 0; index < this->numLines; ++index) {
+        if (!this->linesInUse[index]) {
+            this->linesInUse[index] = true;
+            return this->memory + index * this->lineLength;
+        }
+    }
+    return nullptr;
+}
+
+void DelayLineArena::release(const float* line) {
+    if (line == nullptr || this->lineLength == 0) {
+        return;
+    }
+    const auto index = (int) ((line - this->memory.get()) / this->lineLength);
+    if (isPositiveAndBelow(index, this->numLines)) {
+        this->linesInUse[index] = false;
+    }
+}
+
+int DelayLineArena::getLineLength() const {
+    return this->lineLength;
+}
+
+//// ==============================================================================
+//// WaveguideString Class
+//// ==============================================================================
+
+constexpr int WaveguideString::MAX_BLOCK_SIZE;
+
+const WaveguideString::Patch WaveguideString::PATCHES[] {
+    {"Nylon", 3.0f, 0.45f, 0.18f, 0.5f},
+    {"Steel", 5.0f, 0.15f, 0.12f, 0.9f},
+    {"Harp", 4.0f, 0.35f, 0.5f, 0.6f},
+    {"Bass", 2.5f, 0.4f, 0.3f, 0.35f},
+    {"Muted", 0.4f, 0.5f, 0.25f, 0.3f}
+};
+
+const int WaveguideString::NUM_PATCHES = numElementsInArray(WaveguideString::PATCHES);
+
+StringArray WaveguideString::getPatchNames() {
+    StringArray names;
+    for (const Patch& patchToName : PATCHES) {
+        names.add(patchToName.name);
+    }
+    return names;
+}
+
+void WaveguideString::setDelayLine(float *newLine, int newLineLength) {
+    this->line = newLine;
+    this->lineLength = newLine != nullptr ? newLineLength : 0;
+    this->patch = nullptr;
+}
+
+const float* WaveguideString::getDelayLine() const {
+    return this->line;
+}
+
+bool WaveguideString::startNote(int patchIndex, float period, float velocity, double newSampleRate,
+                                NoiseGenerator &generator) {
+    if (this->line == nullptr) {
+        return false;
+    }
+    this->patch = &PATCHES[jlimit(0, NUM_PATCHES - 1, patchIndex)];
+    this->sampleRate = newSampleRate;
+    this->writeIndex = 0;
+    this->allpassInput = 0.0f;
+    this->allpassOutput = 0.0f;
+    this->filterInput = 0.0f;
+    this->numSilentSamples = 0;
+    FloatVectorOperations::clear(this->line, this->lineLength);
+
+    // One period of low passed noise, written just before the write index. A harder pluck is brighter.
+    const int length = jlimit(2, this->lineLength, roundToInt(period));
+    float* burst = this->line + this->lineLength - length;
+    const float brightness = jlimit(0.05f, 1.0f, this->patch->pluckBrightness * (0.5f + 0.5f * velocity));
+    generator.fillWhite(burst, length);
+    float lowPassed = 0.0f;
+    float sum = 0.0f;
+    for (int i = 0; i < length; ++i) {
+        lowPassed += brightness * (burst[i] - lowPassed);
+        burst[i] = lowPassed;
+        sum += lowPassed;
+    }
+    // A constant offset would circulate for as long as the fundamental.
+    FloatVectorOperations::add(burst, -sum / (float) length, length);
+
+    // Plucking at a fraction of the length cancels the harmonics with a node there.
+    const int pluckDelay = roundToInt(this->patch->pluckPosition * (float) length);
+    if (pluckDelay > 0) {
+        for (int i = length; --i >= pluckDelay;) {
+            burst[i] -= burst[i - pluckDelay];
+        }
+    }
+
+    const Range<float> range = FloatVectorOperations::findMinAndMax(burst, length);
+    const float peak = jmax(-range.getStart(), range.getEnd());
+    if (peak > 0.0f) {
+        FloatVectorOperations::multiply(burst, 1.0f / peak, length);
+    }
+    return true;
+}
+
+bool WaveguideString::render(float *destination, int numSamples, float period, float brightness) {
+    jassert(numSamples <= MAX_BLOCK_SIZE);
+    if (this->patch == nullptr) {
+        FloatVectorOperations::clear(destination, numSamples);
+        return false;
+    }
+
+    // The loop filter delays by its damping, and the allpass by the rest of the period between 0.5 and 1.5 samples.
+    const float damping = jlimit(0.0f, 0.5f, this->patch->damping - 0.5f * brightness);
+    const float delay = jlimit(1.5f, (float) this->lineLength - 1.5f, period - damping);
+    const auto integerDelay = (int) (delay - 0.5f);
+    const float fraction = delay - (float) integerDelay;
+    const float allpass = (1.0f - fraction) / (1.0f + fraction);
+    // The loop gain decays the fundamental by 60 dB in the decay time of the patch.
+    const float gain = std::pow(10.0f, -3.0f * period / (this->patch->decayTime * (float) this->sampleRate));
+    const float currentWeight = gain * (1.0f - damping);
+    const float previousWeight = gain * damping;
+
+    if (integerDelay >= numSamples) {
+        this->readBlock(this->scratch, numSamples, integerDelay);
+        for (int i = 0; i < numSamples; ++i) {
+            const float input = this->scratch[i];
+            this->allpassOutput = allpass * (input - this->allpassOutput) + this->allpassInput;
+            this->allpassInput = input;
+            this->scratch[i] = this->allpassOutput;
+        }
+        destination[0] = currentWeight * this->scratch[0] + previousWeight * this->filterInput;
+        FloatVectorOperations::copyWithMultiply(destination + 1, this->scratch + 1, currentWeight, numSamples - 1);
+        FloatVectorOperations::addWithMultiply(destination + 1, this->scratch, previousWeight, numSamples - 1);
+        this->filterInput = this->scratch[numSamples - 1];
+        this->writeBlock(destination, numSamples);
+    } else {
+        // The loop is shorter than the block, so the block reads its own output.
+        for (int i = 0; i < numSamples; ++i) {
+            int readIndex = this->writeIndex - integerDelay;
+            if (readIndex < 0) {
+                readIndex += this->lineLength;
+            }
+            const float input = this->line[readIndex];
+            this->allpassOutput = allpass * (input - this->allpassOutput) + this->allpassInput;
+            this->allpassInput = input;
+            const float output = currentWeight * this->allpassOutput + previousWeight * this->filterInput;
+            this->filterInput = this->allpassOutput;
+            this->line[this->writeIndex] = output;
+            destination[i] = output;
+            if (++this->writeIndex == this->lineLength) {
+                this->writeIndex = 0;
+            }
+        }
+    }
+
+    // The string is silent once a whole period has stayed below the threshold.
+    const Range<float> range = FloatVectorOperations::findMinAndMax(destination, numSamples);
+    if (jmax(-range.getStart(), range.getEnd()) < SILENCE_THRESHOLD) {
+        this->numSilentSamples += numSamples;
+    } else {
+        this->numSilentSamples = 0;
+    }
+    return (float) this->numSilentSamples < period + (float) numSamples;
+}
+
+void WaveguideString::readBlock(float *destination, int numSamples, int delay) const {
+    int readIndex = this->writeIndex - delay;
+    if (readIndex < 0) {
+        readIndex += this->lineLength;
+    }
+    const int numBeforeWrap = jmin(numSamples, this->lineLength - readIndex);
+    FloatVectorOperations::copy(destination, this->line + readIndex, numBeforeWrap);
+    FloatVectorOperations::copy(destination + numBeforeWrap, this->line, numSamples - numBeforeWrap);
+}
+
+void WaveguideString::writeBlock(const float *source, int numSamples) {
+    const int numBeforeWrap = jmin(numSamples, this->lineLength - this->writeIndex);
+    FloatVectorOperations::copy(this->line + this->writeIndex, source, numBeforeWrap);
+    FloatVectorOperations::copy(this->line, source + numBeforeWrap, numSamples - numBeforeWrap);
+    this->writeIndex += numSamples;
+    if (this->writeIndex >= this->lineLength) {
+        this->writeIndex -= this->lineLength;
+    }
+}
+
+//// ==============================================================================
+//// StringRenderer Class
+//// ==============================================================================
+
+bool StringRenderer::startNote(const Note &note, NoiseGenerator &noise) {
+    // The voice may have been given another line since the last note, e.g. at a new sample rate.
+    this->string.setDelayLine(note.delayLine, note.delayLineLength);
+    const float angleDelta = note.angleDelta * note.startRatio;
+    // The string has no delay line before the synthesiser is prepared.
+    return angleDelta > 0.0f && this->string.startNote(note.patchIndex, MathConstants<float>::twoPi / angleDelta,
+                                                       note.velocity, note.sampleRate, noise);
+}
+
+bool StringRenderer::render(float *const *destinations, int numSamples, const ControlBlock &control,
+                            NoiseGenerator &noise) {
+    return this->string.render(destinations[0], numSamples, MathConstants<float>::twoPi / control.angleDelta,
+                               control.brightness);
+}
@@ -0,0 +1,178 @@
+/*
+  ==============================================================================
+
+    PhysicalModel.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "Noise.h"
+#include "VoiceRenderer.h"
+
+/**
+ * The delay lines of the waveguide strings of all the voices, in one preallocated block of memory.
+ * Every line is long enough for the lowest pitch a string can play at the current sample rate, so the memory does
+ * not depend on the notes played, and no line is allocated when a note starts.
+ * The lines are carved up in prepare() and handed out on the message thread.
+ */
+class DelayLineArena {
+public:
+    /**
+     * Allocate the lines. The lines handed out before are invalid afterwards.
+     * @param newNumLines the number of lines, one per voice
+     * @param sampleRate the device sample rate
+     */
+    void prepare(int newNumLines, double sampleRate);
+
+    /**
+     * Hand out a free line
+     * @return the first sample of the line, or nullptr if the arena is not prepared or every line is used
+     */
+    float* acquire();
+
+    /**
+     * Give a line back to the arena
+     * @param line a line returned by acquire(), or nullptr
+     */
+    void release(const float* line);
+
+    /**
+     * Get the length of every line
+     * @return the number of samples of a line, 0 before prepare()
+     */
+    int getLineLength() const;
+
+private:
+    /** The lowest fundamental frequency of a string. Lower notes are played at this frequency. */
+    const float LOWEST_FREQUENCY = 20.0f;
+
+    HeapBlock<float> memory;
+    HeapBlock<bool> linesInUse;
+    int numLines = 0;
+    int lineLength = 0;
+};
+
+/**
+ * A plucked string modelled by a digital waveguide, i.e. the Karplus-Strong algorithm.
+ * A burst of filtered noise circulates in a delay line one period long. On every pass it goes through a first order
+ * allpass, which tunes the fractional part of the period, and through a two-point low pass, which damps the high
+ * harmonics faster than the fundamental.
+ * When the delay is longer than the block, every sample read by the block was written before it, so each stage of
+ * the loop runs over the whole block instead of sample by sample.
+ */
+class WaveguideString {
+public:
+    /** The longest block passed to render(), the control block size of the voices */
+    static constexpr int MAX_BLOCK_SIZE = 32;
+
+    /**
+     * The names of the built-in patches
+     * @return the patch names, in the order of their indices
+     */
+    static StringArray getPatchNames();
+
+    /**
+     * Set the delay line of the string, handed out by a DelayLineArena. The string goes silent.
+     * @param newLine the first sample of the line, or nullptr
+     * @param newLineLength the number of samples of the line
+     */
+    void setDelayLine(float* newLine, int newLineLength);
+
+    /**
+     * Get the delay line of the string
+     * @return the line, or nullptr if the string has none
+     */
+    const float* getDelayLine() const;
+
+    /**
+     * Pluck the string. It does not allocate, so it can be called from the audio thread.
+     * @param patchIndex the index of the patch in getPatchNames()
+     * @param period the period of the note in samples
+     * @param velocity the velocity of the note, which brightens the pluck
+     * @param sampleRate the sample rate, used by the decay time of the patch
+     * @param generator the noise generator of the voice, which draws the pluck
+     * @return false if the string has no delay line
+     */
+    bool startNote(int patchIndex, float period, float velocity, double sampleRate, NoiseGenerator& generator);
+
+    /**
+     * Render a block. The period is held for the whole block.
+     * @param destination the samples to overwrite
+     * @param numSamples the number of samples, at most MAX_BLOCK_SIZE
+     * @param period the period of the note in samples, bent and modulated
+     * @param brightness from -1 to 1, added to the brightness of the patch
+     * @return false once the string has decayed to silence
+     */
+    bool render(float* destination, int numSamples, float period, float brightness);
+
+private:
+    /**
+     * A patch: the decay time of the fundamental, the damping of the harmonics and the shape of the pluck
+     */
+    struct Patch {
+        const char* name;
+        /** The time for the fundamental to decay by 60 dB in seconds */
+        float decayTime;
+        /** The weight of the previous sample in the loop filter, from 0 for no damping to 0.5 */
+        float damping;
+        /** Where the string is plucked, as a fraction of its length */
+        float pluckPosition;
+        /** The coefficient of the low pass filtering the noise burst, from 0 to 1 for white noise */
+        float pluckBrightness;
+    };
+
+    static const Patch PATCHES[];
+    static const int NUM_PATCHES;
+
+    /** The peak below which a block is silent, -100 dB */
+    const float SILENCE_THRESHOLD = 1.0e-5f;
+
+    const Patch* patch = nullptr;
+    float* line = nullptr;
+    int lineLength = 0;
+    int writeIndex = 0;
+    double sampleRate = 44100.0;
+    /** The last input and output of the allpass, and the last input of the loop filter */
+    float allpassInput = 0.0f;
+    float allpassOutput = 0.0f;
+    float filterInput = 0.0f;
+    int numSilentSamples = 0;
+    float scratch[MAX_BLOCK_SIZE] {};
+
+    /**
+     * Copy the samples written some time ago
+     * @param destination the samples to overwrite
+     * @param numSamples the number of samples
+     * @param delay how many samples ago the first one was written, at least numSamples
+     */
+    void readBlock(float* destination, int numSamples, int delay) const;
+
+    /**
+     * Append a block to the line
+     * @param source the samples to write
+     * @param numSamples the number of samples
+     */
+    void writeBlock(const float* source, int numSamples);
+};
+
+/**
+ * The renderer of the "String" voice type, which plucks a waveguide string. The note ends when the string has rung
+ * out, and the brightness destination changes the damping of the harmonics.
+ * The delay line belongs to the voice, and the string is given it at every note.
+ */
+class StringRenderer : public VoiceRenderer {
+public:
+    StringRenderer() = default;
+
+    bool startNote(const Note& note, NoiseGenerator& noise) override;
+    bool render(float* const* destinations, int numSamples, const ControlBlock& control,
+                NoiseGenerator& noise) override;
+
+private:
+    WaveguideString string;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (StringRenderer)
+};
@@ -0,0 +1,189 @@
+/*
+  ==============================================================================
+
+    PluginProcessor.cpp
+
+  ==============================================================================
+*/
+
+#include "PluginProcessor.h"
+
+namespace {
+const char* const STATE_TAG = "MIDISynthState";
+}
+
+//// ==============================================================================
+//// MIDISynthAudioProcessor
+//// ==============================================================================
+
+MIDISynthAudioProcessor::MIDISynthAudioProcessor()
+    : AudioProcessor(BusesProperties().withOutput("Output", AudioChannelSet::stereo(), true)),
+      audioSource(midiKeyboardState) {
+    addParameter(voiceType = new AudioParameterChoice("voiceType", "Voice type",
+                                                     ElementaryVoice::getVoiceTypeNames(), 0));
+    addParameter(delayTime = new AudioParameterFloat("delayTime", "Delay time", 0.0f, 2.0f, 0.25f));
+    addParameter(delayFeedback = new AudioParameterFloat("delayFeedback", "Delay feedback", 0.0f, 0.95f, 0.3f));
+    addParameter(delayMix = new AudioParameterFloat("delayMix", "Delay mix", 0.0f, 1.0f, 0.0f));
+    addParameter(ceiling = new AudioParameterFloat("ceiling", "Ceiling", -12.0f, 0.0f, -1.0f));
+    addParameter(softClip = new AudioParameterBool("softClip", "Soft clip", false));
+    addParameter(mpe = new AudioParameterBool("mpe", "MPE", false));
+    addParameter(stealingPolicy = new AudioParameterChoice("stealing", "Voice stealing",
+                                                           VoiceAllocator::getPolicyNames(),
+                                                           VoiceAllocator::oldestVoice));
+    addParameter(governor = new AudioParameterBool("governor", "Quality governor", true));
+
+    // The plugin has no voice editor, so it starts with all the voices, of the default type.
+    for (int i = 0; i < VoiceAllocator::MAX_VOICES; ++i) {
+        this->audioSource.addVoice(new ElementaryVoice((ElementaryVoice::VoiceType) this->appliedVoiceType));
+    }
+    // The voices report their errors to the log from the audio thread, it is written to stderr.
+    RealtimeLog::getInstance().addUser();
+    startTimer(VOICE_TYPE_INTERVAL);
+}
+
+MIDISynthAudioProcessor::~MIDISynthAudioProcessor() {
+    stopTimer();
+    // Stopped here rather than by the static destructor, which may only run when the host unloads the library.
+    RealtimeLog::getInstance().removeUser();
+}
+
+//// ==============================================================================
+//// Audio processing
+//// ==============================================================================
+
+void MIDISynthAudioProcessor::prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock) {
+    // Everything is sized for the largest block, so processBlock() never allocates. The first block starts at the
+    // current values of the parameters.
+    this->applyParameters();
+    this->audioSource.prepareToPlay(maximumExpectedSamplesPerBlock, sampleRate);
+    setLatencySamples(this->audioSource.getOutputStage().getLatencyInSamples());
+}
+
+void MIDISynthAudioProcessor::releaseResources() {
+    this->audioSource.releaseResources();
+}
+
+bool MIDISynthAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const {
+    return layouts.getMainOutputChannelSet() == AudioChannelSet::stereo();
+}
+
+void MIDISynthAudioProcessor::processBlock(AudioBuffer<float> &buffer, MidiBuffer &midiMessages) {
+    ScopedNoDenormals noDenormals;
+    this->audioSource.setMpeEnabled(this->mpe->get());
+    this->audioSource.setStealingPolicy((VoiceAllocator::StealingPolicy) this->stealingPolicy->getIndex());
+    this->audioSource.getQualityGovernor().setEnabled(this->governor->get());
+    this->applyParameters();
+
+    // The voices, the effects and the output stage all work in place on the buffer of the host, in one pass.
+    this->audioSource.renderNextBlock(buffer, 0, buffer.getNumSamples(), midiMessages);
+    midiMessages.clear();
+}
+
+//// ==============================================================================
+//// Plugin description
+//// ==============================================================================
+
+AudioProcessorEditor* MIDISynthAudioProcessor::createEditor() {
+    return new GenericAudioProcessorEditor(this);
+}
+
+bool MIDISynthAudioProcessor::hasEditor() const {
+    return true;
+}
+
+const String MIDISynthAudioProcessor::getName() const {
+    return JucePlugin_Name;
+}
+
+bool MIDISynthAudioProcessor::acceptsMidi() const {
+    return true;
+}
+
+bool MIDISynthAudioProcessor::producesMidi() const {
+    return false;
+}
+
+bool MIDISynthAudioProcessor::isMidiEffect() const {
+    return false;
+}
+
+double MIDISynthAudioProcessor::getTailLengthSeconds() const {
+    return this->audioSource.getEffectsBus().getTailLengthSeconds();
+}
+
+int MIDISynthAudioProcessor::getNumPrograms() {
+    return 1;
+}
+
+int MIDISynthAudioProcessor::getCurrentProgram() {
+    return 0;
+}
+
+void MIDISynthAudioProcessor::setCurrentProgram(int index) {}
+
+const String MIDISynthAudioProcessor::getProgramName(int index) {
+    return {};
+}
+
+void MIDISynthAudioProcessor::changeProgramName(int index, const String &newName) {}
+
+void MIDISynthAudioProcessor::getStateInformation(MemoryBlock &destData) {
+    XmlElement state(STATE_TAG);
+    for (AudioProcessorParameter* parameter : getParameters()) {
+        if (auto* parameterWithId = dynamic_cast<AudioProcessorParameterWithID*>(parameter)) {
+            state.setAttribute(parameterWithId->paramID, parameterWithId->getValue());
+        }
+    }
+    copyXmlToBinary(state, destData);
+}
+
+void MIDISynthAudioProcessor::setStateInformation(const void *data, int sizeInBytes) {
+    std::unique_ptr<XmlElement> state = getXmlFromBinary(data, sizeInBytes);
+    if (state == nullptr || !state->hasTagName(STATE_TAG)) {
+        return;
+    }
+    for (AudioProcessorParameter* parameter : getParameters()) {
+        if (auto* parameterWithId = dynamic_cast<AudioProcessorParameterWithID*>(parameter)) {
+            parameterWithId->setValueNotifyingHost(
+                    (float) state->getDoubleAttribute(parameterWithId->paramID, parameterWithId->getValue()));
+        }
+    }
+}
+
+//// ==============================================================================
+//// Private functions
+//// ==============================================================================
+
+void MIDISynthAudioProcessor::applyParameters() {
+    EffectsBus& effectsBus = this->audioSource.getEffectsBus();
+    effectsBus.setDelayTime(this->delayTime->get());
+    effectsBus.setDelayFeedback(this->delayFeedback->get());
+    effectsBus.setDelayMix(this->delayMix->get());
+    this->audioSource.getOutputStage().setCeilingDecibels(this->ceiling->get());
+    this->audioSource.getOutputStage().setSoftClipEnabled(this->softClip->get());
+}
+
+void MIDISynthAudioProcessor::timerCallback() {
+    // The oversampler of the soft clipper is bypassed while it is off, so switching it changes the latency.
+    const int latency = this->audioSource.getOutputStage().getLatencyInSamples();
+    if (latency != getLatencySamples()) {
+        setLatencySamples(latency);
+    }
+
+    const int newVoiceType = this->voiceType->getIndex();
+    if (newVoiceType == this->appliedVoiceType) {
+        return;
+    }
+    this->appliedVoiceType = newVoiceType;
+    for (int i = 0; i < this->audioSource.getTotalNumVoices(); ++i) {
+        this->audioSource.getVoice(i)->setVoiceType((ElementaryVoice::VoiceType) newVoiceType);
+    }
+}
+
+//// ==============================================================================
+//// Plugin entry point
+//// ==============================================================================
+
+AudioProcessor* JUCE_CALLTYPE createPluginFilter() {
+    return new MIDISynthAudioProcessor();
+}
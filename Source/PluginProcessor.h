@@ -0,0 +1,112 @@
+/*
+  ==============================================================================
+
+    PluginProcessor.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "SynthesiserSource.h"
+
+/**
+ * The synthesiser as a plugin, built by Plugin/MIDISynthPlugin.jucer.
+ * An instance has no window and no audio device of its own, so a host can run many of them. The voices render
+ * straight into the buffer of the host, whatever its block size, and the MIDI of the host is played with the
+ * timing of its events. The delay and the output stage are exposed as parameters. A whole host block is rendered
+ * in one pass, and the delay and the limiter move the continuous parameters from the value of the previous block to
+ * the new one in slices of 32 samples inside it. The block is not split at the automation points: the JUCE 5.4.7
+ * wrappers set the parameters before processBlock() and never say where in the block they changed, so the value at
+ * the end of the block is all the processor sees. The reverb needs an impulse response file, so it is left to the
+ * standalone application.
+ */
+class MIDISynthAudioProcessor : public AudioProcessor, private Timer {
+public:
+    MIDISynthAudioProcessor();
+    ~MIDISynthAudioProcessor() override;
+
+//// ==============================================================================
+//// Audio processing
+//// ==============================================================================
+
+    void prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock) override;
+    void releaseResources() override;
+    bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
+
+    /**
+     * Render the next block in place, with the MIDI events of the host.
+     * @param buffer the output buffer of the host, of any length
+     * @param midiMessages the MIDI events of the block, consumed by the synthesiser
+     */
+    void processBlock(AudioBuffer<float>& buffer, MidiBuffer& midiMessages) override;
+
+//// ==============================================================================
+//// Plugin description
+//// ==============================================================================
+
+    AudioProcessorEditor* createEditor() override;
+    bool hasEditor() const override;
+
+    const String getName() const override;
+    bool acceptsMidi() const override;
+    bool producesMidi() const override;
+    bool isMidiEffect() const override;
+    double getTailLengthSeconds() const override;
+
+    int getNumPrograms() override;
+    int getCurrentProgram() override;
+    void setCurrentProgram(int index) override;
+    const String getProgramName(int index) override;
+    void changeProgramName(int index, const String& newName) override;
+
+    /**
+     * Store the normalised value of every parameter, by its ID
+     * @param destData the state of the plugin
+     */
+    void getStateInformation(MemoryBlock& destData) override;
+
+    /**
+     * Restore the parameters stored by getStateInformation(). Unknown IDs are ignored, and missing ones keep
+     * their value.
+     * @param data the state of the plugin
+     * @param sizeInBytes the size of the state
+     */
+    void setStateInformation(const void* data, int sizeInBytes) override;
+
+private:
+    /** How often the message thread checks the voice type and the latency, in milliseconds */
+    const int VOICE_TYPE_INTERVAL = 100;
+
+    MidiKeyboardState midiKeyboardState;
+    VoiceSynthesiser audioSource;
+
+    AudioParameterChoice* voiceType;
+    AudioParameterFloat* delayTime;
+    AudioParameterFloat* delayFeedback;
+    AudioParameterFloat* delayMix;
+    AudioParameterFloat* ceiling;
+    AudioParameterBool* softClip;
+    AudioParameterBool* mpe;
+    AudioParameterChoice* stealingPolicy;
+    AudioParameterBool* governor;
+
+    /** The voice type the voices were last set to, only used on the message thread */
+    int appliedVoiceType = 0;
+
+    /**
+     * Pass the continuous parameters to the effects and the output stage, which reach them at the end of the next
+     * block. It is called once per host block, as the host gives no sample offset for a parameter change.
+     */
+    void applyParameters();
+
+    /**
+     * Report the latency to the host when the soft clip parameter has changed it, and change the type of the voices
+     * when the voice type parameter has changed. The voices are components, so they are only changed on the message
+     * thread.
+     */
+    void timerCallback() override;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MIDISynthAudioProcessor)
+};
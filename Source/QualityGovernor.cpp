@@ -0,0 +1,113 @@
+/*
+  ==============================================================================
+
+    QualityGovernor.cpp
+
+  ==============================================================================
+*/
+
+#include "QualityGovernor.h"
+#include "VoiceAllocator.h"
+
+constexpr int QualityGovernor::MAX_TRANSITIONS;
+
+// Every level keeps the limits of the previous ones and lowers one more, the cheapest savings come first.
+const QualityGovernor::Level QualityGovernor::LEVELS[] {
+    {"Full quality", 8, 1, 16, VoiceAllocator::MAX_VOICES},
+    {"Oversampling 2x", 2, 1, 16, VoiceAllocator::MAX_VOICES},
+    {"No oversampling", 1, 1, 16, VoiceAllocator::MAX_VOICES},
+    {"Short tails", 1, 4, 16, VoiceAllocator::MAX_VOICES},
+    {"Unison 2", 1, 4, 2, VoiceAllocator::MAX_VOICES},
+    {"Half the voices", 1, 4, 2, VoiceAllocator::MAX_VOICES / 2},
+    {"Quarter of the voices", 1, 4, 2, VoiceAllocator::MAX_VOICES / 4}
+};
+
+const int QualityGovernor::NUM_LEVELS = numElementsInArray(QualityGovernor::LEVELS);
+
+QualityGovernor::QualityGovernor() = default;
+
+void QualityGovernor::prepare(double newSampleRate) {
+    this->sampleRate = newSampleRate;
+    this->load = 0.0f;
+    this->samplesSinceTransition = 0;
+    this->samplesBelowRestoreLoad = 0;
+    if (this->level != 0) {
+        this->changeLevel(0);
+    }
+    this->publishedLoad.store(0.0f);
+}
+
+void QualityGovernor::setEnabled(bool shouldBeEnabled) {
+    this->enabled.store(shouldBeEnabled);
+}
+
+bool QualityGovernor::isEnabled() const {
+    return this->enabled.load();
+}
+
+void QualityGovernor::beginBlock() {
+    this->blockStartTicks = Time::getHighResolutionTicks();
+}
+
+void QualityGovernor::endBlock(int numSamples) {
+    if (this->sampleRate <= 0.0 || numSamples <= 0) {
+        return;
+    }
+    const double elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - this->blockStartTicks);
+    const auto blockLoad = (float) (elapsed * this->sampleRate / numSamples);
+    this->load += (blockLoad - this->load) * LOAD_SMOOTHING;
+    this->publishedLoad.store(this->load);
+    this->samplesSinceTransition += numSamples;
+    this->samplesBelowRestoreLoad = this->load < RESTORE_LOAD ? this->samplesBelowRestoreLoad + numSamples : 0;
+
+    if (!this->enabled.load()) {
+        if (this->level != 0) {
+            this->changeLevel(0);
+        }
+        return;
+    }
+    // A missed deadline steps down at once, a load creeping up only once the last step has had time to settle.
+    const bool isOverloaded = blockLoad >= 1.0f || this->load > DEGRADE_LOAD;
+    if (isOverloaded && this->level < NUM_LEVELS - 1
+        && this->samplesSinceTransition >= (int64) (DEGRADE_HOLD_TIME * this->sampleRate)) {
+        this->changeLevel(this->level + 1);
+    } else if (this->level > 0 && this->samplesBelowRestoreLoad >= (int64) (RESTORE_HOLD_TIME * this->sampleRate)) {
+        this->samplesBelowRestoreLoad = 0;
+        this->changeLevel(this->level - 1);
+    }
+}
+
+const QualityGovernor::Level& QualityGovernor::getLevel() const {
+    return LEVELS[this->level];
+}
+
+int QualityGovernor::getLevelIndex() const {
+    return this->publishedLevel.load();
+}
+
+float QualityGovernor::getLoad() const {
+    return this->publishedLoad.load();
+}
+
+bool QualityGovernor::popTransition(Transition &transition) {
+    int start1, size1, start2, size2;
+    this->fifo.prepareToRead(1, start1, size1, start2, size2);
+    if (size1 + size2 == 0) {
+        return false;
+    }
+    transition = this->transitions[size1 > 0 ? start1 : start2];
+    this->fifo.finishedRead(1);
+    return true;
+}
+
+void QualityGovernor::changeLevel(int newLevel) {
+    int start1, size1, start2, size2;
+    this->fifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 + size2 > 0) {
+        this->transitions[size1 > 0 ? start1 : start2] = {this->level, newLevel, this->load};
+        this->fifo.finishedWrite(1);
+    }
+    this->level = newLevel;
+    this->samplesSinceTransition = 0;
+    this->publishedLevel.store(newLevel);
+}
@@ -0,0 +1,137 @@
+/*
+  ==============================================================================
+
+    QualityGovernor.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include <atomic>
+
+/**
+ * Trades the quality of the voices for time when the audio callback gets close to its deadline.
+ * The governor times every block against the duration of its samples, as the CPU meter of the audio device does,
+ * and smooths the load. When the load stays high it steps down one quality level: the oversampling is lowered, then
+ * the release tails are shortened, then the unison is capped, and at last the quietest voices are stolen. When the
+ * load has stayed low for a few seconds it steps back up one level.
+ * The level is read by the audio thread at the start of every block. The transitions are queued without locks and
+ * written to the log by the message thread.
+ */
+class QualityGovernor {
+public:
+    /**
+     * The limits of a quality level
+     */
+    struct Level {
+        const char* name;
+        /** The largest oversampling factor of the voices */
+        int maxOversamplingFactor;
+        /** How many times faster the release tails decay */
+        int releaseSpeedup;
+        /** The largest number of unison copies of a new note */
+        int maxUnisonCopies;
+        /** The number of voices left sounding, the quietest others are stolen */
+        int maxSoundingVoices;
+    };
+
+    /** A change of quality level, for the log */
+    struct Transition {
+        int fromLevel;
+        int toLevel;
+        /** The smoothed load when the level changed, 1 is the whole deadline */
+        float load;
+    };
+
+    static const Level LEVELS[];
+    static const int NUM_LEVELS;
+
+    QualityGovernor();
+
+    /**
+     * Set the sample rate the deadlines are computed with. It goes back to full quality.
+     * @param sampleRate the sample rate of the device
+     */
+    void prepare(double sampleRate);
+
+    /**
+     * Switch the governor on or off. Switched off, it stays at full quality. It can be called from any thread.
+     * @param shouldBeEnabled true to degrade the quality under load
+     */
+    void setEnabled(bool shouldBeEnabled);
+    bool isEnabled() const;
+
+    /**
+     * Start timing a block. It is called on the audio thread at the start of the callback.
+     */
+    void beginBlock();
+
+    /**
+     * Stop timing a block, and change the quality level if the load asks for it. It is called on the audio thread
+     * at the end of the callback.
+     * @param numSamples the number of samples of the block
+     */
+    void endBlock(int numSamples);
+
+    /**
+     * Get the limits the voices should render the next block with. It should only be called from the audio thread.
+     * @return the current quality level
+     */
+    const Level& getLevel() const;
+
+    /**
+     * Get the current quality level from any thread
+     * @return the index of the level, 0 is full quality
+     */
+    int getLevelIndex() const;
+
+    /**
+     * Get the smoothed load of the callback from any thread
+     * @return the load, 1 is the whole deadline
+     */
+    float getLoad() const;
+
+    /**
+     * Take the oldest transition that has not been logged yet. It should only be called from one thread at a time.
+     * @param transition the transition
+     * @return false if there is no transition left
+     */
+    bool popTransition(Transition& transition);
+
+private:
+    /** The load above which the quality goes down, leaving room for the spikes */
+    const float DEGRADE_LOAD = 0.8f;
+    /** The load below which the quality can go back up */
+    const float RESTORE_LOAD = 0.5f;
+    /** The weight of the last block in the smoothed load, as in the CPU meter of the device manager */
+    const float LOAD_SMOOTHING = 0.2f;
+    /** The time the load is given to settle after the quality went down, in seconds */
+    const double DEGRADE_HOLD_TIME = 0.25;
+    /** The time the load must stay low before the quality goes up, in seconds */
+    const double RESTORE_HOLD_TIME = 3.0;
+    static constexpr int MAX_TRANSITIONS = 64;
+
+    double sampleRate = 0.0;
+    int64 blockStartTicks = 0;
+    float load = 0.0f;
+    int level = 0;
+    /** The samples rendered since the last transition, and since the load went below RESTORE_LOAD */
+    int64 samplesSinceTransition = 0;
+    int64 samplesBelowRestoreLoad = 0;
+
+    std::atomic<bool> enabled {true};
+    std::atomic<int> publishedLevel {0};
+    std::atomic<float> publishedLoad {0.0f};
+    AbstractFifo fifo {MAX_TRANSITIONS};
+    Transition transitions[MAX_TRANSITIONS];
+
+    /**
+     * Move to another level and queue the transition. A full queue drops it.
+     * @param newLevel the index of the new level
+     */
+    void changeLevel(int newLevel);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (QualityGovernor)
+};
@@ -0,0 +1,129 @@
+/*
+  ==============================================================================
+
+    RealtimeLog.cpp
+
+  ==============================================================================
+*/
+
+#include "RealtimeLog.h"
+
+constexpr int RealtimeLog::CAPACITY;
+
+RealtimeLog::RealtimeLog() : Thread("Realtime log") {}
+
+RealtimeLog::~RealtimeLog() {
+    this->stop();
+}
+
+RealtimeLog& RealtimeLog::getInstance() {
+    static RealtimeLog log;
+    return log;
+}
+
+void RealtimeLog::post(Code code, float firstArgument, float secondArgument) noexcept {
+    const SpinLock::ScopedTryLockType lock(this->producerLock);
+    if (!lock.isLocked()) {
+        this->numDroppedRecords.fetch_add(1);
+        return;
+    }
+    int start1, size1, start2, size2;
+    this->fifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 + size2 == 0) {
+        this->numDroppedRecords.fetch_add(1);
+        return;
+    }
+    Record& record = this->records[size1 > 0 ? start1 : start2];
+    record.code = code;
+    record.arguments[0] = firstArgument;
+    record.arguments[1] = secondArgument;
+    record.time = Time::getMillisecondCounter();
+    this->fifo.finishedWrite(1);
+}
+
+bool RealtimeLog::start(const File& file) {
+    this->stop();
+    bool opened = true;
+    if (file != File()) {
+        this->fileStream = std::make_unique<FileOutputStream>(file);
+        opened = this->fileStream->openedOk();
+        if (!opened) {
+            this->fileStream = nullptr;
+        }
+    }
+    this->startThread();
+    return opened;
+}
+
+void RealtimeLog::stop() {
+    if (this->isThreadRunning()) {
+        this->stopThread(1000);
+    }
+    this->writePendingRecords();
+    this->fileStream = nullptr;
+}
+
+void RealtimeLog::addUser() {
+    if (this->numUsers++ == 0) {
+        this->start();
+    }
+}
+
+void RealtimeLog::removeUser() {
+    jassert(this->numUsers > 0);
+    if (this->numUsers > 0 && --this->numUsers == 0) {
+        this->stop();
+    }
+}
+
+int RealtimeLog::getNumDroppedRecords() const {
+    return this->numDroppedRecords.load();
+}
+
+const char* RealtimeLog::getMessage(Code code) {
+    switch (code) {
+        case invalidAngleDelta: return "Invalid angle delta, it should be smaller than the angle limit:";
+        case invalidAngleLimit: return "Invalid angle limit, it should be bigger than the angle delta:";
+        case numCodes:
+        default: return "Unknown message:";
+    }
+}
+
+void RealtimeLog::run() {
+    // The audio thread never signals the thread, waking it up could block.
+    while (!this->threadShouldExit()) {
+        this->writePendingRecords();
+        this->wait(WRITE_INTERVAL);
+    }
+}
+
+void RealtimeLog::writePendingRecords() {
+    String text;
+    int start1, size1, start2, size2;
+    this->fifo.prepareToRead(this->fifo.getNumReady(), start1, size1, start2, size2);
+    const auto formatRecords = [this, &text](int start, int size) {
+        for (int i = start; i < start + size; ++i) {
+            const Record& record = this->records[i];
+            text << "[" << String(record.time) << " ms] " << getMessage(record.code) << " "
+                 << String(record.arguments[0]) << " " << String(record.arguments[1]) << "\n";
+        }
+    };
+    formatRecords(start1, size1);
+    formatRecords(start2, size2);
+    this->fifo.finishedRead(size1 + size2);
+
+    const int numDropped = this->numDroppedRecords.load();
+    if (numDropped != this->numReportedDrops) {
+        text << String(numDropped - this->numReportedDrops) << " log records dropped\n";
+        this->numReportedDrops = numDropped;
+    }
+    if (text.isEmpty()) {
+        return;
+    }
+    if (this->fileStream != nullptr) {
+        this->fileStream->writeText(text, false, false, nullptr);
+        this->fileStream->flush();
+    } else {
+        std::cerr << text << std::flush;
+    }
+}
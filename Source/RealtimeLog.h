@@ -0,0 +1,113 @@
+/*
+  ==============================================================================
+
+    RealtimeLog.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include <atomic>
+
+/**
+ * A log the audio thread can write to without formatting, allocating or blocking.
+ * A record is a message code and two numbers, copied into a lock-free ring. A background thread takes the records a
+ * few times per second, formats them and writes them to stderr or to a file. A record that finds the ring full, or
+ * another thread posting at the same moment, is dropped and counted, so a diagnostic never delays the callback.
+ */
+class RealtimeLog : private Thread {
+public:
+    /** The messages of the log, the arguments of each are described by getMessage() */
+    enum Code {
+        invalidAngleDelta = 0,
+        invalidAngleLimit,
+        numCodes
+    };
+
+    /**
+     * Get the log of the application
+     * @return the log
+     */
+    static RealtimeLog& getInstance();
+
+    ~RealtimeLog() override;
+
+    /**
+     * Queue a record. It can be called from any thread, and never waits.
+     * @param code the message
+     * @param firstArgument the first number of the message
+     * @param secondArgument the second number of the message
+     */
+    void post(Code code, float firstArgument = 0.0f, float secondArgument = 0.0f) noexcept;
+
+    /**
+     * Start writing the records. It should be called from the message thread.
+     * @param file the file the records are appended to, or stderr if it is File()
+     * @return false if the file cannot be opened, the records then go to stderr
+     */
+    bool start(const File& file = File());
+
+    /**
+     * Write the records left in the ring and stop the background thread. It should be called from the message thread.
+     */
+    void stop();
+
+    /**
+     * Start writing the records to stderr for one more user. The plugin instances loaded by a host share the log,
+     * so the first one starts it and the last one to call removeUser() stops it. It should be called from the
+     * message thread.
+     */
+    void addUser();
+
+    /**
+     * Stop writing the records if no other user is left. It should be called from the message thread.
+     */
+    void removeUser();
+
+    /**
+     * The number of records dropped because the ring was full or busy
+     * @return the counter of dropped records
+     */
+    int getNumDroppedRecords() const;
+
+private:
+    struct Record {
+        Code code;
+        float arguments[2];
+        /** The millisecond counter when the record was posted */
+        uint32 time;
+    };
+
+    static constexpr int CAPACITY = 1024;
+    /** The time between two passes of the background thread, in milliseconds */
+    const int WRITE_INTERVAL = 100;
+
+    AbstractFifo fifo {CAPACITY};
+    Record records[CAPACITY];
+    SpinLock producerLock;
+    std::atomic<int> numDroppedRecords {0};
+    int numReportedDrops = 0;
+    /** The number of addUser() calls not matched by removeUser(), only used on the message thread */
+    int numUsers = 0;
+    std::unique_ptr<FileOutputStream> fileStream;
+
+    RealtimeLog();
+
+    /**
+     * Describe a message
+     * @param code the message
+     * @return the text of the message, followed by its two arguments
+     */
+    static const char* getMessage(Code code);
+
+    void run() override;
+
+    /**
+     * Format and write all the queued records, and the number of records dropped since the last time
+     */
+    void writePendingRecords();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RealtimeLog)
+};
@@ -0,0 +1,54 @@
+/*
+  ==============================================================================
+
+    SampleRateCache.cpp
+
+  ==============================================================================
+*/
+
+#include "SampleRateCache.h"
+
+const double SampleRateCache::STANDARD_SAMPLE_RATES[] {44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0};
+
+SampleRateCache::SampleRateCache(float pitchBendRangeSemitones) : pitchBendRangeSemitones(pitchBendRangeSemitones) {
+    Array<double> equalTemperament;
+    for (int degree = 1; degree <= 12; ++degree) {
+        equalTemperament.add(100.0 * degree);
+    }
+    this->setTuning(equalTemperament, 69, 440.0);
+}
+
+void SampleRateCache::setTuning(const Array<double> &newScaleCents, int newReferenceNote,
+                                double newReferenceFrequency) {
+    this->scaleCents = newScaleCents;
+    this->referenceNote = newReferenceNote;
+    this->referenceFrequency = newReferenceFrequency;
+
+    Array<double> sampleRates;
+    for (double sampleRate : STANDARD_SAMPLE_RATES) {
+        sampleRates.addIfNotAlreadyThere(sampleRate);
+    }
+    for (const TuningTable* table : this->tables) {
+        sampleRates.addIfNotAlreadyThere(table->getSampleRate());
+    }
+    this->tables.clear();
+    for (double sampleRate : sampleRates) {
+        this->build(sampleRate);
+    }
+}
+
+TuningTable::Ptr SampleRateCache::getTables(double sampleRate) {
+    for (TuningTable* table : this->tables) {
+        if (table->getSampleRate() == sampleRate) {
+            return table;
+        }
+    }
+    return this->build(sampleRate);
+}
+
+TuningTable::Ptr SampleRateCache::build(double sampleRate) {
+    TuningTable::Ptr table = new TuningTable(this->scaleCents, this->referenceNote, this->referenceFrequency,
+                                             sampleRate, this->pitchBendRangeSemitones);
+    this->tables.add(table);
+    return table;
+}
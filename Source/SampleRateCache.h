@@ -0,0 +1,61 @@
+/*
+  ==============================================================================
+
+    SampleRateCache.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "Tuning.h"
+
+/**
+ * The tables of the current tuning at every sample rate the synthesiser may run at.
+ * The tables of the standard device rates are built with the tuning, and the tables of any other rate the first time
+ * it is asked for, so a device switching between rates gets its tables without computing anything. The cache lives
+ * on the message thread; it is not thread safe and the audio thread never sees it, only the tables it hands out.
+ */
+class SampleRateCache {
+public:
+    /** The rates built in advance */
+    static const double STANDARD_SAMPLE_RATES[];
+
+    /**
+     * Build the tables of the twelve tone equal temperament, with A4 at 440 Hz
+     * @param pitchBendRangeSemitones the pitch shift of the pitch wheel at its extreme positions
+     */
+    explicit SampleRateCache(float pitchBendRangeSemitones);
+
+    /**
+     * Replace the tables by the ones of a new tuning, at the standard rates and at every rate asked for before.
+     * @param newScaleCents the pitches of the scale degrees in cents above the tonic, see TuningTable
+     * @param newReferenceNote the MIDI note of the tonic
+     * @param newReferenceFrequency the frequency of the reference note in Hz
+     */
+    void setTuning(const Array<double>& newScaleCents, int newReferenceNote, double newReferenceFrequency);
+
+    /**
+     * Get the tables of a sample rate, built now if the rate was never asked for
+     * @param sampleRate the sample rate of the device
+     * @return the tables of the current tuning at that rate
+     */
+    TuningTable::Ptr getTables(double sampleRate);
+
+private:
+    const float pitchBendRangeSemitones;
+    Array<double> scaleCents;
+    int referenceNote = 69;
+    double referenceFrequency = 440.0;
+    ReferenceCountedArray<TuningTable> tables;
+
+    /**
+     * Build the tables of the current tuning at a sample rate and add them to the cache
+     * @param sampleRate the sample rate
+     * @return the new tables
+     */
+    TuningTable::Ptr build(double sampleRate);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleRateCache)
+};
@@ -0,0 +1,484 @@
+/*
+  ==============================================================================
+
+    Sampler.cpp
+
+  ==============================================================================
+*/
+
+#include "Sampler.h"
+#include "Noise.h"
+
+//// ==============================================================================
+//// StreamedSample Class
+//// ==============================================================================
+
+constexpr double StreamedSample::PRELOAD_SECONDS;
+
+StreamedSample::StreamedSample(MemoryMappedAudioFormatReader *mappedReader, int rootNote) :
+    reader(mappedReader), rootNote(rootNote) {
+    const auto preloadLength = (int) jmin(this->reader->lengthInSamples,
+                                          (int64) (PRELOAD_SECONDS * this->reader->sampleRate));
+    AudioBuffer<float> scratch(2, preloadLength);
+    this->preloaded.setSize(1, preloadLength);
+    this->read(this->preloaded.getWritePointer(0), 0, preloadLength, scratch);
+}
+
+StreamedSample* StreamedSample::createFromFile(const File &file) {
+    std::unique_ptr<AudioFormat> format;
+    if (file.hasFileExtension("wav")) {
+        format = std::make_unique<WavAudioFormat>();
+    } else if (file.hasFileExtension("aif;aiff")) {
+        format = std::make_unique<AiffAudioFormat>();
+    } else {
+        return nullptr;
+    }
+    std::unique_ptr<MemoryMappedAudioFormatReader> mappedReader(format->createMemoryMappedReader(file));
+    // Mapping only reserves address space, the pages are read when they are first touched.
+    if (mappedReader == nullptr || mappedReader->lengthInSamples <= 0 || !mappedReader->mapEntireFile()) {
+        return nullptr;
+    }
+
+    int rootNote = mappedReader->metadataValues.getValue("MidiUnityNote", "-1").getIntValue();
+    if (!isPositiveAndBelow(rootNote, 128)) {
+        const String name = file.getFileNameWithoutExtension();
+        rootNote = CharacterFunctions::isDigit(name.getLastCharacter()) ? name.getTrailingIntValue() : 60;
+        if (!isPositiveAndBelow(rootNote, 128)) {
+            rootNote = 60;
+        }
+    }
+    return new StreamedSample(mappedReader.release(), rootNote);
+}
+
+int StreamedSample::getRootNote() const {
+    return this->rootNote;
+}
+
+double StreamedSample::getSampleRate() const {
+    return this->reader->sampleRate;
+}
+
+int64 StreamedSample::getLengthInSamples() const {
+    return this->reader->lengthInSamples;
+}
+
+int StreamedSample::getPreloadLength() const {
+    return this->preloaded.getNumSamples();
+}
+
+const float* StreamedSample::getPreloadedSamples() const {
+    return this->preloaded.getReadPointer(0);
+}
+
+void StreamedSample::read(float *destination, int64 startSample, int numSamples, AudioBuffer<float> &scratch) const {
+    // A mono file is read into both channels.
+    this->reader->read(&scratch, 0, numSamples, startSample, true, true);
+    if (this->reader->numChannels > 1) {
+        FloatVectorOperations::copyWithMultiply(destination, scratch.getReadPointer(0), 0.5f, numSamples);
+        FloatVectorOperations::addWithMultiply(destination, scratch.getReadPointer(1), 0.5f, numSamples);
+    } else {
+        FloatVectorOperations::copy(destination, scratch.getReadPointer(0), numSamples);
+    }
+}
+
+//// ==============================================================================
+//// SampleLibrary Class
+//// ==============================================================================
+
+bool SampleLibrary::load(const File &fileOrDirectory) {
+    Array<File> files;
+    if (fileOrDirectory.isDirectory()) {
+        fileOrDirectory.findChildFiles(files, File::findFiles, false, getFileWildcard());
+    } else {
+        files.add(fileOrDirectory);
+    }
+    for (const File& file : files) {
+        if (auto* sample = StreamedSample::createFromFile(file)) {
+            this->samples.add(sample);
+        }
+    }
+    if (this->samples.isEmpty()) {
+        return false;
+    }
+
+    for (int note = 0; note < 128; ++note) {
+        const StreamedSample* nearest = nullptr;
+        for (auto* sample : this->samples) {
+            // On a tie the lower sample is pitched up.
+            if (nearest == nullptr || std::abs(sample->getRootNote() - note) < std::abs(nearest->getRootNote() - note)
+                || (std::abs(sample->getRootNote() - note) == std::abs(nearest->getRootNote() - note)
+                    && sample->getRootNote() < nearest->getRootNote())) {
+                nearest = sample;
+            }
+        }
+        this->noteMap[note] = nearest;
+    }
+    return true;
+}
+
+const StreamedSample* SampleLibrary::findSample(int midiNoteNumber) const {
+    return this->noteMap[jlimit(0, 127, midiNoteNumber)];
+}
+
+int SampleLibrary::getNumSamples() const {
+    return this->samples.size();
+}
+
+String SampleLibrary::getFileWildcard() {
+    return "*.wav;*.aif;*.aiff";
+}
+
+//// ==============================================================================
+//// SampleStream Class
+//// ==============================================================================
+
+constexpr int SampleStream::PREFETCH_CHUNK;
+constexpr int SampleStream::RING_SIZE;
+
+void SampleStream::start(const StreamedSample *sample) {
+    this->requestedSample.store(sample);
+    this->generation.store(this->generation.load() + 1);
+}
+
+void SampleStream::stop() {
+    this->start(nullptr);
+}
+
+int SampleStream::read(float *destination, int numSamples) {
+    if (this->publishedGeneration.load() != this->generation.load()) {
+        // The prefetcher has not seen the last start yet, the ring may hold another note.
+        return 0;
+    }
+    int start1, size1, start2, size2;
+    this->fifo.prepareToRead(numSamples, start1, size1, start2, size2);
+    FloatVectorOperations::copy(destination, this->ring + start1, size1);
+    if (size2 > 0) {
+        FloatVectorOperations::copy(destination + size1, this->ring + start2, size2);
+    }
+    this->fifo.finishedRead(size1 + size2);
+    return size1 + size2;
+}
+
+void SampleStream::fill(AudioBuffer<float> &scratch) {
+    const int currentGeneration = this->generation.load();
+    if (currentGeneration != this->streamingGeneration) {
+        // The audio thread does not read the ring until the new generation is published, so it can be reset.
+        this->fifo.reset();
+        this->streamingSample = this->requestedSample.load();
+        this->streamingGeneration = currentGeneration;
+        this->nextReadPosition = this->streamingSample != nullptr ? this->streamingSample->getPreloadLength() : 0;
+        // The audio thread only reads the ring after the generation is published, so it sees the allocation.
+        if (this->streamingSample != nullptr && this->ring == nullptr) {
+            this->ring.calloc((size_t) RING_SIZE);
+        }
+    }
+
+    if (this->streamingSample != nullptr) {
+        const int64 length = this->streamingSample->getLengthInSamples();
+        while (this->nextReadPosition < length && this->generation.load() == currentGeneration) {
+            const auto numToRead = (int) jmin((int64) PREFETCH_CHUNK, length - this->nextReadPosition);
+            if (this->fifo.getFreeSpace() < numToRead) {
+                break;
+            }
+            int start1, size1, start2, size2;
+            this->fifo.prepareToWrite(numToRead, start1, size1, start2, size2);
+            this->streamingSample->read(this->ring + start1, this->nextReadPosition, size1, scratch);
+            if (size2 > 0) {
+                this->streamingSample->read(this->ring + start2, this->nextReadPosition + size1, size2, scratch);
+            }
+            this->fifo.finishedWrite(size1 + size2);
+            this->nextReadPosition += size1 + size2;
+            // Publish after the first chunk, so a note does not wait for the whole ring.
+            this->publishedGeneration.store(currentGeneration);
+        }
+    }
+    this->publishedGeneration.store(currentGeneration);
+}
+
+//// ==============================================================================
+//// SamplePrefetcher Class
+//// ==============================================================================
+
+SamplePrefetcher::SamplePrefetcher() : Thread("Sample prefetcher"), scratch(2, SampleStream::PREFETCH_CHUNK) {
+    this->startThread();
+}
+
+SamplePrefetcher::~SamplePrefetcher() {
+    this->stopThread(-1);
+}
+
+void SamplePrefetcher::addStream(SampleStream *stream) {
+    const ScopedLock lock(this->streamsLock);
+    this->streams.addIfNotAlreadyThere(stream);
+}
+
+void SamplePrefetcher::removeStream(SampleStream *stream) {
+    const ScopedLock lock(this->streamsLock);
+    this->streams.removeFirstMatchingValue(stream);
+}
+
+const CriticalSection& SamplePrefetcher::getLock() const {
+    return this->streamsLock;
+}
+
+void SamplePrefetcher::run() {
+    while (!this->threadShouldExit()) {
+        {
+            const ScopedLock lock(this->streamsLock);
+            for (auto* stream : this->streams) {
+                stream->fill(this->scratch);
+            }
+        }
+        this->wait(PREFETCH_INTERVAL_MS);
+    }
+}
+
+//// ==============================================================================
+//// SampleRenderer Class
+//// ==============================================================================
+
+SampleRenderer::SampleRenderer(SampleStream &voiceStream, std::atomic<int> &voiceUnderruns)
+    : stream(voiceStream), numUnderruns(voiceUnderruns), window(1, SAMPLE_WINDOW_SIZE) {}
+
+bool SampleRenderer::startNote(const Note &note, NoiseGenerator &noise) {
+    this->sample = note.sampleLibrary != nullptr ? note.sampleLibrary->findSample(note.midiNoteNumber) : nullptr;
+    if (this->sample == nullptr) {
+        return false;
+    }
+    // The sample sounds at the 12-TET frequency of its root note at its own sample rate.
+    const auto rootFrequency = (float) MidiMessage::getMidiNoteInHertz(this->sample->getRootNote());
+    this->noteIncrement = jmin(MAX_PLAYBACK_RATE, (float) (note.frequency / rootFrequency
+            * this->sample->getSampleRate() / note.sampleRate));
+    this->increment = jmin(MAX_PLAYBACK_RATE, this->noteIncrement * note.startRatio);
+    this->position = 0.0;
+    this->windowStart = 0;
+    this->windowLength = 0;
+    this->stream.start(this->sample);
+    return true;
+}
+
+bool SampleRenderer::render(float *const *destinations, int numSamples, const ControlBlock &control,
+                            NoiseGenerator &noise) {
+    float* destination = destinations[0];
+    const float targetIncrement = jmin(this->noteIncrement * control.pitchRatio, MAX_PLAYBACK_RATE);
+    const int64 sampleLength = this->sample->getLengthInSamples();
+    float currentIncrement = this->increment;
+    const float incrementStep = (targetIncrement - currentIncrement) / (float) numSamples;
+    this->fillWindow((int64) (this->position + jmax(currentIncrement, targetIncrement) * (float) numSamples) + 1);
+    const float* samples = this->window.getReadPointer(0);
+    const int64 windowEnd = this->windowStart + this->windowLength;
+    bool isPlaying = true;
+    int i = 0;
+
+    while (i < numSamples) {
+        const auto index = (int64) this->position;
+        if (index + 1 >= windowEnd) {
+            if (windowEnd >= sampleLength) {
+                isPlaying = false;
+            } else {
+                // The playhead waits for the prefetcher instead of skipping the missing samples.
+                ++this->numUnderruns;
+            }
+            break;
+        }
+        const auto fraction = (float) (this->position - (double) index);
+        const float* points = samples + (index - this->windowStart);
+        destination[i++] = points[0] + fraction * (points[1] - points[0]);
+        currentIncrement += incrementStep;
+        this->position += currentIncrement;
+    }
+    this->increment = targetIncrement;
+    if (i < numSamples) {
+        FloatVectorOperations::clear(destination + i, numSamples - i);
+    }
+    return isPlaying;
+}
+
+void SampleRenderer::stopNote() {
+    this->sample = nullptr;
+    this->stream.stop();
+}
+
+bool SampleRenderer::isUsingSample() const {
+    return this->sample != nullptr;
+}
+
+void SampleRenderer::fillWindow(int64 lastPositionNeeded) {
+    float* samples = this->window.getWritePointer(0);
+    // Drop what is behind the playhead.
+    const auto numToDrop = (int) jmin((int64) this->windowLength, (int64) this->position - this->windowStart);
+    if (numToDrop > 0) {
+        std::memmove(samples, samples + numToDrop, sizeof(float) * (size_t) (this->windowLength - numToDrop));
+        this->windowStart += numToDrop;
+        this->windowLength -= numToDrop;
+    }
+
+    jassert(lastPositionNeeded - this->windowStart < SAMPLE_WINDOW_SIZE);
+    const int64 windowEnd = jmin(lastPositionNeeded + 1, this->sample->getLengthInSamples(),
+                                 this->windowStart + SAMPLE_WINDOW_SIZE);
+    int64 nextPosition = this->windowStart + this->windowLength;
+    const int preloadLength = this->sample->getPreloadLength();
+    if (nextPosition < windowEnd && nextPosition < preloadLength) {
+        const auto numToCopy = (int) (jmin(windowEnd, (int64) preloadLength) - nextPosition);
+        FloatVectorOperations::copy(samples + this->windowLength, this->sample->getPreloadedSamples() + nextPosition,
+                                    numToCopy);
+        this->windowLength += numToCopy;
+        nextPosition += numToCopy;
+    }
+    // The stream starts where the preloaded attack ends.
+    if (nextPosition < windowEnd) {
+        this->windowLength += this->stream.read(samples + this->windowLength, (int) (windowEnd - nextPosition));
+    }
+}
+
+#if JUCE_UNIT_TESTS
+
+/**
+ * Plays a sample written to a temporary file, filling its stream by hand instead of with the prefetcher thread, and
+ * checks the handover from the preloaded attack to the stream when the stream is late.
+ */
+class SampleStreamTests : public UnitTest {
+public:
+    SampleStreamTests() : UnitTest("Sample stream", "MIDISynth") {}
+
+    void runTest() override {
+        // The trailing number of the name is the root note, so the note 69 plays the sample at its own rate.
+        const File file = File::getSpecialLocation(File::tempDirectory).getChildFile("MIDISynth stream test_69.wav");
+        expect(writeFile(file), "the test file cannot be written");
+        SampleLibrary library;
+        expect(library.load(file));
+        const StreamedSample* sample = library.findSample(69);
+        expect(sample != nullptr && sample->getPreloadLength() == PRELOAD_LENGTH);
+
+        SampleStream stream;
+        std::atomic<int> numUnderruns {0};
+        SampleRenderer renderer(stream, numUnderruns);
+        NoiseGenerator noise;
+        AudioBuffer<float> scratch(2, SampleStream::PREFETCH_CHUNK);
+        const VoiceRenderer::Note note {69, 1.0f, 440.0f, 0.0f, 1.0f, 0, SAMPLE_RATE, &library, nullptr, 0, 1};
+
+        beginTest("Underrun");
+        expect(renderer.startNote(note, noise));
+        int64 position = renderAttack(renderer, noise);
+        expectEquals(numUnderruns.load(), 1);
+        float block[BLOCK_SIZE];
+        expectEquals(stream.read(block, BLOCK_SIZE), 0, "the stream is read before the prefetcher has filled it");
+
+        beginTest("Handover");
+        stream.fill(scratch);
+        renderBlocks(renderer, noise, position, 3);
+        expectEquals(numUnderruns.load(), 1, "the stream is late after being filled");
+
+        beginTest("New note");
+        // The ring still holds the rest of the last note, it is not played by the next one.
+        renderer.stopNote();
+        expect(renderer.startNote(note, noise));
+        position = renderAttack(renderer, noise);
+        expectEquals(numUnderruns.load(), 2);
+        stream.fill(scratch);
+        renderBlocks(renderer, noise, position, 3);
+
+        beginTest("End of the sample");
+        bool isPlaying = true;
+        for (int i = 0; i < LENGTH / BLOCK_SIZE && isPlaying; ++i) {
+            float* destinations[] {block};
+            isPlaying = renderer.render(destinations, BLOCK_SIZE, control, noise);
+        }
+        expect(!isPlaying, "the note goes on after the end of the sample");
+        expectEquals(numUnderruns.load(), 2);
+        renderer.stopNote();
+
+        file.deleteFile();
+    }
+
+private:
+    static constexpr double SAMPLE_RATE = 1000.0;
+    static constexpr int LENGTH = 2000;
+    /** Half a second at the rate of the sample */
+    static constexpr int PRELOAD_LENGTH = 500;
+    static constexpr int BLOCK_SIZE = 100;
+
+    const VoiceRenderer::ControlBlock control {1.0f, 0.0f, 0.0f, SAMPLE_RATE, 1};
+
+    /**
+     * The value of every sample of the file, exact in 16 bits
+     * @param position the position in the file
+     * @return the sample
+     */
+    static float getValue(int64 position) {
+        return (float) position / 32768.0f;
+    }
+
+    /**
+     * Write a mono ramp of LENGTH samples.
+     * @param file the file to overwrite
+     * @return true if the file is written
+     */
+    static bool writeFile(const File& file) {
+        file.deleteFile();
+        auto stream = std::make_unique<FileOutputStream>(file);
+        if (!stream->openedOk()) {
+            return false;
+        }
+        std::unique_ptr<AudioFormatWriter> writer(WavAudioFormat().createWriterFor(stream.get(), SAMPLE_RATE, 1, 16,
+                                                                                   {}, 0));
+        if (writer == nullptr) {
+            return false;
+        }
+        // The writer owns the stream from now on.
+        stream.release();
+        AudioBuffer<float> ramp(1, LENGTH);
+        for (int i = 0; i < LENGTH; ++i) {
+            ramp.setSample(0, i, getValue(i));
+        }
+        return writer->writeFromAudioSampleBuffer(ramp, 0, LENGTH);
+    }
+
+    /**
+     * Render the preloaded attack of a new note, with a stream that has not been filled yet. The playhead stops
+     * before the last sample of the attack, which needs the first streamed sample to be interpolated.
+     * @return the position of the playhead
+     */
+    int64 renderAttack(SampleRenderer& renderer, NoiseGenerator& noise) {
+        int64 position = renderBlocks(renderer, noise, 0, PRELOAD_LENGTH / BLOCK_SIZE - 1);
+        float block[BLOCK_SIZE];
+        float* destinations[] {block};
+        expect(renderer.render(destinations, BLOCK_SIZE, this->control, noise));
+        bool matches = true;
+        for (int i = 0; i < BLOCK_SIZE - 1; ++i) {
+            matches = matches && block[i] == getValue(position++);
+        }
+        expect(matches, "the attack differs from the file");
+        expectEquals(block[BLOCK_SIZE - 1], 0.0f, "the block is not cleared after an underrun");
+        return position;
+    }
+
+    /**
+     * Render blocks and compare them with the file.
+     * @param position the position of the playhead
+     * @param numBlocks the number of blocks to render
+     * @return the position of the playhead after the blocks
+     */
+    int64 renderBlocks(SampleRenderer& renderer, NoiseGenerator& noise, int64 position, int numBlocks) {
+        float block[BLOCK_SIZE];
+        float* destinations[] {block};
+        for (int i = 0; i < numBlocks; ++i) {
+            expect(renderer.render(destinations, BLOCK_SIZE, this->control, noise));
+            bool matches = true;
+            for (int j = 0; j < BLOCK_SIZE; ++j) {
+                matches = matches && block[j] == getValue(position++);
+            }
+            expect(matches, "the block at " + String(position - BLOCK_SIZE) + " differs from the file");
+        }
+        return position;
+    }
+};
+
+constexpr double SampleStreamTests::SAMPLE_RATE;
+constexpr int SampleStreamTests::LENGTH;
+constexpr int SampleStreamTests::PRELOAD_LENGTH;
+constexpr int SampleStreamTests::BLOCK_SIZE;
+
+static SampleStreamTests sampleStreamTests;
+
+#endif
@@ -0,0 +1,260 @@
+/*
+  ==============================================================================
+
+    Sampler.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "VoiceRenderer.h"
+#include <atomic>
+
+/**
+ * A sample played from disk.
+ * The file is memory mapped, so opening it only reads its header and costs the same for any length.
+ * The attack is copied to memory when the sample is loaded, so a note can start before anything has been streamed.
+ * The rest is read by the SamplePrefetcher thread through the mapping. Voices are mono, so the sample is mixed down.
+ */
+class StreamedSample {
+public:
+    /**
+     * Map a WAV or AIFF file and preload its attack.
+     * The root note is read from the sampler chunk of the file, then from a trailing number in the file name,
+     * e.g. "Piano_64.wav", and defaults to middle C.
+     * @param file the audio file
+     * @return the sample, or nullptr if the file cannot be mapped
+     */
+    static StreamedSample* createFromFile(const File& file);
+
+    int getRootNote() const;
+    double getSampleRate() const;
+    int64 getLengthInSamples() const;
+
+    /**
+     * The number of samples at the beginning of the sample which are always in memory
+     * @return the length of the attack in samples
+     */
+    int getPreloadLength() const;
+
+    /**
+     * Get the samples preloaded in memory. They can be read from any thread.
+     * @return getPreloadLength() mono samples
+     */
+    const float* getPreloadedSamples() const;
+
+    /**
+     * Read and mix down samples through the mapping. It may wait for the disk, so it must never be called from
+     * the audio thread. It is only called from one thread at a time.
+     * @param destination the mono samples to overwrite
+     * @param startSample the position of the first sample to read
+     * @param numSamples the number of samples to read
+     * @param scratch a two channel buffer of at least numSamples samples
+     */
+    void read(float* destination, int64 startSample, int numSamples, AudioBuffer<float>& scratch) const;
+
+private:
+    static constexpr double PRELOAD_SECONDS = 0.5;
+
+    StreamedSample(MemoryMappedAudioFormatReader* mappedReader, int rootNote);
+
+    std::unique_ptr<MemoryMappedAudioFormatReader> reader;
+    AudioBuffer<float> preloaded;
+    int rootNote;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (StreamedSample)
+};
+
+/**
+ * A set of samples spread over the keyboard. Every note plays the sample with the nearest root note.
+ * A library is immutable once loaded, so the audio thread can use it without locking.
+ */
+class SampleLibrary {
+public:
+    /**
+     * Load every WAV and AIFF file of a directory, or a single file.
+     * @param fileOrDirectory the directory, which is not searched recursively, or the file
+     * @return false if no sample could be loaded
+     */
+    bool load(const File& fileOrDirectory);
+
+    /**
+     * Get the sample played by a note
+     * @param midiNoteNumber the MIDI note number
+     * @return the sample with the nearest root note, or nullptr if the library is empty
+     */
+    const StreamedSample* findSample(int midiNoteNumber) const;
+
+    int getNumSamples() const;
+
+    /**
+     * Get the wildcard of the files accepted by load()
+     * @return the wildcard for a FileChooser
+     */
+    static String getFileWildcard();
+
+private:
+    OwnedArray<StreamedSample> samples;
+    const StreamedSample* noteMap[128] {};
+};
+
+/**
+ * The streamed part of the sample played by one voice.
+ * The audio thread starts a sample, reads it from the preloaded attack first, and then from a single-reader
+ * single-writer ring buffer that the SamplePrefetcher keeps filled ahead of the playhead.
+ * Every start or stop bumps a generation counter. The prefetcher refills the ring from the end of the attack when it
+ * sees a new generation, and the audio thread ignores the ring until the prefetcher has published that generation,
+ * so a voice never plays data left over from a previous note.
+ * Every voice has a stream, but most never play a sample, so the ring is only allocated by the prefetcher the first
+ * time the voice streams one.
+ */
+class SampleStream {
+public:
+    SampleStream() = default;
+
+    /**
+     * Start streaming a sample after its attack. It is called from the audio thread.
+     * @param sample the sample to stream, or nullptr to stop streaming
+     */
+    void start(const StreamedSample* sample);
+
+    /**
+     * Stop streaming. The prefetcher no longer touches the previous sample once its current pass is over.
+     */
+    void stop();
+
+    /**
+     * Take samples from the ring. It is called from the audio thread and never blocks.
+     * @param destination the samples to overwrite
+     * @param numSamples the number of samples wanted
+     * @return the number of samples read, less than numSamples if the prefetcher is behind
+     */
+    int read(float* destination, int numSamples);
+
+    /**
+     * Refill the ring. It is called from the prefetcher thread.
+     * @param scratch a two channel buffer of PREFETCH_CHUNK samples
+     */
+    void fill(AudioBuffer<float>& scratch);
+
+    /** The number of samples the prefetcher reads at once */
+    static constexpr int PREFETCH_CHUNK = 4096;
+
+private:
+    static constexpr int RING_SIZE = 1 << 16;
+
+    /** Allocated by the prefetcher before it publishes the first generation with a sample */
+    HeapBlock<float> ring;
+    AbstractFifo fifo {RING_SIZE};
+
+    std::atomic<const StreamedSample*> requestedSample {nullptr};
+    /** Written by the audio thread when a sample starts or stops */
+    std::atomic<int> generation {0};
+    /** Written by the prefetcher once the ring only holds data of that generation */
+    std::atomic<int> publishedGeneration {0};
+
+    /** The state of the prefetcher thread */
+    const StreamedSample* streamingSample = nullptr;
+    int streamingGeneration = 0;
+    int64 nextReadPosition = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleStream)
+};
+
+/**
+ * The background thread keeping the rings of every SampleStream filled.
+ * All the disk reads of the sampler happen on this thread, so a page fault of the memory mapping never blocks the
+ * audio thread.
+ */
+class SamplePrefetcher : private Thread {
+public:
+    SamplePrefetcher();
+    ~SamplePrefetcher() override;
+
+    /**
+     * Start filling a stream. It should be called from the message thread.
+     * @param stream the stream, which must stay alive until it is removed
+     */
+    void addStream(SampleStream* stream);
+
+    /**
+     * Stop filling a stream. When it returns, the prefetcher no longer touches the stream.
+     * @param stream the stream to remove
+     */
+    void removeStream(SampleStream* stream);
+
+    /**
+     * Get the lock held during every prefetch pass. Once it has been taken, no sample is being read.
+     * @return the lock of the prefetch passes
+     */
+    const CriticalSection& getLock() const;
+
+private:
+    const int PREFETCH_INTERVAL_MS = 2;
+
+    void run() override;
+
+    CriticalSection streamsLock;
+    Array<SampleStream*> streams;
+    AudioBuffer<float> scratch;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SamplePrefetcher)
+};
+
+/**
+ * The renderer of the "Sample" voice type, which plays the sample of the library nearest to the note, interpolated
+ * linearly. The interpolation does not create harmonics above the ones of the sample, so it ignores the oversampling.
+ * The stream and the underrun counter belong to the voice, as the prefetcher of the synthesiser fills the stream
+ * whatever the voice type.
+ */
+class SampleRenderer : public VoiceRenderer {
+public:
+    /**
+     * Create the renderer of a voice. The window is allocated here, so it is only called on the message thread.
+     * @param voiceStream the sample stream of the voice, filled by the SamplePrefetcher of the synthesiser
+     * @param voiceUnderruns the counter of the control blocks where the prefetcher was late
+     */
+    SampleRenderer(SampleStream& voiceStream, std::atomic<int>& voiceUnderruns);
+
+    bool startNote(const Note& note, NoiseGenerator& noise) override;
+
+    /**
+     * Render the playing sample. If the sample ends inside the block, the note ends and the rest of the block is
+     * cleared. If the prefetcher is late, the rest of the block is cleared and the playhead waits for it.
+     */
+    bool render(float* const* destinations, int numSamples, const ControlBlock& control,
+                NoiseGenerator& noise) override;
+
+    /**
+     * Stop streaming the playing sample
+     */
+    void stopNote() override;
+    bool isUsingSample() const override;
+
+private:
+    const float MAX_PLAYBACK_RATE = 8.0f;
+    const int SAMPLE_WINDOW_SIZE = 512;
+
+    SampleStream& stream;
+    std::atomic<int>& numUnderruns;
+    const StreamedSample* sample = nullptr;
+    /** A short window of the playing sample, filled from the preloaded attack and then from the stream */
+    AudioBuffer<float> window;
+    /** The position of the first sample of the window in the sample */
+    int64 windowStart = 0;
+    int windowLength = 0;
+    double position = 0.0;
+    /** The playback rate of the current note without any modulation, and the rate reached by the last block */
+    float noteIncrement = 0.0f;
+    float increment = 0.0f;
+
+    /**
+     * Move the window to the playhead and fill it up to a position
+     * @param lastPositionNeeded the last position of the sample the next block reads
+     */
+    void fillWindow(int64 lastPositionNeeded);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleRenderer)
+};
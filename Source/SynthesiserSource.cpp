@@ -22,46 +22,456 @@ bool ElementarySound::appliesToChannel(int midiChannel) {
     return true;
 }
 
+//// ==============================================================================
+//// MultitimbralSynthesiser Class
+//// ==============================================================================
+
+constexpr int MultitimbralSynthesiser::NUM_CHANNELS;
+constexpr int MultitimbralSynthesiser::MAX_VOICES;
+constexpr int MultitimbralSynthesiser::MPE_MASTER_CHANNEL;
+constexpr float MultitimbralSynthesiser::MPE_NOTE_BEND_RANGE;
+
+void MultitimbralSynthesiser::updateVoiceTables() {
+    const ScopedLock sl(this->lock);
+    jassert(this->voices.size() <= MAX_VOICES);
+    const int numVoices = jmin(this->voices.size(), MAX_VOICES);
+    const bool mpe = this->mpeEnabled.load();
+    bool hasChanged = numVoices != this->numRoutedVoices || mpe != this->routedMpe;
+    for (int i = 0; i < numVoices && !hasChanged; ++i) {
+        auto* voice = dynamic_cast<ElementaryVoice*>(this->voices.getUnchecked(i));
+        hasChanged = voice != this->routedVoices[i] || voice->getMidiChannel() != this->routedChannels[i];
+    }
+
+    bool active[MAX_VOICES];
+    float levels[MAX_VOICES];
+    if (hasChanged) {
+        for (Part& part : this->parts) {
+            part.numVoices = 0;
+        }
+        std::fill(std::begin(this->channelVoices), std::end(this->channelVoices), -1);
+        if (mpe != this->routedMpe) {
+            std::fill(std::begin(this->channelNoteBends), std::end(this->channelNoteBends), 0.0f);
+        }
+        uint32 groupMasks[MAX_VOICES];
+        for (int i = 0; i < numVoices; ++i) {
+            auto* voice = dynamic_cast<ElementaryVoice*>(this->voices.getUnchecked(i));
+            const int channel = voice->getMidiChannel();
+            // The voices of the master channel play the notes of the whole MPE zone, as omni voices do.
+            const bool isOmni = channel == 0 || (mpe && channel == MPE_MASTER_CHANNEL);
+            // The note-off of the old channel would never reach the voice again.
+            if (!isOmni && voice->isVoiceActive() && !voice->isPlayingChannel(channel)) {
+                this->stopVoice(voice, 0.0f, true);
+            }
+            groupMasks[i] = 0;
+            for (int partChannel = 1; partChannel <= NUM_CHANNELS; ++partChannel) {
+                if (isOmni || channel == partChannel) {
+                    Part& part = this->parts[partChannel - 1];
+                    part.voices[part.numVoices++] = i;
+                    groupMasks[i] |= 1u << (partChannel - 1);
+                }
+            }
+            this->routedVoices[i] = voice;
+            this->routedChannels[i] = channel;
+            active[i] = voice->isVoiceActive();
+        }
+        this->numRoutedVoices = numVoices;
+        this->routedMpe = mpe;
+        this->allocator.assign(numVoices, groupMasks, active);
+    }
+
+    for (int i = 0; i < numVoices; ++i) {
+        active[i] = this->routedVoices[i]->isVoiceActive();
+        levels[i] = this->routedVoices[i]->getEnvelopeLevel();
+    }
+    this->allocator.update((VoiceAllocator::StealingPolicy) this->stealingPolicy.load(), active, levels);
+}
+
+ElementaryVoice* MultitimbralSynthesiser::detachVoice(int index) {
+    const ScopedLock sl(this->lock);
+    return dynamic_cast<ElementaryVoice*>(this->voices.removeAndReturn(index));
+}
+
+void MultitimbralSynthesiser::setStealingPolicy(VoiceAllocator::StealingPolicy newPolicy) {
+    if (isPositiveAndBelow((int) newPolicy, (int) VoiceAllocator::numPolicies)) {
+        this->stealingPolicy.store(newPolicy);
+    }
+}
+
+VoiceAllocator::StealingPolicy MultitimbralSynthesiser::getStealingPolicy() const {
+    return (VoiceAllocator::StealingPolicy) this->stealingPolicy.load();
+}
+
+void MultitimbralSynthesiser::setMpeEnabled(bool shouldBeEnabled) {
+    this->mpeEnabled.store(shouldBeEnabled);
+}
+
+bool MultitimbralSynthesiser::isMpeEnabled() const {
+    return this->mpeEnabled.load();
+}
+
+void MultitimbralSynthesiser::applyQualityLevel(const QualityGovernor::Level &level) {
+    const ScopedLock sl(this->lock);
+    int numSounding = 0;
+    for (int i = 0; i < this->numRoutedVoices; ++i) {
+        this->routedVoices[i]->setQualityLimits(level);
+        if (this->routedVoices[i]->isVoiceActive()) {
+            ++numSounding;
+        }
+    }
+    for (; numSounding > level.maxSoundingVoices; --numSounding) {
+        int quietest = -1;
+        for (int i = 0; i < this->numRoutedVoices; ++i) {
+            if (this->routedVoices[i]->isVoiceActive() && (quietest < 0
+                || this->routedVoices[i]->getEnvelopeLevel() < this->routedVoices[quietest]->getEnvelopeLevel())) {
+                quietest = i;
+            }
+        }
+        // Stolen as by a new note, so the note fades out instead of clicking.
+        this->routedVoices[quietest]->captureStealTail();
+        this->releaseVoice(quietest, 0.0f, false);
+    }
+}
+
+void MultitimbralSynthesiser::noteOn(int midiChannel, int midiNoteNumber, float velocity) {
+    const ScopedLock sl(this->lock);
+    if (this->getPart(midiChannel) == nullptr || this->sounds.size() == 0) {
+        return;
+    }
+    const int group = midiChannel - 1;
+    // Without the sameNote policy, the same note on the same channel is released and doubled.
+    const int sameNoteIndex = this->findNoteVoice(midiChannel, midiNoteNumber);
+    if (sameNoteIndex >= 0 && this->getStealingPolicy() != VoiceAllocator::sameNote) {
+        this->releaseVoice(sameNoteIndex, 1.0f, true);
+    }
+    const int index = this->allocator.allocate(group, midiNoteNumber, this->isNoteStealingEnabled(), velocity);
+    if (index < 0) {
+        return;
+    }
+    ElementaryVoice* voice = this->routedVoices[index];
+    this->channelVoices[group] = index;
+    // A stolen note keeps sounding for a moment, faded out under the new one.
+    voice->captureStealTail();
+    // An MPE controller sends the expression of a note before its note-on.
+    voice->resetNoteExpression(this->channelNoteBends[group], this->channelPressures[group],
+                               this->channelTimbres[group]);
+    this->startVoice(voice, this->sounds.getObjectPointerUnchecked(0), midiChannel, midiNoteNumber, velocity);
+}
+
+void MultitimbralSynthesiser::noteOff(int midiChannel, int midiNoteNumber, float velocity, bool allowTailOff) {
+    const ScopedLock sl(this->lock);
+    const int index = this->findNoteVoice(midiChannel, midiNoteNumber);
+    if (index < 0) {
+        return;
+    }
+    ElementaryVoice* voice = this->routedVoices[index];
+    voice->setKeyDown(false);
+    if (!(voice->isSustainPedalDown() || voice->isSostenutoPedalDown())) {
+        this->releaseVoice(index, velocity, allowTailOff);
+    }
+}
+
+void MultitimbralSynthesiser::handlePitchWheel(int midiChannel, int wheelValue) {
+    const ScopedLock sl(this->lock);
+    const Part* part = this->getPart(midiChannel);
+    if (part == nullptr) {
+        return;
+    }
+    if (this->routedMpe && midiChannel != MPE_MASTER_CHANNEL) {
+        // The bend of a member channel is the bend of its note alone, on top of the bend of the zone.
+        const float semitones = (float) (wheelValue - 8192) / 8192.0f * MPE_NOTE_BEND_RANGE;
+        this->channelNoteBends[midiChannel - 1] = semitones;
+        const int index = this->findMemberVoice(midiChannel);
+        if (index >= 0) {
+            this->routedVoices[index]->setNotePitchBend(semitones);
+        }
+        return;
+    }
+    if (this->routedMpe) {
+        // The notes of every member channel start from the bend of the zone.
+        std::fill(std::begin(this->lastPitchWheelValues), std::end(this->lastPitchWheelValues), wheelValue);
+    } else {
+        this->lastPitchWheelValues[midiChannel - 1] = wheelValue;
+    }
+    for (int i = 0; i < part->numVoices; ++i) {
+        ElementaryVoice* voice = this->routedVoices[part->voices[i]];
+        if (this->receivesChannel(voice, midiChannel)) {
+            voice->pitchWheelMoved(wheelValue);
+        }
+    }
+}
+
+void MultitimbralSynthesiser::handleController(int midiChannel, int controllerNumber, int controllerValue) {
+    switch (controllerNumber) {
+        case 0x40: this->handleSustainPedal(midiChannel, controllerValue >= 64); break;
+        case 0x42: this->handleSostenutoPedal(midiChannel, controllerValue >= 64); break;
+        case 0x43: this->handleSoftPedal(midiChannel, controllerValue >= 64); break;
+        default: break;
+    }
+
+    const ScopedLock sl(this->lock);
+    const Part* part = this->getPart(midiChannel);
+    if (part == nullptr) {
+        return;
+    }
+    if (controllerNumber == 74) {
+        this->channelTimbres[midiChannel - 1] = (float) controllerValue / 127.0f;
+    }
+    if (this->routedMpe && midiChannel != MPE_MASTER_CHANNEL) {
+        const int index = this->findMemberVoice(midiChannel);
+        if (index >= 0) {
+            this->routedVoices[index]->controllerMoved(controllerNumber, controllerValue);
+        }
+        return;
+    }
+    for (int i = 0; i < part->numVoices; ++i) {
+        ElementaryVoice* voice = this->routedVoices[part->voices[i]];
+        if (this->receivesChannel(voice, midiChannel)) {
+            voice->controllerMoved(controllerNumber, controllerValue);
+        }
+    }
+}
+
+void MultitimbralSynthesiser::handleAftertouch(int midiChannel, int midiNoteNumber, int aftertouchValue) {
+    const ScopedLock sl(this->lock);
+    const int index = this->findNoteVoice(midiChannel, midiNoteNumber);
+    if (index >= 0) {
+        this->routedVoices[index]->aftertouchChanged(aftertouchValue);
+    }
+}
+
+void MultitimbralSynthesiser::handleChannelPressure(int midiChannel, int channelPressureValue) {
+    const ScopedLock sl(this->lock);
+    const Part* part = this->getPart(midiChannel);
+    if (part == nullptr) {
+        return;
+    }
+    this->channelPressures[midiChannel - 1] = (float) channelPressureValue / 127.0f;
+    if (this->routedMpe && midiChannel != MPE_MASTER_CHANNEL) {
+        const int index = this->findMemberVoice(midiChannel);
+        if (index >= 0) {
+            this->routedVoices[index]->channelPressureChanged(channelPressureValue);
+        }
+        return;
+    }
+    for (int i = 0; i < part->numVoices; ++i) {
+        ElementaryVoice* voice = this->routedVoices[part->voices[i]];
+        if (this->receivesChannel(voice, midiChannel)) {
+            voice->channelPressureChanged(channelPressureValue);
+        }
+    }
+}
+
+void MultitimbralSynthesiser::handleSustainPedal(int midiChannel, bool isDown) {
+    const ScopedLock sl(this->lock);
+    const Part* part = this->getPart(midiChannel);
+    if (part == nullptr) {
+        return;
+    }
+    for (int i = 0; i < part->numVoices; ++i) {
+        ElementaryVoice* voice = this->routedVoices[part->voices[i]];
+        if (!this->receivesChannel(voice, midiChannel)) {
+            continue;
+        }
+        if (isDown) {
+            if (voice->isKeyDown()) {
+                voice->setSustainPedalDown(true);
+            }
+        } else {
+            voice->setSustainPedalDown(false);
+            if (!(voice->isKeyDown() || voice->isSostenutoPedalDown())) {
+                this->releaseVoice(part->voices[i], 1.0f, true);
+            }
+        }
+    }
+}
+
+void MultitimbralSynthesiser::handleSostenutoPedal(int midiChannel, bool isDown) {
+    const ScopedLock sl(this->lock);
+    const Part* part = this->getPart(midiChannel);
+    if (part == nullptr) {
+        return;
+    }
+    for (int i = 0; i < part->numVoices; ++i) {
+        ElementaryVoice* voice = this->routedVoices[part->voices[i]];
+        if (!this->receivesChannel(voice, midiChannel)) {
+            continue;
+        }
+        if (isDown) {
+            if (voice->isKeyDown()) {
+                voice->setSostenutoPedalDown(true);
+            }
+        } else if (voice->isSostenutoPedalDown()) {
+            voice->setSostenutoPedalDown(false);
+            if (!(voice->isKeyDown() || voice->isSustainPedalDown())) {
+                this->releaseVoice(part->voices[i], 1.0f, true);
+            }
+        }
+    }
+}
+
+const MultitimbralSynthesiser::Part* MultitimbralSynthesiser::getPart(int midiChannel) const {
+    return isPositiveAndBelow(midiChannel - 1, NUM_CHANNELS) ? &this->parts[midiChannel - 1] : nullptr;
+}
+
+int MultitimbralSynthesiser::findNoteVoice(int midiChannel, int midiNoteNumber) const {
+    if (this->getPart(midiChannel) == nullptr || !isPositiveAndBelow(midiNoteNumber, VoiceAllocator::NUM_NOTES)) {
+        return -1;
+    }
+    // The allocator has not seen the notes that ended in this block yet.
+    const int index = this->allocator.findVoice(midiChannel - 1, midiNoteNumber);
+    if (index < 0 || this->routedVoices[index]->getCurrentlyPlayingNote() != midiNoteNumber
+        || !this->routedVoices[index]->isPlayingChannel(midiChannel)) {
+        return -1;
+    }
+    return index;
+}
+
+int MultitimbralSynthesiser::findMemberVoice(int midiChannel) const {
+    if (!this->routedMpe || midiChannel == MPE_MASTER_CHANNEL || this->getPart(midiChannel) == nullptr) {
+        return -1;
+    }
+    const int index = this->channelVoices[midiChannel - 1];
+    if (index < 0 || index >= this->numRoutedVoices || !this->routedVoices[index]->isPlayingChannel(midiChannel)) {
+        return -1;
+    }
+    return index;
+}
+
+bool MultitimbralSynthesiser::receivesChannel(ElementaryVoice *voice, int midiChannel) const {
+    return voice->isPlayingChannel(midiChannel) || (this->routedMpe && midiChannel == MPE_MASTER_CHANNEL);
+}
+
+void MultitimbralSynthesiser::releaseVoice(int voiceIndex, float velocity, bool allowTailOff) {
+    this->stopVoice(this->routedVoices[voiceIndex], velocity, allowTailOff);
+    this->allocator.release(voiceIndex);
+}
+
 //// ==============================================================================
 //// VoiceSynthesiser Class
 //// ==============================================================================
 
+constexpr int VoiceSynthesiser::MAX_VOICES;
+constexpr int VoiceSynthesiser::MIDI_QUEUE_CAPACITY;
+constexpr int VoiceSynthesiser::MAX_BLOCK_EVENTS;
+constexpr size_t VoiceSynthesiser::MIDI_EVENT_BYTES;
+
 VoiceSynthesiser::VoiceSynthesiser(MidiKeyboardState &state)
     : midiKeyboardState(state) {
     this->synthesiser.addSound(new ElementarySound());
 }
 
 void VoiceSynthesiser::prepareToPlay(int samplesPerBlockExpected, double sampleRate) {
-    this->synthesiser.setCurrentPlaybackSampleRate(sampleRate);
+    {
+        const ScopedLock setupLock(this->voiceSetupLock);
+        this->preparedBlockSize.store(samplesPerBlockExpected);
+        this->preparedSampleRate.store(sampleRate);
+        this->synthesiser.setCurrentPlaybackSampleRate(sampleRate);
+        for (int i = 0; i < synthesiser.getNumVoices(); ++i) {
+            this->getVoice(i)->prepareToPlay(samplesPerBlockExpected, sampleRate);
+        }
+        // The lines are carved again for the new sample rate, so every voice gets a new one before the audio thread
+        // can render it again.
+        const ScopedLock lock(this->synthesiser.getLock());
+        this->delayLineArena.prepare(MAX_VOICES, sampleRate);
+        for (int i = 0; i < synthesiser.getNumVoices(); ++i) {
+            this->getVoice(i)->setDelayLine(this->delayLineArena.acquire(), this->delayLineArena.getLineLength());
+        }
+    }
+    this->effectsBus.prepareToPlay(samplesPerBlockExpected, sampleRate);
+    this->outputStage.prepareToPlay(samplesPerBlockExpected, sampleRate, 2);
+    this->sequencer.prepareToPlay(sampleRate);
+    this->qualityGovernor.prepare(sampleRate);
+    this->incomingMidi.ensureSize(MIDI_BUFFER_BYTES);
+    this->publishTuningTable();
 }
 
 void VoiceSynthesiser::releaseResources() {
-    // Do nothing!
+    this->effectsBus.releaseResources();
+    this->outputStage.releaseResources();
 }
 
 void VoiceSynthesiser::getNextAudioBlock(const AudioSourceChannelInfo &bufferToFill) {
-    if (synthesiser.getNumVoices() == 0) {
-        return;
+    this->render(*bufferToFill.buffer, bufferToFill.startSample, bufferToFill.numSamples, nullptr);
+}
+
+void VoiceSynthesiser::renderNextBlock(AudioBuffer<float> &buffer, int startSample, int numSamples,
+                                       const MidiBuffer &hostMidi) {
+    this->render(buffer, startSample, numSamples, &hostMidi);
+}
+
+void VoiceSynthesiser::render(AudioBuffer<float> &buffer, int startSample, int numSamples,
+                              const MidiBuffer *hostMidi) {
+    this->qualityGovernor.beginBlock();
+    buffer.clear(startSample, numSamples);
+    this->updateTuningTable();
+    this->incomingMidi.clear();
+    // Drain the queue and run the sequencer even without voices, so old notes do not start when a voice is added.
+    this->midiMessageQueue.popInto(this->incomingMidi, startSample);
+    this->sequencer.process(this->incomingMidi, startSample, numSamples);
+    if (hostMidi != nullptr) {
+        // The buffer was sized in prepareToPlay(), so adding the events of the host does not allocate.
+        this->incomingMidi.addEvents(*hostMidi, startSample, numSamples, 0);
+    }
+    if (synthesiser.getNumVoices() > 0) {
+        this->synthesiser.applyQualityLevel(this->qualityGovernor.getLevel());
+        // From this block on, a voice moved to another channel plays in its new part, and finished voices are free.
+        this->synthesiser.updateVoiceTables();
+        this->midiKeyboardState.processNextMidiBuffer (this->incomingMidi, startSample, numSamples, true);
+        this->synthesiser.renderNextBlock (buffer, this->incomingMidi, startSample, numSamples);
     }
-    bufferToFill.clearActiveBufferRegion();
-    MidiBuffer incomingMidi;
-    this->midiKeyboardState.processNextMidiBuffer (incomingMidi, bufferToFill.startSample,
-                                               bufferToFill.numSamples, true);
-    this->synthesiser.renderNextBlock (*bufferToFill.buffer, incomingMidi,
-                                       bufferToFill.startSample, bufferToFill.numSamples);
+    this->effectsBus.process(buffer, startSample, numSamples);
+    this->outputStage.process(buffer, startSample, numSamples);
+    this->qualityGovernor.endBlock(numSamples);
 }
 
 void VoiceSynthesiser::removeVoice(int index) {
-    this->synthesiser.removeVoice(index);
+    const ScopedLock setupLock(this->voiceSetupLock);
+    std::unique_ptr<ElementaryVoice> voice;
+    {
+        // The table must not point to the removed voice when the next event is dispatched.
+        const ScopedLock lock(this->synthesiser.getLock());
+        voice.reset(this->synthesiser.detachVoice(index));
+        this->synthesiser.updateVoiceTables();
+    }
+    // The audio thread cannot render the voice anymore, so its stream and its delay line can be given back.
+    if (voice != nullptr) {
+        this->samplePrefetcher.removeStream(&voice->getSampleStream());
+        this->delayLineArena.release(voice->getDelayLine());
+    }
 }
 
 void VoiceSynthesiser::addVoice(ElementaryVoice *voice) {
+    const ScopedLock setupLock(this->voiceSetupLock);
     if (this->synthesiser.getNumVoices() >= MAX_VOICES) { return; }
+    // Allocate the render buffers before the audio thread can see the voice.
+    if (this->preparedBlockSize.load() > 0) {
+        voice->prepareToPlay(this->preparedBlockSize.load(), this->preparedSampleRate.load());
+    }
+    voice->setSampleLibrary(this->sampleLibrary.get());
+    voice->setRenderLock(&this->synthesiser.getLock());
+    this->samplePrefetcher.addStream(&voice->getSampleStream());
+    voice->setDelayLine(this->delayLineArena.acquire(), this->delayLineArena.getLineLength());
+    // Every voice draws its own noise, and the same voices added in the same order always draw the same noise.
+    voice->setNoiseSeed(this->nextNoiseSeed++);
+    const ScopedLock lock(this->synthesiser.getLock());
     this->synthesiser.addVoice(voice);
+    this->synthesiser.updateVoiceTables();
 }
 
 void VoiceSynthesiser::removeAllVoices() {
-    this->synthesiser.clearVoices();
+    const ScopedLock setupLock(this->voiceSetupLock);
+    OwnedArray<ElementaryVoice> voices;
+    {
+        const ScopedLock lock(this->synthesiser.getLock());
+        while (this->synthesiser.getNumVoices() > 0) {
+            voices.add(this->synthesiser.detachVoice(this->synthesiser.getNumVoices() - 1));
+        }
+        this->synthesiser.updateVoiceTables();
+    }
+    for (ElementaryVoice* voice : voices) {
+        this->samplePrefetcher.removeStream(&voice->getSampleStream());
+        this->delayLineArena.release(voice->getDelayLine());
+    }
 }
 
 ElementaryVoice* VoiceSynthesiser::getVoice(int index) {
@@ -81,19 +491,207 @@ bool VoiceSynthesiser::shouldUpdateStatus() {
     return false;
 }
 
+EffectsBus& VoiceSynthesiser::getEffectsBus() {
+    return effectsBus;
+}
+
+const EffectsBus& VoiceSynthesiser::getEffectsBus() const {
+    return effectsBus;
+}
+
+OutputStage& VoiceSynthesiser::getOutputStage() {
+    return outputStage;
+}
+
+bool VoiceSynthesiser::loadScalaTuning(const File &file) {
+    Array<double> scaleCents;
+    String description;
+    if (!TuningTable::parseScalaFile(file, scaleCents, description)) {
+        return false;
+    }
+    {
+        const ScopedLock lock(this->tuningSettingsLock);
+        this->sampleRateCache.setTuning(scaleCents, 60, MidiMessage::getMidiNoteInHertz(60));
+        this->tuningName = description.isNotEmpty() ? description : file.getFileNameWithoutExtension();
+    }
+    this->publishTuningTable();
+    return true;
+}
+
+void VoiceSynthesiser::resetTuning() {
+    Array<double> scaleCents;
+    for (int degree = 1; degree <= 12; ++degree) {
+        scaleCents.add(100.0 * degree);
+    }
+    {
+        const ScopedLock lock(this->tuningSettingsLock);
+        this->sampleRateCache.setTuning(scaleCents, 69, 440.0);
+        this->tuningName = "12-TET";
+    }
+    this->publishTuningTable();
+}
+
+String VoiceSynthesiser::getTuningName() const {
+    const ScopedLock lock(this->tuningSettingsLock);
+    return this->tuningName;
+}
+
+MidiMessageQueue& VoiceSynthesiser::getMidiMessageQueue() {
+    return midiMessageQueue;
+}
+
+MidiSequencer& VoiceSynthesiser::getSequencer() {
+    return sequencer;
+}
+
+bool VoiceSynthesiser::loadSampleLibrary(const File &fileOrDirectory) {
+    auto newLibrary = std::make_unique<SampleLibrary>();
+    if (!newLibrary->load(fileOrDirectory)) {
+        return false;
+    }
+    {
+        const ScopedLock lock(this->synthesiser.getLock());
+        for (int i = 0; i < synthesiser.getNumVoices(); ++i) {
+            this->getVoice(i)->setSampleLibrary(newLibrary.get());
+        }
+        std::swap(this->sampleLibrary, newLibrary);
+    }
+    // A prefetch pass started before the voices were stopped may still read the old samples.
+    const ScopedLock lock(this->samplePrefetcher.getLock());
+    newLibrary = nullptr;
+    return true;
+}
+
+int VoiceSynthesiser::getNumLoadedSamples() const {
+    return this->sampleLibrary != nullptr ? this->sampleLibrary->getNumSamples() : 0;
+}
+
+void VoiceSynthesiser::setStealingPolicy(VoiceAllocator::StealingPolicy newPolicy) {
+    this->synthesiser.setStealingPolicy(newPolicy);
+}
+
+VoiceAllocator::StealingPolicy VoiceSynthesiser::getStealingPolicy() const {
+    return this->synthesiser.getStealingPolicy();
+}
+
+void VoiceSynthesiser::setMpeEnabled(bool shouldBeEnabled) {
+    this->synthesiser.setMpeEnabled(shouldBeEnabled);
+}
+
+bool VoiceSynthesiser::isMpeEnabled() const {
+    return this->synthesiser.isMpeEnabled();
+}
+
+QualityGovernor& VoiceSynthesiser::getQualityGovernor() {
+    return this->qualityGovernor;
+}
+
+void VoiceSynthesiser::logQualityTransitions() {
+    QualityGovernor::Transition transition;
+    while (this->qualityGovernor.popTransition(transition)) {
+        Logger::writeToLog(String("Quality ") + (transition.toLevel > transition.fromLevel ? "lowered" : "raised")
+                           + " to " + QualityGovernor::LEVELS[transition.toLevel].name + " at "
+                           + String(100.0f * transition.load, 1) + " % load");
+    }
+}
+
+void VoiceSynthesiser::publishTuningTable() {
+    const ScopedLock lock(this->tuningSettingsLock);
+    const double sampleRate = this->preparedSampleRate.load();
+    if (sampleRate <= 0.0) {
+        // The table is handed over when the device is prepared.
+        return;
+    }
+    TuningTable::Ptr table = this->sampleRateCache.getTables(sampleRate);
+    // A table only referenced by this array has been dropped by the audio thread and by the cache, so it cannot
+    // come back.
+    for (int i = this->retainedTuningTables.size(); --i >= 0;) {
+        if (this->retainedTuningTables.getObjectPointerUnchecked(i)->getReferenceCount() == 1) {
+            this->retainedTuningTables.remove(i);
+        }
+    }
+    this->retainedTuningTables.addIfNotAlreadyThere(table.get());
+
+    const SpinLock::ScopedLockType handOverLock(this->tuningTableLock);
+    this->pendingTuningTable = table;
+}
+
+void VoiceSynthesiser::updateTuningTable() {
+    {
+        const SpinLock::ScopedTryLockType handOverLock(this->tuningTableLock);
+        if (handOverLock.isLocked() && this->pendingTuningTable != nullptr) {
+            // The retained array still owns the old table, so it is not freed here.
+            this->currentTuningTable = this->pendingTuningTable;
+            this->pendingTuningTable = nullptr;
+        }
+    }
+    for (int i = 0; i < synthesiser.getNumVoices(); ++i) {
+        this->getVoice(i)->setTuningTable(this->currentTuningTable.get());
+    }
+}
+
 //// ==============================================================================
 //// ElementaryVoice Class
 //// ==============================================================================
 
-ElementaryVoice::ElementaryVoice(const String& newVoiceType) {
-    assert(this->voiceTypes.contains(newVoiceType));
-    this->voiceType = newVoiceType;
+StringArray ElementaryVoice::getVoiceTypeNames() {
+    return StringArray {"Sine", "Square", "Triangle", "Sawtooth", "Sample", "Additive", "FM", "String", "Noise",
+                        "Granular"};
+}
+
+ElementaryVoice::ElementaryVoice(const String& newVoiceType)
+    : ElementaryVoice((VoiceType) jmax(0, getVoiceTypeNames().indexOf(newVoiceType))) {
+    assert(getVoiceTypeNames().contains(newVoiceType));
+}
+
+ElementaryVoice::ElementaryVoice(VoiceType newVoiceType) {
+    this->voiceType.store(newVoiceType);
+    this->renderer = createRenderer(newVoiceType);
+    this->rendererType = newVoiceType;
 
     voiceSelection.addListener(this);
-    voiceSelection.addItemList(voiceTypes, 1);
-    voiceSelection.setSelectedItemIndex(voiceTypes.indexOf(this->voiceType));
+    voiceSelection.addItemList(getVoiceTypeNames(), 1);
+    voiceSelection.setSelectedItemIndex(this->voiceType.load());
     addAndMakeVisible(voiceSelection);
 
+    patchSelection.addListener(this);
+    updatePatchSelection();
+    addAndMakeVisible(patchSelection);
+
+    oversamplingSelection.addListener(this);
+    oversamplingSelection.addItemList(oversamplingFactors, 1);
+    oversamplingSelection.setSelectedItemIndex(0);
+    addAndMakeVisible(oversamplingSelection);
+
+    unisonSelection.addListener(this);
+    unisonSelection.addItemList(unisonCopies, 1);
+    unisonSelection.setSelectedItemIndex(0);
+    addAndMakeVisible(unisonSelection);
+    addAndMakeVisible(unisonLabel);
+
+    unisonDetuneSlider.addListener(this);
+    unisonDetuneSlider.setRange(0.0, 100.0);
+    unisonDetuneSlider.setValue(unisonDetune.load());
+    unisonDetuneSlider.setTextValueSuffix(" cents");
+    addAndMakeVisible(unisonDetuneSlider);
+
+    unisonSpreadSlider.addListener(this);
+    unisonSpreadSlider.setRange(0.0, 1.0);
+    unisonSpreadSlider.setValue(unisonSpread.load());
+    addAndMakeVisible(unisonSpreadSlider);
+    addAndMakeVisible(unisonSpreadLabel);
+
+    channelSelection.addListener(this);
+    channelSelection.addItemList(midiChannels, 1);
+    channelSelection.setSelectedItemIndex(0);
+    addAndMakeVisible(channelSelection);
+    addAndMakeVisible(channelLabel);
+
+    controlBlockSizeSelection.addListener(this);
+    controlBlockSizeSelection.addItemList(controlBlockSizes, 1);
+    controlBlockSizeSelection.setSelectedItemIndex(controlBlockSizes.indexOf(String(controlBlockSize.load())));
+    addAndMakeVisible(controlBlockSizeSelection);
+
     amplitudeFactorSlider.addListener(this);
     amplitudeFactorSlider.setRange(0.0, 10.0);
     amplitudeFactorSlider.setValue(1.0);
@@ -122,7 +720,44 @@ ElementaryVoice::ElementaryVoice(const String& newVoiceType) {
     addAndMakeVisible(tailOffSlider);
     addAndMakeVisible(tailOffLabel);
 
-    this->setSize(480, 168);
+    filterCutoffSlider.addListener(this);
+    filterCutoffSlider.setRange(MIN_FILTER_CUTOFF, MAX_FILTER_CUTOFF);
+    filterCutoffSlider.setValue(MAX_FILTER_CUTOFF);
+    filterCutoffSlider.setSkewFactorFromMidPoint(1000.0);
+    addAndMakeVisible(filterCutoffSlider);
+    addAndMakeVisible(filterCutoffLabel);
+
+    lfo1RateSlider.addListener(this);
+    lfo1RateSlider.setRange(0.05, 20.0);
+    lfo1RateSlider.setValue(lfo1Rate.load());
+    lfo1RateSlider.setSkewFactorFromMidPoint(2.0);
+    addAndMakeVisible(lfo1RateSlider);
+    addAndMakeVisible(lfo1RateLabel);
+
+    lfo2RateSlider.addListener(this);
+    lfo2RateSlider.setRange(0.05, 20.0);
+    lfo2RateSlider.setValue(lfo2Rate.load());
+    lfo2RateSlider.setSkewFactorFromMidPoint(2.0);
+    addAndMakeVisible(lfo2RateSlider);
+    addAndMakeVisible(lfo2RateLabel);
+
+    addAndMakeVisible(modulationLabel);
+    addAndMakeVisible(modulationMatrixEditor);
+
+    this->setSize(480, 424 + ModulationMatrixEditor::getIdealHeight());
+}
+
+void ElementaryVoice::prepareToPlay(int samplesPerBlockExpected, double sampleRate) {
+    this->maxBlockSize = samplesPerBlockExpected;
+    this->oversampledBuffer.setSize(1, samplesPerBlockExpected * 8);
+    // The second channel is only used by the stereo renderers.
+    this->voiceBuffer.setSize(2, samplesPerBlockExpected);
+    this->decimators.prepare(samplesPerBlockExpected);
+    this->renderFactor = this->oversamplingFactor.load();
+    this->decimators.setFactor(this->renderFactor);
+    this->stealTail.setSize(2, STEAL_FADE_SAMPLES);
+    this->stealTailLength = 0;
+    this->stealTailPosition = 0;
 }
 
 bool ElementaryVoice::canPlaySound(SynthesiserSound *sound) {
@@ -132,15 +767,72 @@ bool ElementaryVoice::canPlaySound(SynthesiserSound *sound) {
 void
 ElementaryVoice::startNote(int midiNoteNumber, float velocity, SynthesiserSound *sound, int currentPitchWheelPosition) {
     this->angle.setCurrentAngle(0.0);
-    this->dynamics = velocity * this->amplitudeFactor;
-    auto frequency = (float) (this->frequencyFactor * MidiMessage::getMidiNoteInHertz(midiNoteNumber));
-    // If the frequency is bigger than Nyquist frequency we do not bother setup the angleDelta
-    float angleDelta = frequency <= NYQUIST_FREQUENCY ?
-            MathConstants<float>::twoPi * frequency / (float) this->getSampleRate() : 0.0f;
-    this->angle.setAngleDelta(angleDelta);
+    this->noteVelocity = velocity;
+    this->dynamics = velocity * this->amplitudeFactor.load();
+    const float factor = this->frequencyFactor.load();
+    float frequency;
+    float angleDelta;
+    float nyquistFrequency;
+    if (this->tuningTable != nullptr && this->tuningTable->getSampleRate() == this->getSampleRate()) {
+        frequency = factor * this->tuningTable->getFrequency(midiNoteNumber);
+        angleDelta = factor * this->tuningTable->getAngleDelta(midiNoteNumber);
+        nyquistFrequency = this->tuningTable->getNyquistFrequency();
+    } else {
+        frequency = (float) (factor * MidiMessage::getMidiNoteInHertz(midiNoteNumber));
+        angleDelta = MathConstants<float>::twoPi * frequency / (float) this->getSampleRate();
+        nyquistFrequency = (float) (this->getSampleRate() / 2.0);
+    }
+    // A note above the Nyquist frequency would only alias, so it stays silent.
+    this->noteAngleDelta = frequency < nyquistFrequency ? angleDelta : 0.0f;
+    // A new note starts at the current pitch wheel position without gliding.
+    this->pitchBendRatio = this->getPitchBendRatio(currentPitchWheelPosition);
+    this->targetPitchBendRatio = this->pitchBendRatio;
+    float startRatio = this->pitchBendRatio;
+    if (this->notePitchBend != 0.0f) {
+        startRatio *= std::exp2(this->notePitchBend / 12.0f);
+    }
+
+    const int64 noiseSeed = this->pendingNoiseSeed.exchange(-1);
+    if (noiseSeed >= 0) {
+        this->noiseGenerator.setSeed((uint32) noiseSeed);
+    }
+    this->noteVoiceType = (VoiceType) this->voiceType.load();
+    this->stopRenderer();
+    if (this->pendingRenderer != nullptr) {
+        // A renderer is only published together with the release of the retired one, see changeVoiceType().
+        jassert(this->retiredRenderer == nullptr);
+        this->retiredRenderer = std::move(this->renderer);
+        this->renderer = std::move(this->pendingRenderer);
+        this->rendererType = this->pendingRendererType;
+    }
+    const int numCopies = jmin(this->numUnisonCopies.load(), this->maxUnisonCopies);
+    VoiceRenderer* newRenderer = nullptr;
+    if (this->renderer != nullptr && this->rendererType == this->noteVoiceType) {
+        newRenderer = this->renderer.get();
+    } else if (numCopies > 1 && this->noteVoiceType <= sawtoothVoice) {
+        this->unisonRenderer.setCopies((UnisonOscillator::Waveform) this->noteVoiceType, numCopies);
+        newRenderer = &this->unisonRenderer;
+    }
+    if (newRenderer != nullptr) {
+        const VoiceRenderer::Note note {midiNoteNumber, velocity, frequency, this->noteAngleDelta, startRatio,
+                                        this->patchIndex.load(), this->getSampleRate(), this->sampleLibrary,
+                                        this->delayLine, this->delayLineLength, this->renderFactor};
+        if (!newRenderer->startNote(note, this->noiseGenerator)) {
+            this->clearCurrentNote();
+            return;
+        }
+        this->noteRenderer = newRenderer;
+    }
+    this->angle.setAngleDelta(jmin(this->noteAngleDelta * startRatio, MathConstants<float>::pi)
+                              / (float) this->renderFactor);
 
     this->tailOff = 0.0f;
     this->tailOn = 0.0f;
+    this->decimators.reset();
+    this->lfo1.reset();
+    this->lfo2.reset();
+    this->modulationGain = 1.0f;
+    this->filterWasActive = false;
 }
 
 void ElementaryVoice::stopNote(float velocity, bool allowTailOff) {
@@ -151,41 +843,175 @@ void ElementaryVoice::stopNote(float velocity, bool allowTailOff) {
     } else {
         this->clearCurrentNote();
         this->angle.setAngleDelta(0.0);
+        this->stopRenderer();
     }
 }
 
 void ElementaryVoice::pitchWheelMoved(int newPitchWheelValue) {
-    // No operation
+    // The ratio is smoothed towards the target in renderNextBlock().
+    this->targetPitchBendRatio = this->getPitchBendRatio(newPitchWheelValue);
 }
 
 void ElementaryVoice::controllerMoved(int controllerNumber, int newControllerValue) {
-    // No operation
+    // The modulation wheel controls the vibrato depth, and both controllers are sources of the modulation matrix.
+    if (controllerNumber == 1) {
+        this->modulationWheel = (float) newControllerValue / 127.0f;
+    } else if (controllerNumber == 11) {
+        this->expression = (float) newControllerValue / 127.0f;
+    } else if (controllerNumber == 74) {
+        // The timbre dimension of MPE, smoothed in renderNextBlock().
+        this->targetTimbre = (float) newControllerValue / 127.0f;
+    }
+}
+
+void ElementaryVoice::aftertouchChanged(int newAftertouchValue) {
+    this->targetPressure = (float) newAftertouchValue / 127.0f;
+}
+
+void ElementaryVoice::channelPressureChanged(int newChannelPressureValue) {
+    this->targetPressure = (float) newChannelPressureValue / 127.0f;
+}
+
+void ElementaryVoice::resetNoteExpression(float pitchBendSemitones, float newPressure, float newTimbre) {
+    this->notePitchBend = pitchBendSemitones;
+    this->targetNotePitchBend = pitchBendSemitones;
+    this->pressure = newPressure;
+    this->targetPressure = newPressure;
+    this->timbre = newTimbre;
+    this->targetTimbre = newTimbre;
+}
+
+void ElementaryVoice::setNotePitchBend(float semitones) {
+    this->targetNotePitchBend = semitones;
 }
 
 void ElementaryVoice::renderNextBlock(AudioBuffer<float> &outputBuffer, int startSample, int numSamples) {
-    if (this->angle.getAngleDelta() == 0.0 && !voiceTypes.contains(voiceType)) {
+    const DspKernels& kernels = DspKernels::get();
+    if (this->stealTailPosition < this->stealTailLength) {
+        const int numToMix = jmin(numSamples, this->stealTailLength - this->stealTailPosition);
+        for (int i = outputBuffer.getNumChannels(); --i >= 0;) {
+            kernels.add(outputBuffer.getWritePointer(i, startSample),
+                        this->stealTail.getReadPointer(jmin(i, 1), this->stealTailPosition), numToMix);
+        }
+        this->stealTailPosition += numToMix;
+    }
+    if (!this->isVoiceActive() || this->maxBlockSize == 0) {
         return;
     }
-//    while (--numSamples >= 0) {
-//        float amplitude = dynamics;
-//        float currentSample = getCurrentSample(amplitude);
-//        for (int i = outputBuffer.getNumChannels(); --i >= 0;) {
-//            outputBuffer.addSample(i, startSample, currentSample);
-//        }
-//        ++angle;
-//        ++startSample;
-//    }
+
+    const int requestedFactor = jmin(this->oversamplingFactor.load(), this->maxOversamplingFactor);
+    // The envelopes last as long at every sample rate, and under load the release tails decay several times faster.
+    const float envelopeRateRatio = this->getEnvelopeRateRatio();
+    const float releaseExponent = envelopeRateRatio * (float) this->releaseSpeedup;
+    // The controls are written by the message thread, they are read once for the whole block.
+    const float tailOffValue = this->tailOffFactor.load();
+    const float lfo1Frequency = this->lfo1Rate.load();
+    const float lfo2Frequency = this->lfo2Rate.load();
+    const float cutoff = this->filterCutoff.load();
+    this->releaseFactor = releaseExponent == 1.0f ? tailOffValue : std::pow(tailOffValue, releaseExponent);
+    this->attackStep = this->tailOnFactor.load() * envelopeRateRatio;
+    if (requestedFactor != this->renderFactor) {
+        // Keep the pitch of a sounding note when the rate changes.
+        this->angle.setAngleDelta(this->angle.getAngleDelta() * (float) this->renderFactor / (float) requestedFactor);
+        this->renderFactor = requestedFactor;
+        this->decimators.setFactor(requestedFactor);
+    }
+    this->unisonRenderer.setSpread(this->unisonDetune.load(), this->unisonSpread.load());
+
+    float* oversampled = this->oversampledBuffer.getWritePointer(0);
+    float* const channels[] {this->voiceBuffer.getWritePointer(0), this->voiceBuffer.getWritePointer(1)};
+    float* decimated = channels[0];
+    while (numSamples > 0 && this->isVoiceActive()) {
+        const int numToRender = jmin(numSamples, this->maxBlockSize, controlBlockSize.load());
+        const double sampleRate = this->getSampleRate();
+
+        // The modulation is evaluated once per control block, the render loops only ramp towards its values.
+        float sources[ModulationMatrix::numSources];
+        sources[ModulationMatrix::lfo1Source] = this->lfo1.advance(lfo1Frequency, numToRender, sampleRate);
+        sources[ModulationMatrix::lfo2Source] = this->lfo2.advance(lfo2Frequency, numToRender, sampleRate);
+        sources[ModulationMatrix::envelopeSource] = this->tailOff > 0.0f ? this->tailOn * this->tailOff : this->tailOn;
+        sources[ModulationMatrix::velocitySource] = this->noteVelocity;
+        sources[ModulationMatrix::modWheelSource] = this->modulationWheel;
+        sources[ModulationMatrix::expressionSource] = this->expression;
+        // A new random value every control block, and a slow random walk between values drawn every DRIFT_PERIOD.
+        sources[ModulationMatrix::noiseSource] = this->noiseGenerator.nextWhite();
+        this->driftPhase += (float) numToRender / (DRIFT_PERIOD * (float) sampleRate);
+        if (this->driftPhase >= 1.0f) {
+            this->driftPhase -= std::floor(this->driftPhase);
+            this->driftStart = this->driftTarget;
+            this->driftTarget = this->noiseGenerator.nextWhite();
+        }
+        sources[ModulationMatrix::driftSource] = this->driftStart
+                + (this->driftTarget - this->driftStart) * this->driftPhase;
+        // The expression of the note arrives at the rate of the controller, it is smoothed like the pitch wheel.
+        this->pressure += (this->targetPressure - this->pressure) * PITCH_BEND_SMOOTHING;
+        this->timbre += (this->targetTimbre - this->timbre) * PITCH_BEND_SMOOTHING;
+        sources[ModulationMatrix::pressureSource] = this->pressure;
+        sources[ModulationMatrix::timbreSource] = this->timbre;
+        float modulation[ModulationMatrix::numDestinations];
+        this->modulationMatrix.evaluate(sources, modulation);
+
+        this->pitchBendRatio += (this->targetPitchBendRatio - this->pitchBendRatio) * PITCH_BEND_SMOOTHING;
+        this->notePitchBend += (this->targetNotePitchBend - this->notePitchBend) * PITCH_BEND_SMOOTHING;
+        float semitones = modulation[ModulationMatrix::frequencyDestination] * MAX_FREQUENCY_MODULATION
+                + this->notePitchBend;
+        if (this->modulationWheel > 0.0f) {
+            this->vibratoPhase += MathConstants<float>::twoPi * VIBRATO_RATE * (float) numToRender / (float) sampleRate;
+            if (this->vibratoPhase >= MathConstants<float>::twoPi) {
+                this->vibratoPhase -= MathConstants<float>::twoPi;
+            }
+            semitones += this->modulationWheel * VIBRATO_DEPTH_SEMITONES * std::sin(this->vibratoPhase);
+        }
+        float ratio = this->pitchBendRatio;
+        if (semitones != 0.0f) {
+            ratio *= std::exp2(semitones / 12.0f);
+        }
+
+        int numChannels = 1;
+        if (this->noteRenderer != nullptr) {
+            numChannels = this->noteRenderer->getNumChannels();
+            const VoiceRenderer::ControlBlock control {ratio, this->noteAngleDelta * ratio,
+                                                       modulation[ModulationMatrix::brightnessDestination],
+                                                       sampleRate, this->renderFactor};
+            if (!this->noteRenderer->render(channels, numToRender, control, this->noiseGenerator)) {
+                this->clearCurrentNote();
+            }
+            this->applyEnvelope(channels, numChannels, numToRender);
+        } else {
+            const float targetAngleDelta = jmin(this->noteAngleDelta * ratio, MathConstants<float>::pi)
+                    / (float) this->renderFactor;
+            this->renderOversampled(oversampled, numToRender * this->renderFactor, targetAngleDelta);
+            this->decimators.process(oversampled, decimated, numToRender);
+        }
+        this->applyModulation(channels, numChannels, numToRender, modulation, cutoff);
+        for (int i = outputBuffer.getNumChannels(); --i >= 0;) {
+            kernels.add(outputBuffer.getWritePointer(i, startSample), channels[jmin(i, numChannels - 1)], numToRender);
+        }
+        startSample += numToRender;
+        numSamples -= numToRender;
+    }
+    if (!this->isVoiceActive()) {
+        this->stopRenderer();
+    }
+}
+
+void ElementaryVoice::renderOversampled(float *destination, int numSamples, float targetAngleDelta) {
+    // The envelope factors are given per device sample, scale them to the oversampled rate.
+    const float tailOnStep = attackStep / (float) this->renderFactor;
+    const float tailOffStep = this->renderFactor == 1 ? releaseFactor
+            : std::pow(releaseFactor, 1.0f / (float) this->renderFactor);
+    float angleDelta = this->angle.getAngleDelta();
+    const float angleDeltaStep = (targetAngleDelta - angleDelta) / (float) numSamples;
+    int i = 0;
 
     if (this->tailOff > 0.0) {
-        while (--numSamples >= 0) {
+        while (i < numSamples) {
             float amplitude = dynamics * tailOn * tailOff;
-            float currentSample = getCurrentSample(amplitude);
-            for (int i = outputBuffer.getNumChannels(); --i >= 0;) {
-                outputBuffer.addSample(i, startSample, currentSample);
-            }
+            destination[i++] = getCurrentSample(amplitude);
+            angleDelta += angleDeltaStep;
+            angle.setAngleDelta(angleDelta);
             ++angle;
-            ++startSample;
-            tailOff *= tailOffFactor;
+            tailOff *= tailOffStep;
             if (this->tailOff <= 0.005) {
                 clearCurrentNote();
                 angle.setAngleDelta(0.0);
@@ -193,39 +1019,205 @@ void ElementaryVoice::renderNextBlock(AudioBuffer<float> &outputBuffer, int star
             }
         }
     } else {
-        while (--numSamples >= 0) {
+        while (i < numSamples) {
             if (this->tailOn < 1.0) {
-                this->tailOn += tailOnFactor;
+                this->tailOn += tailOnStep;
             }
             float amplitude = dynamics * tailOn;
-            float currentSample = getCurrentSample(amplitude);
-            for (int i = outputBuffer.getNumChannels(); --i >= 0;) {
-                outputBuffer.addSample(i, startSample, currentSample);
-            }
+            destination[i++] = getCurrentSample(amplitude);
+            angleDelta += angleDeltaStep;
+            angle.setAngleDelta(angleDelta);
             ++angle;
-            ++startSample;
+        }
+    }
+    // The note has ended, feed silence to the decimators.
+    if (i < numSamples) {
+        FloatVectorOperations::clear(destination + i, numSamples - i);
+    }
+}
+
+std::unique_ptr<VoiceRenderer> ElementaryVoice::createRenderer(VoiceType type) {
+    switch (type) {
+        case sampleVoice:
+            return std::make_unique<SampleRenderer>(this->sampleStream, this->numSampleUnderruns);
+        case additiveVoice:
+            return std::make_unique<AdditiveRenderer>();
+        case fmVoice:
+            return std::make_unique<FmRenderer>();
+        case stringVoice:
+            return std::make_unique<StringRenderer>();
+        case noiseVoice:
+            return std::make_unique<NoiseRenderer>();
+        case granularVoice:
+            return std::make_unique<GranularRenderer>();
+        default:
+            return nullptr;
+    }
+}
+
+void ElementaryVoice::changeVoiceType(VoiceType newVoiceType) {
+    if (newVoiceType == this->voiceType.load()) {
+        return;
+    }
+    std::unique_ptr<VoiceRenderer> newRenderer = createRenderer(newVoiceType);
+    std::unique_ptr<VoiceRenderer> unusedRenderer;
+    std::unique_ptr<VoiceRenderer> oldRenderer;
+    {
+        const ScopedLock sl(this->renderLock != nullptr ? *this->renderLock : this->ownRenderLock);
+        unusedRenderer = std::move(this->pendingRenderer);
+        oldRenderer = std::move(this->retiredRenderer);
+        this->pendingRenderer = std::move(newRenderer);
+        this->pendingRendererType = newVoiceType;
+        this->voiceType.store(newVoiceType);
+    }
+    // The renderers nobody uses anymore are freed here, after the audio thread is let go.
+}
+
+void ElementaryVoice::stopRenderer() {
+    if (this->noteRenderer != nullptr) {
+        this->noteRenderer->stopNote();
+        this->noteRenderer = nullptr;
+    }
+}
+
+void ElementaryVoice::updatePatchSelection() {
+    StringArray patches;
+    switch (voiceType.load()) {
+        case additiveVoice:
+            patches = AdditiveOscillatorBank::getPatchNames();
+            break;
+        case fmVoice:
+            patches = FmEngine::getPatchNames();
+            break;
+        case stringVoice:
+            patches = WaveguideString::getPatchNames();
+            break;
+        case noiseVoice:
+            patches = NoiseOscillator::getPatchNames();
+            break;
+        case granularVoice:
+            patches = GrainCloud::getPatchNames();
+            break;
+        default:
+            break;
+    }
+    patchSelection.clear(dontSendNotification);
+    patchSelection.addItemList(patches, 1);
+    patchSelection.setEnabled(!patches.isEmpty());
+    if (!patches.isEmpty()) {
+        // Keep the patch number when switching between two types with patches.
+        patchSelection.setSelectedItemIndex(jmin(patchIndex.load(), patches.size() - 1), sendNotificationSync);
+    }
+}
+
+void ElementaryVoice::applyEnvelope(float *const *channels, int numChannels, int numSamples) {
+    const DspKernels& kernels = DspKernels::get();
+    int i = numSamples;
+    if (this->tailOff > 0.0) {
+        // The tail ends after the first sample that takes it below 0.005, the ramp stops there.
+        if (this->releaseFactor < 1.0f) {
+            const int numUntilEnd = this->releaseFactor <= 0.0f ? 1 : jmax(1, (int) std::ceil(
+                    std::log(0.005f / this->tailOff) / std::log(this->releaseFactor)));
+            i = jmin(numSamples, numUntilEnd);
+        }
+        for (int channel = 0; channel < numChannels; ++channel) {
+            kernels.multiplyByDecay(channels[channel], i, dynamics * tailOn * tailOff, releaseFactor);
+        }
+        tailOff *= std::pow(releaseFactor, (float) i);
+        if (i < numSamples || this->tailOff <= 0.005) {
+            clearCurrentNote();
+        }
+    } else {
+        // The attack ramps up until tailOn reaches 1, then the gain holds.
+        int numRamped = 0;
+        if (this->tailOn < 1.0 && attackStep > 0.0f) {
+            numRamped = jmin(numSamples, (int) std::ceil((1.0f - this->tailOn) / attackStep));
+        }
+        for (int channel = 0; channel < numChannels; ++channel) {
+            kernels.multiplyByRamp(channels[channel], numRamped, dynamics * (tailOn + attackStep),
+                                   dynamics * attackStep);
+        }
+        this->tailOn += attackStep * (float) numRamped;
+        for (int channel = 0; channel < numChannels; ++channel) {
+            kernels.multiplyByRamp(channels[channel] + numRamped, numSamples - numRamped, dynamics * tailOn, 0.0f);
+        }
+    }
+    if (i < numSamples) {
+        for (int channel = 0; channel < numChannels; ++channel) {
+            FloatVectorOperations::clear(channels[channel] + i, numSamples - i);
         }
     }
 }
 
+void ElementaryVoice::applyModulation(float *const *channels, int numChannels, int numSamples,
+                                      const float *modulation, float cutoff) {
+    const double sampleRate = this->getSampleRate();
+    // The filter is skipped while it is fully open and nothing modulates it.
+    const bool filterActive = cutoff < MAX_FILTER_CUTOFF
+            || this->modulationMatrix.isModulated(ModulationMatrix::filterCutoffDestination);
+    if (filterActive) {
+        const float octaves = modulation[ModulationMatrix::filterCutoffDestination] * MAX_CUTOFF_MODULATION;
+        const float modulatedCutoff = jlimit(MIN_FILTER_CUTOFF, 0.45f * (float) sampleRate,
+                                             cutoff * (octaves != 0.0f ? std::exp2(octaves) : 1.0f));
+        if (!this->filterWasActive) {
+            this->filter.reset(modulatedCutoff, sampleRate);
+        }
+        this->filter.process(channels, numChannels, numSamples, modulatedCutoff, sampleRate);
+    }
+    this->filterWasActive = filterActive;
+
+    const float targetGain = jmax(0.0f, 1.0f + modulation[ModulationMatrix::amplitudeDestination]);
+    if (targetGain != 1.0f || this->modulationGain != 1.0f) {
+        const float gainStep = (targetGain - this->modulationGain) / (float) numSamples;
+        for (int i = 0; i < numSamples; ++i) {
+            this->modulationGain += gainStep;
+            for (int channel = 0; channel < numChannels; ++channel) {
+                channels[channel][i] *= this->modulationGain;
+            }
+        }
+        this->modulationGain = targetGain;
+    }
+}
+
 void ElementaryVoice::sliderValueChanged(Slider *slider) {
-    shouldUpdate = true;
+    shouldUpdate.store(true);
     if (slider == &amplitudeFactorSlider) {
-        amplitudeFactor = (float) slider->getValue();
+        amplitudeFactor.store((float) slider->getValue());
     } else if (slider == &frequencyFactorSlider) {
-        frequencyFactor = (float) slider->getValue();
+        frequencyFactor.store((float) slider->getValue());
     }
     else if (slider == &tailOnSlider) {
-        tailOnFactor = (float) slider->getValue();
+        tailOnFactor.store((float) slider->getValue());
     } else if (slider == &tailOffSlider) {
-        tailOffFactor = (float) slider->getValue();
+        tailOffFactor.store((float) slider->getValue());
+    } else if (slider == &filterCutoffSlider) {
+        filterCutoff.store((float) slider->getValue());
+    } else if (slider == &lfo1RateSlider) {
+        lfo1Rate.store((float) slider->getValue());
+    } else if (slider == &lfo2RateSlider) {
+        lfo2Rate.store((float) slider->getValue());
+    } else if (slider == &unisonDetuneSlider) {
+        unisonDetune.store((float) slider->getValue());
+    } else if (slider == &unisonSpreadSlider) {
+        unisonSpread.store((float) slider->getValue());
     }
 }
 
 void ElementaryVoice::comboBoxChanged(ComboBox *comboBoxThatHasChanged) {
-    shouldUpdate = true;
+    shouldUpdate.store(true);
     if (comboBoxThatHasChanged == &voiceSelection) {
-        voiceType = voiceTypes[comboBoxThatHasChanged->getSelectedItemIndex()];
+        changeVoiceType((VoiceType) jmax(0, comboBoxThatHasChanged->getSelectedItemIndex()));
+        updatePatchSelection();
+    } else if (comboBoxThatHasChanged == &patchSelection) {
+        patchIndex.store(jmax(0, comboBoxThatHasChanged->getSelectedItemIndex()));
+    } else if (comboBoxThatHasChanged == &oversamplingSelection) {
+        setOversamplingFactor(1 << comboBoxThatHasChanged->getSelectedItemIndex());
+    } else if (comboBoxThatHasChanged == &unisonSelection) {
+        numUnisonCopies.store(unisonCopies[comboBoxThatHasChanged->getSelectedItemIndex()].getIntValue());
+    } else if (comboBoxThatHasChanged == &channelSelection) {
+        setMidiChannel(comboBoxThatHasChanged->getSelectedItemIndex());
+    } else if (comboBoxThatHasChanged == &controlBlockSizeSelection) {
+        setControlBlockSize(controlBlockSizes[comboBoxThatHasChanged->getSelectedItemIndex()].getIntValue());
     }
 }
 
@@ -250,8 +1242,28 @@ void ElementaryVoice::resized() {
     Rectangle<int> thirdRow = globalBound.removeFromTop(24);
     globalBound.removeFromTop(8);
     Rectangle<int> fourthRow = globalBound.removeFromTop(24);
+    globalBound.removeFromTop(8);
+    Rectangle<int> filterRow = globalBound.removeFromTop(24);
+    globalBound.removeFromTop(8);
+    Rectangle<int> unisonRow = globalBound.removeFromTop(24);
+    globalBound.removeFromTop(8);
+    Rectangle<int> spreadRow = globalBound.removeFromTop(24);
+    globalBound.removeFromTop(8);
+    Rectangle<int> channelRow = globalBound.removeFromTop(24);
+    globalBound.removeFromTop(8);
+    Rectangle<int> lfo1Row = globalBound.removeFromTop(24);
+    globalBound.removeFromTop(8);
+    Rectangle<int> lfo2Row = globalBound.removeFromTop(24);
+    globalBound.removeFromTop(8);
+    Rectangle<int> modulationHeader = globalBound.removeFromTop(24);
+    globalBound.removeFromTop(8);
 
     voiceSelection.setBounds(header.removeFromLeft(120));
+    header.removeFromLeft(8);
+    patchSelection.setBounds(header.removeFromLeft(100));
+    oversamplingSelection.setBounds(header.removeFromRight(80));
+    header.removeFromRight(8);
+    controlBlockSizeSelection.setBounds(header.removeFromRight(80));
 
     amplitudeFactorLabel.setBounds(firstRow.removeFromLeft(120));
     amplitudeFactorSlider.setBounds(firstRow);
@@ -264,38 +1276,261 @@ void ElementaryVoice::resized() {
 
     tailOffLabel.setBounds(fourthRow.removeFromLeft(120));
     tailOffSlider.setBounds(fourthRow);
+
+    filterCutoffLabel.setBounds(filterRow.removeFromLeft(120));
+    filterCutoffSlider.setBounds(filterRow);
+
+    unisonLabel.setBounds(unisonRow.removeFromLeft(120));
+    unisonSelection.setBounds(unisonRow.removeFromLeft(60));
+    unisonRow.removeFromLeft(8);
+    unisonDetuneSlider.setBounds(unisonRow);
+
+    unisonSpreadLabel.setBounds(spreadRow.removeFromLeft(120));
+    unisonSpreadSlider.setBounds(spreadRow);
+
+    channelLabel.setBounds(channelRow.removeFromLeft(120));
+    channelSelection.setBounds(channelRow.removeFromLeft(80));
+
+    lfo1RateLabel.setBounds(lfo1Row.removeFromLeft(120));
+    lfo1RateSlider.setBounds(lfo1Row);
+
+    lfo2RateLabel.setBounds(lfo2Row.removeFromLeft(120));
+    lfo2RateSlider.setBounds(lfo2Row);
+
+    modulationLabel.setBounds(modulationHeader.removeFromLeft(120));
+    modulationMatrixEditor.setBounds(globalBound.removeFromTop(ModulationMatrixEditor::getIdealHeight()));
 }
 
 float ElementaryVoice::getCurrentSample(float amplitude) {
-    if (voiceType == "Square") {
-        return (float) this->angle < (angle.getAngleLimit() / 2.0f) ? amplitude : -amplitude;
-    } else if (voiceType == "Sawtooth") {
-        return (float) angle * (amplitude / (angle.getAngleLimit() / 2.0f)) - amplitude;
-    } else if (voiceType == "Triangle") {
-        if ((float) angle <= angle.getAngleLimit() / 2.0f) {
-            return (4.0f * amplitude / angle.getAngleLimit()) * (float) angle - amplitude;
-        } else {
-            return (-4.0f * amplitude / angle.getAngleLimit()) * (float) angle + 3.0f * amplitude;
-        }
+    switch (noteVoiceType) {
+        case squareVoice:
+            return (float) this->angle < (angle.getAngleLimit() / 2.0f) ? amplitude : -amplitude;
+        case sawtoothVoice:
+            return (float) angle * (amplitude / (angle.getAngleLimit() / 2.0f)) - amplitude;
+        case triangleVoice:
+            if ((float) angle <= angle.getAngleLimit() / 2.0f) {
+                return (4.0f * amplitude / angle.getAngleLimit()) * (float) angle - amplitude;
+            } else {
+                return (-4.0f * amplitude / angle.getAngleLimit()) * (float) angle + 3.0f * amplitude;
+            }
+        default:
+            // If no matching voiceType return sine wave
+            return (float) std::sin((float) angle) * amplitude;
     }
-    // If no matching voiceType return sine wave
-    return (float) std::sin((float) angle) * amplitude;
 }
 
 String ElementaryVoice::toString() {
     std::stringstream ss;
-    ss << voiceType << " wave. ";
-    ss << "amp: " << std::fixed << std::setprecision(2) <<  amplitudeFactor << ". ";
-    ss << "freq: " << std::fixed << std::setprecision(2) <<  frequencyFactor << ". ";
-    ss << "on: " << std::fixed << std::setprecision(2) <<  tailOnFactor << ". ";
-    ss << "off: " << std::fixed << std::setprecision(2) <<  tailOffFactor << ".";
+    ss << getVoiceTypeNames()[voiceType.load()] << " wave. ";
+    ss << "amp: " << std::fixed << std::setprecision(2) <<  amplitudeFactor.load() << ". ";
+    ss << "freq: " << std::fixed << std::setprecision(2) <<  frequencyFactor.load() << ". ";
+    ss << "on: " << std::fixed << std::setprecision(2) <<  tailOnFactor.load() << ". ";
+    ss << "off: " << std::fixed << std::setprecision(2) <<  tailOffFactor.load() << ". ";
+    ss << "os: " << oversamplingFactor.load() << "x. ";
+    ss << "uni: " << numUnisonCopies.load() << ". ";
+    ss << "ch: " << midiChannels[midiChannel.load()] << ".";
     return ss.str();
 }
 
 bool ElementaryVoice::shouldUpdateStatus() {
-    if (shouldUpdate) {
-        shouldUpdate = false;
+    return shouldUpdate.exchange(false);
+}
+
+void ElementaryVoice::setOversamplingFactor(int newFactor) {
+    if (newFactor != 1 && newFactor != 2 && newFactor != 4 && newFactor != 8) {
+        return;
+    }
+    shouldUpdate.store(true);
+    oversamplingFactor.store(newFactor);
+}
+
+int ElementaryVoice::getOversamplingFactor() const {
+    return oversamplingFactor.load();
+}
+
+void ElementaryVoice::setSampleLibrary(const SampleLibrary *newSampleLibrary) {
+    this->sampleLibrary = newSampleLibrary;
+    if (this->noteRenderer != nullptr && this->noteRenderer->isUsingSample()) {
+        this->clearCurrentNote();
+        this->stopRenderer();
+    }
+}
+
+SampleStream& ElementaryVoice::getSampleStream() {
+    return sampleStream;
+}
+
+void ElementaryVoice::setDelayLine(float *newLine, int newLineLength) {
+    this->delayLine = newLine;
+    this->delayLineLength = newLineLength;
+    if (this->noteRenderer != nullptr && this->noteVoiceType == stringVoice) {
+        this->clearCurrentNote();
+        this->stopRenderer();
+    }
+}
+
+const float* ElementaryVoice::getDelayLine() const {
+    return delayLine;
+}
+
+void ElementaryVoice::setRenderLock(const CriticalSection *newRenderLock) {
+    renderLock = newRenderLock;
+}
+
+void ElementaryVoice::setNoiseSeed(uint32 seed) {
+    pendingNoiseSeed.store((int64) seed);
+}
+
+int ElementaryVoice::getNumSampleUnderruns() const {
+    return numSampleUnderruns.load();
+}
+
+void ElementaryVoice::setTuningTable(const TuningTable *newTuningTable) {
+    this->tuningTable = newTuningTable;
+}
+
+float ElementaryVoice::getPitchBendRatio(int pitchWheelValue) const {
+    if (this->tuningTable != nullptr) {
+        return this->tuningTable->getPitchBendRatio(pitchWheelValue);
+    }
+    // Without a table the pitch wheel has the default range of two semitones.
+    const float position = (float) (pitchWheelValue - 8192) / 8192.0f;
+    return std::exp2(position * 2.0f / 12.0f);
+}
+
+float ElementaryVoice::getEnvelopeRateRatio() const {
+    if (this->tuningTable != nullptr && this->tuningTable->getSampleRate() == this->getSampleRate()) {
+        return this->tuningTable->getEnvelopeRateRatio();
+    }
+    return (float) (TuningTable::ENVELOPE_REFERENCE_SAMPLE_RATE / this->getSampleRate());
+}
+
+void ElementaryVoice::setControlBlockSize(int newControlBlockSize) {
+    if (newControlBlockSize != 16 && newControlBlockSize != 32) {
+        return;
+    }
+    shouldUpdate.store(true);
+    controlBlockSize.store(newControlBlockSize);
+}
+
+int ElementaryVoice::getControlBlockSize() const {
+    return controlBlockSize.load();
+}
+
+float ElementaryVoice::getEnvelopeLevel() const {
+    if (!this->isVoiceActive()) {
+        return 0.0f;
+    }
+    return this->tailOff > 0.0f ? this->dynamics * this->tailOff : this->dynamics;
+}
+
+void ElementaryVoice::captureStealTail() {
+    if (!this->isVoiceActive() || this->maxBlockSize == 0) {
+        return;
+    }
+    // What is left of the tail of an earlier steal is moved to the front, and the new tail is added to it.
+    const int numLeft = this->stealTailLength - this->stealTailPosition;
+    for (int channel = 0; channel < this->stealTail.getNumChannels(); ++channel) {
+        float* samples = this->stealTail.getWritePointer(channel);
+        std::memmove(samples, samples + this->stealTailPosition, sizeof(float) * (size_t) numLeft);
+        FloatVectorOperations::clear(samples + numLeft, STEAL_FADE_SAMPLES - numLeft);
+    }
+    this->stealTailLength = 0;
+    this->stealTailPosition = 0;
+    this->renderNextBlock(this->stealTail, 0, STEAL_FADE_SAMPLES);
+    this->stealTail.applyGainRamp(0, STEAL_FADE_SAMPLES, 1.0f, 0.0f);
+    this->stealTailLength = STEAL_FADE_SAMPLES;
+}
+
+void ElementaryVoice::setMidiChannel(int newMidiChannel) {
+    if (!isPositiveAndNotGreaterThan(newMidiChannel, MultitimbralSynthesiser::NUM_CHANNELS)) {
+        return;
+    }
+    shouldUpdate.store(true);
+    midiChannel.store(newMidiChannel);
+}
+
+int ElementaryVoice::getMidiChannel() const {
+    return midiChannel.load();
+}
+
+void ElementaryVoice::setQualityLimits(const QualityGovernor::Level &level) {
+    this->maxOversamplingFactor = level.maxOversamplingFactor;
+    this->releaseSpeedup = level.releaseSpeedup;
+    this->maxUnisonCopies = level.maxUnisonCopies;
+}
+
+ModulationMatrix& ElementaryVoice::getModulationMatrix() {
+    return modulationMatrix;
+}
+
+bool ElementaryVoice::setParameter(const String &parameterName, float value) {
+    Slider* slider = nullptr;
+    if (parameterName == "amplitude") {
+        slider = &amplitudeFactorSlider;
+    } else if (parameterName == "frequency") {
+        slider = &frequencyFactorSlider;
+    } else if (parameterName == "tailOn") {
+        slider = &tailOnSlider;
+    } else if (parameterName == "tailOff") {
+        slider = &tailOffSlider;
+    } else if (parameterName == "cutoff") {
+        slider = &filterCutoffSlider;
+    } else if (parameterName == "lfo1Rate") {
+        slider = &lfo1RateSlider;
+    } else if (parameterName == "lfo2Rate") {
+        slider = &lfo2RateSlider;
+    } else if (parameterName == "detune") {
+        slider = &unisonDetuneSlider;
+    } else if (parameterName == "spread") {
+        slider = &unisonSpreadSlider;
+    }
+    if (slider != nullptr) {
+        slider->setValue(value, sendNotificationSync);
         return true;
     }
-    return false;
+
+    ComboBox* comboBox = nullptr;
+    int index = -1;
+    if (parameterName == "oversampling") {
+        comboBox = &oversamplingSelection;
+        index = oversamplingFactors.indexOf(String(roundToInt(value)) + "x");
+    } else if (parameterName == "controlRate") {
+        comboBox = &controlBlockSizeSelection;
+        index = controlBlockSizes.indexOf(String(roundToInt(value)));
+    } else if (parameterName == "unison") {
+        comboBox = &unisonSelection;
+        index = unisonCopies.indexOf(String(roundToInt(value)));
+    } else if (parameterName == "channel") {
+        comboBox = &channelSelection;
+        index = midiChannels.indexOf(roundToInt(value) == 0 ? String("Omni") : String(roundToInt(value)));
+    } else if (parameterName == "patch") {
+        comboBox = &patchSelection;
+        index = isPositiveAndBelow(roundToInt(value), patchSelection.getNumItems()) ? roundToInt(value) : -1;
+    }
+    if (parameterName == "seed") {
+        if (value < 0.0f) {
+            return false;
+        }
+        setNoiseSeed((uint32) value);
+        return true;
+    }
+    if (comboBox == nullptr || index < 0) {
+        return false;
+    }
+    comboBox->setSelectedItemIndex(index, sendNotificationSync);
+    return true;
+}
+
+bool ElementaryVoice::setVoiceType(const String &newVoiceType) {
+    const int index = getVoiceTypeNames().indexOf(newVoiceType);
+    if (index < 0) {
+        return false;
+    }
+    setVoiceType((VoiceType) index);
+    return true;
+}
+
+void ElementaryVoice::setVoiceType(VoiceType newVoiceType) {
+    voiceSelection.setSelectedItemIndex(newVoiceType, sendNotificationSync);
 }
@@ -11,6 +11,27 @@
 #pragma once
 
 #include "JuceHeader.h"
+#include "EffectsBus.h"
+#include "OutputStage.h"
+#include "Decimation.h"
+#include "Tuning.h"
+#include "SampleRateCache.h"
+#include "Modulation.h"
+#include "MidiMessageQueue.h"
+#include "MidiSequencer.h"
+#include "Sampler.h"
+#include "Additive.h"
+#include "FmSynthesis.h"
+#include "Unison.h"
+#include "PhysicalModel.h"
+#include "Noise.h"
+#include "Granular.h"
+#include "VoiceAllocator.h"
+#include "QualityGovernor.h"
+#include "DspKernels.h"
+#include "RealtimeLog.h"
+#include "VoiceRenderer.h"
+#include <atomic>
 #include <cmath>
 
 class PeriodicAngle {
@@ -39,7 +60,8 @@ public:
 
     void setAngleDelta(float newAngleDelta) {
         if (!checkAngleDelta(newAngleDelta)) {
-            std::cerr << "Invalid angleDelta. It should be bigger than the angleLimit. " << std::endl;
+            // It is reached from the audio thread, so the message is formatted later.
+            RealtimeLog::getInstance().post(RealtimeLog::invalidAngleDelta, newAngleDelta, angleLimit);
             return;
         }
         angleDelta = newAngleDelta;
@@ -51,7 +73,7 @@ public:
 
     void setAngleLimit(float newAngleLimit) {
         if (!checkAngleLimit(newAngleLimit)) {
-            std::cerr << "Invalid angleLimit. It should be bigger than the angleLimit. " << std::endl;
+            RealtimeLog::getInstance().post(RealtimeLog::invalidAngleLimit, newAngleLimit, angleDelta);
             return;
         }
         angleLimit = newAngleLimit;
@@ -121,16 +143,65 @@ class ElementarySound : public SynthesiserSound {
     bool appliesToChannel (int midiChannel) override;
 };
 
+/**
+ * A voice of the synthesiser, with the controls of its timbre.
+ * The voice plays a single copy of the "Sine", "Square", "Triangle" and "Sawtooth" types itself, at the oversampled
+ * rate. Their unison copies and the other types are played by a VoiceRenderer the voice owns, with only one active at
+ * a time. Whatever the type, the voice applies the envelope, the modulation matrix and the filter to the note.
+ */
 class ElementaryVoice :
 public SynthesiserVoice, public Component, public Slider::Listener, public ComboBox::Listener {
 public:
+    /** The voice types, the waveforms first in the order of UnisonOscillator::Waveform */
+    enum VoiceType {
+        sineVoice = 0,
+        squareVoice,
+        triangleVoice,
+        sawtoothVoice,
+        sampleVoice,
+        additiveVoice,
+        fmVoice,
+        stringVoice,
+        noiseVoice,
+        granularVoice,
+        numVoiceTypes
+    };
+
+    /**
+     * The names of the voice types
+     * @return the names, in the order of VoiceType
+     */
+    static StringArray getVoiceTypeNames();
+
 //// ==============================================================================
 //// Constructors and destructors
 //// ==============================================================================
 
+    /**
+     * Create a voice of a type
+     * @param newVoiceType the voice type of the first note
+     */
+    explicit ElementaryVoice(VoiceType newVoiceType);
+
+    /**
+     * Create a voice of a type given by its name
+     * @param newVoiceType one of the names of getVoiceTypeNames()
+     */
     explicit ElementaryVoice(const String& newVoiceType);
     ~ElementaryVoice() override = default;
 
+//// ==============================================================================
+//// Audio source life cycle
+//// ==============================================================================
+
+    /**
+     * Allocate the render buffers of the voice for the largest oversampling factor.
+     * It is called by the VoiceSynthesiser before the voice is rendered, never from the audio callback.
+     * @param samplesPerBlockExpected the expected device block size
+     * @param sampleRate the device sample rate
+     */
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate);
+
 //// ==============================================================================
 //// Voice rendering methods
 //// ==============================================================================
@@ -140,6 +211,8 @@ public:
     void stopNote(float velocity, bool allowTailOff) override;
     void pitchWheelMoved(int newPitchWheelValue) override;
     void controllerMoved(int controllerNumber, int newControllerValue) override;
+    void aftertouchChanged(int newAftertouchValue) override;
+    void channelPressureChanged(int newChannelPressureValue) override;
     void renderNextBlock(AudioBuffer<float> &outputBuffer, int startSample, int numSamples) override;
 
 //// ==============================================================================
@@ -163,41 +236,548 @@ public:
     String toString();
     bool shouldUpdateStatus();
 
+    /**
+     * Set the internal oversampling factor of the voice.
+     * The voice renders at the oversampled rate and decimates back to the device rate, which reduces aliasing of the
+     * square, triangle and sawtooth waves at the expense of CPU. It can be called from any thread.
+     * @param newFactor 1, 2, 4 or 8
+     */
+    void setOversamplingFactor(int newFactor);
+    int getOversamplingFactor() const;
+
+    /**
+     * Apply the limits of the quality governor. The oversampling and the release tails follow them from the next
+     * block, the unison from the next note. It should only be called from the audio thread.
+     * @param level the quality level of the synthesiser
+     */
+    void setQualityLimits(const QualityGovernor::Level& level);
+
+    /**
+     * Set the tuning table used by the following notes. It is called from the audio thread before every block.
+     * @param newTuningTable the table, or nullptr to compute the 12-TET frequencies on every note
+     */
+    void setTuningTable(const TuningTable* newTuningTable);
+
+    /**
+     * Set the samples played by the "Sample" voice type. It is called with the lock of the synthesiser held,
+     * and stops a note playing from the previous library.
+     * @param newSampleLibrary the library, or nullptr if no samples are loaded
+     */
+    void setSampleLibrary(const SampleLibrary* newSampleLibrary);
+
+    /**
+     * Get the stream of the samples played by the voice, filled by the SamplePrefetcher of the synthesiser
+     * @return the sample stream
+     */
+    SampleStream& getSampleStream();
+
+    /**
+     * The number of control blocks where the prefetcher had not streamed the sample in time
+     * @return the counter of sample underruns
+     */
+    int getNumSampleUnderruns() const;
+
+    /**
+     * Set the delay line of the "String" voice type, handed out by the DelayLineArena of the synthesiser. It is
+     * called with the lock of the synthesiser held, and stops a string note playing on the previous line.
+     * @param newLine the first sample of the line, or nullptr
+     * @param newLineLength the number of samples of the line
+     */
+    void setDelayLine(float* newLine, int newLineLength);
+
+    /**
+     * Get the delay line of the "String" voice type
+     * @return the line, or nullptr if the voice has none
+     */
+    const float* getDelayLine() const;
+
+    /**
+     * Set the lock the synthesiser renders the voice under. The renderer of a new voice type is handed to the audio
+     * thread under it. It is called by the VoiceSynthesiser before the voice is added, and a voice without one
+     * uses a lock of its own.
+     * @param newRenderLock the lock of the synthesiser
+     */
+    void setRenderLock(const CriticalSection* newRenderLock);
+
+    /**
+     * Restart the noise of the voice from a seed, so that an offline render is reproducible. It can be called from
+     * any thread, and is applied at the next note.
+     * The noise feeds the "Noise" voice type, the noise and drift modulation sources, the plucks of the strings and
+     * the phases of the unison copies.
+     * @param seed the seed of the noise generator
+     */
+    void setNoiseSeed(uint32 seed);
+
+    /**
+     * Set how often the modulation is evaluated. It can be called from any thread.
+     * The modulation is interpolated linearly between two control points.
+     * @param newControlBlockSize the number of samples between two control points, 16 or 32
+     */
+    void setControlBlockSize(int newControlBlockSize);
+    int getControlBlockSize() const;
+
+    /**
+     * Set the MIDI channel the voice answers, i.e. its part. It can be called from any thread, and the synthesiser
+     * moves the voice to its new part before the next block.
+     * @param newMidiChannel from 1 to 16, or 0 to answer every channel
+     */
+    void setMidiChannel(int newMidiChannel);
+    int getMidiChannel() const;
+
+    /**
+     * The level of the envelope of the note, without the attack ramp, so that a note that has just started is not
+     * mistaken for a quiet one
+     * @return the velocity and amplitude factor of the note, decayed by its tail, or 0 if the voice is silent
+     */
+    float getEnvelopeLevel() const;
+
+    /**
+     * Render the next few milliseconds of the note, faded out, before the voice is stolen by another note.
+     * The tail is mixed into the first samples of the next note, so the stolen note does not click.
+     * It is called on the audio thread with the lock of the synthesiser held, and does nothing if the voice is silent.
+     */
+    void captureStealTail();
+
+    /**
+     * Set the expression the next note starts with, without smoothing. It is called before the note is started, so
+     * an MPE note starts with the bend, pressure and timbre its channel had before the note-on.
+     * @param pitchBendSemitones the pitch bend of the note alone, on top of the pitch wheel of the channel
+     * @param newPressure the pressure, between 0 and 1
+     * @param newTimbre the timbre, or CC74, between 0 and 1
+     */
+    void resetNoteExpression(float pitchBendSemitones, float newPressure, float newTimbre);
+
+    /**
+     * Bend the pitch of the current note alone, as the member channel of an MPE note does. The bend is smoothed
+     * once per control block, like the pitch wheel.
+     * @param semitones the bend, in semitones
+     */
+    void setNotePitchBend(float semitones);
+
+    /**
+     * Get the modulation matrix of the voice
+     * @return the modulation matrix
+     */
+    ModulationMatrix& getModulationMatrix();
+
+    /**
+     * Set a parameter of the voice by its name, as if its control was changed. It should be called from the
+     * message thread.
+     * @param parameterName one of "amplitude", "frequency", "tailOn", "tailOff", "cutoff", "lfo1Rate", "lfo2Rate",
+     * "oversampling", "controlRate", "patch", the index of the additive, FM, string, noise or granular patch,
+     * "unison", the number of copies of every note, "detune", "spread", "seed", see setNoiseSeed(), and "channel",
+     * see setMidiChannel()
+     * @param value the new value of the parameter
+     * @return false if the name or the value is not valid
+     */
+    bool setParameter(const String& parameterName, float value);
+
+    /**
+     * Change the waveform of the voice from the next note. It should be called from the message thread.
+     * @param newVoiceType one of the names of getVoiceTypeNames()
+     * @return false if the voice type is unknown
+     */
+    bool setVoiceType(const String& newVoiceType);
+
+    /**
+     * Change the waveform of the voice from the next note. It should be called from the message thread.
+     * @param newVoiceType the new voice type
+     */
+    void setVoiceType(VoiceType newVoiceType);
+
 private:
-    bool shouldUpdate = false;
+    std::atomic<bool> shouldUpdate {false};
 
-    const StringArray voiceTypes {"Sine", "Square", "Triangle", "Sawtooth"};
-    String voiceType {"Sine"};
+    /** The VoiceType chosen on the message thread */
+    std::atomic<int> voiceType {sineVoice};
+    /**
+     * The voice type of the current note, read once by startNote() so that a note keeps its type. The render loop
+     * dispatches on it, and its engine is the only one started for the note.
+     */
+    VoiceType noteVoiceType = sineVoice;
     ComboBox voiceSelection {"voiceSelection"};
 
-    const float NYQUIST_FREQUENCY = 44100.0f;
+    const StringArray oversamplingFactors {"1x", "2x", "4x", "8x"};
+    ComboBox oversamplingSelection {"oversamplingSelection"};
+    std::atomic<int> oversamplingFactor {1};
+    /** The oversampling factor used by the audio thread. It follows oversamplingFactor at block boundaries. */
+    int renderFactor = 1;
+    /** The limits of the quality governor, only used by the audio thread */
+    int maxOversamplingFactor = 8;
+    int releaseSpeedup = 1;
+    int maxUnisonCopies = 16;
+    int maxBlockSize = 0;
+    AudioBuffer<float> oversampledBuffer;
+    AudioBuffer<float> voiceBuffer;
+    DecimatorCascade decimators;
+
+    /** The faded tail of a stolen note, about a millisecond long, mixed into the first samples of the next note */
+    const int STEAL_FADE_SAMPLES = 64;
+    AudioBuffer<float> stealTail;
+    int stealTailLength = 0;
+    int stealTailPosition = 0;
+
+    /**
+     * The modulation is evaluated once per control block, independently of the device block size,
+     * and the phase increment, the filter coefficients and the gain are ramped in between.
+     */
+    const StringArray controlBlockSizes {"16", "32"};
+    ComboBox controlBlockSizeSelection {"controlBlockSizeSelection"};
+    std::atomic<int> controlBlockSize {32};
+    const float PITCH_BEND_SMOOTHING = 0.25f;
+    const float VIBRATO_RATE = 5.5f;
+    const float VIBRATO_DEPTH_SEMITONES = 0.5f;
+
+    const TuningTable* tuningTable = nullptr;
+    /** The phase increment of the current note at the device rate, without any modulation */
+    float noteAngleDelta = 0.0f;
+    float pitchBendRatio = 1.0f;
+    float targetPitchBendRatio = 1.0f;
+    float modulationWheel = 0.0f;
+    float expression = 1.0f;
+    /** The expression of the note, smoothed towards its target once per control block */
+    float notePitchBend = 0.0f;
+    float targetNotePitchBend = 0.0f;
+    float pressure = 0.0f;
+    float targetPressure = 0.0f;
+    float timbre = 0.0f;
+    float targetTimbre = 0.0f;
+    float vibratoPhase = 0.0f;
+    float noteVelocity = 0.0f;
+
+    /** The frequency destination shifts the pitch by up to this many semitones */
+    const float MAX_FREQUENCY_MODULATION = 12.0f;
+    /** The filter cutoff destination shifts the cutoff by up to this many octaves */
+    const float MAX_CUTOFF_MODULATION = 4.0f;
+    const float MAX_FILTER_CUTOFF = 20000.0f;
+    const float MIN_FILTER_CUTOFF = 20.0f;
+
+    ModulationMatrix modulationMatrix;
+    ModulationMatrixEditor modulationMatrixEditor {modulationMatrix};
+    Label modulationLabel {"modulationLabel", "Modulation:"};
+    Lfo lfo1 {Lfo::sine};
+    Lfo lfo2 {Lfo::triangle};
+    float modulationGain = 1.0f;
+    StateVariableFilter filter;
+    bool filterWasActive = false;
+
+    std::atomic<float> lfo1Rate {2.0f};
+    Slider lfo1RateSlider
+        {Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::TextBoxLeft};
+    Label lfo1RateLabel {"lfo1RateLabel", "LFO 1 rate:"};
+
+    std::atomic<float> lfo2Rate {0.5f};
+    Slider lfo2RateSlider
+        {Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::TextBoxLeft};
+    Label lfo2RateLabel {"lfo2RateLabel", "LFO 2 rate:"};
+
+    /**
+     * The samples of the "Sample" and "Granular" voice types. The stream is registered with the prefetcher of the
+     * synthesiser for the life of the voice, so it stays in the voice and the sample renderer plays through it.
+     */
+    const SampleLibrary* sampleLibrary = nullptr;
+    SampleStream sampleStream;
+    std::atomic<int> numSampleUnderruns {0};
+
+    /**
+     * The patch of the "Additive", "FM", "String", "Noise" and "Granular" voice types. The list follows the voice
+     * type.
+     */
+    ComboBox patchSelection {"patchSelection"};
+    std::atomic<int> patchIndex {0};
+
+    /**
+     * The engine of the voice type, for the types that render their notes themselves. A new one is built on the
+     * message thread and handed over under the render lock: it waits in pendingRenderer until the next note starts,
+     * and the one it replaces waits in retiredRenderer until the next change of voice type frees it, so the audio
+     * thread never allocates or frees a renderer.
+     */
+    std::unique_ptr<VoiceRenderer> renderer;
+    VoiceType rendererType = numVoiceTypes;
+    std::unique_ptr<VoiceRenderer> pendingRenderer;
+    VoiceType pendingRendererType = numVoiceTypes;
+    std::unique_ptr<VoiceRenderer> retiredRenderer;
+    /** The renderer playing the current note, or nullptr if the voice plays it itself */
+    VoiceRenderer* noteRenderer = nullptr;
+    const CriticalSection* renderLock = nullptr;
+    CriticalSection ownRenderLock;
+
+    /**
+     * The "Sine", "Square", "Triangle" and "Sawtooth" voice types can play several detuned copies of every note,
+     * spread across the stereo field. A note of several copies is played by the unison renderer.
+     */
+    const StringArray unisonCopies {"1", "2", "3", "4", "5", "6", "7", "8", "12", "16"};
+    ComboBox unisonSelection {"unisonSelection"};
+    Label unisonLabel {"unisonLabel", "Unison:"};
+    std::atomic<int> numUnisonCopies {1};
+    std::atomic<float> unisonDetune {15.0f};
+    Slider unisonDetuneSlider
+        {Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::TextBoxLeft};
+    std::atomic<float> unisonSpread {0.5f};
+    Slider unisonSpreadSlider
+        {Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::TextBoxLeft};
+    Label unisonSpreadLabel {"unisonSpreadLabel", "Stereo spread:"};
+    UnisonRenderer unisonRenderer;
+
+    /** The MIDI channel of the part of the voice, 0 in omni mode */
+    const StringArray midiChannels {"Omni", "1", "2", "3", "4", "5", "6", "7", "8", "9", "10", "11", "12", "13", "14",
+                                    "15", "16"};
+    ComboBox channelSelection {"channelSelection"};
+    Label channelLabel {"channelLabel", "MIDI channel:"};
+    std::atomic<int> midiChannel {0};
+
+    /** The delay line of the "String" voice type, from the DelayLineArena of the synthesiser */
+    float* delayLine = nullptr;
+    int delayLineLength = 0;
+
+    /**
+     * The noise of the voice, drawn by the "Noise" voice type, the noise and drift modulation sources, the plucks of
+     * the strings and the phases of the unison copies
+     */
+    NoiseGenerator noiseGenerator;
+    /** The seed set by setNoiseSeed(), or -1 once it has been applied */
+    std::atomic<int64> pendingNoiseSeed {-1};
+    /** The drift source moves to a new random value in this time, in seconds */
+    const float DRIFT_PERIOD = 0.25f;
+    float driftPhase = 0.0f;
+    float driftStart = 0.0f;
+    float driftTarget = 0.0f;
+
+    std::atomic<float> filterCutoff {20000.0f};
+    Slider filterCutoffSlider
+        {Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::TextBoxLeft};
+    Label filterCutoffLabel {"filterCutoffLabel", "Filter cutoff:"};
 
     mutable PeriodicAngle angle;
     float dynamics = 0.0f;
     float tailOn = 0.0f;
     float tailOff = 0.0f;
 
-    float amplitudeFactor = 1.0f;
+    std::atomic<float> amplitudeFactor {1.0f};
     Slider amplitudeFactorSlider
         {Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::TextBoxLeft};
     Label amplitudeFactorLabel {"amplitudeFactorLabel", "Amplitude factor:"};
 
-    float frequencyFactor = 1.0f;
+    std::atomic<float> frequencyFactor {1.0f};
     Slider frequencyFactorSlider
         {Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::TextBoxLeft};;
     Label frequencyFactorLabel {"frequencyFactorLabel", "Frequency factor:"};
 
-    float tailOnFactor = 1.0f;
+    std::atomic<float> tailOnFactor {1.0f};
+    /** The attack increment in the current block, tailOnFactor scaled to the sample rate */
+    float attackStep = 1.0f;
     Slider tailOnSlider
         {Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::TextBoxLeft};;
     Label tailOnLabel {"tailOnLabel", "Tail on value:"};
 
-    float tailOffFactor = 0.0f;
+    std::atomic<float> tailOffFactor {0.0f};
+    /** The decay of the release tails in the current block, tailOffFactor scaled to the sample rate and the load */
+    float releaseFactor = 0.0f;
     Slider tailOffSlider
         {Slider::SliderStyle::LinearHorizontal, Slider::TextEntryBoxPosition::TextBoxLeft};;
     Label tailOffLabel {"tailOffLabel", "Tail off value:"};
 
     inline float getCurrentSample(float amplitude);
+
+    /**
+     * Render the voice at the oversampled rate into a mono buffer.
+     * If the note ends inside the block, the rest of the block is cleared.
+     * @param destination the buffer to overwrite
+     * @param numSamples the number of oversampled samples to render
+     * @param targetAngleDelta the phase increment reached at the end of the block. It is ramped linearly.
+     */
+    void renderOversampled(float* destination, int numSamples, float targetAngleDelta);
+
+    /**
+     * Build the renderer of a voice type. It allocates, so it is only called on the message thread.
+     * @param type the voice type
+     * @return the renderer, or nullptr for the types rendered by the voice itself
+     */
+    std::unique_ptr<VoiceRenderer> createRenderer(VoiceType type);
+
+    /**
+     * Switch the voice to another type from the next note, and hand its renderer to the audio thread.
+     * It is called on the message thread.
+     * @param newVoiceType the new voice type
+     */
+    void changeVoiceType(VoiceType newVoiceType);
+
+    /**
+     * Stop the note of the renderer. It is called on the audio thread when a note ends or is replaced.
+     */
+    void stopRenderer();
+
+    /**
+     * Fill the patch selection with the patches of the current voice type, and disable it for the other types.
+     */
+    void updatePatchSelection();
+
+    /**
+     * Apply the envelope of the note to a block rendered at the device rate.
+     * If the note ends inside the block, the rest of the block is cleared.
+     * @param channels the samples of every channel to scale in place
+     * @param numChannels the number of channels, one or two
+     * @param numSamples the number of samples
+     */
+    void applyEnvelope(float* const* channels, int numChannels, int numSamples);
+
+    /**
+     * Apply the modulated filter and gain to a decimated control block, ramping both from their previous values.
+     * @param channels the samples of every channel at the device rate
+     * @param numChannels the number of channels, one or two
+     * @param numSamples the length of the control block
+     * @param modulation the output of the modulation matrix for this control block
+     * @param cutoff the unmodulated filter cutoff of the host block
+     */
+    void applyModulation(float* const* channels, int numChannels, int numSamples, const float* modulation,
+                         float cutoff);
+
+    /**
+     * Get the frequency ratio of a pitch wheel position
+     * @param pitchWheelValue the 14 bit pitch wheel value
+     * @return the ratio from the tuning table, or computed if there is no table
+     */
+    float getPitchBendRatio(int pitchWheelValue) const;
+
+    /**
+     * Get the ratio scaling the envelope factors to the sample rate
+     * @return the ratio from the tuning table, or computed if there is no table of the current rate
+     */
+    float getEnvelopeRateRatio() const;
+};
+
+/**
+ * A synthesiser with up to sixteen parts, one per MIDI channel.
+ * Every voice answers one MIDI channel, or all of them in omni mode, and plays the timbre set on it. A table
+ * lists the voices of every channel, so a channel event only visits the voices of its part, and the sound checks
+ * are skipped since the only sound applies to every note and channel. The notes are given their voices by a
+ * VoiceAllocator, so a note-on or a note-off does not visit the voices at all. A sounding voice that is stolen
+ * fades out its note under the new one.
+ * The tables are rebuilt when a voice is added, removed or moved to another channel, never while an event is
+ * dispatched.
+ * In MPE mode the synthesiser follows a lower zone: the voices of channel 1 play the notes of the member channels 2
+ * to 16, every note on a channel of its own. The pitch wheel, pressure and CC74 of a member channel go to the voice
+ * last started on it alone, while the events of channel 1 go to every voice of the zone.
+ */
+class MultitimbralSynthesiser : public Synthesiser {
+public:
+    static constexpr int NUM_CHANNELS = VoiceAllocator::NUM_GROUPS;
+    static constexpr int MAX_VOICES = VoiceAllocator::MAX_VOICES;
+    static constexpr int MPE_MASTER_CHANNEL = 1;
+    /** The pitch bend range of the member channels, the default of the MPE specification */
+    static constexpr float MPE_NOTE_BEND_RANGE = 48.0f;
+
+    /**
+     * Rebuild the channel table if the voices or their channels have changed, and give the voices that have
+     * finished back to the allocator. A voice moved away from the channel of its note releases it. It is called on
+     * the audio thread before every block, and after voices are added or removed.
+     */
+    void updateVoiceTables();
+
+    /**
+     * Take a voice out of the synthesiser without deleting it, so that its resources can be given back once the
+     * audio thread cannot render it anymore. The caller holds the lock of the synthesiser.
+     * @param index the index of the voice
+     * @return the voice, now owned by the caller, or nullptr if the index is out of range
+     */
+    ElementaryVoice* detachVoice(int index);
+
+    /**
+     * Set how a voice is stolen when a note finds every voice of its part busy. It can be called from any thread,
+     * and applies from the next block.
+     * @param newPolicy the stealing policy
+     */
+    void setStealingPolicy(VoiceAllocator::StealingPolicy newPolicy);
+    VoiceAllocator::StealingPolicy getStealingPolicy() const;
+
+    /**
+     * Switch the MPE lower zone on or off. It can be called from any thread, and applies from the next block.
+     * @param shouldBeEnabled true to read the channels as an MPE zone
+     */
+    void setMpeEnabled(bool shouldBeEnabled);
+    bool isMpeEnabled() const;
+
+    /**
+     * Pass the limits of a quality level to the voices, and steal the quietest voices beyond the number it allows.
+     * It is called on the audio thread before every block.
+     * @param level the quality level
+     */
+    void applyQualityLevel(const QualityGovernor::Level& level);
+
+    void noteOn(int midiChannel, int midiNoteNumber, float velocity) override;
+    void noteOff(int midiChannel, int midiNoteNumber, float velocity, bool allowTailOff) override;
+    void handlePitchWheel(int midiChannel, int wheelValue) override;
+    void handleController(int midiChannel, int controllerNumber, int controllerValue) override;
+    void handleAftertouch(int midiChannel, int midiNoteNumber, int aftertouchValue) override;
+    void handleChannelPressure(int midiChannel, int channelPressureValue) override;
+    void handleSustainPedal(int midiChannel, bool isDown) override;
+    void handleSostenutoPedal(int midiChannel, bool isDown) override;
+
+private:
+    /**
+     * The indices of the voices answering a MIDI channel, in the order they were added
+     */
+    struct Part {
+        int voices[MAX_VOICES];
+        int numVoices = 0;
+    };
+
+    Part parts[NUM_CHANNELS];
+    /** The voices and their channels when the table was built */
+    ElementaryVoice* routedVoices[MAX_VOICES] {};
+    int routedChannels[MAX_VOICES] {};
+    int numRoutedVoices = 0;
+
+    VoiceAllocator allocator;
+    std::atomic<int> stealingPolicy {VoiceAllocator::oldestVoice};
+    std::atomic<bool> mpeEnabled {false};
+    /** Whether the table was built for the MPE zone */
+    bool routedMpe = false;
+    /** The voice last started on every channel, the one an MPE member channel sends its expression to */
+    int channelVoices[NUM_CHANNELS] {};
+    /** The expression of every channel, which the next note on it starts with */
+    float channelNoteBends[NUM_CHANNELS] {};
+    float channelPressures[NUM_CHANNELS] {};
+    float channelTimbres[NUM_CHANNELS] {};
+
+    /**
+     * Get the part of a channel
+     * @param midiChannel the MIDI channel, from 1 to 16
+     * @return the part, or nullptr if the channel is out of range
+     */
+    const Part* getPart(int midiChannel) const;
+
+    /**
+     * Find the voice holding a note
+     * @param midiChannel the MIDI channel of the note, from 1 to 16
+     * @param midiNoteNumber the MIDI note number
+     * @return the index of the voice, or -1 if no voice plays the note on the channel
+     */
+    int findNoteVoice(int midiChannel, int midiNoteNumber) const;
+
+    /**
+     * Find the voice of the note of an MPE member channel
+     * @param midiChannel the MIDI channel, from 1 to 16
+     * @return the index of the voice, or -1 if the channel is not a member channel or plays no note
+     */
+    int findMemberVoice(int midiChannel) const;
+
+    /**
+     * Whether a voice of the part of a channel receives its channel events: the voices playing the channel, and
+     * every voice of the zone for the master channel of MPE
+     * @param voice a voice of the part of the channel
+     * @param midiChannel the MIDI channel, from 1 to 16
+     * @return true if the voice receives the events
+     */
+    bool receivesChannel(ElementaryVoice* voice, int midiChannel) const;
+
+    /**
+     * Stop the note of a voice, and tell the allocator it is released
+     * @param voiceIndex the index of the voice
+     * @param velocity the note-off velocity
+     * @param allowTailOff false to stop the voice at once
+     */
+    void releaseVoice(int voiceIndex, float velocity, bool allowTailOff);
 };
 
 class VoiceSynthesiser : public AudioSource {
@@ -219,17 +799,29 @@ public:
 
     /**
      * Called when the audio source is changing from prepared state to unprepared state.
-     * This function is NOP
+     * It releases the resources of the effects bus.
      */
     void releaseResources() override;
 
     /**
      * Render the next audio buffer.
      * This function accepts a reference to the buffer we need to fill.
+     * The mixed voices are then processed by the effects bus, so reverb and delay tails keep ringing
+     * even if all the voices are removed. At last the output stage limits the sum of all the voices.
      * @param bufferToFill the buffer to fill in with expected audio data
      */
     void getNextAudioBlock(const AudioSourceChannelInfo& bufferToFill) override;
 
+    /**
+     * Render a block of a plugin host in place, as getNextAudioBlock() does, with the MIDI events of the host added
+     * to those of the keyboard, the queue and the sequencer. Blocks of any size are accepted without allocating.
+     * @param buffer the output buffer of the host
+     * @param startSample the first sample to render
+     * @param numSamples the number of samples to render
+     * @param hostMidi the MIDI of the host block, only the events within the rendered range are used
+     */
+    void renderNextBlock(AudioBuffer<float>& buffer, int startSample, int numSamples, const MidiBuffer& hostMidi);
+
     /**
      * Add voice to the internal synthesiser
      * @param voice
@@ -271,8 +863,118 @@ public:
      */
     bool shouldUpdateStatus();
 
+    /**
+     * Get the post-mix effects stage
+     * @return the effects bus processing the output of the synthesiser
+     */
+    EffectsBus& getEffectsBus();
+    const EffectsBus& getEffectsBus() const;
+
+    /**
+     * Get the limiter and soft clipper stage
+     * @return the output stage processing the output of the effects bus
+     */
+    OutputStage& getOutputStage();
+
+    /**
+     * Load a Scala scale. The tonic of the scale is mapped to middle C at its 12-TET frequency.
+     * It should be called from the message thread. Notes that are already playing keep their pitch.
+     * @param file the .scl file
+     * @return true if the scale is loaded
+     */
+    bool loadScalaTuning(const File& file);
+
+    /**
+     * Go back to the twelve tone equal temperament. It should be called from the message thread.
+     */
+    void resetTuning();
+
+    /**
+     * Get the description of the current tuning
+     * @return the description line of the Scala file, or "12-TET"
+     */
+    String getTuningName() const;
+
+    /**
+     * Get the queue of MIDI messages rendered at the beginning of the next block.
+     * It is the lock-free way for other threads to play notes without the keyboard state.
+     * @return the MIDI message queue
+     */
+    MidiMessageQueue& getMidiMessageQueue();
+
+    /**
+     * Get the MIDI file player feeding the synthesiser
+     * @return the sequencer
+     */
+    MidiSequencer& getSequencer();
+
+    /**
+     * Load the samples played by the "Sample" voice type. It should be called from the message thread.
+     * The files are memory mapped and only their attacks are read, so large libraries load quickly.
+     * Notes playing from the previous library are stopped.
+     * @param fileOrDirectory a directory of WAV and AIFF files, or a single file
+     * @return false if no sample could be loaded
+     */
+    bool loadSampleLibrary(const File& fileOrDirectory);
+
+    /**
+     * Get the number of samples of the library
+     * @return the number of samples, 0 if no library is loaded
+     */
+    int getNumLoadedSamples() const;
+
+    /**
+     * Set how a voice is stolen when a note finds every voice of its part busy. It can be called from any thread.
+     * @param newPolicy the stealing policy
+     */
+    void setStealingPolicy(VoiceAllocator::StealingPolicy newPolicy);
+    VoiceAllocator::StealingPolicy getStealingPolicy() const;
+
+    /**
+     * Switch the MPE lower zone of the synthesiser on or off
+     * @param shouldBeEnabled true to read the channels as an MPE zone
+     */
+    void setMpeEnabled(bool shouldBeEnabled);
+    bool isMpeEnabled() const;
+
+    /**
+     * Get the governor lowering the quality of the voices when the callback gets close to its deadline
+     * @return the quality governor
+     */
+    QualityGovernor& getQualityGovernor();
+
+    /**
+     * Write the quality transitions of the governor to the log. It is called periodically from the message thread.
+     */
+    void logQualityTransitions();
+
 private:
-    const int MAX_VOICES = 8;
+    static constexpr int MAX_VOICES = MultitimbralSynthesiser::MAX_VOICES;
+    /** The number of messages the queue of the other threads can hold */
+    static constexpr int MIDI_QUEUE_CAPACITY = 1024;
+    /** Room for the events of the file or of the host in one block */
+    static constexpr int MAX_BLOCK_EVENTS = 4096;
+    /** A short message in a MidiBuffer takes its position, its size and up to three bytes */
+    static constexpr size_t MIDI_EVENT_BYTES = sizeof(int32) + sizeof(uint16) + 3;
+    /**
+     * Room for the worst block: a full queue, a seek of the sequencer ending at the end of the file, and the events
+     * of the block
+     */
+    const size_t MIDI_BUFFER_BYTES = (size_t) (MIDI_QUEUE_CAPACITY + MidiSequencer::MAX_TRANSPORT_EVENTS
+                                               + MAX_BLOCK_EVENTS) * MIDI_EVENT_BYTES;
+    const float PITCH_BEND_RANGE_SEMITONES = 2.0f;
+
+    /**
+     * Guards the delay line arena, the prepared device settings and the voices being set up, so that prepareToPlay()
+     * and the editing of the voices never interleave. It is never taken on the audio thread, which only sees the
+     * result once it is handed over under the lock of the synthesiser.
+     */
+    CriticalSection voiceSetupLock;
+
+    /** The device settings of the last prepareToPlay(), voices added later are prepared with them */
+    std::atomic<int> preparedBlockSize {0};
+    std::atomic<double> preparedSampleRate {0.0};
+
     /**
      * Reference of the MIDI Keyboard State
      * The whole application should only accepts one MIDI Keyboard State, which is from the main component
@@ -280,7 +982,90 @@ private:
     MidiKeyboardState& midiKeyboardState;
 
     /**
-     * The internal synthesiser that combines different voices.
+     * The internal synthesiser that combines different voices, and dispatches the events of every MIDI channel to
+     * the voices of its part.
+     */
+    MultitimbralSynthesiser synthesiser;
+
+    /**
+     * The post-mix effects stage. It runs after all the voices have been rendered.
+     */
+    EffectsBus effectsBus;
+
+    /**
+     * The limiter and soft clipper. It is the last stage before the audio device.
+     */
+    OutputStage outputStage;
+
+    /**
+     * MIDI messages from other threads, e.g. the OSC receiver of the headless mode.
+     */
+    MidiMessageQueue midiMessageQueue {MIDI_QUEUE_CAPACITY};
+
+    /**
+     * The MIDI file player. Its events are merged with the keyboard and the queue.
+     */
+    MidiSequencer sequencer;
+
+    /**
+     * The samples of the "Sample" voice type. It is only replaced with the lock of the synthesiser held.
+     */
+    std::unique_ptr<SampleLibrary> sampleLibrary;
+
+    /**
+     * Streams the samples played by the voices from disk.
+     */
+    SamplePrefetcher samplePrefetcher;
+
+    /**
+     * The delay lines of the "String" voice type, one per voice, carved up in prepareToPlay().
+     */
+    DelayLineArena delayLineArena;
+
+    /** The noise seed of the next added voice */
+    uint32 nextNoiseSeed = 1;
+
+    /**
+     * Times every block and lowers the quality of the voices under load.
+     */
+    QualityGovernor qualityGovernor;
+
+    /**
+     * The MIDI events of the current block. It is allocated once, so rendering never allocates.
+     */
+    MidiBuffer incomingMidi;
+
+    /** Guards the tuning settings, the cache and the retained tables. It is never taken on the audio thread. */
+    CriticalSection tuningSettingsLock;
+    String tuningName {"12-TET"};
+    /** The tables of the tuning at every sample rate, so a device changing its rate gets them at once */
+    SampleRateCache sampleRateCache {PITCH_BEND_RANGE_SEMITONES};
+    /** Every published table stays here until the audio thread has dropped it, so it is never freed there. */
+    ReferenceCountedArray<TuningTable> retainedTuningTables;
+
+    /** Guards the hand-over of a new table. The audio thread only tries to take it. */
+    SpinLock tuningTableLock;
+    TuningTable::Ptr pendingTuningTable;
+    /** The table used by the audio thread */
+    TuningTable::Ptr currentTuningTable;
+
+    /**
+     * Render a block in place, the body of getNextAudioBlock() and renderNextBlock()
+     * @param buffer the buffer to fill
+     * @param startSample the first sample to render
+     * @param numSamples the number of samples to render
+     * @param hostMidi the MIDI of a plugin host, or nullptr
+     */
+    void render(AudioBuffer<float>& buffer, int startSample, int numSamples, const MidiBuffer* hostMidi);
+
+    /**
+     * Hand the tuning table of the prepared sample rate over to the audio thread.
+     * The table comes from the cache, only a rate that was never used before builds one.
+     */
+    void publishTuningTable();
+
+    /**
+     * Adopt the pending tuning table and pass it to every voice. It is called on the audio thread.
      */
-    Synthesiser synthesiser;
+    void updateTuningTable();
 };
\ No newline at end of file
@@ -0,0 +1,124 @@
+/*
+  ==============================================================================
+
+    Tuning.cpp
+
+  ==============================================================================
+*/
+
+#include "Tuning.h"
+
+constexpr int TuningTable::NUM_NOTES;
+constexpr int TuningTable::NUM_PITCH_WHEEL_VALUES;
+constexpr double TuningTable::ENVELOPE_REFERENCE_SAMPLE_RATE;
+
+TuningTable::TuningTable(const Array<double> &scaleCents, int referenceNote, double referenceFrequency,
+                         double sampleRate, float pitchBendRangeSemitones) :
+                         sampleRate(sampleRate), nyquistFrequency((float) (sampleRate / 2.0)),
+                         envelopeRateRatio((float) (ENVELOPE_REFERENCE_SAMPLE_RATE / sampleRate)),
+                         pitchBendRatios((size_t) NUM_PITCH_WHEEL_VALUES) {
+    jassert(!scaleCents.isEmpty());
+    const int numDegrees = scaleCents.size();
+    const double period = scaleCents.getLast();
+
+    for (int note = 0; note < NUM_NOTES; ++note) {
+        const int distance = note - referenceNote;
+        // Floor division, so the notes below the reference note fall into the previous period.
+        const int numPeriods = distance >= 0 ? distance / numDegrees : -((numDegrees - 1 - distance) / numDegrees);
+        const int degree = distance - numPeriods * numDegrees;
+        const double cents = numPeriods * period + (degree == 0 ? 0.0 : scaleCents[degree - 1]);
+        const double frequency = referenceFrequency * std::pow(2.0, cents / 1200.0);
+        this->frequencies[note] = (float) frequency;
+        this->angleDeltas[note] = (float) (MathConstants<double>::twoPi * frequency / sampleRate);
+    }
+
+    for (int value = 0; value < NUM_PITCH_WHEEL_VALUES; ++value) {
+        // The centre is 8192, and both extremes reach the full range.
+        const double position = value < 8192 ? (value - 8192) / 8192.0 : (value - 8192) / 8191.0;
+        this->pitchBendRatios[value] = (float) std::pow(2.0, position * pitchBendRangeSemitones / 12.0);
+    }
+}
+
+TuningTable::Ptr TuningTable::createEqualTemperament(double sampleRate) {
+    Array<double> scaleCents;
+    for (int degree = 1; degree <= 12; ++degree) {
+        scaleCents.add(100.0 * degree);
+    }
+    return new TuningTable(scaleCents, 69, 440.0, sampleRate, 2.0f);
+}
+
+bool TuningTable::parseScalaFile(const File &file, Array<double> &scaleCents, String &newDescription) {
+    StringArray lines;
+    file.readLines(lines);
+
+    String description;
+    int expectedSize = -1;
+    bool hasDescription = false;
+    Array<double> pitches;
+    for (const String& line : lines) {
+        // Lines starting with an exclamation mark are comments.
+        if (line.startsWithChar('!')) {
+            continue;
+        }
+        if (!hasDescription) {
+            description = line.trim();
+            hasDescription = true;
+            continue;
+        }
+        const String token = line.trim().upToFirstOccurrenceOf(" ", false, false)
+                .upToFirstOccurrenceOf("\t", false, false);
+        if (expectedSize < 0) {
+            if (!token.containsOnly("0123456789") || token.isEmpty()) {
+                return false;
+            }
+            expectedSize = token.getIntValue();
+            continue;
+        }
+        if (token.isEmpty()) {
+            continue;
+        }
+        if (token.containsChar('.')) {
+            pitches.add(token.getDoubleValue());
+        } else {
+            const double numerator = token.upToFirstOccurrenceOf("/", false, false).getDoubleValue();
+            const double denominator = token.containsChar('/')
+                    ? token.fromFirstOccurrenceOf("/", false, false).getDoubleValue() : 1.0;
+            if (numerator <= 0.0 || denominator <= 0.0) {
+                return false;
+            }
+            pitches.add(1200.0 * std::log2(numerator / denominator));
+        }
+    }
+
+    // The scale needs a period above the tonic, otherwise the notes cannot be mapped.
+    if (expectedSize <= 0 || pitches.size() != expectedSize || pitches.getLast() <= 0.0) {
+        return false;
+    }
+    scaleCents = pitches;
+    newDescription = description;
+    return true;
+}
+
+float TuningTable::getFrequency(int midiNoteNumber) const {
+    return this->frequencies[jlimit(0, NUM_NOTES - 1, midiNoteNumber)];
+}
+
+float TuningTable::getAngleDelta(int midiNoteNumber) const {
+    return this->angleDeltas[jlimit(0, NUM_NOTES - 1, midiNoteNumber)];
+}
+
+float TuningTable::getPitchBendRatio(int pitchWheelValue) const {
+    return this->pitchBendRatios[jlimit(0, NUM_PITCH_WHEEL_VALUES - 1, pitchWheelValue)];
+}
+
+double TuningTable::getSampleRate() const {
+    return this->sampleRate;
+}
+
+float TuningTable::getNyquistFrequency() const {
+    return this->nyquistFrequency;
+}
+
+float TuningTable::getEnvelopeRateRatio() const {
+    return this->envelopeRateRatio;
+}
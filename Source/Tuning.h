@@ -0,0 +1,103 @@
+/*
+  ==============================================================================
+
+    Tuning.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/**
+ * A precomputed table of the frequency and the phase increment of every MIDI note, together with the frequency ratio
+ * of every pitch wheel position.
+ * A table is built for one tuning and one sample rate on the message thread, and it is never modified afterwards,
+ * so the audio thread can read it without any lock. Starting a note or moving the pitch wheel is then a table lookup.
+ * The other constants of the sample rate that the voices need are computed with it, see SampleRateCache.
+ */
+class TuningTable : public ReferenceCountedObject {
+public:
+    using Ptr = ReferenceCountedObjectPtr<TuningTable>;
+
+    static constexpr int NUM_NOTES = 128;
+    static constexpr int NUM_PITCH_WHEEL_VALUES = 16384;
+    /** The sample rate the per-sample envelope factors of the voices are given at */
+    static constexpr double ENVELOPE_REFERENCE_SAMPLE_RATE = 44100.0;
+
+    /**
+     * Build the table.
+     * @param scaleCents the pitches of the scale degrees in cents above the tonic. The last one is the period
+     * of the scale, e.g. {100, 200, ..., 1200} for 12-TET. It should not be empty.
+     * @param referenceNote the MIDI note of the tonic
+     * @param referenceFrequency the frequency of the reference note in Hz
+     * @param sampleRate the sample rate the phase increments are computed for
+     * @param pitchBendRangeSemitones the pitch shift of the pitch wheel at its extreme positions
+     */
+    TuningTable(const Array<double>& scaleCents, int referenceNote, double referenceFrequency,
+                double sampleRate, float pitchBendRangeSemitones);
+
+    /**
+     * Create the table of the twelve tone equal temperament, with A4 at 440 Hz.
+     * @param sampleRate the sample rate the phase increments are computed for
+     * @return the new table
+     */
+    static Ptr createEqualTemperament(double sampleRate);
+
+    /**
+     * Read the scale of a Scala .scl file.
+     * Pitches containing a period are in cents, the others are ratios such as 3/2 or integers.
+     * @param file the Scala file
+     * @param scaleCents the pitches of the scale in cents. It is only modified on success.
+     * @param description the description line of the file. It is only modified on success.
+     * @return true if the file has been parsed successfully
+     */
+    static bool parseScalaFile(const File& file, Array<double>& scaleCents, String& description);
+
+    /**
+     * The frequency of a note
+     * @param midiNoteNumber the note between 0 and 127
+     * @return the frequency in Hz
+     */
+    float getFrequency(int midiNoteNumber) const;
+
+    /**
+     * The phase increment of a note at the sample rate of the table
+     * @param midiNoteNumber the note between 0 and 127
+     * @return the increment in radians per sample
+     */
+    float getAngleDelta(int midiNoteNumber) const;
+
+    /**
+     * The frequency ratio of a pitch wheel position
+     * @param pitchWheelValue the 14 bit pitch wheel value, 8192 is the centre
+     * @return the ratio to apply to the phase increment
+     */
+    float getPitchBendRatio(int pitchWheelValue) const;
+
+    double getSampleRate() const;
+
+    /**
+     * The highest frequency a note can have without aliasing
+     * @return half the sample rate, in Hz
+     */
+    float getNyquistFrequency() const;
+
+    /**
+     * Scale the per-sample envelope factors of the voices to the sample rate of the table, so that the attacks and
+     * the release tails last as long at every rate
+     * @return ENVELOPE_REFERENCE_SAMPLE_RATE divided by the sample rate
+     */
+    float getEnvelopeRateRatio() const;
+
+private:
+    double sampleRate;
+    float nyquistFrequency;
+    float envelopeRateRatio;
+    float frequencies[NUM_NOTES] {};
+    float angleDeltas[NUM_NOTES] {};
+    HeapBlock<float> pitchBendRatios;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TuningTable)
+};
@@ -0,0 +1,221 @@
+/*
+  ==============================================================================
+
+    Unison.cpp
+
+  ==============================================================================
+*/
+
+#include "Unison.h"
+
+namespace {
+using Register = dsp::SIMDRegister<float>;
+
+Register absolute(Register value) {
+    return Register::max(value, Register::expand(0.0f) - value);
+}
+
+/**
+ * The waveforms of ElementaryVoice, of a phase shifted by half a cycle so that it lies between -0.5 and 0.5.
+ * None of them branches, so every lane of a register can be at a different point of the cycle.
+ */
+template <int shape>
+Register computeWaveform(Register phase);
+
+template <>
+Register computeWaveform<UnisonOscillator::sine>(Register phase) {
+    // A parabola through the peaks and the zeros of the sine, refined once. The error stays below 0.1%.
+    const Register parabola = phase * absolute(phase) * 16.0f - phase * 8.0f;
+    return parabola + (parabola * absolute(parabola) - parabola) * 0.225f;
+}
+
+template <>
+Register computeWaveform<UnisonOscillator::square>(Register phase) {
+    return Register::expand(1.0f)
+            - (Register::expand(2.0f) & Register::greaterThanOrEqual(phase, Register::expand(0.0f)));
+}
+
+template <>
+Register computeWaveform<UnisonOscillator::triangle>(Register phase) {
+    return Register::expand(1.0f) - absolute(phase) * 4.0f;
+}
+
+template <>
+Register computeWaveform<UnisonOscillator::sawtooth>(Register phase) {
+    return phase * 2.0f;
+}
+}
+
+//// ==============================================================================
+//// UnisonOscillator Class
+//// ==============================================================================
+
+constexpr int UnisonOscillator::MAX_COPIES;
+constexpr int UnisonOscillator::MAX_BLOCK_SIZE;
+constexpr int UnisonOscillator::NUM_LANES;
+
+UnisonOscillator::UnisonOscillator() {
+    const int numCopyArrays = 4;
+    this->memory.calloc((size_t) (numCopyArrays * MAX_COPIES + 2 * MAX_BLOCK_SIZE * NUM_LANES + NUM_LANES));
+    float* aligned = Register::getNextSIMDAlignedPtr(this->memory.get());
+    for (float** array : {&this->phases, &this->ratios, &this->leftGains, &this->rightGains}) {
+        *array = aligned;
+        aligned += MAX_COPIES;
+    }
+    this->leftAccumulators = aligned;
+    this->rightAccumulators = aligned + MAX_BLOCK_SIZE * NUM_LANES;
+}
+
+void UnisonOscillator::startNote(Waveform newWaveform, int newNumCopies, float initialIncrement,
+                                 NoiseGenerator &generator) {
+    this->waveform = newWaveform;
+    this->numCopies = jlimit(1, MAX_COPIES, newNumCopies);
+    this->numBatchedCopies = (this->numCopies + NUM_LANES - 1) / NUM_LANES * NUM_LANES;
+    this->increment = initialIncrement;
+    FloatVectorOperations::clear(this->phases, MAX_COPIES);
+    generator.fillUniform(this->phases, this->numCopies);
+    FloatVectorOperations::add(this->phases, -0.5f, this->numCopies);
+    // Force the ratios and the gains of the new number of copies.
+    this->currentDetune = -1.0f;
+}
+
+void UnisonOscillator::setSpread(float detuneCents, float stereoSpread) {
+    if (detuneCents == this->currentDetune && stereoSpread == this->currentSpread) {
+        return;
+    }
+    // The copies are louder together, keep the loudness of a single copy.
+    const float copyGain = 1.0f / std::sqrt((float) this->numCopies);
+    for (int copy = 0; copy < MAX_COPIES; ++copy) {
+        if (copy >= this->numCopies) {
+            this->ratios[copy] = 1.0f;
+            this->leftGains[copy] = 0.0f;
+            this->rightGains[copy] = 0.0f;
+            continue;
+        }
+        // From -1 for the lowest copy to 1 for the highest one.
+        const float position = this->numCopies > 1 ? 2.0f * (float) copy / (float) (this->numCopies - 1) - 1.0f
+                                                   : 0.0f;
+        const float pan = position * stereoSpread;
+        this->ratios[copy] = std::exp2(position * detuneCents / 1200.0f);
+        this->leftGains[copy] = copyGain * (1.0f - jmax(0.0f, pan));
+        this->rightGains[copy] = copyGain * (1.0f + jmin(0.0f, pan));
+    }
+    this->currentDetune = detuneCents;
+    this->currentSpread = stereoSpread;
+}
+
+void UnisonOscillator::scaleIncrement(float factor) {
+    this->increment *= factor;
+}
+
+void UnisonOscillator::render(float *left, float *right, int numSamples, float targetIncrement) {
+    jassert(numSamples <= MAX_BLOCK_SIZE);
+    const float incrementStep = (targetIncrement - this->increment) / (float) numSamples;
+    // The waveform is chosen once per block, the render loops are instantiated for each one.
+    switch (this->waveform) {
+        case square:
+            this->renderCopies<square>(numSamples, incrementStep);
+            break;
+        case triangle:
+            this->renderCopies<triangle>(numSamples, incrementStep);
+            break;
+        case sawtooth:
+            this->renderCopies<sawtooth>(numSamples, incrementStep);
+            break;
+        case sine:
+        default:
+            this->renderCopies<sine>(numSamples, incrementStep);
+            break;
+    }
+    this->increment = targetIncrement;
+
+    for (int i = 0; i < numSamples; ++i) {
+        left[i] = Register::fromRawArray(this->leftAccumulators + i * NUM_LANES).sum();
+        right[i] = Register::fromRawArray(this->rightAccumulators + i * NUM_LANES).sum();
+    }
+}
+
+template <int shape>
+void UnisonOscillator::renderCopies(int numSamples, float incrementStep) {
+    FloatVectorOperations::clear(this->leftAccumulators, numSamples * NUM_LANES);
+    FloatVectorOperations::clear(this->rightAccumulators, numSamples * NUM_LANES);
+    const Register half = Register::expand(0.5f);
+    const Register one = Register::expand(1.0f);
+
+    for (int first = 0; first < this->numBatchedCopies; first += NUM_LANES) {
+        Register phase = Register::fromRawArray(this->phases + first);
+        const Register ratio = Register::fromRawArray(this->ratios + first);
+        const Register leftGain = Register::fromRawArray(this->leftGains + first);
+        const Register rightGain = Register::fromRawArray(this->rightGains + first);
+        float noteIncrement = this->increment;
+
+        for (int i = 0; i < numSamples; ++i) {
+            noteIncrement += incrementStep;
+            phase += ratio * noteIncrement;
+            // The increment stays below one cycle, so a single subtraction wraps the phase.
+            phase -= one & Register::greaterThanOrEqual(phase, half);
+            const Register sample = computeWaveform<shape>(phase);
+            float* leftAccumulator = this->leftAccumulators + i * NUM_LANES;
+            float* rightAccumulator = this->rightAccumulators + i * NUM_LANES;
+            (Register::fromRawArray(leftAccumulator) + sample * leftGain).copyToRawArray(leftAccumulator);
+            (Register::fromRawArray(rightAccumulator) + sample * rightGain).copyToRawArray(rightAccumulator);
+        }
+        phase.copyToRawArray(this->phases + first);
+    }
+}
+
+//// ==============================================================================
+//// UnisonRenderer Class
+//// ==============================================================================
+
+constexpr int UnisonRenderer::MAX_BLOCK_SIZE;
+
+UnisonRenderer::UnisonRenderer() : oversampledBuffer(2, UnisonOscillator::MAX_BLOCK_SIZE) {
+    this->leftDecimators.prepare(MAX_BLOCK_SIZE);
+    this->rightDecimators.prepare(MAX_BLOCK_SIZE);
+}
+
+void UnisonRenderer::setCopies(UnisonOscillator::Waveform newWaveform, int newNumCopies) {
+    this->waveform = newWaveform;
+    this->numCopies = newNumCopies;
+}
+
+void UnisonRenderer::setSpread(float detuneCents, float stereoSpread) {
+    this->oscillator.setSpread(detuneCents, stereoSpread);
+}
+
+bool UnisonRenderer::startNote(const Note &note, NoiseGenerator &noise) {
+    this->factor = note.oversamplingFactor;
+    // Setting the factor clears the history of the decimators.
+    this->leftDecimators.setFactor(this->factor);
+    this->rightDecimators.setFactor(this->factor);
+    this->oscillator.startNote(this->waveform, this->numCopies, this->getIncrement(note.angleDelta * note.startRatio),
+                               noise);
+    return true;
+}
+
+bool UnisonRenderer::render(float *const *destinations, int numSamples, const ControlBlock &control,
+                            NoiseGenerator &noise) {
+    jassert(numSamples <= MAX_BLOCK_SIZE);
+    if (control.oversamplingFactor != this->factor) {
+        // Keep the pitch of a sounding note when the rate changes.
+        this->oscillator.scaleIncrement((float) this->factor / (float) control.oversamplingFactor);
+        this->factor = control.oversamplingFactor;
+        this->leftDecimators.setFactor(this->factor);
+        this->rightDecimators.setFactor(this->factor);
+    }
+    float* left = this->oversampledBuffer.getWritePointer(0);
+    float* right = this->oversampledBuffer.getWritePointer(1);
+    this->oscillator.render(left, right, numSamples * this->factor, this->getIncrement(control.angleDelta));
+    this->leftDecimators.process(left, destinations[0], numSamples);
+    this->rightDecimators.process(right, destinations[1], numSamples);
+    return true;
+}
+
+int UnisonRenderer::getNumChannels() const {
+    return 2;
+}
+
+float UnisonRenderer::getIncrement(float angleDelta) const {
+    return jmin(angleDelta, MathConstants<float>::pi) / (MathConstants<float>::twoPi * (float) this->factor);
+}
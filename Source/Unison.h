@@ -0,0 +1,155 @@
+/*
+  ==============================================================================
+
+    Unison.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "Noise.h"
+#include "Decimation.h"
+#include "VoiceRenderer.h"
+
+/**
+ * Up to MAX_COPIES detuned copies of a basic waveform, spread across the stereo field.
+ * The copies of a note run together in the lanes of SIMD registers: the phases, the frequency ratios and the pan
+ * gains are stored as arrays, and every waveform is computed without a branch, so a batch of copies costs about
+ * as much as a single one. The copies share the phase increment of the note, so the pitch is ramped once for all.
+ */
+class UnisonOscillator {
+public:
+    static constexpr int MAX_COPIES = 16;
+    /** The longest block passed to render(), a control block at the highest oversampling factor */
+    static constexpr int MAX_BLOCK_SIZE = 256;
+
+    /** The waveforms, in the order of the voice types of ElementaryVoice */
+    enum Waveform {
+        sine = 0,
+        square,
+        triangle,
+        sawtooth
+    };
+
+    UnisonOscillator();
+
+    /**
+     * Restart the copies of a note with random phases, so they do not start with a peak.
+     * It does not allocate, so it can be called from the audio thread.
+     * @param newWaveform the waveform of every copy
+     * @param newNumCopies the number of copies, from 1 to MAX_COPIES
+     * @param initialIncrement the phase increment of the note in cycles per sample
+     * @param generator the noise generator of the voice, which draws the phases
+     */
+    void startNote(Waveform newWaveform, int newNumCopies, float initialIncrement, NoiseGenerator& generator);
+
+    /**
+     * Set the detune and the stereo spread of the copies. It only recomputes them when they change.
+     * @param detuneCents the detune of the outermost copies in cents. The others are spaced evenly in between.
+     * @param stereoSpread the pan of the outermost copies, from 0 for mono to 1 for hard left and right
+     */
+    void setSpread(float detuneCents, float stereoSpread);
+
+    /**
+     * Scale the phase increment reached by the last block, when the oversampling factor changes.
+     * @param factor the ratio between the new and the old increment
+     */
+    void scaleIncrement(float factor);
+
+    /**
+     * Render the sum of the copies. The phase increment is ramped linearly from the previous block.
+     * A copy at the centre has a gain of one in both channels.
+     * @param left the left samples to overwrite
+     * @param right the right samples to overwrite
+     * @param numSamples the number of samples, at most MAX_BLOCK_SIZE
+     * @param targetIncrement the phase increment of the note reached at the end of the block, in cycles per sample
+     */
+    void render(float* left, float* right, int numSamples, float targetIncrement);
+
+private:
+    static constexpr int NUM_LANES = (int) dsp::SIMDRegister<float>::SIMDNumElements;
+
+    Waveform waveform = sine;
+    int numCopies = 1;
+    /** The number of copies rounded up to whole registers. The extra lanes have a gain of zero. */
+    int numBatchedCopies = NUM_LANES;
+    float increment = 0.0f;
+    float currentDetune = -1.0f;
+    float currentSpread = -1.0f;
+
+    /** The memory of all the arrays below, aligned to the SIMD register size */
+    HeapBlock<float> memory;
+    /** The phase of every copy in cycles, kept between -0.5 and 0.5 */
+    float* phases;
+    float* ratios;
+    float* leftGains;
+    float* rightGains;
+    /** One register of left and one of right partial sums per sample, reduced once at the end of the block */
+    float* leftAccumulators;
+    float* rightAccumulators;
+
+    /**
+     * The render loop of one waveform
+     * @param numSamples the number of samples
+     * @param incrementStep the change of the phase increment on every sample
+     */
+    template <int shape>
+    void renderCopies(int numSamples, float incrementStep);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (UnisonOscillator)
+};
+
+/**
+ * The renderer of the unison copies of the "Sine", "Square", "Triangle" and "Sawtooth" voice types. The copies are
+ * rendered together by one UnisonOscillator at the oversampled rate, and both channels are decimated back to the
+ * device rate, so the envelope, the filter coefficients and the gain are computed once for all of them.
+ * The voice plays a note of one copy itself.
+ */
+class UnisonRenderer : public VoiceRenderer {
+public:
+    /** The longest block passed to render(), the control block size of the voices */
+    static constexpr int MAX_BLOCK_SIZE = 32;
+
+    UnisonRenderer();
+
+    /**
+     * Set the waveform and the number of copies of the next note. It is called on the audio thread before
+     * startNote().
+     * @param newWaveform the waveform of every copy
+     * @param newNumCopies the number of copies, from 2 to UnisonOscillator::MAX_COPIES
+     */
+    void setCopies(UnisonOscillator::Waveform newWaveform, int newNumCopies);
+
+    /**
+     * Set the detune and the stereo spread of the copies. It is called on the audio thread before every block.
+     * @param detuneCents the detune of the outermost copies in cents
+     * @param stereoSpread the pan of the outermost copies, from 0 for mono to 1 for hard left and right
+     */
+    void setSpread(float detuneCents, float stereoSpread);
+
+    bool startNote(const Note& note, NoiseGenerator& noise) override;
+    bool render(float* const* destinations, int numSamples, const ControlBlock& control,
+                NoiseGenerator& noise) override;
+    int getNumChannels() const override;
+
+private:
+    UnisonOscillator oscillator;
+    UnisonOscillator::Waveform waveform = UnisonOscillator::sine;
+    int numCopies = 2;
+    /** The oversampling factor the note is rendered at. It follows the voice at block boundaries. */
+    int factor = 1;
+    AudioBuffer<float> oversampledBuffer;
+    DecimatorCascade leftDecimators;
+    DecimatorCascade rightDecimators;
+
+    /**
+     * Get the phase increment of the oscillator for a phase increment of the note at the device rate
+     * @param angleDelta the phase increment of the note at the device rate
+     * @return the phase increment in cycles per oversampled sample, held below the Nyquist frequency
+     */
+    float getIncrement(float angleDelta) const;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (UnisonRenderer)
+};
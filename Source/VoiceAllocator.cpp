@@ -0,0 +1,298 @@
+/*
+  ==============================================================================
+
+    VoiceAllocator.cpp
+
+  ==============================================================================
+*/
+
+#include "VoiceAllocator.h"
+
+constexpr int VoiceAllocator::MAX_VOICES;
+constexpr int VoiceAllocator::NUM_GROUPS;
+constexpr int VoiceAllocator::NUM_NOTES;
+
+VoiceAllocator::VoiceAllocator() {
+    this->assign(0, nullptr, nullptr);
+}
+
+StringArray VoiceAllocator::getPolicyNames() {
+    return StringArray {"Oldest", "Quietest", "Same note"};
+}
+
+void VoiceAllocator::assign(int newNumVoices, const uint32 *newGroupMasks, const bool *active) {
+    jassert(newNumVoices <= MAX_VOICES);
+    this->numVoices = jmin(newNumVoices, MAX_VOICES);
+    for (auto& notes : this->noteVoices) {
+        std::fill(std::begin(notes), std::end(notes), (int8) -1);
+    }
+    for (Group& group : this->groups) {
+        group.numFreeVoices = 0;
+        group.heapSize = 0;
+        std::fill(std::begin(group.isStacked), std::end(group.isStacked), false);
+        std::fill(std::begin(group.heapPositions), std::end(group.heapPositions), -1);
+    }
+    // The stacks are filled backwards, so the first voices are popped first.
+    for (int voice = this->numVoices; --voice >= 0;) {
+        this->groupMasks[voice] = newGroupMasks[voice];
+        this->voiceGroups[voice] = -1;
+        this->voiceNotes[voice] = -1;
+        this->busy[voice] = true;
+        if (active[voice]) {
+            // Their notes are unknown, so they go before every new note.
+            this->released[voice] = true;
+            this->levels[voice] = 0.0f;
+            this->startOrders[voice] = this->nextStartOrder++;
+            for (int index = 0; index < NUM_GROUPS; ++index) {
+                if ((this->groupMasks[voice] >> index) & 1u) {
+                    Group& group = this->groups[index];
+                    group.heapPositions[voice] = group.heapSize;
+                    group.heap[group.heapSize++] = voice;
+                    this->siftUp(group, group.heapPositions[voice]);
+                }
+            }
+        } else {
+            this->markFree(voice);
+        }
+    }
+}
+
+void VoiceAllocator::update(StealingPolicy newPolicy, const bool *active, const float *newLevels) {
+    const bool shouldReorder = newPolicy != this->policy || newPolicy == quietestVoice;
+    this->policy = newPolicy;
+    for (int voice = 0; voice < this->numVoices; ++voice) {
+        this->levels[voice] = newLevels[voice];
+        if (this->busy[voice] && !active[voice]) {
+            this->markFree(voice);
+        } else if (!this->busy[voice] && active[voice]) {
+            this->released[voice] = true;
+            this->markBusy(voice);
+        }
+    }
+    if (shouldReorder) {
+        for (Group& group : this->groups) {
+            for (int position = group.heapSize / 2; --position >= 0;) {
+                this->siftDown(group, position);
+            }
+        }
+    }
+}
+
+int VoiceAllocator::findVoice(int group, int note) const {
+    jassert(isPositiveAndBelow(group, NUM_GROUPS) && isPositiveAndBelow(note, NUM_NOTES));
+    return this->noteVoices[group][note];
+}
+
+int VoiceAllocator::allocate(int group, int note, bool canSteal, float level) {
+    jassert(isPositiveAndBelow(group, NUM_GROUPS) && isPositiveAndBelow(note, NUM_NOTES));
+    Group& candidates = this->groups[group];
+    int voice = -1;
+    if (this->policy == sameNote) {
+        const int sameNoteVoice = this->noteVoices[group][note];
+        if (sameNoteVoice >= 0 && this->busy[sameNoteVoice]) {
+            voice = sameNoteVoice;
+        }
+    }
+    // A voice taken by another group since it was stacked is dropped from the stack.
+    while (voice < 0 && candidates.numFreeVoices > 0) {
+        const int stackedVoice = candidates.freeVoices[--candidates.numFreeVoices];
+        candidates.isStacked[stackedVoice] = false;
+        if (!this->busy[stackedVoice]) {
+            voice = stackedVoice;
+        }
+    }
+    if (voice < 0 && canSteal && candidates.heapSize > 0) {
+        voice = candidates.heap[0];
+    }
+    if (voice < 0) {
+        return -1;
+    }
+
+    this->forgetNote(voice);
+    this->released[voice] = false;
+    this->levels[voice] = level;
+    this->startOrders[voice] = this->nextStartOrder++;
+    if (this->busy[voice]) {
+        for (int index = 0; index < NUM_GROUPS; ++index) {
+            if ((this->groupMasks[voice] >> index) & 1u) {
+                this->reorder(this->groups[index], voice);
+            }
+        }
+    } else {
+        this->markBusy(voice);
+    }
+    this->noteVoices[group][note] = (int8) voice;
+    this->voiceGroups[voice] = group;
+    this->voiceNotes[voice] = note;
+    return voice;
+}
+
+void VoiceAllocator::release(int voice) {
+    if (!isPositiveAndBelow(voice, this->numVoices) || !this->busy[voice] || this->released[voice]) {
+        return;
+    }
+    this->released[voice] = true;
+    for (int index = 0; index < NUM_GROUPS; ++index) {
+        if ((this->groupMasks[voice] >> index) & 1u) {
+            this->reorder(this->groups[index], voice);
+        }
+    }
+}
+
+bool VoiceAllocator::isStolenBefore(int first, int second) const {
+    if (this->policy == quietestVoice) {
+        if (this->levels[first] != this->levels[second]) {
+            return this->levels[first] < this->levels[second];
+        }
+    } else if (this->released[first] != this->released[second]) {
+        return this->released[first];
+    }
+    return this->startOrders[first] < this->startOrders[second];
+}
+
+void VoiceAllocator::markBusy(int voice) {
+    this->busy[voice] = true;
+    for (int index = 0; index < NUM_GROUPS; ++index) {
+        if ((this->groupMasks[voice] >> index) & 1u) {
+            Group& group = this->groups[index];
+            group.heapPositions[voice] = group.heapSize;
+            group.heap[group.heapSize++] = voice;
+            this->siftUp(group, group.heapPositions[voice]);
+        }
+    }
+}
+
+void VoiceAllocator::markFree(int voice) {
+    this->busy[voice] = false;
+    this->forgetNote(voice);
+    for (int index = 0; index < NUM_GROUPS; ++index) {
+        if (!((this->groupMasks[voice] >> index) & 1u)) {
+            continue;
+        }
+        Group& group = this->groups[index];
+        const int position = group.heapPositions[voice];
+        if (position >= 0) {
+            // The last voice of the heap takes the place of the removed one.
+            this->swap(group, position, --group.heapSize);
+            group.heapPositions[voice] = -1;
+            if (position < group.heapSize) {
+                this->reorder(group, group.heap[position]);
+            }
+        }
+        // A voice still stacked from before becomes valid again.
+        if (!group.isStacked[voice]) {
+            group.isStacked[voice] = true;
+            group.freeVoices[group.numFreeVoices++] = voice;
+        }
+    }
+}
+
+void VoiceAllocator::forgetNote(int voice) {
+    const int group = this->voiceGroups[voice];
+    const int note = this->voiceNotes[voice];
+    if (group >= 0 && note >= 0 && this->noteVoices[group][note] == voice) {
+        this->noteVoices[group][note] = -1;
+    }
+    this->voiceGroups[voice] = -1;
+    this->voiceNotes[voice] = -1;
+}
+
+void VoiceAllocator::reorder(Group &group, int voice) {
+    const int position = group.heapPositions[voice];
+    if (position < 0) {
+        return;
+    }
+    this->siftUp(group, position);
+    this->siftDown(group, group.heapPositions[voice]);
+}
+
+void VoiceAllocator::siftUp(Group &group, int position) {
+    while (position > 0) {
+        const int parent = (position - 1) / 2;
+        if (!this->isStolenBefore(group.heap[position], group.heap[parent])) {
+            break;
+        }
+        this->swap(group, position, parent);
+        position = parent;
+    }
+}
+
+void VoiceAllocator::siftDown(Group &group, int position) {
+    while (true) {
+        int first = position;
+        const int left = 2 * position + 1;
+        const int right = left + 1;
+        if (left < group.heapSize && this->isStolenBefore(group.heap[left], group.heap[first])) {
+            first = left;
+        }
+        if (right < group.heapSize && this->isStolenBefore(group.heap[right], group.heap[first])) {
+            first = right;
+        }
+        if (first == position) {
+            break;
+        }
+        this->swap(group, position, first);
+        position = first;
+    }
+}
+
+void VoiceAllocator::swap(Group &group, int firstPosition, int secondPosition) {
+    std::swap(group.heap[firstPosition], group.heap[secondPosition]);
+    group.heapPositions[group.heap[firstPosition]] = firstPosition;
+    group.heapPositions[group.heap[secondPosition]] = secondPosition;
+}
+
+#if JUCE_UNIT_TESTS
+
+/**
+ * Plays notes on a few voices and checks the voice chosen by every stealing policy, and the groups of shared voices.
+ */
+class VoiceAllocatorTests : public UnitTest {
+public:
+    VoiceAllocatorTests() : UnitTest("Voice allocator", "MIDISynth") {}
+
+    void runTest() override {
+        beginTest("Stealing policies");
+        VoiceAllocator allocator;
+        const uint32 masks[] {1u, 1u, 1u, 1u};
+        bool active[] {false, false, false, false};
+        allocator.assign(4, masks, active);
+        for (int voice = 0; voice < 4; ++voice) {
+            expectEquals(allocator.allocate(0, 60 + voice, false, 1.0f), voice);
+        }
+        expectEquals(allocator.findVoice(0, 61), 1);
+        expectEquals(allocator.allocate(0, 64, false, 1.0f), -1, "a busy voice is taken without stealing");
+        expectEquals(allocator.allocate(0, 64, true, 1.0f), 0, "the oldest voice is not stolen");
+        expectEquals(allocator.findVoice(0, 60), -1);
+        expectEquals(allocator.findVoice(0, 64), 0);
+
+        allocator.release(2);
+        expectEquals(allocator.allocate(0, 65, true, 1.0f), 2, "the released voice is not stolen first");
+
+        const float levels[] {0.5f, 0.2f, 0.9f, 0.7f};
+        active[0] = active[2] = active[3] = true;
+        allocator.update(VoiceAllocator::oldestVoice, active, levels);
+        expectEquals(allocator.allocate(0, 66, false, 1.0f), 1, "the finished voice is not given back");
+
+        active[1] = true;
+        allocator.update(VoiceAllocator::sameNote, active, levels);
+        expectEquals(allocator.allocate(0, 63, true, 1.0f), 3, "a repeated note does not take its own voice");
+
+        allocator.update(VoiceAllocator::quietestVoice, active, levels);
+        expectEquals(allocator.allocate(0, 70, true, 1.0f), 1, "the quietest voice is not stolen");
+
+        beginTest("Shared voices");
+        // The first voice plays the first channel only, the second one both channels.
+        const uint32 sharedMasks[] {1u, 3u};
+        const bool inactive[] {false, false};
+        allocator.assign(2, sharedMasks, inactive);
+        expectEquals(allocator.allocate(1, 60, false, 1.0f), 1);
+        expectEquals(allocator.allocate(1, 61, false, 1.0f), -1);
+        expectEquals(allocator.allocate(0, 62, false, 1.0f), 0);
+        expectEquals(allocator.allocate(0, 63, false, 1.0f), -1, "a voice playing another channel is free");
+    }
+};
+
+static VoiceAllocatorTests voiceAllocatorTests;
+
+#endif
@@ -0,0 +1,141 @@
+/*
+  ==============================================================================
+
+    VoiceAllocator.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/**
+ * Chooses the voice of every new note without scanning the voices.
+ * The voices are numbered from 0 and belong to one or more groups, the parts of the MIDI channels. Every group keeps
+ * a stack of its free voices, and a binary heap of its busy voices ordered by the stealing policy, so a note-on pops
+ * a free voice or the voice to steal in constant or logarithmic time. The voice of every note of a group is indexed,
+ * so a note-off finds it directly.
+ * The allocator only learns that a voice has finished its tail in update(), called once per block. A voice shared by
+ * several groups can sit in the stack of a group while another one plays it, so the stacks are cleaned lazily when
+ * they are popped.
+ */
+class VoiceAllocator {
+public:
+    /** The largest number of voices of the synthesiser, every other voice count follows it */
+    static constexpr int MAX_VOICES = 8;
+    static constexpr int NUM_GROUPS = 16;
+    static constexpr int NUM_NOTES = 128;
+
+    /** How a busy voice is chosen when a note finds no free voice */
+    enum StealingPolicy {
+        /** The oldest released voice, or the oldest voice if they are all held */
+        oldestVoice = 0,
+        /** The voice with the lowest envelope level at the last update */
+        quietestVoice,
+        /** A repeated note takes over the voice of the same note, otherwise as oldestVoice */
+        sameNote,
+        numPolicies
+    };
+
+    VoiceAllocator();
+
+    /**
+     * The names of the stealing policies
+     * @return the names, in the order of StealingPolicy
+     */
+    static StringArray getPolicyNames();
+
+    /**
+     * Assign the voices to their groups. The notes are forgotten, and the voices still sounding can be stolen.
+     * @param newNumVoices the number of voices, at most MAX_VOICES
+     * @param newGroupMasks for every voice, the bit of every group it belongs to
+     * @param active for every voice, whether it is sounding
+     */
+    void assign(int newNumVoices, const uint32* newGroupMasks, const bool* active);
+
+    /**
+     * Give back the voices that have finished, and take the envelope levels of the others. It is called once per
+     * block, and reorders the heaps if the order of the voices may have changed.
+     * @param newPolicy the stealing policy of the following notes
+     * @param active for every voice, whether it is sounding
+     * @param newLevels for every voice, its envelope level
+     */
+    void update(StealingPolicy newPolicy, const bool* active, const float* newLevels);
+
+    /**
+     * Find the voice given to a note
+     * @param group the group of the note
+     * @param note the MIDI note number
+     * @return the voice, or -1 if the note has none. It may have been released or finished since.
+     */
+    int findVoice(int group, int note) const;
+
+    /**
+     * Choose the voice of a note: the voice of the same note with the sameNote policy, else a free voice, else the
+     * first voice of the heap if notes can be stolen.
+     * @param group the group of the note
+     * @param note the MIDI note number
+     * @param canSteal whether a busy voice can be taken
+     * @param level the envelope level the note is expected to reach
+     * @return the voice, or -1 if every voice of the group is busy and notes cannot be stolen
+     */
+    int allocate(int group, int note, bool canSteal, float level);
+
+    /**
+     * Mark the note of a voice as released, so the oldestVoice policy steals it first
+     * @param voice the voice
+     */
+    void release(int voice);
+
+private:
+    /**
+     * The free voices and the heap of the busy voices of a group
+     */
+    struct Group {
+        int freeVoices[MAX_VOICES];
+        int numFreeVoices = 0;
+        /** Whether a voice is in the stack, free or not */
+        bool isStacked[MAX_VOICES];
+        int heap[MAX_VOICES];
+        int heapSize = 0;
+        /** The position of every voice in the heap, or -1 */
+        int heapPositions[MAX_VOICES];
+    };
+
+    StealingPolicy policy = oldestVoice;
+    int numVoices = 0;
+    uint32 groupMasks[MAX_VOICES] {};
+    bool busy[MAX_VOICES] {};
+    bool released[MAX_VOICES] {};
+    float levels[MAX_VOICES] {};
+    int64 startOrders[MAX_VOICES] {};
+    int64 nextStartOrder = 0;
+    /** The group and the note a voice was given to, -1 once the note is forgotten */
+    int voiceGroups[MAX_VOICES];
+    int voiceNotes[MAX_VOICES];
+    int8 noteVoices[NUM_GROUPS][NUM_NOTES];
+    Group groups[NUM_GROUPS];
+
+    /**
+     * Whether a voice is stolen before another one under the current policy
+     * @param first a busy voice
+     * @param second another busy voice
+     * @return true if the first voice goes first
+     */
+    bool isStolenBefore(int first, int second) const;
+
+    void markBusy(int voice);
+    void markFree(int voice);
+    void forgetNote(int voice);
+
+    /**
+     * Move a voice of a heap towards the top, or towards the bottom, until the heap is ordered again
+     * @param group the group of the heap
+     * @param voice a voice in the heap
+     */
+    void reorder(Group& group, int voice);
+    void siftUp(Group& group, int position);
+    void siftDown(Group& group, int position);
+    void swap(Group& group, int firstPosition, int secondPosition);
+};
@@ -0,0 +1,100 @@
+/*
+  ==============================================================================
+
+    VoiceRenderer.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+class NoiseGenerator;
+class SampleLibrary;
+
+/**
+ * The engine of a voice type that renders its notes itself, such as the additive bank or the FM operators, or of the
+ * unison copies of the waveforms.
+ * An ElementaryVoice owns the renderer of its voice type and hands it the notes, while the voice keeps the envelope,
+ * the modulation and the filter shared by every type. A renderer is built on the message thread when the voice type
+ * changes, and is only used by the audio thread from the next note on, so none of its methods allocates.
+ * The renderers output the device rate. Only the unison renderer oversamples, the other engines ignore the
+ * oversampling of the voice.
+ */
+class VoiceRenderer {
+public:
+    /** What a renderer is told about a new note */
+    struct Note {
+        int midiNoteNumber;
+        float velocity;
+        /** The frequency of the note, after the tuning and the frequency factor */
+        float frequency;
+        /** The phase increment of the note at the device rate, or 0 if the note is above the Nyquist frequency */
+        float angleDelta;
+        /** The pitch bend ratio the note starts with */
+        float startRatio;
+        int patchIndex;
+        double sampleRate;
+        /** The samples loaded in the synthesiser, or nullptr */
+        const SampleLibrary* sampleLibrary;
+        /** The delay line of the voice, handed out by the DelayLineArena of the synthesiser, or nullptr */
+        float* delayLine;
+        int delayLineLength;
+        /** The oversampling factor of the voice */
+        int oversamplingFactor;
+    };
+
+    /** The pitch and the modulation of the note for one control block */
+    struct ControlBlock {
+        /** The ratio of the pitch bend and the frequency modulation reached at the end of the block */
+        float pitchRatio;
+        /** The phase increment of the note with pitchRatio applied */
+        float angleDelta;
+        /** The output of the brightness destination of the modulation matrix */
+        float brightness;
+        double sampleRate;
+        /** The oversampling factor of the voice, which changes at block boundaries */
+        int oversamplingFactor;
+    };
+
+    virtual ~VoiceRenderer() = default;
+
+    /**
+     * Start a note. It is called on the audio thread with the lock of the synthesiser held.
+     * @param note the note to start
+     * @param noise the noise generator of the voice
+     * @return false if the note cannot be played and stays silent
+     */
+    virtual bool startNote(const Note& note, NoiseGenerator& noise) = 0;
+
+    /**
+     * Render a control block of the note, without the envelope.
+     * If the note ends inside the block, the rest of the block is cleared.
+     * @param destinations the buffers to overwrite, one per channel given by getNumChannels()
+     * @param numSamples the length of the control block
+     * @param control the pitch and the modulation of the block
+     * @param noise the noise generator of the voice
+     * @return false if the note has ended
+     */
+    virtual bool render(float* const* destinations, int numSamples, const ControlBlock& control,
+                        NoiseGenerator& noise) = 0;
+
+    /**
+     * The number of channels written by render()
+     * @return 1, or 2 for a renderer spreading the note across the stereo field
+     */
+    virtual int getNumChannels() const { return 1; }
+
+    /**
+     * Stop the note, and give back what it holds. It is called when the voice stops the note without a tail, when
+     * the note has ended and before the next note starts.
+     */
+    virtual void stopNote() {}
+
+    /**
+     * Whether the note plays a sample of the library, in which case it is stopped before the library changes
+     * @return true if the current note reads a sample
+     */
+    virtual bool isUsingSample() const { return false; }
+};